@@ -5,9 +5,11 @@
 #include "Framework/AffineTransform2.h"
 #include "Framework/AffineTransform3.h"
 #include "Framework/Application.h"
+#include "Framework/AudioClip.h"
 #include "Framework/AudioDevice.h"
 #include "Framework/AudioDeviceContext.h"
 #include "Framework/AudioListener.h"
+#include "Framework/AudioMixer.h"
 #include "Framework/AudioPlayer.h"
 #include "Framework/AudioSource.h"
 #include "Framework/AudioStream.h"
@@ -17,6 +19,7 @@
 #include "Framework/CommandBuffer.h"
 #include "Framework/CommandEncoder.h"
 #include "Framework/CommandQueue.h"
+#include "Framework/CompressedImage.h"
 #include "Framework/Compression.h"
 #include "Framework/ComputeCommandEncoder.h"
 #include "Framework/ComputePipeline.h"
@@ -36,7 +39,11 @@
 #include "Framework/Matrix2.h"
 #include "Framework/Matrix3.h"
 #include "Framework/Matrix4.h"
+#include "Framework/Meshlet.h"
 #include "Framework/Mesh.h"
+#include "Framework/MeshOptimizer.h"
+#include "Framework/MeshProcessor.h"
+#include "Framework/MeshSimplifier.h"
 #include "Framework/PipelineReflection.h"
 #include "Framework/PixelFormat.h"
 #include "Framework/Plane.h"
@@ -52,12 +59,14 @@
 #include "Framework/ShaderFunction.h"
 #include "Framework/ShaderModule.h"
 #include "Framework/ShaderResource.h"
+#include "Framework/SoundBank.h"
 #include "Framework/Sphere.h"
 #include "Framework/SwapChain.h"
 #include "Framework/Texture.h"
 #include "Framework/Transform.h"
 #include "Framework/Triangle.h"
 #include "Framework/Unicode.h"
+#include "Framework/UploadManager.h"
 #include "Framework/Vector2.h"
 #include "Framework/Vector3.h"
 #include "Framework/Vector4.h"
@@ -0,0 +1,32 @@
+#include "../Libs/OpenAL/include/AL/al.h"
+
+#include "AudioClip.h"
+#include "AudioDevice.h"
+#include "Logger.h"
+
+using namespace FV;
+
+AudioClip::AudioClip(std::shared_ptr<AudioDevice> dev, uint32_t bID,
+                     uint32_t rate, uint32_t ch, uint32_t b, size_t size,
+                     std::vector<float> s)
+    : bufferID(bID)
+    , sampleRate(rate)
+    , channels(ch)
+    , bits(b)
+    , bytes(size)
+    , samples(std::move(s))
+    , device(dev) {
+    FVASSERT_DEBUG(bufferID != 0);
+    FVASSERT_DEBUG(bytesSecond() != 0);
+    FVASSERT_DEBUG(samples.empty() || samples.size() == frames() * channels);
+}
+
+AudioClip::~AudioClip() {
+    ALuint buffer = bufferID;
+    alDeleteBuffers(1, &buffer);
+
+    // check error
+    if (ALenum err = alGetError(); err != AL_NO_ERROR) {
+        Log::error("AudioClip error: {}, {}", err, alGetString(err));
+    }
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include "../include.h"
+#include <vector>
+
+namespace FV {
+    class AudioDevice;
+    // Fully decoded PCM data in an AL buffer. A clip is immutable and
+    // can be queued on any number of sources at the same time.
+    class FVCORE_API AudioClip {
+    public:
+        AudioClip(std::shared_ptr<AudioDevice>, uint32_t bufferID,
+                  uint32_t sampleRate, uint32_t channels, uint32_t bits, size_t bytes,
+                  std::vector<float> samples = {});
+        ~AudioClip();
+
+        const uint32_t bufferID;
+        const uint32_t sampleRate;
+        const uint32_t channels;
+        const uint32_t bits;
+        const size_t bytes;
+        // interleaved copy of the PCM data for software mixing (AudioMixer),
+        // empty unless the clip was made with keepSamples.
+        const std::vector<float> samples;
+
+        size_t bytesSecond() const { return size_t(sampleRate) * channels * (bits >> 3); }
+        double duration() const { return double(bytes) / double(bytesSecond()); }
+        size_t frames() const { return bytes / (channels * (bits >> 3)); }
+        // bytes of the AL buffer and the sample copy
+        size_t memorySize() const { return bytes + samples.size() * sizeof(float); }
+
+    private:
+        std::shared_ptr<AudioDevice> device;
+    };
+}
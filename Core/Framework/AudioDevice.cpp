@@ -6,6 +6,8 @@
 
 #include "AudioDevice.h"
 #include "AudioSource.h"
+#include "AudioClip.h"
+#include "AudioStream.h"
 #include "Logger.h"
 
 using namespace FV;
@@ -47,17 +49,28 @@ std::vector<AudioDevice::DeviceInfo> AudioDevice::availableDevices() {
     return deviceList;
 }
 
-AudioDevice::AudioDevice(const std::string& deviceName)
+AudioDevice::AudioDevice()
     : device(nullptr), context(nullptr)
-    , majorVersion(0), minorVersion(0) {
+    , majorVersion(0), minorVersion(0)
+    , renderSamples(nullptr) {
+}
+
+AudioDevice::AudioDevice(const std::string& deviceName)
+    : AudioDevice() {
     ALCdevice* device = alcOpenDevice(deviceName.c_str());
     FVASSERT_THROW(device != nullptr);
+    FVASSERT_THROW(initialize(device, nullptr));
+}
+
+bool AudioDevice::initialize(void* dev, const int* attributes) {
+    ALCdevice* device = (ALCdevice*)dev;
+    this->device = device;
 
-    ALCcontext* context = alcCreateContext(device, nullptr);
-    FVASSERT_THROW(context != nullptr);
+    ALCcontext* context = alcCreateContext(device, attributes);
+    if (context == nullptr)
+        return false;
 
     alcMakeContextCurrent(context);
-    this->device = device;
     this->context = context;
     this->deviceName = alcGetString(device, ALC_DEVICE_SPECIFIER);
     ALCint majorVersion = 0;
@@ -91,6 +104,51 @@ AudioDevice::AudioDevice(const std::string& deviceName)
     formatTable[BitsChannels{32, 4}.value] = alGetEnumValue("AL_FORMAT_QUAD32");
     formatTable[BitsChannels{32, 6}.value] = alGetEnumValue("AL_FORMAT_51CHN32");
     formatTable[BitsChannels{32, 8}.value] = alGetEnumValue("AL_FORMAT_71CHN32");
+    return true;
+}
+
+std::shared_ptr<AudioDevice> AudioDevice::makeLoopback(uint32_t sampleRate) {
+    if (alcIsExtensionPresent(nullptr, "ALC_SOFT_loopback") != ALC_TRUE) {
+        Log::error("AudioDevice: ALC_SOFT_loopback is not supported.");
+        return nullptr;
+    }
+    auto openDevice = (LPALCLOOPBACKOPENDEVICESOFT)alcGetProcAddress(nullptr, "alcLoopbackOpenDeviceSOFT");
+    auto isFormatSupported = (LPALCISRENDERFORMATSUPPORTEDSOFT)alcGetProcAddress(nullptr, "alcIsRenderFormatSupportedSOFT");
+    auto renderSamples = (LPALCRENDERSAMPLESSOFT)alcGetProcAddress(nullptr, "alcRenderSamplesSOFT");
+    if (openDevice == nullptr || isFormatSupported == nullptr || renderSamples == nullptr) {
+        Log::error("AudioDevice: ALC_SOFT_loopback functions not found.");
+        return nullptr;
+    }
+
+    ALCdevice* device = openDevice(nullptr);
+    if (device == nullptr) {
+        Log::error("AudioDevice: cannot open loopback device.");
+        return nullptr;
+    }
+    if (isFormatSupported(device, (ALCsizei)sampleRate, ALC_STEREO_SOFT, ALC_FLOAT_SOFT) != ALC_TRUE) {
+        Log::error("AudioDevice: loopback format (stereo, float, {}Hz) is not supported.", sampleRate);
+        alcCloseDevice(device);
+        return nullptr;
+    }
+    const ALCint attributes[] = {
+        ALC_FORMAT_CHANNELS_SOFT, ALC_STEREO_SOFT,
+        ALC_FORMAT_TYPE_SOFT, ALC_FLOAT_SOFT,
+        ALC_FREQUENCY, (ALCint)sampleRate,
+        0
+    };
+    auto audioDevice = std::shared_ptr<AudioDevice>(new AudioDevice());
+    if (audioDevice->initialize(device, attributes) == false) {
+        Log::error("AudioDevice: cannot create loopback context.");
+        return nullptr; // the destructor closes the device.
+    }
+    audioDevice->renderSamples = (void*)renderSamples;
+    return audioDevice;
+}
+
+void AudioDevice::render(float* buffer, size_t frames) {
+    FVASSERT_DEBUG(renderSamples);
+    if (renderSamples && frames > 0)
+        ((LPALCRENDERSAMPLESSOFT)renderSamples)((ALCdevice*)device, buffer, (ALCsizei)frames);
 }
 
 AudioDevice::~AudioDevice() {
@@ -119,3 +177,72 @@ std::shared_ptr<AudioSource> AudioDevice::makeSource() {
     return std::make_shared<AudioSource>(shared_from_this(),
                                          (uint32_t)sourceID);
 }
+
+std::shared_ptr<AudioClip> AudioDevice::makeClip(AudioStream& stream, bool keepSamples) {
+    uint32_t sampleRate = stream.sampleRate();
+    uint32_t channels = stream.channels();
+    uint32_t bits = stream.bits();
+    uint32_t format = this->format(bits, channels);
+    if (format == 0) {
+        Log::error("Unsupported audio format, bits:{}, channels:{}", bits, channels);
+        return nullptr;
+    }
+
+    size_t sampleAlignment = channels * bits >> 3;
+    size_t totalBytes = stream.pcmTotal() * sampleAlignment;
+    size_t chunkSize = std::max(sampleRate * sampleAlignment, size_t(4096));
+
+    std::vector<uint8_t> data;
+    data.reserve(totalBytes);
+    stream.seekPcm(0);
+    while (true) {
+        size_t offset = data.size();
+        size_t bytesToRead = std::max(totalBytes - std::min(totalBytes, offset), chunkSize);
+        data.resize(offset + bytesToRead);
+        size_t bytesRead = stream.read(data.data() + offset, bytesToRead);
+        if (bytesRead == size_t(-1)) {
+            Log::error("AudioStream::read failed.");
+            return nullptr;
+        }
+        data.resize(offset + bytesRead);
+        if (bytesRead == 0)
+            break;
+    }
+    data.resize(data.size() - data.size() % sampleAlignment);
+    if (data.empty()) {
+        Log::error("AudioDevice::makeClip failed: empty stream.");
+        return nullptr;
+    }
+
+    ALuint bufferID = 0;
+    alGenBuffers(1, &bufferID);
+    alBufferData(bufferID, format, data.data(), (ALsizei)data.size(), (ALsizei)sampleRate);
+
+    // check error
+    if (ALenum err = alGetError(); err != AL_NO_ERROR) {
+        Log::error("AudioDevice error: {}, {}", err, alGetString(err));
+        alDeleteBuffers(1, &bufferID);
+        return nullptr;
+    }
+    std::vector<float> samples;
+    if (keepSamples) {
+        size_t count = data.size() / (bits >> 3);
+        samples.resize(count);
+        if (bits == 8) {
+            for (size_t i = 0; i < count; ++i)
+                samples[i] = float(int(data[i]) - 128) * (1.0f / 128.0f);
+        } else if (bits == 16) {
+            const int16_t* p = reinterpret_cast<const int16_t*>(data.data());
+            for (size_t i = 0; i < count; ++i)
+                samples[i] = float(p[i]) * (1.0f / 32768.0f);
+        } else if (bits == 32) {
+            memcpy(samples.data(), data.data(), count * sizeof(float));
+        } else {
+            Log::warning("AudioDevice::makeClip: samples of {} bits are not kept.", bits);
+            samples.clear();
+        }
+    }
+    return std::make_shared<AudioClip>(shared_from_this(), (uint32_t)bufferID,
+                                       sampleRate, channels, bits, data.size(),
+                                       std::move(samples));
+}
@@ -5,6 +5,8 @@
 
 namespace FV {
     class AudioSource;
+    class AudioClip;
+    class AudioStream;
     class FVCORE_API AudioDevice : public std::enable_shared_from_this<AudioDevice> {
     public:
         struct DeviceInfo {
@@ -19,8 +21,21 @@ namespace FV {
         ~AudioDevice();
 
         std::shared_ptr<AudioSource> makeSource();
+        // decodes the whole stream from the beginning into a clip.
+        // keepSamples keeps a float copy of the PCM data for AudioMixer.
+        std::shared_ptr<AudioClip> makeClip(AudioStream&, bool keepSamples = false);
         static std::vector<DeviceInfo> availableDevices();
+
+        // A device without audio hardware (ALC_SOFT_loopback), the output
+        // is pulled with render(). Used for offline rendering and tests.
+        static std::shared_ptr<AudioDevice> makeLoopback(uint32_t sampleRate);
+        bool isLoopback() const { return renderSamples != nullptr; }
+        // renders interleaved stereo float samples of a loopback device.
+        void render(float* buffer, size_t frames);
     private:
+        AudioDevice();
+        bool initialize(void* device, const int* attributes);
+
         union BitsChannels {
             struct {
                 uint16_t bits;
@@ -36,5 +51,6 @@ namespace FV {
         int majorVersion;
         int minorVersion;
         std::map<uint32_t, uint32_t> formatTable;
+        void* renderSamples;
     };
 }
\ No newline at end of file
@@ -3,129 +3,253 @@
 #include <algorithm>
 #include "Logger.h"
 #include "AudioDeviceContext.h"
+#include "Private/AudioRingBuffer.h"
 
 using namespace FV;
 
 AudioDeviceContext::AudioDeviceContext(std::shared_ptr<AudioDevice> dev)
     : device(dev)
     , listener(std::make_shared<AudioListener>(dev))
+    , mixerEvent(std::make_shared<AudioEvent>())
+    , decoderEvent(std::make_shared<AudioEvent>())
     , maxBufferCount(3)
+    , decodeAheadCount(2)
     , minBufferTime(0.4)
     , maxBufferTime(10.0) {
-    this->thread = std::jthread(
-        [this](std::stop_token stopToken) {
-            Log::info("AudioDeviceContext playback task is started.)");
-
-            std::vector<uint8_t> buffer(1024, 0);
-            std::vector<std::shared_ptr<AudioPlayer>> retainedPlayers;
-
-            while (stopToken.stop_requested() == false) {
-                std::vector<std::shared_ptr<AudioPlayer>> activePlayers;
-                if (true) {
-                    std::scoped_lock guard(lock);
-                    activePlayers.reserve(this->players.size());
-                    for (auto& wpl : this->players) {
-                        if (auto player = wpl.lock())
-                            activePlayers.push_back(player);
+    this->decoderThread = std::jthread([this](std::stop_token stopToken) {
+        decoderTask(stopToken);
+    });
+    this->mixerThread = std::jthread([this](std::stop_token stopToken) {
+        mixerTask(stopToken);
+    });
+}
+
+AudioDeviceContext::~AudioDeviceContext() {
+    this->mixerThread.request_stop();
+    this->decoderThread.request_stop();
+    this->mixerThread.join();
+    this->decoderThread.join();
+}
+
+std::vector<std::shared_ptr<AudioPlayer>> AudioDeviceContext::activePlayers() {
+    std::vector<std::shared_ptr<AudioPlayer>> activePlayers;
+    std::scoped_lock guard(lock);
+    activePlayers.reserve(this->players.size());
+    std::erase_if(this->players, [&](auto& wpl) {
+        if (auto player = wpl.lock()) {
+            activePlayers.push_back(player);
+            return false;
+        }
+        return true;
+    });
+    return activePlayers;
+}
+
+void AudioDeviceContext::mixerTask(std::stop_token stopToken) {
+    Log::info("AudioDeviceContext playback task is started.");
+
+    struct Notification {
+        bool playback;  // playbackStateChanged or bufferingStateChanged
+        bool state;
+        double time;
+    };
+    std::vector<Notification> notifications;
+    std::vector<std::shared_ptr<AudioPlayer>> retainedPlayers;
+
+    while (stopToken.stop_requested() == false) {
+        std::vector<std::shared_ptr<AudioPlayer>> activePlayers = this->activePlayers();
+        double timeout = std::numeric_limits<double>::infinity();
+
+        retainedPlayers.clear();
+        for (auto& player : activePlayers) {
+            notifications.clear();
+            bool retain = false;
+            if (true) {
+                std::scoped_lock guard(player->controlLock);
+                if (player->playing == false)
+                    continue;
+
+                auto& source = player->source;
+                auto& stream = player->stream;
+                AudioRingBuffer* ringBuffer = player->ringBuffer.get();
+                uint32_t generation = player->generation.load(std::memory_order_relaxed);
+
+                source->dequeueBuffers();
+                size_t queuedBuffers = source->numberOfBuffersInQueue();
+                if (player->clip) {
+                    // queue the shared buffer again for the remaining loops.
+                    std::scoped_lock guard2(player->streamLock);
+                    while (player->playLoopCount > 0 && queuedBuffers < size_t(maxBufferCount)) {
+                        if (source->enqueueBuffer(player->clip, 0.0) == false)
+                            break;
+                        player->playLoopCount--;
+                        queuedBuffers++;
                     }
                 }
-                retainedPlayers.clear();
-                for (auto& player : activePlayers) {
-                    if (player->playing) {
-                        auto& source = player->source;
-                        source->dequeueBuffers();
-
-                        if (player->buffering && source->numberOfBuffersInQueue() < maxBufferCount) {
-                            // buffering!
-                            auto& stream = player->stream;
-                            double bufferingTime = std::clamp(player->maxBufferingTime,
-                                                              minBufferTime, maxBufferTime);
-                            uint32_t sampleAlignment = stream->channels() * stream->bits() >> 3;
-                            size_t bufferSize = size_t(bufferingTime * double(stream->sampleRate())) * sampleAlignment;
-
-                            if (bufferSize > buffer.size()) // resize buffer
-                                buffer.resize(bufferSize);
-
-                            double bufferPos = stream->timePosition();
-                            uint64_t bytesRead = stream->read(buffer.data(), bufferSize);
-                            if (bytesRead > 0 && bytesRead != uint64_t(-1)) {
-                                player->processStream(buffer.data(), bytesRead, bufferPos);
-                                if (source->enqueueBuffer(stream->sampleRate(),
-                                                          stream->bits(),
-                                                          stream->channels(),
-                                                          buffer.data(),
-                                                          bufferSize,
-                                                          bufferPos)) {
-                                    player->playing = true;
-                                    player->bufferedPosition = stream->timePosition();
-                                    player->bufferingStateChanged(true, bufferPos);
-                                } else // error
-                                {
-                                    Log::error("AudioSource::enqueueBuffer failed.");
-                                    player->buffering = false;
-                                    player->playing = false;
-                                }
-                            } else if (bytesRead == 0) // eof
-                            {
-                                if (player->playLoopCount > 1) {
-                                    player->playLoopCount -= 1;
-                                    stream->seekPcm(0); // rewind
-                                } else {
-                                    player->buffering = false;
-                                }
-                            } else // error (-1)
-                            {
-                                Log::error("AudioStream::read failed.");
-                                player->playing = false;
-                                player->buffering = false;
-                                source->stop();
-                                source->dequeueBuffers();
-                            }
-
-                            if (player->buffering == false)
-                                player->bufferingStateChanged(false, bufferPos);
+                while (ringBuffer && player->playing && queuedBuffers < size_t(maxBufferCount)) {
+                    AudioRingBuffer::Slot* slot = ringBuffer->front();
+                    if (slot == nullptr)
+                        break;
+                    if (slot->generation == generation) {
+                        if (source->enqueueBuffer(stream->sampleRate(),
+                                                  stream->bits(),
+                                                  stream->channels(),
+                                                  slot->data,
+                                                  slot->bytes,
+                                                  slot->timestamp)) {
+                            queuedBuffers++;
+                            player->bufferedPosition = slot->position;
+                            notifications.push_back({ false, true, slot->timestamp });
+                        } else // error
+                        {
+                            Log::error("AudioSource::enqueueBuffer failed.");
+                            player->buffering = false;
+                            player->playing = false;
+                            notifications.push_back({ false, false, slot->timestamp });
                         }
+                    }
+                    ringBuffer->pop();
+                    decoderEvent->notify();
+                }
 
-                        // update state
-                        if (player->playing) {
-                            if (source->state() == AudioSource::StateStopped) {
-                                if (source->numberOfBuffersInQueue() > 0)
-                                    source->play();          // resume.
-                                else
-                                    player->playing = false; // done.
-                            }
+                if (player->buffering) {
+                    // the decoder publishes its last slot before it leaves the decoding state.
+                    auto decodeState = player->decodeState.load(std::memory_order_acquire);
+                    if (decodeState != AudioPlayer::DecodeState::Decoding && ringBuffer->isEmpty()) {
+                        if (decodeState == AudioPlayer::DecodeState::Failed) {
+                            Log::error("AudioStream::read failed.");
+                            player->playing = false;
+                            source->stop();
+                            source->dequeueBuffers();
+                            queuedBuffers = 0;
                         }
+                        player->buffering = false;
+                        notifications.push_back({ false, false, player->bufferedPosition });
+                    }
+                }
 
-                        if (player->playing) {
-                            double pos = source->timePosition();
-                            if (player->playbackPosition != pos) {
-                                player->playbackPosition = pos;
-                                player->playbackStateChanged(true, pos);
-                            }
-                            if (player->retainedWhilePlaying)
-                                retainedPlayers.push_back(player);
-                        } else {
-                            player->playbackStateChanged(false, player->playbackPosition);
-                        }
+                // update state
+                if (player->playing) {
+                    if (source->state() == AudioSource::StateStopped) {
+                        if (queuedBuffers > 0)
+                            source->play();          // resume.
+                        else if (player->buffering == false)
+                            player->playing = false; // done.
                     }
                 }
-                // sleep 200ms
-                std::this_thread::sleep_for(std::chrono::duration<int, std::milli>(200));
-            };
-            Log::info("AudioDeviceContext playback task is finished.");
+
+                if (player->playing) {
+                    double pos = source->timePosition();
+                    if (player->playbackPosition != pos) {
+                        player->playbackPosition = pos;
+                        notifications.push_back({ true, true, pos });
+                    }
+                    retain = player->retainedWhilePlaying;
+
+                    // wake up when the front buffer is processed, an empty
+                    // ring buffer wakes this thread when it gets data.
+                    if (queuedBuffers > 0 && source->state() == AudioSource::StatePlaying)
+                        timeout = std::min(timeout, std::max(source->bufferTimeRemaining(), 0.01));
+                } else {
+                    notifications.push_back({ true, false, player->playbackPosition });
+                }
+            }
+            // callbacks are called without locks, they can control the player.
+            for (auto& n : notifications) {
+                if (n.playback)
+                    player->playbackStateChanged(n.state, n.time);
+                else
+                    player->bufferingStateChanged(n.state, n.time);
+            }
+            if (retain)
+                retainedPlayers.push_back(player);
+        }
+        activePlayers.clear();
+
+        if (std::isfinite(timeout)) {
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(timeout);
+            mixerEvent->waitUntil(stopToken, deadline);
+        } else {
+            mixerEvent->wait(stopToken);
         }
-    );
+    }
+    Log::info("AudioDeviceContext playback task is finished.");
 }
 
-AudioDeviceContext::~AudioDeviceContext() {
-    this->thread.request_stop();
-    this->thread.join();
+void AudioDeviceContext::decoderTask(std::stop_token stopToken) {
+    while (stopToken.stop_requested() == false) {
+        std::vector<std::shared_ptr<AudioPlayer>> activePlayers = this->activePlayers();
+        // one slot per player in turn, until every ring buffer is full.
+        for (bool progress = true; progress && stopToken.stop_requested() == false; ) {
+            progress = false;
+            for (auto& player : activePlayers) {
+                if (decode(player.get()))
+                    progress = true;
+            }
+        }
+        activePlayers.clear();
+        decoderEvent->wait(stopToken);
+    }
+}
+
+bool AudioDeviceContext::decode(AudioPlayer* player) {
+    AudioRingBuffer* ringBuffer = player->ringBuffer.get();
+
+    std::unique_lock guard(player->streamLock);
+    if (player->decodeState.load(std::memory_order_relaxed) != AudioPlayer::DecodeState::Decoding)
+        return false;
+
+    AudioRingBuffer::Slot* slot = ringBuffer->beginWrite();
+    if (slot == nullptr)
+        return false;
+
+    auto& stream = player->stream;
+    double bufferPos = stream->timePosition();
+    uint64_t bytesRead = stream->read(slot->data, ringBuffer->slotBytes);
+    if (bytesRead > 0 && bytesRead != uint64_t(-1)) {
+        slot->bytes = bytesRead;
+        slot->timestamp = bufferPos;
+        slot->position = stream->timePosition();
+        slot->generation = player->generation.load(std::memory_order_relaxed);
+        guard.unlock();
+
+        player->processStream(slot->data, bytesRead, bufferPos);
+        bool starving = ringBuffer->isEmpty();
+        ringBuffer->endWrite();
+        if (starving)
+            mixerEvent->notify();
+        return true;
+    }
+
+    if (bytesRead == 0) // eof
+    {
+        if (player->playLoopCount > 1) {
+            player->playLoopCount -= 1;
+            stream->seekPcm(0); // rewind
+            return true;
+        }
+        player->decodeState.store(AudioPlayer::DecodeState::Finished, std::memory_order_release);
+    } else // error (-1)
+    {
+        player->decodeState.store(AudioPlayer::DecodeState::Failed, std::memory_order_release);
+    }
+    guard.unlock();
+    mixerEvent->notify();
+    return false;
 }
 
 std::shared_ptr<AudioPlayer> AudioDeviceContext::makePlayer(std::shared_ptr<AudioStream> stream) {
     if (auto source = device->makeSource()) {
         auto player = std::make_shared<AudioPlayer>(source, stream);
 
+        // each slot holds one source buffer of PCM data.
+        double bufferingTime = std::clamp(player->maxBufferingTime, minBufferTime, maxBufferTime);
+        uint32_t sampleAlignment = stream->channels() * stream->bits() >> 3;
+        size_t bufferSize = size_t(bufferingTime * double(stream->sampleRate())) * sampleAlignment;
+        player->ringBuffer = std::make_unique<AudioRingBuffer>(decodeAheadCount, bufferSize);
+        player->mixerEvent = mixerEvent;
+        player->decoderEvent = decoderEvent;
+
         std::scoped_lock guard(lock);
         this->players.push_back(player);
         return player;
@@ -133,6 +257,25 @@ std::shared_ptr<AudioPlayer> AudioDeviceContext::makePlayer(std::shared_ptr<Audi
     return nullptr;
 }
 
+std::shared_ptr<AudioPlayer> AudioDeviceContext::makePlayer(std::shared_ptr<AudioClip> clip) {
+    if (clip == nullptr)
+        return nullptr;
+    if (auto source = device->makeSource()) {
+        auto player = std::make_shared<AudioPlayer>(source, clip);
+        player->mixerEvent = mixerEvent;
+        player->decoderEvent = decoderEvent;
+
+        std::scoped_lock guard(lock);
+        this->players.push_back(player);
+        return player;
+    }
+    return nullptr;
+}
+
+std::shared_ptr<AudioMixer> AudioDeviceContext::makeMixer(const AudioMixer::Configuration& config) {
+    return std::make_shared<AudioMixer>(device, listener, config);
+}
+
 std::shared_ptr<AudioDeviceContext> AudioDeviceContext::makeDefault() {
     static std::weak_ptr<AudioDeviceContext> defaultCtxt;
     static std::mutex lock;
@@ -6,6 +6,7 @@
 
 #include "AudioDevice.h"
 #include "AudioListener.h"
+#include "AudioMixer.h"
 #include "AudioPlayer.h"
 #include "AudioStream.h"
 
@@ -19,14 +20,28 @@ namespace FV {
         const std::shared_ptr<AudioListener> listener;
 
         std::shared_ptr<AudioPlayer> makePlayer(std::shared_ptr<AudioStream>);
+        std::shared_ptr<AudioPlayer> makePlayer(std::shared_ptr<AudioClip>);
+        std::shared_ptr<AudioMixer> makeMixer(const AudioMixer::Configuration& = {});
 
         static std::shared_ptr<AudioDeviceContext> makeDefault();
     private:
+        std::vector<std::shared_ptr<AudioPlayer>> activePlayers();
+        // the mixer thread feeds decoded slots to the sources and sleeps
+        // until the front buffer of a queue is played out or it is woken.
+        void mixerTask(std::stop_token);
+        // the decoder thread fills the ring buffer of every player.
+        void decoderTask(std::stop_token);
+        bool decode(AudioPlayer*);
+
         std::vector<std::weak_ptr<AudioPlayer>> players;
         std::mutex lock;
-        std::jthread thread;
+        std::shared_ptr<AudioEvent> mixerEvent;
+        std::shared_ptr<AudioEvent> decoderEvent;
+        std::jthread mixerThread;
+        std::jthread decoderThread;
 
         int maxBufferCount;
+        int decodeAheadCount;
         double minBufferTime;
         double maxBufferTime;
     };
@@ -0,0 +1,874 @@
+#include <cmath>
+#include <cfloat>
+#include <numbers>
+#include <chrono>
+#include <algorithm>
+#include "AudioMixer.h"
+#include "Logger.h"
+#include "Private/AudioRingBuffer.h"
+#include "Private/CPUFeatures.h"
+
+#if FVCORE_ARCH_X86 && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#   define FVCORE_AUDIO_SSE 1
+#elif FVCORE_ARCH_ARM64
+#   define FVCORE_AUDIO_NEON 1
+#endif
+
+using namespace FV;
+
+namespace {
+    constexpr float speedOfSound = 343.3f;      // AL_SPEED_OF_SOUND default
+    constexpr float audibleGain = 1.0e-4f;      // quieter voices are virtual
+    constexpr float hardwareHysteresis = 1.5f;  // keeps hardware voices from flapping
+
+    // Lane types for the kernels below, the scalar type handles the
+    // remainder and targets without SIMD.
+    struct Scalar {
+        static constexpr size_t width = 1;
+        using Mask = bool;
+        float v;
+
+        static Scalar load(const float* p) { return { *p }; }
+        void store(float* p) const { *p = v; }
+        static Scalar splat(float f) { return { f }; }
+        static Scalar lanes() { return { 0.0f }; }
+
+        friend Scalar operator + (Scalar a, Scalar b) { return { a.v + b.v }; }
+        friend Scalar operator - (Scalar a, Scalar b) { return { a.v - b.v }; }
+        friend Scalar operator * (Scalar a, Scalar b) { return { a.v * b.v }; }
+        friend Scalar operator / (Scalar a, Scalar b) { return { a.v / b.v }; }
+        friend Mask operator > (Scalar a, Scalar b) { return a.v > b.v; }
+        friend Mask operator >= (Scalar a, Scalar b) { return a.v >= b.v; }
+        static Scalar min(Scalar a, Scalar b) { return { std::min(a.v, b.v) }; }
+        static Scalar max(Scalar a, Scalar b) { return { std::max(a.v, b.v) }; }
+        static Scalar sqrt(Scalar a) { return { std::sqrt(a.v) }; }
+        static Scalar select(Mask m, Scalar a, Scalar b) { return m ? a : b; }
+    };
+
+#if FVCORE_AUDIO_SSE
+    struct SIMD {
+        static constexpr size_t width = 4;
+        using Mask = __m128;
+        __m128 v;
+
+        static SIMD load(const float* p) { return { _mm_loadu_ps(p) }; }
+        void store(float* p) const { _mm_storeu_ps(p, v); }
+        static SIMD splat(float f) { return { _mm_set1_ps(f) }; }
+        static SIMD lanes() { return { _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f) }; }
+
+        friend SIMD operator + (SIMD a, SIMD b) { return { _mm_add_ps(a.v, b.v) }; }
+        friend SIMD operator - (SIMD a, SIMD b) { return { _mm_sub_ps(a.v, b.v) }; }
+        friend SIMD operator * (SIMD a, SIMD b) { return { _mm_mul_ps(a.v, b.v) }; }
+        friend SIMD operator / (SIMD a, SIMD b) { return { _mm_div_ps(a.v, b.v) }; }
+        friend Mask operator > (SIMD a, SIMD b) { return _mm_cmpgt_ps(a.v, b.v); }
+        friend Mask operator >= (SIMD a, SIMD b) { return _mm_cmpge_ps(a.v, b.v); }
+        static SIMD min(SIMD a, SIMD b) { return { _mm_min_ps(a.v, b.v) }; }
+        static SIMD max(SIMD a, SIMD b) { return { _mm_max_ps(a.v, b.v) }; }
+        static SIMD sqrt(SIMD a) { return { _mm_sqrt_ps(a.v) }; }
+        static SIMD select(Mask m, SIMD a, SIMD b) {
+            return { _mm_or_ps(_mm_and_ps(m, a.v), _mm_andnot_ps(m, b.v)) };
+        }
+    };
+#elif FVCORE_AUDIO_NEON
+    struct SIMD {
+        static constexpr size_t width = 4;
+        using Mask = uint32x4_t;
+        float32x4_t v;
+
+        static SIMD load(const float* p) { return { vld1q_f32(p) }; }
+        void store(float* p) const { vst1q_f32(p, v); }
+        static SIMD splat(float f) { return { vdupq_n_f32(f) }; }
+        static SIMD lanes() {
+            static const float index[4] = { 0.0f, 1.0f, 2.0f, 3.0f };
+            return { vld1q_f32(index) };
+        }
+
+        friend SIMD operator + (SIMD a, SIMD b) { return { vaddq_f32(a.v, b.v) }; }
+        friend SIMD operator - (SIMD a, SIMD b) { return { vsubq_f32(a.v, b.v) }; }
+        friend SIMD operator * (SIMD a, SIMD b) { return { vmulq_f32(a.v, b.v) }; }
+        friend SIMD operator / (SIMD a, SIMD b) { return { vdivq_f32(a.v, b.v) }; }
+        friend Mask operator > (SIMD a, SIMD b) { return vcgtq_f32(a.v, b.v); }
+        friend Mask operator >= (SIMD a, SIMD b) { return vcgeq_f32(a.v, b.v); }
+        static SIMD min(SIMD a, SIMD b) { return { vminq_f32(a.v, b.v) }; }
+        static SIMD max(SIMD a, SIMD b) { return { vmaxq_f32(a.v, b.v) }; }
+        static SIMD sqrt(SIMD a) { return { vsqrtq_f32(a.v) }; }
+        static SIMD select(Mask m, SIMD a, SIMD b) { return { vbslq_f32(m, a.v, b.v) }; }
+    };
+#else
+    using SIMD = Scalar;
+#endif
+
+    struct SpatialArrays {
+        const float *px, *py, *pz, *vx, *vy, *vz, *dx, *dy, *dz;
+        const float *gain, *minGain, *maxGain;
+        const float *referenceDistance, *maxDistance, *rolloff;
+        const float *coneInner, *coneOuter, *coneOuterGain;
+        const float *pitch, *rateRatio;
+        float *gainLeft, *gainRight, *step, *audibility;
+    };
+
+    struct ListenerVectors {
+        float px, py, pz;   // position
+        float vx, vy, vz;   // velocity
+        float rx, ry, rz;   // unit right vector
+    };
+
+    // OpenAL 1.1 inverse distance clamped model. The cone gain is
+    // interpolated between the cosines of the half angles, the panning
+    // is equal power along the right axis of the listener.
+    template <typename V>
+    size_t spatializeVoices(const SpatialArrays& a, const ListenerVectors& l, size_t begin, size_t count) {
+        const V zero = V::splat(0.0f), one = V::splat(1.0f), half = V::splat(0.5f);
+        const V tiny = V::splat(1.0e-6f);
+        const V ss = V::splat(speedOfSound), maxVelocity = V::splat(speedOfSound * 0.99f);
+        const V lpx = V::splat(l.px), lpy = V::splat(l.py), lpz = V::splat(l.pz);
+        const V lvx = V::splat(l.vx), lvy = V::splat(l.vy), lvz = V::splat(l.vz);
+        const V lrx = V::splat(l.rx), lry = V::splat(l.ry), lrz = V::splat(l.rz);
+
+        size_t i = begin;
+        for (; i + V::width <= count; i += V::width) {
+            V rx = V::load(a.px + i) - lpx;
+            V ry = V::load(a.py + i) - lpy;
+            V rz = V::load(a.pz + i) - lpz;
+            V dist = V::sqrt(rx * rx + ry * ry + rz * rz);
+            V invDist = V::select(dist > tiny, one / V::max(dist, tiny), zero);
+
+            // distance attenuation
+            V ref = V::load(a.referenceDistance + i);
+            V d = V::min(V::max(dist, ref), V::load(a.maxDistance + i));
+            V den = ref + V::load(a.rolloff + i) * (d - ref);
+            V distGain = V::select(den > tiny, ref / V::max(den, tiny), one);
+
+            // cone, the direction points from the source to the listener.
+            V dx = V::load(a.dx + i), dy = V::load(a.dy + i), dz = V::load(a.dz + i);
+            V dirLength2 = dx * dx + dy * dy + dz * dz;
+            V cosAngle = (zero - (dx * rx + dy * ry + dz * rz)) * invDist / V::sqrt(V::max(dirLength2, tiny));
+            V cosInner = V::load(a.coneInner + i);
+            V cosOuter = V::load(a.coneOuter + i);
+            V outerGain = V::load(a.coneOuterGain + i);
+            V t = (cosAngle - cosOuter) / V::max(cosInner - cosOuter, tiny);
+            V coneGain = outerGain + (one - outerGain) * V::min(V::max(t, zero), one);
+            coneGain = V::select(cosAngle >= cosInner, one, coneGain);
+            coneGain = V::select(dirLength2 > tiny, coneGain, one);
+            coneGain = V::select(dist > tiny, coneGain, one);
+
+            V g = V::load(a.gain + i) * distGain * coneGain;
+            g = V::min(V::max(g, V::load(a.minGain + i)), V::load(a.maxGain + i));
+
+            // panning
+            V pan = (rx * lrx + ry * lry + rz * lrz) * invDist;
+            pan = V::min(V::max(pan, zero - one), one);
+            (g * V::sqrt(half - half * pan)).store(a.gainLeft + i);
+            (g * V::sqrt(half + half * pan)).store(a.gainRight + i);
+            g.store(a.audibility + i);
+
+            // doppler shift, velocities along the source to listener vector.
+            V vls = (zero - (rx * lvx + ry * lvy + rz * lvz)) * invDist;
+            V vss = (zero - (rx * V::load(a.vx + i) + ry * V::load(a.vy + i) + rz * V::load(a.vz + i))) * invDist;
+            vls = V::min(vls, maxVelocity);
+            vss = V::min(vss, maxVelocity);
+            V doppler = (ss - vls) / (ss - vss);
+            (V::load(a.pitch + i) * doppler * V::load(a.rateRatio + i)).store(a.step + i);
+        }
+        return i;
+    }
+
+    // accumulates a voice with linear gain ramps into planar stereo.
+    template <typename V>
+    size_t mixFrames(const float* left, const float* right, float* outLeft, float* outRight,
+                     size_t begin, size_t count,
+                     float gainLeft, float stepLeft, float gainRight, float stepRight) {
+        const V lanes = V::lanes();
+        const V sl = V::splat(stepLeft), sr = V::splat(stepRight);
+        size_t i = begin;
+        for (; i + V::width <= count; i += V::width) {
+            V index = V::splat(float(i)) + lanes;
+            V gl = V::splat(gainLeft) + sl * index;
+            V gr = V::splat(gainRight) + sr * index;
+            (V::load(outLeft + i) + V::load(left + i) * gl).store(outLeft + i);
+            (V::load(outRight + i) + V::load(right + i) * gr).store(outRight + i);
+        }
+        return i;
+    }
+
+    // linear interpolation, writes up to 2 planar channels of count frames.
+    size_t resample(const AudioClip& clip, double& cursor, double step, bool looping,
+                    float* output, size_t stride, size_t count) {
+        const float* samples = clip.samples.data();
+        const size_t channels = clip.channels;
+        const size_t outputChannels = std::min<size_t>(channels, 2);
+        const size_t frames = clip.frames();
+        const double length = double(frames);
+
+        size_t n = 0;
+        if (step == 1.0 && channels == 1 && cursor == std::floor(cursor)) {
+            while (n < count) {
+                if (cursor >= length) {
+                    if (looping == false)
+                        break;
+                    cursor = 0.0;
+                }
+                size_t offset = size_t(cursor);
+                size_t copy = std::min(count - n, frames - offset);
+                memcpy(output + n, samples + offset, copy * sizeof(float));
+                n += copy;
+                cursor += double(copy);
+            }
+            return n;
+        }
+        while (n < count) {
+            if (cursor >= length) {
+                if (looping == false)
+                    break;
+                cursor = std::fmod(cursor, length);
+            }
+            size_t i0 = size_t(cursor);
+            size_t i1 = i0 + 1;
+            if (i1 >= frames)
+                i1 = looping ? 0 : i0;
+            float t = float(cursor - double(i0));
+            for (size_t c = 0; c < outputChannels; ++c) {
+                float s0 = samples[i0 * channels + c];
+                float s1 = samples[i1 * channels + c];
+                output[c * stride + n] = s0 + (s1 - s0) * t;
+            }
+            cursor += step;
+            ++n;
+        }
+        return n;
+    }
+}
+
+std::vector<float> AudioMixer::Parameters::* const AudioMixer::parameterArrays[] = {
+    &Parameters::px, &Parameters::py, &Parameters::pz,
+    &Parameters::vx, &Parameters::vy, &Parameters::vz,
+    &Parameters::dx, &Parameters::dy, &Parameters::dz,
+    &Parameters::gain, &Parameters::minGain, &Parameters::maxGain,
+    &Parameters::referenceDistance, &Parameters::maxDistance, &Parameters::rolloff,
+    &Parameters::coneInner, &Parameters::coneOuter, &Parameters::coneOuterGain,
+    &Parameters::pitch, &Parameters::rateRatio,
+    &Parameters::gainLeft, &Parameters::gainRight, &Parameters::step, &Parameters::audibility,
+};
+
+AudioMixer::AudioMixer(std::shared_ptr<AudioDevice> dev, std::shared_ptr<AudioListener> lis, const Configuration& cfg)
+    : device(dev)
+    , listener(lis)
+    , config(cfg)
+    , floatOutput(false)
+    , streamTime(0.0)
+    , mixerEvent(std::make_shared<AudioEvent>()) {
+    FVASSERT_DEBUG(device && listener);
+    FVASSERT_DEBUG(config.sampleRate > 0 && config.blockFrames > 0);
+
+    mixBuffer.resize(size_t(config.blockFrames) * 2);
+    voiceBuffer.resize(size_t(config.blockFrames) * 2);
+    floatOutput = device->format(32, 2) != 0;
+    outputBuffer.resize(size_t(config.blockFrames) * 2 * (floatOutput ? sizeof(float) : sizeof(int16_t)));
+
+    // the stream is not attenuated, its voices are.
+    streamSource = device->makeSource();
+    streamSource->setRolloffFactor(0.0f);
+
+    hardwareSources.reserve(config.hardwareVoices);
+    for (uint32_t i = 0; i < config.hardwareVoices; ++i)
+        hardwareSources.push_back(device->makeSource());
+    hardwareSlots.resize(hardwareSources.size(), -1);
+
+    if (config.mixerThread) {
+        this->mixerThread = std::jthread([this](std::stop_token stopToken) {
+            while (stopToken.stop_requested() == false) {
+                double timeout = update();
+                auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(timeout);
+                mixerEvent->waitUntil(stopToken, deadline);
+            }
+        });
+    }
+}
+
+AudioMixer::~AudioMixer() {
+    if (mixerThread.joinable()) {
+        mixerThread.request_stop();
+        mixerThread.join();
+    }
+    for (auto& source : hardwareSources)
+        source->stop();
+    streamSource->stop();
+}
+
+std::shared_ptr<AudioVoice> AudioMixer::makeVoice(std::shared_ptr<AudioClip> clip) {
+    if (clip == nullptr)
+        return nullptr;
+    if (clip->samples.empty()) {
+        Log::error("AudioMixer::makeVoice failed: the clip has no samples.");
+        return nullptr;
+    }
+    uint32_t slot = allocSlot(clip);
+    return std::shared_ptr<AudioVoice>(new AudioVoice(shared_from_this(), clip, slot));
+}
+
+uint32_t AudioMixer::allocSlot(std::shared_ptr<AudioClip> clip) {
+    std::scoped_lock guard(lock);
+    uint32_t slot;
+    if (freeSlots.empty() == false) {
+        slot = freeSlots.back();
+        freeSlots.pop_back();
+    } else {
+        slot = uint32_t(voices.size());
+        voices.push_back({});
+        for (auto array : parameterArrays)
+            (parameters.*array).resize(voices.size());
+    }
+    auto& voice = voices[slot];
+    voice.clip = clip;
+    voice.cursor = 0.0;
+    voice.generation++;
+    voice.hardwareGeneration = 0;
+    voice.active = true;
+    voice.playing = false;
+    voice.looping = false;
+    voice.tier = Tier::Virtual;
+    voice.hardwareSource = -1;
+    voice.lastGainLeft = 0.0f;
+    voice.lastGainRight = 0.0f;
+
+    for (auto array : parameterArrays)
+        (parameters.*array)[slot] = 0.0f;
+    parameters.gain[slot] = 1.0f;
+    parameters.maxGain[slot] = 1.0f;
+    parameters.referenceDistance[slot] = 1.0f;
+    parameters.maxDistance[slot] = FLT_MAX;
+    parameters.rolloff[slot] = 1.0f;
+    parameters.coneInner[slot] = -1.0f; // 360 degrees
+    parameters.coneOuter[slot] = -1.0f;
+    parameters.pitch[slot] = 1.0f;
+    parameters.rateRatio[slot] = float(clip->sampleRate) / float(config.sampleRate);
+    return slot;
+}
+
+void AudioMixer::releaseSlot(uint32_t slot) {
+    std::scoped_lock guard(lock);
+    auto& voice = voices.at(slot);
+    voice.active = false;
+    voice.playing = false;
+    voice.generation++;
+    // a hardware source is stopped by the mixer, which frees the slot.
+    if (voice.hardwareSource < 0) {
+        voice.clip = nullptr;
+        freeSlots.push_back(slot);
+    }
+}
+
+void AudioMixer::setValue(uint32_t slot, std::vector<float> Parameters::* array, float value) {
+    std::scoped_lock guard(lock);
+    (parameters.*array)[slot] = value;
+}
+
+float AudioMixer::value(uint32_t slot, std::vector<float> Parameters::* array) const {
+    std::scoped_lock guard(lock);
+    return (parameters.*array)[slot];
+}
+
+size_t AudioMixer::numberOfVoices() const {
+    std::scoped_lock guard(lock);
+    return voices.size() - freeSlots.size();
+}
+
+size_t AudioMixer::numberOfPlayingVoices() const {
+    std::scoped_lock guard(lock);
+    return std::count_if(voices.begin(), voices.end(), [](const Voice& voice) {
+        return voice.active && voice.playing;
+    });
+}
+
+double AudioMixer::update() {
+    std::scoped_lock guard(updateLock);
+    const size_t frames = config.blockFrames;
+    size_t queued = streamSource->numberOfBuffersInQueue();
+    bool mixed = false;
+    while (queued < config.queuedBlocks) {
+        mixBlock(frames);
+
+        const float* left = mixBuffer.data();
+        const float* right = left + frames;
+        if (floatOutput) {
+            float* output = reinterpret_cast<float*>(outputBuffer.data());
+            for (size_t i = 0; i < frames; ++i) {
+                output[i * 2] = left[i];
+                output[i * 2 + 1] = right[i];
+            }
+        } else {
+            int16_t* output = reinterpret_cast<int16_t*>(outputBuffer.data());
+            for (size_t i = 0; i < frames; ++i) {
+                output[i * 2] = int16_t(std::clamp(left[i], -1.0f, 1.0f) * 32767.0f);
+                output[i * 2 + 1] = int16_t(std::clamp(right[i], -1.0f, 1.0f) * 32767.0f);
+            }
+        }
+        if (streamSource->enqueueBuffer(config.sampleRate, floatOutput ? 32 : 16, 2,
+                                        outputBuffer.data(), outputBuffer.size(), streamTime) == false) {
+            Log::error("AudioMixer: AudioSource::enqueueBuffer failed.");
+            break;
+        }
+        streamTime += double(frames) / double(config.sampleRate);
+        queued++;
+        mixed = true;
+    }
+    if (mixed == false)
+        mixBlock(0);
+
+    if (queued > 0 && streamSource->state() != AudioSource::StatePlaying)
+        streamSource->play();
+
+    double blockTime = double(frames) / double(config.sampleRate);
+    if (queued > 0)
+        return std::max(std::min(streamSource->bufferTimeRemaining(), blockTime), 0.001);
+    return blockTime;
+}
+
+void AudioMixer::mixBlock(size_t frames) {
+    ListenerState listenerState = {
+        listener->position(),
+        listener->velocity(),
+        listener->forward(),
+        listener->up(),
+    };
+
+    if (true) {
+        std::scoped_lock guard(lock);
+        spatialize(listenerState);
+        selectVoices(frames);
+    }
+    updateHardware();
+
+    std::fill_n(mixBuffer.begin(), frames * 2, 0.0f);
+    for (auto& job : mixJobs)
+        mixVoice(job, frames);
+
+    if (true) {
+        std::scoped_lock guard(lock);
+        for (auto& job : mixJobs) {
+            auto& voice = voices[job.slot];
+            if (voice.generation != job.generation)
+                continue;
+            voice.cursor = job.cursor;
+            if (job.finished)
+                voice.playing = false;
+        }
+        for (auto& job : hardwareJobs) {
+            auto& voice = voices[job.slot];
+            if (voice.generation != job.generation || job.action == HardwareJob::Stop)
+                continue;
+            voice.cursor = job.cursor;
+            if (job.finished)
+                voice.playing = false; // the next block stops the source.
+        }
+    }
+    mixJobs.clear();
+    hardwareJobs.clear();
+}
+
+void AudioMixer::spatialize(const ListenerState& state) {
+    Vector3 forward = state.forward;
+    Vector3 right = Vector3::cross(forward, state.up);
+    if (right.magnitudeSquared() > 0.0f)
+        right.normalize();
+    else
+        right = Vector3(1, 0, 0);
+
+    const ListenerVectors listener = {
+        state.position.x, state.position.y, state.position.z,
+        state.velocity.x, state.velocity.y, state.velocity.z,
+        right.x, right.y, right.z,
+    };
+    auto& p = parameters;
+    const SpatialArrays arrays = {
+        p.px.data(), p.py.data(), p.pz.data(),
+        p.vx.data(), p.vy.data(), p.vz.data(),
+        p.dx.data(), p.dy.data(), p.dz.data(),
+        p.gain.data(), p.minGain.data(), p.maxGain.data(),
+        p.referenceDistance.data(), p.maxDistance.data(), p.rolloff.data(),
+        p.coneInner.data(), p.coneOuter.data(), p.coneOuterGain.data(),
+        p.pitch.data(), p.rateRatio.data(),
+        p.gainLeft.data(), p.gainRight.data(), p.step.data(), p.audibility.data(),
+    };
+    size_t count = voices.size();
+    size_t i = spatializeVoices<SIMD>(arrays, listener, 0, count);
+    spatializeVoices<Scalar>(arrays, listener, i, count);
+}
+
+void AudioMixer::sourceProperties(uint32_t slot, HardwareJob& job) const {
+    auto& p = parameters;
+    job.position = Vector3(p.px[slot], p.py[slot], p.pz[slot]);
+    job.velocity = Vector3(p.vx[slot], p.vy[slot], p.vz[slot]);
+    job.direction = Vector3(p.dx[slot], p.dy[slot], p.dz[slot]);
+    job.gain = p.gain[slot];
+    job.minGain = p.minGain[slot];
+    job.maxGain = p.maxGain[slot];
+    job.referenceDistance = p.referenceDistance[slot];
+    job.maxDistance = p.maxDistance[slot];
+    job.rolloff = p.rolloff[slot];
+    job.coneInnerAngle = 2.0f * std::acos(p.coneInner[slot]);
+    job.coneOuterAngle = 2.0f * std::acos(p.coneOuter[slot]);
+    job.coneOuterGain = p.coneOuterGain[slot];
+    job.pitch = p.pitch[slot];
+}
+
+void AudioMixer::selectVoices(size_t frames) {
+    selection.clear();
+    for (uint32_t i = 0; i < voices.size(); ++i) {
+        auto& voice = voices[i];
+        if (voice.hardwareSource >= 0 &&
+            (voice.playing == false || voice.generation != voice.hardwareGeneration)) {
+            // stopped, released or restarted.
+            HardwareJob job = { HardwareJob::Stop, i, voice.generation, voice.hardwareSource };
+            hardwareJobs.push_back(job);
+            hardwareSlots[voice.hardwareSource] = -1;
+            voice.hardwareSource = -1;
+            voice.tier = Tier::Virtual;
+            if (voice.active == false) {
+                voice.clip = nullptr;
+                freeSlots.push_back(i);
+            }
+        }
+        if (voice.active && voice.playing)
+            selection.push_back({ i, Tier::Virtual, false });
+    }
+
+    // rank by gain, the hardware voices first.
+    auto score = [this](const Selection& s) {
+        float gain = parameters.audibility[s.slot];
+        return voices[s.slot].tier == Tier::Hardware ? gain * hardwareHysteresis : gain;
+    };
+    auto louder = [&](const Selection& a, const Selection& b) { return score(a) > score(b); };
+    const size_t numHardware = std::min(hardwareSources.size(), selection.size());
+    const size_t numSoftware = std::min(size_t(config.softwareVoices), selection.size() - numHardware);
+    if (numHardware + numSoftware < selection.size())
+        std::nth_element(selection.begin(), selection.begin() + (numHardware + numSoftware), selection.end(), louder);
+    if (numHardware > 0 && numSoftware > 0)
+        std::nth_element(selection.begin(), selection.begin() + numHardware, selection.begin() + (numHardware + numSoftware), louder);
+
+    // demoted voices free their sources first, the source knows their position.
+    for (size_t n = 0; n < selection.size(); ++n) {
+        auto& s = selection[n];
+        auto& voice = voices[s.slot];
+        bool audible = parameters.audibility[s.slot] > audibleGain;
+        if (audible && n < numHardware)
+            s.tier = Tier::Hardware;
+        else if (audible && n < numHardware + numSoftware)
+            s.tier = Tier::Software;
+
+        if (voice.tier == Tier::Hardware && s.tier != Tier::Hardware) {
+            HardwareJob job = { HardwareJob::Demote, s.slot, voice.generation, voice.hardwareSource, voice.clip };
+            hardwareJobs.push_back(job);
+            hardwareSlots[voice.hardwareSource] = -1;
+            voice.hardwareSource = -1;
+            voice.tier = s.tier;
+            voice.lastGainLeft = voice.lastGainRight = 0.0f;
+            s.demoted = true;
+        }
+    }
+
+    for (auto& s : selection) {
+        if (s.demoted)
+            continue;
+        auto& voice = voices[s.slot];
+        if (s.tier == Tier::Hardware) {
+            if (voice.hardwareSource < 0) {
+                auto it = std::find(hardwareSlots.begin(), hardwareSlots.end(), -1);
+                if (it == hardwareSlots.end()) {
+                    s.tier = Tier::Software; // not expected, there is a source for each.
+                } else {
+                    int source = int(it - hardwareSlots.begin());
+                    *it = s.slot;
+                    voice.hardwareSource = source;
+                    voice.hardwareGeneration = voice.generation;
+                    HardwareJob job = { HardwareJob::Start, s.slot, voice.generation, source,
+                                        voice.clip, voice.cursor, voice.looping };
+                    sourceProperties(s.slot, job);
+                    hardwareJobs.push_back(job);
+                    voice.tier = Tier::Hardware;
+                    continue;
+                }
+            } else {
+                HardwareJob job = { HardwareJob::Update, s.slot, voice.generation, voice.hardwareSource,
+                                    voice.clip, voice.cursor, voice.looping };
+                sourceProperties(s.slot, job);
+                hardwareJobs.push_back(job);
+                continue;
+            }
+        }
+        if (frames == 0)
+            continue;
+
+        const bool stereo = voice.clip->channels > 1;
+        float gainLeft = stereo ? parameters.audibility[s.slot] : parameters.gainLeft[s.slot];
+        float gainRight = stereo ? parameters.audibility[s.slot] : parameters.gainRight[s.slot];
+        if (s.tier == Tier::Virtual) {
+            if (voice.tier == Tier::Software) {
+                // fades out in one more block.
+                gainLeft = gainRight = 0.0f;
+            } else {
+                // virtual voices only advance.
+                double length = double(voice.clip->frames());
+                voice.cursor += double(parameters.step[s.slot]) * double(frames);
+                if (voice.cursor >= length) {
+                    if (voice.looping)
+                        voice.cursor = std::fmod(voice.cursor, length);
+                    else
+                        voice.playing = false;
+                }
+                continue;
+            }
+        }
+        // a voice entering the mix fades in.
+        if (voice.tier != Tier::Software)
+            voice.lastGainLeft = voice.lastGainRight = 0.0f;
+        MixJob job = {
+            s.slot, voice.generation, voice.clip,
+            voice.cursor, double(parameters.step[s.slot]), voice.looping, false,
+            { voice.lastGainLeft, gainLeft },
+            { voice.lastGainRight, gainRight },
+        };
+        mixJobs.push_back(job);
+        voice.lastGainLeft = gainLeft;
+        voice.lastGainRight = gainRight;
+        voice.tier = s.tier;
+    }
+}
+
+void AudioMixer::updateHardware() {
+    for (auto& job : hardwareJobs) {
+        auto& source = hardwareSources[job.source];
+        if (job.action == HardwareJob::Stop) {
+            source->stop();
+            continue;
+        }
+        if (job.action == HardwareJob::Demote) {
+            job.cursor = source->timePosition() * double(job.clip->sampleRate);
+            source->stop();
+            continue;
+        }
+        source->setPosition(job.position);
+        source->setVelocity(job.velocity);
+        source->setDirection(job.direction);
+        source->setGain(job.gain);
+        source->setMinGain(job.minGain);
+        source->setMaxGain(job.maxGain);
+        source->setReferenceDistance(job.referenceDistance);
+        source->setMaxDistance(job.maxDistance);
+        source->setRolloffFactor(job.rolloff);
+        source->setConeInnerAngle(job.coneInnerAngle);
+        source->setConeOuterAngle(job.coneOuterAngle);
+        source->setConeOuterGain(job.coneOuterGain);
+        source->setPitch(job.pitch);
+
+        if (job.action == HardwareJob::Start) {
+            source->stop();
+            if (source->enqueueBuffer(job.clip, 0.0) == false) {
+                Log::error("AudioMixer: AudioSource::enqueueBuffer failed.");
+                job.finished = true;
+                continue;
+            }
+            source->setLooping(job.looping);
+            source->setTimeOffset(job.cursor / double(job.clip->sampleRate));
+            source->play();
+        } else {
+            source->setLooping(job.looping);
+            if (source->state() == AudioSource::StateStopped)
+                job.finished = true;
+            else
+                job.cursor = source->timePosition() * double(job.clip->sampleRate);
+        }
+    }
+}
+
+void AudioMixer::mixVoice(MixJob& job, size_t frames) {
+    const size_t stride = config.blockFrames;
+    float* left = voiceBuffer.data();
+    float* right = job.clip->channels > 1 ? left + stride : left;
+    size_t count = resample(*job.clip, job.cursor, job.step, job.looping, left, stride, frames);
+    job.finished = count < frames;
+
+    float* outLeft = mixBuffer.data();
+    float* outRight = outLeft + stride;
+    float stepLeft = (job.gainLeft[1] - job.gainLeft[0]) / float(frames);
+    float stepRight = (job.gainRight[1] - job.gainRight[0]) / float(frames);
+    size_t i = mixFrames<SIMD>(left, right, outLeft, outRight, 0, count,
+                               job.gainLeft[0], stepLeft, job.gainRight[0], stepRight);
+    mixFrames<Scalar>(left, right, outLeft, outRight, i, count,
+                      job.gainLeft[0], stepLeft, job.gainRight[0], stepRight);
+}
+
+AudioVoice::AudioVoice(std::shared_ptr<AudioMixer> m, std::shared_ptr<AudioClip> c, uint32_t s)
+    : mixer(m), clip(c), slot(s) {
+}
+
+AudioVoice::~AudioVoice() {
+    mixer->releaseSlot(slot);
+}
+
+void AudioVoice::play(double start) {
+    if (true) {
+        std::scoped_lock guard(mixer->lock);
+        auto& voice = mixer->voices[slot];
+        voice.cursor = std::max(start, 0.0) * double(clip->sampleRate);
+        voice.playing = true;
+        voice.generation++;
+    }
+    mixer->mixerEvent->notify();
+}
+
+void AudioVoice::stop() {
+    std::scoped_lock guard(mixer->lock);
+    auto& voice = mixer->voices[slot];
+    voice.playing = false;
+    voice.generation++;
+}
+
+bool AudioVoice::isPlaying() const {
+    std::scoped_lock guard(mixer->lock);
+    return mixer->voices[slot].playing;
+}
+
+bool AudioVoice::isHardware() const {
+    std::scoped_lock guard(mixer->lock);
+    return mixer->voices[slot].hardwareSource >= 0;
+}
+
+double AudioVoice::timePosition() const {
+    std::scoped_lock guard(mixer->lock);
+    return mixer->voices[slot].cursor / double(clip->sampleRate);
+}
+
+bool AudioVoice::looping() const {
+    std::scoped_lock guard(mixer->lock);
+    return mixer->voices[slot].looping;
+}
+
+void AudioVoice::setLooping(bool looping) {
+    std::scoped_lock guard(mixer->lock);
+    mixer->voices[slot].looping = looping;
+}
+
+float AudioVoice::pitch() const {
+    return mixer->value(slot, &AudioMixer::Parameters::pitch);
+}
+
+void AudioVoice::setPitch(float f) {
+    mixer->setValue(slot, &AudioMixer::Parameters::pitch, std::max(f, 0.0f));
+}
+
+float AudioVoice::gain() const {
+    return mixer->value(slot, &AudioMixer::Parameters::gain);
+}
+
+void AudioVoice::setGain(float f) {
+    mixer->setValue(slot, &AudioMixer::Parameters::gain, std::max(f, 0.0f));
+}
+
+float AudioVoice::minGain() const {
+    return mixer->value(slot, &AudioMixer::Parameters::minGain);
+}
+
+void AudioVoice::setMinGain(float f) {
+    mixer->setValue(slot, &AudioMixer::Parameters::minGain, std::clamp(f, 0.0f, 1.0f));
+}
+
+float AudioVoice::maxGain() const {
+    return mixer->value(slot, &AudioMixer::Parameters::maxGain);
+}
+
+void AudioVoice::setMaxGain(float f) {
+    mixer->setValue(slot, &AudioMixer::Parameters::maxGain, std::clamp(f, 0.0f, 1.0f));
+}
+
+float AudioVoice::maxDistance() const {
+    return mixer->value(slot, &AudioMixer::Parameters::maxDistance);
+}
+
+void AudioVoice::setMaxDistance(float f) {
+    mixer->setValue(slot, &AudioMixer::Parameters::maxDistance, std::max(f, 0.0f));
+}
+
+float AudioVoice::rolloffFactor() const {
+    return mixer->value(slot, &AudioMixer::Parameters::rolloff);
+}
+
+void AudioVoice::setRolloffFactor(float f) {
+    mixer->setValue(slot, &AudioMixer::Parameters::rolloff, std::max(f, 0.0f));
+}
+
+float AudioVoice::coneOuterGain() const {
+    return mixer->value(slot, &AudioMixer::Parameters::coneOuterGain);
+}
+
+void AudioVoice::setConeOuterGain(float f) {
+    mixer->setValue(slot, &AudioMixer::Parameters::coneOuterGain, std::clamp(f, 0.0f, 1.0f));
+}
+
+float AudioVoice::coneInnerAngle() const {
+    return 2.0f * std::acos(mixer->value(slot, &AudioMixer::Parameters::coneInner));
+}
+
+void AudioVoice::setConeInnerAngle(float f) {
+    f = std::clamp(f, 0.0f, 2.0f * std::numbers::pi_v<float>);
+    mixer->setValue(slot, &AudioMixer::Parameters::coneInner, std::cos(f * 0.5f));
+}
+
+float AudioVoice::coneOuterAngle() const {
+    return 2.0f * std::acos(mixer->value(slot, &AudioMixer::Parameters::coneOuter));
+}
+
+void AudioVoice::setConeOuterAngle(float f) {
+    f = std::clamp(f, 0.0f, 2.0f * std::numbers::pi_v<float>);
+    mixer->setValue(slot, &AudioMixer::Parameters::coneOuter, std::cos(f * 0.5f));
+}
+
+float AudioVoice::referenceDistance() const {
+    return mixer->value(slot, &AudioMixer::Parameters::referenceDistance);
+}
+
+void AudioVoice::setReferenceDistance(float f) {
+    mixer->setValue(slot, &AudioMixer::Parameters::referenceDistance, std::max(f, 0.0f));
+}
+
+Vector3 AudioVoice::position() const {
+    std::scoped_lock guard(mixer->lock);
+    auto& p = mixer->parameters;
+    return Vector3(p.px[slot], p.py[slot], p.pz[slot]);
+}
+
+void AudioVoice::setPosition(const Vector3& v) {
+    std::scoped_lock guard(mixer->lock);
+    auto& p = mixer->parameters;
+    p.px[slot] = v.x;
+    p.py[slot] = v.y;
+    p.pz[slot] = v.z;
+}
+
+Vector3 AudioVoice::velocity() const {
+    std::scoped_lock guard(mixer->lock);
+    auto& p = mixer->parameters;
+    return Vector3(p.vx[slot], p.vy[slot], p.vz[slot]);
+}
+
+void AudioVoice::setVelocity(const Vector3& v) {
+    std::scoped_lock guard(mixer->lock);
+    auto& p = mixer->parameters;
+    p.vx[slot] = v.x;
+    p.vy[slot] = v.y;
+    p.vz[slot] = v.z;
+}
+
+Vector3 AudioVoice::direction() const {
+    std::scoped_lock guard(mixer->lock);
+    auto& p = mixer->parameters;
+    return Vector3(p.dx[slot], p.dy[slot], p.dz[slot]);
+}
+
+void AudioVoice::setDirection(const Vector3& v) {
+    std::scoped_lock guard(mixer->lock);
+    auto& p = mixer->parameters;
+    p.dx[slot] = v.x;
+    p.dy[slot] = v.y;
+    p.dz[slot] = v.z;
+}
@@ -0,0 +1,209 @@
+#pragma once
+#include "../include.h"
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "AudioDevice.h"
+#include "AudioListener.h"
+#include "AudioSource.h"
+#include "AudioClip.h"
+#include "Vector3.h"
+
+namespace FV {
+    class AudioMixer;
+    class AudioEvent;
+
+    // A virtual 3D voice of an AudioMixer playing a clip with samples
+    // (AudioDevice::makeClip with keepSamples). The properties follow
+    // AudioSource, angles are in radians.
+    class FVCORE_API AudioVoice {
+    public:
+        ~AudioVoice();
+
+        const std::shared_ptr<AudioMixer> mixer;
+        const std::shared_ptr<AudioClip> clip;
+
+        void play(double start = 0.0);
+        void stop();
+        bool isPlaying() const;
+        // the voice is played by an AudioSource of the device.
+        bool isHardware() const;
+        double timePosition() const;
+
+        bool looping() const;
+        void setLooping(bool);
+
+        float pitch() const;
+        void setPitch(float);
+        float gain() const;
+        void setGain(float);
+        float minGain() const;
+        void setMinGain(float);
+        float maxGain() const;
+        void setMaxGain(float);
+        float maxDistance() const;
+        void setMaxDistance(float);
+        float rolloffFactor() const;
+        void setRolloffFactor(float);
+        float coneOuterGain() const;
+        void setConeOuterGain(float);
+        float coneInnerAngle() const;
+        void setConeInnerAngle(float);
+        float coneOuterAngle() const;
+        void setConeOuterAngle(float);
+        float referenceDistance() const;
+        void setReferenceDistance(float);
+
+        Vector3 position() const;
+        void setPosition(const Vector3&);
+        Vector3 velocity() const;
+        void setVelocity(const Vector3&);
+        Vector3 direction() const;
+        void setDirection(const Vector3&);
+
+    private:
+        AudioVoice(std::shared_ptr<AudioMixer>, std::shared_ptr<AudioClip>, uint32_t slot);
+        const uint32_t slot;
+        friend class AudioMixer;
+    };
+
+    // Mixes thousands of voices in software. Every block the voices are
+    // spatialized with SIMD (distance attenuation, cone, stereo panning
+    // and doppler as in OpenAL), the loudest ones are promoted to the
+    // AudioSources of the device, the next ones are mixed into a shared
+    // stereo stream and the rest only advance (virtual voices).
+    class FVCORE_API AudioMixer : public std::enable_shared_from_this<AudioMixer> {
+    public:
+        struct Configuration {
+            uint32_t sampleRate = 48000;
+            uint32_t blockFrames = 512;     // frames of a stream buffer
+            uint32_t queuedBlocks = 3;      // stream buffers queued ahead
+            uint32_t hardwareVoices = 16;   // AudioSources for the loudest voices
+            uint32_t softwareVoices = 256;  // voices mixed into the stream
+            // without the mixer thread, update() must be called regularly.
+            bool mixerThread = true;
+        };
+
+        AudioMixer(std::shared_ptr<AudioDevice>, std::shared_ptr<AudioListener>, const Configuration&);
+        ~AudioMixer();
+
+        const std::shared_ptr<AudioDevice> device;
+        const std::shared_ptr<AudioListener> listener;
+        const Configuration config;
+
+        // returns nullptr if the clip has no samples.
+        std::shared_ptr<AudioVoice> makeVoice(std::shared_ptr<AudioClip>);
+
+        // mixes stream buffers until the queue is full and updates the
+        // hardware voices, returns the time until the next update.
+        double update();
+
+        size_t numberOfVoices() const;
+        size_t numberOfPlayingVoices() const;
+
+    private:
+        // per slot parameters, stored as arrays for the SIMD spatializer.
+        struct Parameters {
+            std::vector<float> px, py, pz;
+            std::vector<float> vx, vy, vz;
+            std::vector<float> dx, dy, dz;
+            std::vector<float> gain, minGain, maxGain;
+            std::vector<float> referenceDistance, maxDistance, rolloff;
+            std::vector<float> coneInner, coneOuter; // cosines of the half angles
+            std::vector<float> coneOuterGain;
+            std::vector<float> pitch;
+            std::vector<float> rateRatio;            // clip rate / mixer rate
+            // results
+            std::vector<float> gainLeft, gainRight, step, audibility;
+        };
+        static std::vector<float> Parameters::* const parameterArrays[];
+
+        enum class Tier : uint8_t { Virtual, Software, Hardware };
+        struct Voice {
+            std::shared_ptr<AudioClip> clip;
+            double cursor;          // frames
+            uint32_t generation;    // changed by play, stop and release
+            uint32_t hardwareGeneration; // generation the source was started with
+            bool active;
+            bool playing;
+            bool looping;
+            Tier tier;
+            int hardwareSource;     // index of hardwareSources or -1
+            float lastGainLeft;
+            float lastGainRight;
+        };
+        struct Selection {
+            uint32_t slot;
+            Tier tier;
+            bool demoted;
+        };
+        struct MixJob {
+            uint32_t slot;
+            uint32_t generation;
+            std::shared_ptr<AudioClip> clip;
+            double cursor;
+            double step;
+            bool looping;
+            bool finished;
+            float gainLeft[2];      // start and end of the block
+            float gainRight[2];
+        };
+        struct HardwareJob {
+            enum Action : uint8_t { Start, Update, Demote, Stop };
+            Action action;
+            uint32_t slot;
+            uint32_t generation;
+            int source;
+            std::shared_ptr<AudioClip> clip;
+            double cursor;
+            bool looping;
+            bool finished;
+            // source properties
+            Vector3 position, velocity, direction;
+            float gain, minGain, maxGain;
+            float referenceDistance, maxDistance, rolloff;
+            float coneInnerAngle, coneOuterAngle, coneOuterGain;
+            float pitch;
+        };
+
+        uint32_t allocSlot(std::shared_ptr<AudioClip>);
+        void releaseSlot(uint32_t);
+        void setValue(uint32_t slot, std::vector<float> Parameters::*, float);
+        float value(uint32_t slot, std::vector<float> Parameters::*) const;
+        void sourceProperties(uint32_t slot, HardwareJob&) const;
+
+        struct ListenerState {
+            Vector3 position, velocity, forward, up;
+        };
+        // mixes a block into mixBuffer, frames can be 0 to update the hardware voices only.
+        void mixBlock(size_t frames);
+        void spatialize(const ListenerState&);
+        void selectVoices(size_t frames);
+        void updateHardware();
+        void mixVoice(MixJob&, size_t frames);
+
+        Parameters parameters;
+        std::vector<Voice> voices;
+        std::vector<uint32_t> freeSlots;
+        std::vector<Selection> selection;
+        std::vector<MixJob> mixJobs;
+        std::vector<HardwareJob> hardwareJobs;
+        std::vector<float> mixBuffer;       // planar left, right
+        std::vector<float> voiceBuffer;     // planar resampled channels of a voice
+        std::vector<uint8_t> outputBuffer;
+        bool floatOutput;
+        double streamTime;
+
+        std::vector<std::shared_ptr<AudioSource>> hardwareSources;
+        std::vector<int64_t> hardwareSlots; // slot of a source, -1 if free
+        std::shared_ptr<AudioSource> streamSource;
+
+        mutable std::mutex lock;            // voices and parameters
+        std::mutex updateLock;              // update() and the buffers above
+        std::shared_ptr<AudioEvent> mixerEvent;
+        std::jthread mixerThread;
+
+        friend class AudioVoice;
+    };
+}
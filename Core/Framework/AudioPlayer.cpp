@@ -1,14 +1,28 @@
 #include "AudioPlayer.h"
+#include "Private/AudioRingBuffer.h"
 
 using namespace FV;
 
 AudioPlayer::AudioPlayer(std::shared_ptr<AudioSource> src, std::shared_ptr<AudioStream> st)
-    : playing(false)
+    : source(src), stream(st)
+    , playing(false)
     , buffering(false)
     , bufferedPosition(0)
     , playbackPosition(0), playLoopCount(0)
     , maxBufferingTime(1.0)
-    , source(src), stream(st) {
+    , generation(0)
+    , decodeState(DecodeState::Idle) {
+}
+
+AudioPlayer::AudioPlayer(std::shared_ptr<AudioSource> src, std::shared_ptr<AudioClip> c)
+    : source(src), clip(c)
+    , playing(false)
+    , buffering(false)
+    , bufferedPosition(0)
+    , playbackPosition(0), playLoopCount(0)
+    , maxBufferingTime(1.0)
+    , generation(0)
+    , decodeState(DecodeState::Idle) {
 }
 
 AudioPlayer::~AudioPlayer() {
@@ -16,38 +30,96 @@ AudioPlayer::~AudioPlayer() {
     source->dequeueBuffers();
 }
 
+void AudioPlayer::wakeup() {
+    if (mixerEvent)
+        mixerEvent->notify();
+    if (decoderEvent)
+        decoderEvent->notify();
+}
+
+// controlLock must be held. The first loop is queued and started here,
+// the mixer thread queues the remaining loops.
+void AudioPlayer::playClip(double start, int loopCount) {
+    source->stop();
+    source->dequeueBuffers();
+
+    std::scoped_lock guard(streamLock);
+    generation++;
+    playLoopCount = std::max(loopCount, 1) - 1;
+    buffering = false;
+    playing = source->enqueueBuffer(clip, 0.0);
+    if (playing) {
+        if (start > 0.0)
+            source->setTimePosition(start);
+        source->play();
+        playbackPosition = start;
+        bufferedPosition = clip->duration();
+    }
+}
+
 void AudioPlayer::play() {
-    if (playing == false) {
-        playing = true;
-        buffering = true;
-        playLoopCount = 1;
+    if (true) {
+        std::scoped_lock guard(controlLock);
+        if (playing == false && clip) {
+            playClip(0.0, 1);
+        } else if (playing == false) {
+            std::scoped_lock guard2(streamLock);
+            playing = true;
+            buffering = true;
+            playLoopCount = 1;
+            decodeState = DecodeState::Decoding;
+        } else if (source->state() == AudioSource::StatePaused) {
+            source->play();
+        }
     }
+    wakeup();
 }
 
 void AudioPlayer::play(double start, int loopCount) {
-    if (playing == false) {
-        source->stop();
-        source->dequeueBuffers();
+    if (true) {
+        std::scoped_lock guard(controlLock);
+        if (playing == false && clip) {
+            playClip(start, loopCount);
+        } else if (playing == false) {
+            source->stop();
+            source->dequeueBuffers();
 
-        playing = true;
-        buffering = true;
-        playLoopCount = loopCount;
-        stream->seekTime(start);
-        playbackPosition = stream->timePosition();
+            std::scoped_lock guard2(streamLock);
+            generation++;
+            playing = true;
+            buffering = true;
+            playLoopCount = loopCount;
+            decodeState = DecodeState::Decoding;
+            stream->seekTime(start);
+            playbackPosition = stream->timePosition();
+        }
     }
+    wakeup();
 }
 
 void AudioPlayer::stop() {
-    stream->seekPcm(0);
-    source->stop();
-    source->dequeueBuffers();
+    if (true) {
+        std::scoped_lock guard(controlLock);
+        if (true) {
+            std::scoped_lock guard2(streamLock);
+            generation++;
+            decodeState = DecodeState::Idle;
+            if (stream)
+                stream->seekPcm(0);
+        }
+        source->stop();
+        source->dequeueBuffers();
 
-    playing = false;
-    playbackPosition = 0;
-    bufferedPosition = 0;
+        playing = false;
+        buffering = false;
+        playbackPosition = 0;
+        bufferedPosition = 0;
+    }
+    wakeup();
 }
 
 void AudioPlayer::pause() {
+    std::scoped_lock guard(controlLock);
     if (playing)
         source->pause();
 }
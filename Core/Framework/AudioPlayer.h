@@ -1,19 +1,27 @@
 #pragma once
 #include "../include.h"
+#include <atomic>
+#include <mutex>
 #include "AudioSource.h"
 #include "AudioStream.h"
+#include "AudioClip.h"
 
 namespace FV {
+    class AudioRingBuffer;
+    class AudioEvent;
+
     class FVCORE_API AudioPlayer {
     public:
         AudioPlayer(std::shared_ptr<AudioSource>, std::shared_ptr<AudioStream>);
+        // plays a decoded clip, starts without decoding.
+        AudioPlayer(std::shared_ptr<AudioSource>, std::shared_ptr<AudioClip>);
         virtual ~AudioPlayer();
 
-        uint32_t sampleRate() const { stream->sampleRate(); }
-        uint32_t channels() const { stream->channels(); }
-        uint32_t bits() const { stream->bits(); }
-        double duration() const { stream->timeTotal(); }
-        double position() const { stream->timePosition(); }
+        uint32_t sampleRate() const { return stream ? stream->sampleRate() : clip->sampleRate; }
+        uint32_t channels() const { return stream ? stream->channels() : clip->channels; }
+        uint32_t bits() const { return stream ? stream->bits() : clip->bits; }
+        double duration() const { return stream ? stream->timeTotal() : clip->duration(); }
+        double position() const { return stream ? stream->timePosition() : source->timePosition(); }
 
         bool retainedWhilePlaying = false;
 
@@ -22,22 +30,42 @@ namespace FV {
         void stop();
         void pause();
 
-        AudioSource::State state() const { source->state(); }
+        AudioSource::State state() const { return source->state(); }
 
         const std::shared_ptr<AudioSource> source;
         const std::shared_ptr<AudioStream> stream;
+        const std::shared_ptr<AudioClip> clip;
 
     protected:
+        // called on the mixer thread
         virtual void bufferingStateChanged(bool, double timestamp) {}
         virtual void playbackStateChanged(bool, double  position) {}
+        // called on the decoder thread, ahead of playback
         virtual void processStream(void* data, size_t byteCount, double timestamp) {}
     private:
+        enum class DecodeState : uint8_t { Idle, Decoding, Finished, Failed };
+        void wakeup();
+        void playClip(double start, int loops);
+
+        // guarded by controlLock
         bool playing;
         bool buffering;
         double bufferedPosition;
         double playbackPosition;
+        // guarded by streamLock
         int playLoopCount;
         double maxBufferingTime;
+
+        // changed with both locks held, decoded data of an older
+        // generation is discarded by the mixer.
+        std::atomic<uint32_t> generation;
+        std::atomic<DecodeState> decodeState;
+        std::mutex controlLock;
+        std::mutex streamLock;
+
+        std::unique_ptr<AudioRingBuffer> ringBuffer;
+        std::shared_ptr<AudioEvent> mixerEvent;
+        std::shared_ptr<AudioEvent> decoderEvent;
         friend class AudioDeviceContext;
     };
 }
@@ -7,6 +7,7 @@
 
 #include "AudioSource.h"
 #include "AudioDevice.h"
+#include "AudioClip.h"
 #include "Logger.h"
 #include "Quaternion.h"
 
@@ -26,6 +27,8 @@ AudioSource::~AudioSource() {
     FVASSERT_DEBUG(buffers.empty());
 
     alDeleteSources(1, &sourceID);
+    if (freeBuffers.empty() == false)
+        alDeleteBuffers((ALsizei)freeBuffers.size(), freeBuffers.data());
 
     // check error
     auto err = alGetError();
@@ -76,9 +79,10 @@ void AudioSource::stop() {
     alSourcei(sourceID, AL_BUFFER, 0);
     alSourceRewind(sourceID);
 
+    // detached buffers go back to the pool.
     for (auto& buffer : buffers) {
-        ALuint bufferID = buffer.bufferID;
-        alDeleteBuffers(1, &bufferID);
+        if (buffer.clip == nullptr)
+            freeBuffers.push_back(buffer.bufferID);
     }
     buffers.clear();
 
@@ -103,18 +107,30 @@ size_t AudioSource::numberOfBuffersInQueue() const {
 
 void AudioSource::dequeueBuffers() const {
     std::scoped_lock guard(bufferLock);
+    unqueueProcessedBuffers();
+}
+
+void AudioSource::unqueueProcessedBuffers() const {
     ALint bufferProcessed = 0;
     alGetSourcei(sourceID, AL_BUFFERS_PROCESSED, &bufferProcessed);
     for (int i = 0; i < bufferProcessed; ++i) {
         ALuint bufferID = 0;
         alSourceUnqueueBuffers(sourceID, 1, &bufferID);
         if (bufferID) {
-            if (auto it = std::find_if(
+            bool shared = false;
+            // buffers are processed in the order they were queued.
+            if (buffers.empty() == false && buffers.front().bufferID == bufferID) {
+                shared = buffers.front().clip != nullptr;
+                buffers.pop_front();
+            } else if (auto it = std::find_if(
                 buffers.begin(), buffers.end(), [bufferID](const Buffer& buffer) {
                     return buffer.bufferID == bufferID;
-                }); it != this->buffers.end())
+                }); it != this->buffers.end()) {
+                shared = it->clip != nullptr;
                 this->buffers.erase(it);
-                alDeleteBuffers(1, &bufferID);
+            }
+            if (shared == false)
+                freeBuffers.push_back(bufferID);
         } else {
             Log::error("AudioSource failed to dequeue buffer! source:{}", sourceID);
         }
@@ -136,39 +152,15 @@ bool AudioSource::enqueueBuffer(int sampleRate,
         uint32_t format = device->format(bits, channels);
         if (format) {
             std::scoped_lock guard(bufferLock);
-
-            std::vector<ALuint> finishedBuffers;
-            ALint numBuffersProcessed = 0;
-            alGetSourcei(sourceID, AL_BUFFERS_PROCESSED, &numBuffersProcessed);
-            finishedBuffers.reserve(numBuffersProcessed);
-
-            while (numBuffersProcessed > 0) {
-                ALuint bufferID = 0;
-                alSourceUnqueueBuffers(sourceID, 1, &bufferID);
-                if (bufferID)
-                    finishedBuffers.push_back(bufferID);
-                numBuffersProcessed--;
-            }
+            unqueueProcessedBuffers();
 
             ALuint bufferID = 0;
-            if (finishedBuffers.empty() == false) {
-                for (ALuint id : finishedBuffers) {
-                    if (auto it = std::find_if(
-                        buffers.begin(), buffers.end(),
-                        [id](const Buffer& buffer) {
-                            return buffer.bufferID == id;
-                        }); it != this->buffers.end())
-                        this->buffers.erase(it);
-                }
-                bufferID = finishedBuffers[0];
-                ALsizei numBuffers = (ALsizei)finishedBuffers.size();
-                if (numBuffers > 1) {
-                    ALuint* buff = finishedBuffers.data();
-                    alDeleteBuffers(numBuffers - 1, &buff[1]);
-                }
-            }
-            if (bufferID == 0)
+            if (freeBuffers.empty() == false) {
+                bufferID = freeBuffers.back();
+                freeBuffers.pop_back();
+            } else {
                 alGenBuffers(1, &bufferID);
+            }
             // enqueue buffer.
             alBufferData(bufferID, format, data, (ALsizei)byteCount, sampleRate);
             alSourceQueueBuffers(sourceID, 1, &bufferID);
@@ -190,6 +182,43 @@ bool AudioSource::enqueueBuffer(int sampleRate,
     return false;
 }
 
+bool AudioSource::enqueueBuffer(std::shared_ptr<AudioClip> clip, double timeStamp) {
+    if (clip) {
+        std::scoped_lock guard(bufferLock);
+        unqueueProcessedBuffers();
+
+        ALuint bufferID = clip->bufferID;
+        alSourceQueueBuffers(sourceID, 1, &bufferID);
+
+        // check error
+        if (ALenum err = alGetError(); err != AL_NO_ERROR) {
+            Log::error("AudioSource error: {}, {}", err, alGetString(err));
+            return false;
+        }
+        Buffer bufferInfo = { timeStamp, clip->bytes, clip->bytesSecond(), bufferID, clip };
+        this->buffers.push_back(bufferInfo);
+        return true;
+    }
+    return false;
+}
+
+double AudioSource::bufferTimeRemaining() const {
+    dequeueBuffers();
+    FVASSERT_DEBUG(sourceID != 0);
+    std::scoped_lock guard(bufferLock);
+    if (buffers.empty())
+        return 0.0;
+
+    const Buffer& buffInfo = buffers.front();
+    FVASSERT_DEBUG(buffInfo.bytesSecond != 0);
+
+    ALint bytesOffset = 0;
+    alGetSourcei(sourceID, AL_BYTE_OFFSET, &bytesOffset);
+    bytesOffset = std::clamp(bytesOffset, 0, (ALint)buffInfo.bytes);
+
+    return static_cast<double>(buffInfo.bytes - bytesOffset) / static_cast<double>(buffInfo.bytesSecond);
+}
+
 double AudioSource::timePosition() const {
     dequeueBuffers();
     FVASSERT_DEBUG(sourceID != 0);
@@ -279,6 +308,18 @@ void AudioSource::setTimeOffset(double t) {
     }
 }
 
+bool AudioSource::looping() const {
+    FVASSERT_DEBUG(sourceID != 0);
+    ALint looping = 0;
+    alGetSourcei(sourceID, AL_LOOPING, &looping);
+    return looping != 0;
+}
+
+void AudioSource::setLooping(bool looping) {
+    FVASSERT_DEBUG(sourceID != 0);
+    alSourcei(sourceID, AL_LOOPING, looping ? AL_TRUE : AL_FALSE);
+}
+
 float AudioSource::pitch() const {
     FVASSERT_DEBUG(sourceID != 0);
     float f = 1.0;
@@ -1,11 +1,13 @@
 #pragma once
 #include "../include.h"
 #include <vector>
+#include <deque>
 #include <mutex>
 #include "Vector3.h"
 
 namespace FV {
     class AudioDevice;
+    class AudioClip;
     class FVCORE_API AudioSource {
     public:
         AudioSource(std::shared_ptr<AudioDevice>, uint32_t);
@@ -18,8 +20,12 @@ namespace FV {
         };
         State state() const;
         bool enqueueBuffer(int sampleRate, int bits, int channels, const void* data, size_t bytes, double timeStamp);
+        // queues the shared buffer of a clip, no data is copied.
+        bool enqueueBuffer(std::shared_ptr<AudioClip>, double timeStamp);
         void dequeueBuffers() const;
         size_t numberOfBuffersInQueue() const;
+        // time until the front buffer of the queue is processed
+        double bufferTimeRemaining() const;
 
         double timePosition() const;
         void setTimePosition(double);
@@ -30,6 +36,10 @@ namespace FV {
         void pause();
         void stop();
 
+        // repeats the queued buffers, stop() turns it off.
+        bool looping() const;
+        void setLooping(bool);
+
         // pitch control
         float pitch() const;
         void setPitch(float f);
@@ -83,6 +93,8 @@ namespace FV {
         void setDirection(const Vector3& v);
 
     private:
+        void unqueueProcessedBuffers() const;
+
         uint32_t sourceID;
         mutable std::mutex bufferLock;
         struct Buffer {
@@ -90,8 +102,13 @@ namespace FV {
             size_t bytes;
             size_t bytesSecond;
             uint32_t bufferID;
+            std::shared_ptr<AudioClip> clip; // owner of a shared buffer
         };
-        mutable std::vector<Buffer> buffers;
+        // queued buffers in playback order, OpenAL unqueues from the front.
+        mutable std::deque<Buffer> buffers;
+        // AL buffers are generated on demand and recycled until the source
+        // is destroyed, the pool stays at the deepest queue length.
+        mutable std::vector<uint32_t> freeBuffers;
         std::shared_ptr<AudioDevice> device;
     };
 }
@@ -2,9 +2,12 @@
 #include <fstream>
 #include <vector>
 #include <algorithm>
+#include <mutex>
+#include <unordered_map>
 
 #include "../Libs/dkwrapper/DKAudioStream.h"
 #include "AudioStream.h"
+#include "Logger.h"
 
 using namespace FV;
 
@@ -83,13 +86,14 @@ namespace {
             uint64_t s = std::min(size, data.size() - position);
             if (s > 0)
                 memcpy(buff, &(data.data()[position]), s);
+            position += s;
             return s;
         }
         std::vector<uint8_t> data;
         uint64_t position;
     };
 
-    DKAudioStream* allocStream(StreamSource* source) {
+    DKAudioStream* allocStream(StreamSource* source, const std::vector<uint8_t>& seekIndex = {}) {
         if (source) {
             DKStream* proxy = new DKStream{};
             proxy->userContext = source;
@@ -115,8 +119,9 @@ namespace {
                 return source->totalLength();
             };
 
-            DKAudioStream* stream = DKAudioStreamCreate(source->proxy);
+            DKAudioStream* stream = DKAudioStreamCreateWithSeekIndex(proxy, seekIndex.data(), seekIndex.size());
             if (stream) {
+                stream->userContext = source;
                 source->proxy = proxy;
                 return stream;
             }
@@ -129,13 +134,161 @@ namespace {
             StreamSource* src = (StreamSource*)(stream->userContext);
             DKStream* proxy = src->proxy;
             DKAudioStreamDestroy(stream);
-            delete stream;
             delete proxy;
             src->proxy = nullptr;
             return src;
         }
         return nullptr;
     }
+
+    // Seek index files beside the audio files, "song.mp3.seekindex".
+    // They are valid as long as size and modification time of the audio
+    // file do not change. Loaded indices are also kept in memory, for
+    // files in directories that are not writable.
+    struct SeekIndexFileHeader {
+        char magic[4];
+        uint32_t version;
+        uint64_t fileSize;
+        int64_t fileTime;
+        uint64_t indexSize;
+    };
+    constexpr char seekIndexMagic[4] = { 'F', 'V', 'S', 'I' };
+    constexpr uint32_t seekIndexVersion = 1;
+
+    struct SeekIndexEntry {
+        uint64_t fileSize;
+        int64_t fileTime;
+        std::vector<uint8_t> index;
+    };
+    std::mutex seekIndexLock;
+    std::unordered_map<std::string, SeekIndexEntry> seekIndexCache;
+
+    std::filesystem::path seekIndexFilePath(const std::filesystem::path& path) {
+        auto p = path;
+        p += ".seekindex";
+        return p;
+    }
+
+    bool fileStamp(const std::filesystem::path& path, uint64_t& size, int64_t& time) {
+        std::error_code ec;
+        size = std::filesystem::file_size(path, ec);
+        if (ec)
+            return false;
+        auto t = std::filesystem::last_write_time(path, ec);
+        if (ec)
+            return false;
+        time = t.time_since_epoch().count();
+        return true;
+    }
+
+    // Only MP3 streams have a seek index, the other formats have their
+    // own seek tables or are seekable by offset.
+    bool hasSeekIndex(const std::filesystem::path& path) {
+        char header[DKAUDIO_IDENTIFY_FORMAT_HEADER_LENGTH] = {};
+        std::ifstream file(path, std::ios::binary | std::ios::in);
+        if (file.good() == false)
+            return false;
+        file.read(header, sizeof(header));
+        return DKAudioStreamDetermineFormatFromHeader(header, size_t(file.gcount()))
+            == DKAudioStreamEncodingFormat_MP3;
+    }
+
+    std::vector<uint8_t> loadSeekIndex(const std::filesystem::path& path) {
+        if (hasSeekIndex(path) == false)
+            return {};
+        uint64_t fileSize;
+        int64_t fileTime;
+        if (fileStamp(path, fileSize, fileTime) == false)
+            return {};
+
+        std::scoped_lock guard(seekIndexLock);
+        if (auto it = seekIndexCache.find(path.string()); it != seekIndexCache.end()) {
+            if (it->second.fileSize == fileSize && it->second.fileTime == fileTime)
+                return it->second.index;
+            seekIndexCache.erase(it);
+        }
+
+        std::ifstream file(seekIndexFilePath(path), std::ios::binary | std::ios::in);
+        if (file.good() == false)
+            return {};
+        SeekIndexFileHeader header = {};
+        file.read(reinterpret_cast<char*>(&header), sizeof(header));
+        if (file.gcount() != sizeof(header) ||
+            memcmp(header.magic, seekIndexMagic, 4) != 0 ||
+            header.version != seekIndexVersion ||
+            header.fileSize != fileSize ||
+            header.fileTime != fileTime ||
+            header.indexSize > fileSize) // an index is much smaller than its file.
+            return {};
+
+        std::vector<uint8_t> index(header.indexSize);
+        file.read(reinterpret_cast<char*>(index.data()), index.size());
+        if (file.gcount() != std::streamsize(index.size()))
+            return {};
+
+        seekIndexCache[path.string()] = { fileSize, fileTime, index };
+        return index;
+    }
+
+    void storeSeekIndex(const std::filesystem::path& path, const std::vector<uint8_t>& index) {
+        uint64_t fileSize;
+        int64_t fileTime;
+        if (fileStamp(path, fileSize, fileTime) == false)
+            return;
+
+        std::scoped_lock guard(seekIndexLock);
+        seekIndexCache[path.string()] = { fileSize, fileTime, index };
+
+        SeekIndexFileHeader header = {};
+        memcpy(header.magic, seekIndexMagic, 4);
+        header.version = seekIndexVersion;
+        header.fileSize = fileSize;
+        header.fileTime = fileTime;
+        header.indexSize = index.size();
+
+        // write to a temporary file and rename it, readers never see a partial file.
+        auto indexPath = seekIndexFilePath(path);
+        auto tempPath = indexPath;
+        tempPath += ".tmp";
+        if (true) {
+            std::ofstream file(tempPath, std::ios::binary | std::ios::out | std::ios::trunc);
+            if (file.good() == false) {
+                Log::debug("AudioStream: cannot write seek index file: {}", indexPath.string());
+                return;
+            }
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(reinterpret_cast<const char*>(index.data()), index.size());
+            if (file.good() == false) {
+                file.close();
+                std::error_code ec;
+                std::filesystem::remove(tempPath, ec);
+                return;
+            }
+        }
+        std::error_code ec;
+        std::filesystem::rename(tempPath, indexPath, ec);
+        if (ec) {
+            std::filesystem::remove(tempPath, ec);
+            Log::debug("AudioStream: cannot write seek index file: {}", indexPath.string());
+        }
+    }
+}
+
+void AudioStream::storeSeekIndex() {
+    if (path.empty())
+        return;
+    DKAudioStream* stream = reinterpret_cast<DKAudioStream*>(this->stream);
+    size_t size = DKAudioStreamCopySeekIndex(stream, nullptr, 0);
+    if (size == 0 || size == seekIndex.size())
+        return;
+
+    std::vector<uint8_t> index(size);
+    if (DKAudioStreamCopySeekIndex(stream, index.data(), index.size()) != size)
+        return;
+    if (index != seekIndex) {
+        ::storeSeekIndex(path, index);
+        seekIndex = std::move(index);
+    }
 }
 
 AudioStream::AudioStream()
@@ -145,7 +298,12 @@ AudioStream::AudioStream()
 
 AudioStream::AudioStream(const std::filesystem::path& path)
     : stream(nullptr) {
-    this->stream = allocStream(new FileStreamSource(path));
+    this->seekIndex = loadSeekIndex(path);
+    this->stream = allocStream(new FileStreamSource(path), seekIndex);
+    if (this->stream) {
+        this->path = path;
+        storeSeekIndex();
+    }
 }
 
 AudioStream::AudioStream(const void* data, size_t size)
@@ -154,6 +312,9 @@ AudioStream::AudioStream(const void* data, size_t size)
 }
 
 AudioStream::~AudioStream() {
+    // an index built by seeking after the open is stored as well.
+    if (this->stream)
+        storeSeekIndex();
     auto source = deallocStream((DKAudioStream*)stream);
     delete source;
 }
@@ -163,7 +324,7 @@ size_t AudioStream::read(void* buffer, size_t length) {
     uint64_t read = stream->read(stream, buffer, length);
     if (read == ~uint64_t(0))
         return -1;
-    return 0;
+    return read;
 }
 
 uint64_t AudioStream::seekRaw(uint64_t raw) {
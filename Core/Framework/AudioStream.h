@@ -1,6 +1,7 @@
 #pragma once
 #include "../include.h"
 #include <filesystem>
+#include <vector>
 
 namespace FV {
     enum class AudioStreamEncodingFormat {
@@ -39,7 +40,13 @@ namespace FV {
         AudioStreamEncodingFormat mediaType() const { return format; }
 
     private:
+        // stores the seek index of the decoder beside the file, the next
+        // open of the file loads it instead of scanning the whole stream.
+        void storeSeekIndex();
+
         AudioStreamEncodingFormat format;
         void* stream;
+        std::filesystem::path path;
+        std::vector<uint8_t> seekIndex; // index loaded or stored for the file
     };
 }
@@ -1,5 +1,6 @@
 #pragma once
 #include "../include.h"
+#include <mutex>
 #include "RenderPass.h"
 #include "CommandBuffer.h"
 #include "SwapChain.h"
@@ -7,6 +8,7 @@
 namespace FV {
     class Window;
     class GraphicsDevice;
+    class UploadManager;
     class CommandQueue {
     public:
         enum TypeFlags : uint32_t {
@@ -22,6 +24,13 @@ namespace FV {
 
         virtual uint32_t flags() const = 0;
         virtual std::shared_ptr<GraphicsDevice> device() const = 0;
+
+        // staging ring shared by uploads through this queue, made on first use.
+        FVCORE_API UploadManager* uploadManager();
+
+    private:
+        std::mutex uploadManagerLock;
+        std::shared_ptr<UploadManager> _uploadManager;
     };
 
     inline std::shared_ptr<GraphicsDevice> CommandBuffer::device() const {
@@ -0,0 +1,904 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include "CompressedImage.h"
+#include "GraphicsDevice.h"
+#include "DispatchQueue.h"
+#include "Logger.h"
+#include "Hash.h"
+
+namespace {
+    using namespace FV;
+
+    using Quality = ImageCompressionQuality;
+
+    struct BitWriter {
+        uint8_t* data;
+        uint32_t offset = 0;
+        void write(uint32_t value, uint32_t bits) {
+            for (uint32_t i = 0; i < bits; ++i, ++offset) {
+                if ((value >> i) & 1)
+                    data[offset >> 3] |= uint8_t(1U << (offset & 7));
+            }
+        }
+    };
+
+    struct BitReader {
+        const uint8_t* data;
+        uint32_t offset = 0;
+        uint32_t read(uint32_t bits) {
+            uint32_t value = 0;
+            for (uint32_t i = 0; i < bits; ++i, ++offset) {
+                value |= uint32_t((data[offset >> 3] >> (offset & 7)) & 1) << i;
+            }
+            return value;
+        }
+    };
+
+    // 4x4 RGBA8 texels, edges are clamped for images not multiple of 4.
+    using Block = uint8_t[16][4];
+
+    void loadBlock(const uint8_t* pixels, uint32_t width, uint32_t height,
+                   uint32_t bx, uint32_t by, Block& block) {
+        for (uint32_t y = 0; y < 4; ++y) {
+            const uint32_t py = std::min(by * 4 + y, height - 1);
+            for (uint32_t x = 0; x < 4; ++x) {
+                const uint32_t px = std::min(bx * 4 + x, width - 1);
+                memcpy(block[y * 4 + x], &pixels[(size_t(py) * width + px) * 4], 4);
+            }
+        }
+    }
+
+    void storeBlock(const Block& block, uint32_t bx, uint32_t by,
+                    uint8_t* pixels, uint32_t width, uint32_t height,
+                    uint32_t components) {
+        for (uint32_t y = 0; y < 4 && by * 4 + y < height; ++y) {
+            for (uint32_t x = 0; x < 4 && bx * 4 + x < width; ++x) {
+                const size_t offset = (size_t(by * 4 + y) * width + (bx * 4 + x)) * components;
+                memcpy(&pixels[offset], block[y * 4 + x], components);
+            }
+        }
+    }
+
+    template <int N> struct Vector {
+        float v[N] = {};
+        float& operator[](int i) { return v[i]; }
+        float operator[](int i) const { return v[i]; }
+    };
+
+    template <int N>
+    float dot(const Vector<N>& a, const Vector<N>& b) {
+        float d = 0;
+        for (int i = 0; i < N; ++i) d += a[i] * b[i];
+        return d;
+    }
+
+    // Fits a line segment through the points.
+    // Fast uses the bounding box diagonal, others use the principal axis.
+    template <int N>
+    void fitEndpoints(const Vector<N>* points, int count, Quality quality,
+                      Vector<N>& e0, Vector<N>& e1) {
+        Vector<N> mean = {}, minValue, maxValue;
+        for (int c = 0; c < N; ++c) {
+            minValue[c] = std::numeric_limits<float>::max();
+            maxValue[c] = std::numeric_limits<float>::lowest();
+        }
+        for (int i = 0; i < count; ++i) {
+            for (int c = 0; c < N; ++c) {
+                mean[c] += points[i][c];
+                minValue[c] = std::min(minValue[c], points[i][c]);
+                maxValue[c] = std::max(maxValue[c], points[i][c]);
+            }
+        }
+        for (int c = 0; c < N; ++c) mean[c] /= float(count);
+
+        float cov[N][N] = {};
+        for (int i = 0; i < count; ++i) {
+            Vector<N> d;
+            for (int c = 0; c < N; ++c) d[c] = points[i][c] - mean[c];
+            for (int r = 0; r < N; ++r)
+                for (int c = 0; c < N; ++c)
+                    cov[r][c] += d[r] * d[c];
+        }
+
+        if (quality == Quality::Fast) {
+            // orient the box along the channel with the widest range.
+            int k = 0;
+            for (int c = 1; c < N; ++c)
+                if (maxValue[c] - minValue[c] > maxValue[k] - minValue[k]) k = c;
+            e0 = minValue;
+            e1 = maxValue;
+            for (int c = 0; c < N; ++c) {
+                if (c != k && cov[c][k] < 0)
+                    std::swap(e0[c], e1[c]);
+            }
+            return;
+        }
+
+        Vector<N> axis;
+        for (int c = 0; c < N; ++c) axis[c] = maxValue[c] - minValue[c];
+        for (int iteration = 0; iteration < 8; ++iteration) {
+            Vector<N> next = {};
+            for (int r = 0; r < N; ++r)
+                for (int c = 0; c < N; ++c)
+                    next[r] += cov[r][c] * axis[c];
+            float length = std::sqrt(dot(next, next));
+            if (length < 1.0e-6f)
+                break;
+            for (int c = 0; c < N; ++c) axis[c] = next[c] / length;
+        }
+        float length = std::sqrt(dot(axis, axis));
+        if (length < 1.0e-6f) {
+            e0 = mean;
+            e1 = mean;
+            return;
+        }
+        for (int c = 0; c < N; ++c) axis[c] /= length;
+
+        float tMin = std::numeric_limits<float>::max();
+        float tMax = std::numeric_limits<float>::lowest();
+        for (int i = 0; i < count; ++i) {
+            Vector<N> d;
+            for (int c = 0; c < N; ++c) d[c] = points[i][c] - mean[c];
+            float t = dot(d, axis);
+            tMin = std::min(tMin, t);
+            tMax = std::max(tMax, t);
+        }
+        for (int c = 0; c < N; ++c) {
+            e0[c] = std::clamp(mean[c] + axis[c] * tMin, 0.0f, 255.0f);
+            e1[c] = std::clamp(mean[c] + axis[c] * tMax, 0.0f, 255.0f);
+        }
+    }
+
+    // Least-squares endpoints for fixed interpolation weights:
+    // minimize sum |(1-t) e0 + t e1 - p|^2
+    template <int N>
+    bool refineEndpoints(const Vector<N>* points, const float* weights, int count,
+                         Vector<N>& e0, Vector<N>& e1) {
+        float aa = 0, ab = 0, bb = 0;
+        Vector<N> ax = {}, bx = {};
+        for (int i = 0; i < count; ++i) {
+            const float t = weights[i];
+            const float s = 1.0f - t;
+            aa += s * s;
+            ab += s * t;
+            bb += t * t;
+            for (int c = 0; c < N; ++c) {
+                ax[c] += s * points[i][c];
+                bx[c] += t * points[i][c];
+            }
+        }
+        const float det = aa * bb - ab * ab;
+        if (std::abs(det) < 1.0e-6f)
+            return false;
+        for (int c = 0; c < N; ++c) {
+            e0[c] = std::clamp((ax[c] * bb - bx[c] * ab) / det, 0.0f, 255.0f);
+            e1[c] = std::clamp((bx[c] * aa - ax[c] * ab) / det, 0.0f, 255.0f);
+        }
+        return true;
+    }
+
+    // BC1 color block
+    uint16_t packRGB565(const Vector<3>& c) {
+        uint32_t r = uint32_t(std::lround(c[0] * 31.0f / 255.0f));
+        uint32_t g = uint32_t(std::lround(c[1] * 63.0f / 255.0f));
+        uint32_t b = uint32_t(std::lround(c[2] * 31.0f / 255.0f));
+        return uint16_t((r << 11) | (g << 5) | b);
+    }
+
+    void unpackRGB565(uint16_t c, int rgb[3]) {
+        const int r = (c >> 11) & 0x1f;
+        const int g = (c >> 5) & 0x3f;
+        const int b = c & 0x1f;
+        rgb[0] = (r << 3) | (r >> 2);
+        rgb[1] = (g << 2) | (g >> 4);
+        rgb[2] = (b << 3) | (b >> 2);
+    }
+
+    // palette[3] is transparent black in 3-color mode (c0 <= c1).
+    void bc1Palette(uint16_t c0, uint16_t c1, int palette[4][4]) {
+        unpackRGB565(c0, palette[0]);
+        unpackRGB565(c1, palette[1]);
+        palette[0][3] = palette[1][3] = 255;
+        if (c0 > c1) {
+            for (int c = 0; c < 3; ++c) {
+                palette[2][c] = (2 * palette[0][c] + palette[1][c] + 1) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c] + 1) / 3;
+            }
+            palette[2][3] = palette[3][3] = 255;
+        } else {
+            for (int c = 0; c < 3; ++c) {
+                palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+                palette[3][c] = 0;
+            }
+            palette[2][3] = 255;
+            palette[3][3] = 0;
+        }
+    }
+
+    struct BC1Result {
+        uint16_t c0, c1;
+        uint32_t indices;
+        float error;
+        float weights[16];
+    };
+
+    BC1Result quantizeBC1(const Block& block, const bool* transparent,
+                          const Vector<3>& e0, const Vector<3>& e1, bool threeColor) {
+        BC1Result result = {};
+        result.c0 = packRGB565(e0);
+        result.c1 = packRGB565(e1);
+        if (threeColor) {
+            if (result.c0 > result.c1) std::swap(result.c0, result.c1);
+        } else {
+            if (result.c0 < result.c1) std::swap(result.c0, result.c1);
+        }
+        int palette[4][4];
+        bc1Palette(result.c0, result.c1, palette);
+
+        static constexpr float weights4[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+        static constexpr float weights3[4] = { 0.0f, 1.0f, 0.5f, 0.0f };
+        const int colors = (result.c0 > result.c1) ? 4 : 3;
+        for (int i = 0; i < 16; ++i) {
+            uint32_t index = 3;
+            if (transparent == nullptr || !transparent[i]) {
+                int bestError = std::numeric_limits<int>::max();
+                for (int p = 0; p < colors; ++p) {
+                    int error = 0;
+                    for (int c = 0; c < 3; ++c) {
+                        const int d = int(block[i][c]) - palette[p][c];
+                        error += d * d;
+                    }
+                    if (error < bestError) {
+                        bestError = error;
+                        index = p;
+                    }
+                }
+                result.error += float(bestError);
+            }
+            result.indices |= index << (i * 2);
+            result.weights[i] = colors == 4 ? weights4[index] : weights3[index];
+        }
+        return result;
+    }
+
+    void encodeBC1Color(const Block& block, Quality quality, bool allowTransparent, uint8_t* output) {
+        Vector<3> points[16];
+        bool transparent[16] = {};
+        int count = 0;
+        for (int i = 0; i < 16; ++i) {
+            transparent[i] = allowTransparent && block[i][3] < 128;
+            if (transparent[i] == false) {
+                for (int c = 0; c < 3; ++c)
+                    points[count][c] = float(block[i][c]);
+                count++;
+            }
+        }
+
+        BC1Result result = {};
+        if (count == 0) {
+            result.c0 = 0;
+            result.c1 = 0;
+            result.indices = 0xffffffff;
+        } else {
+            const bool threeColor = count < 16;
+            Vector<3> e0, e1;
+            fitEndpoints(points, count, quality, e0, e1);
+            result = quantizeBC1(block, threeColor ? transparent : nullptr, e0, e1, threeColor);
+
+            if (quality == Quality::High) {
+                for (int iteration = 0; iteration < 2 && result.error > 0; ++iteration) {
+                    float weights[16];
+                    int n = 0;
+                    for (int i = 0; i < 16; ++i) {
+                        if (transparent[i] == false)
+                            weights[n++] = result.weights[i];
+                    }
+                    if (refineEndpoints(points, weights, count, e0, e1) == false)
+                        break;
+                    auto refined = quantizeBC1(block, threeColor ? transparent : nullptr, e0, e1, threeColor);
+                    if (refined.error >= result.error)
+                        break;
+                    result = refined;
+                }
+            }
+        }
+        output[0] = uint8_t(result.c0 & 0xff);
+        output[1] = uint8_t(result.c0 >> 8);
+        output[2] = uint8_t(result.c1 & 0xff);
+        output[3] = uint8_t(result.c1 >> 8);
+        for (int i = 0; i < 4; ++i)
+            output[4 + i] = uint8_t(result.indices >> (i * 8));
+    }
+
+    void decodeBC1Color(const uint8_t* input, Block& block, bool forceFourColor) {
+        const uint16_t c0 = uint16_t(input[0]) | (uint16_t(input[1]) << 8);
+        const uint16_t c1 = uint16_t(input[2]) | (uint16_t(input[3]) << 8);
+        int palette[4][4];
+        if (forceFourColor && c0 <= c1) {
+            // BC3 color blocks always use 4-color mode.
+            unpackRGB565(c0, palette[0]);
+            unpackRGB565(c1, palette[1]);
+            for (int c = 0; c < 3; ++c) {
+                palette[2][c] = (2 * palette[0][c] + palette[1][c] + 1) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c] + 1) / 3;
+            }
+            palette[0][3] = palette[1][3] = palette[2][3] = palette[3][3] = 255;
+        } else {
+            bc1Palette(c0, c1, palette);
+        }
+        const uint32_t indices = uint32_t(input[4]) | (uint32_t(input[5]) << 8) |
+                                 (uint32_t(input[6]) << 16) | (uint32_t(input[7]) << 24);
+        for (int i = 0; i < 16; ++i) {
+            const int index = (indices >> (i * 2)) & 3;
+            for (int c = 0; c < 4; ++c)
+                block[i][c] = uint8_t(palette[index][c]);
+        }
+    }
+
+    // BC4 single channel block
+    void bc4Palette(uint8_t e0, uint8_t e1, int palette[8]) {
+        palette[0] = e0;
+        palette[1] = e1;
+        if (e0 > e1) {
+            for (int i = 2; i < 8; ++i)
+                palette[i] = ((8 - i) * e0 + (i - 1) * e1 + 3) / 7;
+        } else {
+            for (int i = 2; i < 6; ++i)
+                palette[i] = ((6 - i) * e0 + (i - 1) * e1 + 2) / 5;
+            palette[6] = 0;
+            palette[7] = 255;
+        }
+    }
+
+    struct BC4Result {
+        uint8_t e0, e1;
+        uint64_t indices;
+        int error;
+        float weights[16];
+    };
+
+    BC4Result quantizeBC4(const uint8_t* values, uint8_t e0, uint8_t e1) {
+        BC4Result result = { e0, e1, 0, 0 };
+        int palette[8];
+        bc4Palette(e0, e1, palette);
+        for (int i = 0; i < 16; ++i) {
+            int index = 0;
+            int bestError = std::numeric_limits<int>::max();
+            for (int p = 0; p < 8; ++p) {
+                const int d = int(values[i]) - palette[p];
+                if (d * d < bestError) {
+                    bestError = d * d;
+                    index = p;
+                }
+            }
+            result.error += bestError;
+            result.indices |= uint64_t(index) << (i * 3);
+            if (e0 > e1)
+                result.weights[i] = index == 0 ? 0.0f : index == 1 ? 1.0f : float(index - 1) / 7.0f;
+            else
+                result.weights[i] = index == 0 ? 0.0f : index == 1 ? 1.0f : float(index - 1) / 5.0f;
+        }
+        return result;
+    }
+
+    void encodeBC4(const uint8_t* values, Quality quality, uint8_t* output) {
+        uint8_t minValue = 255, maxValue = 0;
+        uint8_t innerMin = 255, innerMax = 0;
+        for (int i = 0; i < 16; ++i) {
+            minValue = std::min(minValue, values[i]);
+            maxValue = std::max(maxValue, values[i]);
+            if (values[i] != 0 && values[i] != 255) {
+                innerMin = std::min(innerMin, values[i]);
+                innerMax = std::max(innerMax, values[i]);
+            }
+        }
+        // 8-value mode (e0 > e1)
+        BC4Result result = quantizeBC4(values, maxValue, minValue);
+        if (quality != Quality::Fast && result.error > 0) {
+            // 6-value mode with explicit 0 and 255, for blocks with extremes.
+            if (innerMin <= innerMax && (minValue == 0 || maxValue == 255)) {
+                auto alt = quantizeBC4(values, innerMin, innerMax);
+                if (alt.error < result.error)
+                    result = alt;
+            }
+            if (quality == Quality::High && result.e0 > result.e1) {
+                Vector<1> points[16];
+                for (int i = 0; i < 16; ++i) points[i][0] = float(values[i]);
+                for (int iteration = 0; iteration < 2 && result.error > 0; ++iteration) {
+                    Vector<1> e0, e1;
+                    if (refineEndpoints(points, result.weights, 16, e0, e1) == false)
+                        break;
+                    uint8_t a = uint8_t(std::lround(e0[0]));
+                    uint8_t b = uint8_t(std::lround(e1[0]));
+                    if (a <= b)
+                        break;
+                    auto refined = quantizeBC4(values, a, b);
+                    if (refined.error >= result.error)
+                        break;
+                    result = refined;
+                }
+            }
+        }
+        output[0] = result.e0;
+        output[1] = result.e1;
+        for (int i = 0; i < 6; ++i)
+            output[2 + i] = uint8_t(result.indices >> (i * 8));
+    }
+
+    void decodeBC4(const uint8_t* input, Block& block, int component) {
+        int palette[8];
+        bc4Palette(input[0], input[1], palette);
+        uint64_t indices = 0;
+        for (int i = 0; i < 6; ++i)
+            indices |= uint64_t(input[2 + i]) << (i * 8);
+        for (int i = 0; i < 16; ++i)
+            block[i][component] = uint8_t(palette[(indices >> (i * 3)) & 7]);
+    }
+
+    // BC7 mode 6: single subset, RGBA 7.7.7.7 endpoints with unique p-bits,
+    // 4-bit indices.
+    constexpr int bc7Weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    struct BC7Result {
+        uint8_t e0[4], e1[4];   // 7-bit values
+        uint8_t p0, p1;
+        uint8_t indices[16];
+        float error;
+        float weights[16];
+    };
+
+    void quantizeBC7Endpoint(const Vector<4>& e, Quality quality, uint8_t q[4], uint8_t& pbit) {
+        float bestError = std::numeric_limits<float>::max();
+        for (uint8_t p = 0; p < 2; ++p) {
+            uint8_t value[4];
+            float error = 0;
+            for (int c = 0; c < 4; ++c) {
+                const int v = std::clamp(int(std::lround((e[c] - p) * 0.5f)), 0, 127);
+                value[c] = uint8_t(v);
+                const float d = float((v << 1) | p) - e[c];
+                error += d * d;
+            }
+            if (error < bestError) {
+                bestError = error;
+                pbit = p;
+                memcpy(q, value, 4);
+            }
+            if (quality == Quality::Fast)
+                break;  // p-bit 0 only
+        }
+    }
+
+    BC7Result quantizeBC7(const Block& block, const Vector<4>& e0, const Vector<4>& e1, Quality quality) {
+        BC7Result result = {};
+        quantizeBC7Endpoint(e0, quality, result.e0, result.p0);
+        quantizeBC7Endpoint(e1, quality, result.e1, result.p1);
+        int a[4], b[4];
+        for (int c = 0; c < 4; ++c) {
+            a[c] = (result.e0[c] << 1) | result.p0;
+            b[c] = (result.e1[c] << 1) | result.p1;
+        }
+        int palette[16][4];
+        for (int i = 0; i < 16; ++i) {
+            for (int c = 0; c < 4; ++c)
+                palette[i][c] = ((64 - bc7Weights4[i]) * a[c] + bc7Weights4[i] * b[c] + 32) >> 6;
+        }
+        for (int i = 0; i < 16; ++i) {
+            int index = 0;
+            int bestError = std::numeric_limits<int>::max();
+            for (int p = 0; p < 16; ++p) {
+                int error = 0;
+                for (int c = 0; c < 4; ++c) {
+                    const int d = int(block[i][c]) - palette[p][c];
+                    error += d * d;
+                }
+                if (error < bestError) {
+                    bestError = error;
+                    index = p;
+                }
+            }
+            result.indices[i] = uint8_t(index);
+            result.weights[i] = float(bc7Weights4[index]) / 64.0f;
+            result.error += float(bestError);
+        }
+        return result;
+    }
+
+    void encodeBC7(const Block& block, Quality quality, uint8_t* output) {
+        Vector<4> points[16];
+        for (int i = 0; i < 16; ++i)
+            for (int c = 0; c < 4; ++c)
+                points[i][c] = float(block[i][c]);
+
+        Vector<4> e0, e1;
+        fitEndpoints(points, 16, quality, e0, e1);
+        BC7Result result = quantizeBC7(block, e0, e1, quality);
+        if (quality == Quality::High) {
+            for (int iteration = 0; iteration < 2 && result.error > 0; ++iteration) {
+                if (refineEndpoints(points, result.weights, 16, e0, e1) == false)
+                    break;
+                auto refined = quantizeBC7(block, e0, e1, quality);
+                if (refined.error >= result.error)
+                    break;
+                result = refined;
+            }
+        }
+
+        // the anchor index has an implicit 0 msb.
+        if (result.indices[0] & 0x8) {
+            std::swap(result.e0, result.e1);
+            std::swap(result.p0, result.p1);
+            for (auto& index : result.indices)
+                index = 15 - index;
+        }
+
+        memset(output, 0, 16);
+        BitWriter writer = { output };
+        writer.write(1U << 6, 7);     // mode 6
+        for (int c = 0; c < 4; ++c) {
+            writer.write(result.e0[c], 7);
+            writer.write(result.e1[c], 7);
+        }
+        writer.write(result.p0, 1);
+        writer.write(result.p1, 1);
+        writer.write(result.indices[0], 3);
+        for (int i = 1; i < 16; ++i)
+            writer.write(result.indices[i], 4);
+        FVASSERT_DEBUG(writer.offset == 128);
+    }
+
+    bool decodeBC7(const uint8_t* input, Block& block) {
+        if ((input[0] & 0x7f) != 0x40) {
+            memset(block, 0, sizeof(Block));
+            return false;
+        }
+        BitReader reader = { input };
+        reader.read(7);
+        int a[4], b[4];
+        for (int c = 0; c < 4; ++c) {
+            a[c] = int(reader.read(7)) << 1;
+            b[c] = int(reader.read(7)) << 1;
+        }
+        const int p0 = int(reader.read(1));
+        const int p1 = int(reader.read(1));
+        for (int c = 0; c < 4; ++c) {
+            a[c] |= p0;
+            b[c] |= p1;
+        }
+        for (int i = 0; i < 16; ++i) {
+            const int w = bc7Weights4[reader.read(i == 0 ? 3 : 4)];
+            for (int c = 0; c < 4; ++c)
+                block[i][c] = uint8_t(((64 - w) * a[c] + w * b[c] + 32) >> 6);
+        }
+        return true;
+    }
+
+    struct CacheFileHeader {
+        char magic[4];
+        uint32_t version;
+        uint32_t pixelFormat;
+        uint32_t width;
+        uint32_t height;
+        uint32_t sourceHash;
+        uint64_t length;
+    };
+    constexpr char cacheFileMagic[4] = { 'F', 'V', 'B', 'C' };
+    constexpr uint32_t cacheFileVersion = 1;
+}
+
+using namespace FV;
+
+CompressedImage::CompressedImage(uint32_t w, uint32_t h, PixelFormat format, std::vector<uint8_t>&& d)
+    : width(w)
+    , height(h)
+    , pixelFormat(format)
+    , data(std::move(d)) {
+    FVASSERT_DEBUG(isCompressedFormat(format));
+    FVASSERT_DEBUG(data.size() == pixelFormatBufferLength(format, width, height));
+}
+
+CompressedImage::~CompressedImage() {
+}
+
+bool CompressedImage::isEncodingSupported(PixelFormat format) {
+    switch (format) {
+    case PixelFormat::BC1RGBAUnorm:
+    case PixelFormat::BC1RGBAUnorm_srgb:
+    case PixelFormat::BC3RGBAUnorm:
+    case PixelFormat::BC3RGBAUnorm_srgb:
+    case PixelFormat::BC4RUnorm:
+    case PixelFormat::BC5RGUnorm:
+    case PixelFormat::BC7RGBAUnorm:
+    case PixelFormat::BC7RGBAUnorm_srgb:
+        return true;
+    }
+    return false;
+}
+
+std::shared_ptr<CompressedImage> CompressedImage::encode(const Image& image, PixelFormat format, ImageCompressionQuality quality) {
+    if (isEncodingSupported(format) == false) {
+        Log::error("Unsupported compression format: {}", int(format));
+        return nullptr;
+    }
+    if (image.width == 0 || image.height == 0)
+        return nullptr;
+
+    std::shared_ptr<Image> converted;
+    const uint8_t* pixels = image.data.data();
+    if (image.pixelFormat != ImagePixelFormat::RGBA8) {
+        converted = image.resample(ImagePixelFormat::RGBA8);
+        if (converted == nullptr) {
+            Log::error("Failed to convert image to RGBA8");
+            return nullptr;
+        }
+        pixels = converted->data.data();
+    }
+
+    const uint32_t width = image.width;
+    const uint32_t height = image.height;
+    const uint32_t blocksWide = (width + 3) / 4;
+    const uint32_t blocksHigh = (height + 3) / 4;
+    const size_t bytesPerBlock = pixelFormatBytesPerBlock(format);
+    std::vector<uint8_t> output(pixelFormatBufferLength(format, width, height));
+
+    // block rows are independent, encode them in parallel.
+    dispatchApply(blocksHigh, [&](size_t by) {
+        Block block;
+        uint8_t* row = &output[by * blocksWide * bytesPerBlock];
+        for (uint32_t bx = 0; bx < blocksWide; ++bx) {
+            loadBlock(pixels, width, height, bx, uint32_t(by), block);
+            uint8_t* out = &row[bx * bytesPerBlock];
+            switch (format) {
+            case PixelFormat::BC1RGBAUnorm:
+            case PixelFormat::BC1RGBAUnorm_srgb:
+                encodeBC1Color(block, quality, true, out);
+                break;
+            case PixelFormat::BC3RGBAUnorm:
+            case PixelFormat::BC3RGBAUnorm_srgb: {
+                uint8_t alpha[16];
+                for (int i = 0; i < 16; ++i) alpha[i] = block[i][3];
+                encodeBC4(alpha, quality, out);
+                encodeBC1Color(block, quality, false, out + 8);
+                break;
+            }
+            case PixelFormat::BC4RUnorm:
+            case PixelFormat::BC5RGUnorm: {
+                const int channels = format == PixelFormat::BC4RUnorm ? 1 : 2;
+                for (int c = 0; c < channels; ++c) {
+                    uint8_t values[16];
+                    for (int i = 0; i < 16; ++i) values[i] = block[i][c];
+                    encodeBC4(values, quality, out + c * 8);
+                }
+                break;
+            }
+            case PixelFormat::BC7RGBAUnorm:
+            case PixelFormat::BC7RGBAUnorm_srgb:
+                encodeBC7(block, quality, out);
+                break;
+            }
+        }
+    });
+    return std::make_shared<CompressedImage>(width, height, format, std::move(output));
+}
+
+std::shared_ptr<Image> CompressedImage::decode() const {
+    ImagePixelFormat imageFormat = ImagePixelFormat::RGBA8;
+    uint32_t components = 4;
+    if (pixelFormat == PixelFormat::BC4RUnorm) {
+        imageFormat = ImagePixelFormat::R8;
+        components = 1;
+    } else if (pixelFormat == PixelFormat::BC5RGUnorm) {
+        imageFormat = ImagePixelFormat::RG8;
+        components = 2;
+    }
+    if (data.size() < pixelFormatBufferLength(pixelFormat, width, height)) {
+        Log::error("Insufficient compressed data.");
+        return nullptr;
+    }
+
+    auto image = std::make_shared<Image>(width, height, imageFormat);
+    uint8_t* pixels = image->data.data();
+    const uint32_t blocksWide = (width + 3) / 4;
+    const uint32_t blocksHigh = (height + 3) / 4;
+    const size_t bytesPerBlock = pixelFormatBytesPerBlock(pixelFormat);
+
+    bool unsupportedBlocks = false;
+    for (uint32_t by = 0; by < blocksHigh; ++by) {
+        for (uint32_t bx = 0; bx < blocksWide; ++bx) {
+            const uint8_t* in = &data[(size_t(by) * blocksWide + bx) * bytesPerBlock];
+            Block block = {};
+            switch (pixelFormat) {
+            case PixelFormat::BC1RGBAUnorm:
+            case PixelFormat::BC1RGBAUnorm_srgb:
+                decodeBC1Color(in, block, false);
+                break;
+            case PixelFormat::BC3RGBAUnorm:
+            case PixelFormat::BC3RGBAUnorm_srgb:
+                decodeBC1Color(in + 8, block, true);
+                decodeBC4(in, block, 3);
+                break;
+            case PixelFormat::BC4RUnorm:
+                decodeBC4(in, block, 0);
+                break;
+            case PixelFormat::BC5RGUnorm:
+                decodeBC4(in, block, 0);
+                decodeBC4(in + 8, block, 1);
+                break;
+            case PixelFormat::BC7RGBAUnorm:
+            case PixelFormat::BC7RGBAUnorm_srgb:
+                if (decodeBC7(in, block) == false)
+                    unsupportedBlocks = true;
+                break;
+            }
+            storeBlock(block, bx, by, pixels, width, height, components);
+        }
+    }
+    if (unsupportedBlocks)
+        Log::warning("BC7 blocks other than mode 6 are decoded as black.");
+    return image;
+}
+
+double CompressedImage::psnr(const Image& reference) const {
+    if (reference.width != width || reference.height != height) {
+        Log::error("Image size mismatch.");
+        return 0.0;
+    }
+    auto decoded = decode();
+    if (decoded == nullptr)
+        return 0.0;
+
+    std::shared_ptr<Image> converted;
+    const uint8_t* source = reference.data.data();
+    if (reference.pixelFormat != decoded->pixelFormat) {
+        converted = reference.resample(decoded->pixelFormat);
+        if (converted == nullptr)
+            return 0.0;
+        source = converted->data.data();
+    }
+    const uint8_t* target = decoded->data.data();
+    const size_t length = decoded->data.size();
+
+    double sum = 0.0;
+    for (size_t i = 0; i < length; ++i) {
+        const double d = double(source[i]) - double(target[i]);
+        sum += d * d;
+    }
+    const double mse = sum / double(length);
+    if (mse == 0.0)
+        return std::numeric_limits<double>::infinity();
+    return 10.0 * std::log10(255.0 * 255.0 / mse);
+}
+
+std::shared_ptr<Texture> CompressedImage::makeTexture(CommandQueue* queue, uint32_t usage) const {
+    if (queue == nullptr)
+        return nullptr;
+
+    auto uploads = queue->uploadManager();
+    auto texture = makeTexture(uploads, usage);
+    if (texture)
+        uploads->flush();
+    return texture;
+}
+
+std::shared_ptr<Texture> CompressedImage::makeTexture(UploadManager* uploads, uint32_t usage) const {
+    if (uploads == nullptr)
+        return nullptr;
+
+    auto device = uploads->queue->device();
+
+    auto texture = device->makeTexture(
+        TextureDescriptor {
+            TextureType2D,
+            pixelFormat,
+            width,
+            height,
+            1, 1, 1, 1,
+            TextureUsageCopyDestination | TextureUsageCopySource | usage
+        });
+    if (texture == nullptr)
+        return nullptr;
+
+    // buffer rows are whole blocks.
+    const uint32_t blockSize = pixelFormatBlockSize(pixelFormat);
+    const uint32_t bufferWidth = (width + blockSize - 1) / blockSize * blockSize;
+    const uint32_t bufferHeight = (height + blockSize - 1) / blockSize * blockSize;
+    bool staged = uploads->upload(data.size(), [this](void* p) {
+        memcpy(p, data.data(), data.size());
+    }, texture, TextureOrigin{ 0 }, TextureSize{ width, height, 1 }, bufferWidth, bufferHeight);
+    if (staged == false)
+        return nullptr;
+    return texture;
+}
+
+bool CompressedImage::write(const std::filesystem::path& path, uint32_t sourceHash) const {
+    CacheFileHeader header = {};
+    memcpy(header.magic, cacheFileMagic, sizeof(cacheFileMagic));
+    header.version = cacheFileVersion;
+    header.pixelFormat = uint32_t(pixelFormat);
+    header.width = width;
+    header.height = height;
+    header.sourceHash = sourceHash;
+    header.length = data.size();
+
+    // write to a temporary file first, readers never see a partial file.
+    auto tmpPath = path;
+    tmpPath += ".tmp";
+    {
+        std::ofstream fs(tmpPath, std::ofstream::binary | std::ofstream::out | std::ofstream::trunc);
+        if (fs.good() == false) {
+            Log::error("Failed to open file: {}", tmpPath.generic_u8string());
+            return false;
+        }
+        fs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        fs.write(reinterpret_cast<const char*>(data.data()), std::streamsize(data.size()));
+        if (fs.good() == false) {
+            Log::error("Failed to write file: {}", tmpPath.generic_u8string());
+            return false;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmpPath, path, ec);
+    if (ec) {
+        Log::error("Failed to rename file: {}, error: {}", path.generic_u8string(), ec.message());
+        std::filesystem::remove(tmpPath, ec);
+        return false;
+    }
+    return true;
+}
+
+std::shared_ptr<CompressedImage> CompressedImage::read(const std::filesystem::path& path, std::optional<uint32_t> sourceHash) {
+    std::ifstream fs(path, std::ifstream::binary | std::ifstream::in);
+    if (fs.good() == false)
+        return nullptr;
+
+    CacheFileHeader header = {};
+    fs.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (fs.good() == false ||
+        memcmp(header.magic, cacheFileMagic, sizeof(cacheFileMagic)) != 0 ||
+        header.version != cacheFileVersion) {
+        Log::warning("Invalid compressed image file: {}", path.generic_u8string());
+        return nullptr;
+    }
+    if (sourceHash.has_value() && sourceHash.value() != header.sourceHash)
+        return nullptr; // stale
+
+    const PixelFormat format = PixelFormat(header.pixelFormat);
+    if (isCompressedFormat(format) == false || header.width == 0 || header.height == 0 ||
+        header.length != pixelFormatBufferLength(format, header.width, header.height)) {
+        Log::warning("Invalid compressed image file: {}", path.generic_u8string());
+        return nullptr;
+    }
+    std::vector<uint8_t> data(header.length);
+    fs.read(reinterpret_cast<char*>(data.data()), std::streamsize(data.size()));
+    if (fs.gcount() != std::streamsize(data.size())) {
+        Log::warning("Truncated compressed image file: {}", path.generic_u8string());
+        return nullptr;
+    }
+    return std::make_shared<CompressedImage>(header.width, header.height, format, std::move(data));
+}
+
+CompressedImageCache::CompressedImageCache(const std::filesystem::path& path, const void* source, size_t length)
+    : path(path)
+    , sourceHash(CRC32::hash(source, length).hash) {
+}
+
+std::shared_ptr<CompressedImage> CompressedImageCache::read() const {
+    return CompressedImage::read(path, sourceHash);
+}
+
+std::shared_ptr<CompressedImage> CompressedImageCache::compress(const Image& image) const {
+    PixelFormat format = PixelFormat::Invalid;
+    switch (image.pixelFormat) {
+    case ImagePixelFormat::R8:      format = PixelFormat::BC4RUnorm;    break;
+    case ImagePixelFormat::RG8:     format = PixelFormat::BC5RGUnorm;   break;
+    case ImagePixelFormat::RGB8:
+    case ImagePixelFormat::RGBA8:   format = PixelFormat::BC7RGBAUnorm; break;
+    default:
+        return nullptr;
+    }
+    auto compressed = image.compress(format);
+    if (compressed && compressed->write(path, sourceHash) == false)
+        Log::warning("Failed to write texture cache: {}", path.generic_u8string());
+    return compressed;
+}
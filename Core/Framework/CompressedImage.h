@@ -0,0 +1,61 @@
+#pragma once
+#include "../include.h"
+#include <vector>
+#include <optional>
+#include <filesystem>
+#include "Image.h"
+#include "PixelFormat.h"
+
+namespace FV {
+    /// Block compressed (BCn) texture data.
+    /// Encoded from an Image with Image::compress or loaded from a cache file.
+    class FVCORE_API CompressedImage {
+    public:
+        CompressedImage(uint32_t width, uint32_t height, PixelFormat, std::vector<uint8_t>&& data);
+        ~CompressedImage();
+
+        const uint32_t width;
+        const uint32_t height;
+        const PixelFormat pixelFormat;
+
+        const void* contents() const { return data.data(); }
+        size_t length() const { return data.size(); }
+
+        static bool isEncodingSupported(PixelFormat);
+        static std::shared_ptr<CompressedImage> encode(const Image&, PixelFormat, ImageCompressionQuality);
+
+        /// decode to R8 (BC4), RG8 (BC5) or RGBA8.
+        /// BC7 blocks other than mode 6 (which the encoder produces) are not supported.
+        std::shared_ptr<Image> decode() const;
+        /// peak signal-to-noise ratio in dB, against the source image.
+        double psnr(const Image& reference) const;
+
+        std::shared_ptr<Texture> makeTexture(CommandQueue*, uint32_t usage = TextureUsageSampled) const;
+        // stages the pixels in the manager, the copy is committed by its next flush().
+        std::shared_ptr<Texture> makeTexture(UploadManager*, uint32_t usage = TextureUsageSampled) const;
+
+        /// Cache files store the hash of the source pixels, so a stale cache
+        /// can be rejected by passing the hash of the current source to read().
+        bool write(const std::filesystem::path&, uint32_t sourceHash = 0) const;
+        static std::shared_ptr<CompressedImage> read(const std::filesystem::path&, std::optional<uint32_t> sourceHash = {});
+
+    private:
+        std::vector<uint8_t> data;
+    };
+
+    /// Block compressed texture of a source image, encoded once and cached
+    /// in a file. The cache is keyed by the source data, if it is valid
+    /// the source does not have to be decoded at all.
+    class FVCORE_API CompressedImageCache {
+    public:
+        CompressedImageCache(const std::filesystem::path&, const void* source, size_t length);
+
+        const std::filesystem::path path;
+        const uint32_t sourceHash;
+
+        std::shared_ptr<CompressedImage> read() const;
+        /// BC4 for R8, BC5 for RG8, BC7 for RGB8 and RGBA8, nullptr for the
+        /// others. Writes the cache file, a failure is only logged.
+        std::shared_ptr<CompressedImage> compress(const Image&) const;
+    };
+}
@@ -1,8 +1,138 @@
 #include <algorithm>
+#include <limits>
 #include "../Libs/dkwrapper/DKCompression.h"
 #include "Compression.h"
+#include "DispatchQueue.h"
 #include "Logger.h"
 
+namespace {
+    using namespace FV;
+
+    DKCompressionAlgorithm encodingAlgorithm(CompressionMethod method, int& level) {
+        level = method.level;
+        switch (method.algorithm) {
+        case CompressionAlgorithm::Zlib:    return DKCompressionAlgorithm_Zlib;
+        case CompressionAlgorithm::Zstd:    return DKCompressionAlgorithm_Zstd;
+        case CompressionAlgorithm::Lz4:     return DKCompressionAlgorithm_Lz4;
+        case CompressionAlgorithm::Lzma:    return DKCompressionAlgorithm_Lzma;
+        default:
+            break;
+        }
+        level = 3;
+        return DKCompressionAlgorithm_Zstd;
+    }
+
+    struct MemoryInputContext {
+        const uint8_t* data;
+        size_t length;
+        size_t offset;
+    };
+
+    DKStream memoryInputStream(MemoryInputContext& context) {
+        DKStream stream = {};
+        stream.userContext = &context;
+        stream.read = [](void* p, void* buffer, size_t size)->uint64_t {
+            auto ctx = (MemoryInputContext*)p;
+            size = std::min(size, ctx->length - ctx->offset);
+            memcpy(buffer, &ctx->data[ctx->offset], size);
+            ctx->offset += size;
+            return size;
+        };
+        stream.remainLength = [](void* p)->uint64_t {
+            auto ctx = (MemoryInputContext*)p;
+            return ctx->length - ctx->offset;
+        };
+        stream.totalLength = [](void* p)->uint64_t {
+            return ((MemoryInputContext*)p)->length;
+        };
+        return stream;
+    }
+
+    // appends to the vector.
+    DKStream vectorOutputStream(std::vector<uint8_t>& output) {
+        DKStream stream = {};
+        stream.userContext = &output;
+        stream.write = [](void* p, const void* data, size_t size)->uint64_t {
+            auto& output = *(std::vector<uint8_t>*)p;
+            auto bytes = (const uint8_t*)data;
+            try {
+                output.insert(output.end(), &bytes[0], &bytes[size]);
+            } catch (const std::bad_alloc&) {
+                return ~uint64_t(0);
+            }
+            return size;
+        };
+        return stream;
+    }
+
+    // writes into a fixed region, used to decode frames in place.
+    struct MemoryOutputContext {
+        uint8_t* data;
+        size_t length;
+        size_t offset;
+    };
+
+    DKStream memoryOutputStream(MemoryOutputContext& context) {
+        DKStream stream = {};
+        stream.userContext = &context;
+        stream.write = [](void* p, const void* data, size_t size)->uint64_t {
+            auto ctx = (MemoryOutputContext*)p;
+            if (size > ctx->length - ctx->offset)
+                return ~uint64_t(0); // frame is larger than the index says.
+            memcpy(&ctx->data[ctx->offset], data, size);
+            ctx->offset += size;
+            return size;
+        };
+        return stream;
+    }
+
+    struct FrameHeader {
+        char magic[4];
+        uint32_t version;
+        uint32_t algorithm;
+        uint32_t frameCount;
+        uint64_t frameSize;
+        uint64_t decompressedLength;
+    };
+    struct FrameIndexEntry {
+        uint64_t length;
+        uint64_t decompressedLength;
+    };
+    constexpr char frameMagic[4] = { 'F', 'V', 'C', 'F' };
+    constexpr uint32_t frameVersion = 1;
+
+    // Upper bound of the decompressed length of compressed data, from the
+    // largest expansion of each codec. Lengths read from a corrupt header
+    // are rejected with it, before allocating.
+    uint64_t decompressedLengthBound(DKCompressionAlgorithm algo, uint64_t length) {
+        uint64_t ratio = 0;
+        switch (algo) {
+        case DKCompressionAlgorithm_Zlib:   ratio = 1032;   break;  // deflate limit
+        case DKCompressionAlgorithm_Lz4:    ratio = 256;    break;
+        case DKCompressionAlgorithm_Zstd:   ratio = 32768;  break;  // 128KB RLE block of 4 bytes
+        case DKCompressionAlgorithm_Lzma:   ratio = 65536;  break;  // about 10x of zeros
+        default:
+            return 0;
+        }
+        if (length > std::numeric_limits<uint64_t>::max() / ratio)
+            return std::numeric_limits<uint64_t>::max();
+        return length * ratio;
+    }
+
+    CompressionResult decodeFrame(DKCompressionAlgorithm algo,
+                                  const uint8_t* input, const CompressionFrameInfo& frame,
+                                  uint8_t* output) {
+        MemoryInputContext inContext = { input + frame.offset, size_t(frame.length), 0 };
+        MemoryOutputContext outContext = { output, size_t(frame.decompressedLength), 0 };
+        DKStream inStream = memoryInputStream(inContext);
+        DKStream outStream = memoryOutputStream(outContext);
+        auto result = (CompressionResult)DKCompressionDecode(algo, &inStream, &outStream);
+        if (result == CompressionResult::Success && outContext.offset != outContext.length)
+            result = CompressionResult::DataError;
+        return result;
+    }
+}
+
 namespace FV {
 
     const CompressionMethod CompressionMethod::fastest = { CompressionAlgorithm::Lz4, 0 };
@@ -12,22 +142,20 @@ namespace FV {
     const CompressionMethod CompressionMethod::automatic = { CompressionAlgorithm::Automatic, 0 };
 
     CompressionResult FVCORE_API compress(std::istream& input, std::ostream& output, CompressionMethod method, size_t inputBytes) {
+        // the remaining length is tracked here, the stream is queried only once.
         struct InputContext {
             std::istream& stream;
-            std::streampos offset;
-            std::streampos end;
+            std::streamoff remains;
             InputContext(std::istream& s, uint64_t size)
-                : stream(s), offset(s.tellg()) {
+                : stream(s) {
+                auto offset = s.tellg();
                 stream.seekg(0, std::ios::end);
                 auto streamEnd = stream.tellg();
                 stream.clear();
                 stream.seekg(offset);
 
                 auto length = streamEnd - offset;
-                auto inputBytes = std::min((std::streamoff)size, length);
-
-                end = offset + inputBytes;
-                FVASSERT_DEBUG(end <= streamEnd);
+                remains = std::min((std::streamoff)size, length);
             }
         };
         InputContext inContext(input, inputBytes);
@@ -35,17 +163,18 @@ namespace FV {
         inStream.userContext = &inContext;
         inStream.read = [](void* p, void* buffer, size_t size)->uint64_t {
             InputContext* ctx = (InputContext*)p;
-            auto remains = ctx->end - ctx->stream.tellg();
-            size = std::min((std::streamoff)size, remains);
+            size = std::min((std::streamoff)size, ctx->remains);
             if (size > 0) {
                 ctx->stream.read((char*)buffer, size);
-                return ctx->stream.gcount();
+                auto read = ctx->stream.gcount();
+                ctx->remains -= read;
+                return read;
             }
             return 0;
         };
         inStream.remainLength = [](void* p)->uint64_t {
             InputContext* ctx = (InputContext*)p;
-            return ctx->end - ctx->stream.tellg();
+            return ctx->remains;
         };
 
         struct OutputContext {
@@ -59,28 +188,19 @@ namespace FV {
             if (ctx->stream.good() == false)
                 return ~uint64_t(0); // error
 
-            auto current = ctx->stream.tellp();
             try {
                 ctx->stream.write((const char*)data, size);
             } catch (const std::exception& exp) {
                 Log::error("stream write failed: {}", exp.what());
             }
-            auto written = ctx->stream.tellp() - current;
-            return written;
+            // ostream::write is all-or-nothing, no need to query tellp.
+            if (ctx->stream.good() == false)
+                return ~uint64_t(0);
+            return size;
         };
 
-        int level = method.level;
-        DKCompressionAlgorithm algo = DKCompressionAlgorithm_Zstd;
-        switch (method.algorithm) {
-        case CompressionAlgorithm::Zlib:    algo = DKCompressionAlgorithm_Zlib; break;
-        case CompressionAlgorithm::Zstd:    algo = DKCompressionAlgorithm_Zstd; break;
-        case CompressionAlgorithm::Lz4:     algo = DKCompressionAlgorithm_Lz4; break;
-        case CompressionAlgorithm::Lzma:    algo = DKCompressionAlgorithm_Lzma; break;
-        case CompressionAlgorithm::Automatic:
-            algo = DKCompressionAlgorithm_Zstd;
-            level = 3;
-        }
-
+        int level = 0;
+        DKCompressionAlgorithm algo = encodingAlgorithm(method, level);
         auto result = DKCompressionEncode(algo, &inStream, &outStream, level);
         return (CompressionResult)result;
     }
@@ -112,14 +232,15 @@ namespace FV {
             if (ctx->stream.good() == false)
                 return ~uint64_t(0); // error
 
-            auto current = ctx->stream.tellp();
             try {
                 ctx->stream.write((const char*)data, size);
             } catch (const std::exception& exp) {
                 Log::error("stream write failed: {}", exp.what());
             }
-            auto written = ctx->stream.tellp() - current;
-            return written;
+            // ostream::write is all-or-nothing, no need to query tellp.
+            if (ctx->stream.good() == false)
+                return ~uint64_t(0);
+            return size;
         };
 
         DKCompressionAlgorithm algo;
@@ -140,4 +261,252 @@ namespace FV {
         result = DKCompressionDecode(algo, &inStream, &outStream);
         return (CompressionResult)result;
     }
+
+    CompressionResult FVCORE_API compress(std::span<const uint8_t> input, std::vector<uint8_t>& output, CompressionMethod method) {
+        MemoryInputContext inContext = { input.data(), input.size(), 0 };
+        DKStream inStream = memoryInputStream(inContext);
+        DKStream outStream = vectorOutputStream(output);
+
+        int level = 0;
+        DKCompressionAlgorithm algo = encodingAlgorithm(method, level);
+        return (CompressionResult)DKCompressionEncode(algo, &inStream, &outStream, level);
+    }
+
+    CompressionResult FVCORE_API decompress(std::span<const uint8_t> input, std::vector<uint8_t>& output, CompressionAlgorithm algorithm) {
+        MemoryInputContext inContext = { input.data(), input.size(), 0 };
+        DKStream inStream = memoryInputStream(inContext);
+        DKStream outStream = vectorOutputStream(output);
+
+        DKCompressionAlgorithm algo;
+        if (algorithm == CompressionAlgorithm::Automatic)
+            return (CompressionResult)DKCompressionDecodeAutoDetect(&inStream, &outStream, &algo);
+
+        int level = 0;
+        algo = encodingAlgorithm({ algorithm, 0 }, level);
+        return (CompressionResult)DKCompressionDecode(algo, &inStream, &outStream);
+    }
+
+    CompressionResult FVCORE_API compressFrames(std::span<const uint8_t> input, std::vector<uint8_t>& output, CompressionMethod method, size_t frameSize) {
+        if (frameSize == 0)
+            return CompressionResult::InvalidParameter;
+
+        const size_t frameCount = (input.size() + frameSize - 1) / frameSize;
+        if (frameCount > std::numeric_limits<uint32_t>::max())
+            return CompressionResult::InvalidParameter;
+
+        int level = 0;
+        DKCompressionAlgorithm algo = encodingAlgorithm(method, level);
+
+        std::vector<std::vector<uint8_t>> frames(frameCount);
+        std::vector<CompressionResult> results(frameCount, CompressionResult::Success);
+        dispatchApply(frameCount, [&](size_t index) {
+            const size_t offset = index * frameSize;
+            MemoryInputContext inContext = { input.data() + offset, std::min(frameSize, input.size() - offset), 0 };
+            DKStream inStream = memoryInputStream(inContext);
+            DKStream outStream = vectorOutputStream(frames[index]);
+            results[index] = (CompressionResult)DKCompressionEncode(algo, &inStream, &outStream, level);
+        });
+        for (auto result : results) {
+            if (result != CompressionResult::Success)
+                return result;
+        }
+
+        FrameHeader header = {};
+        memcpy(header.magic, frameMagic, sizeof(frameMagic));
+        header.version = frameVersion;
+        header.algorithm = uint32_t(algo);
+        header.frameCount = uint32_t(frameCount);
+        header.frameSize = frameSize;
+        header.decompressedLength = input.size();
+
+        size_t length = sizeof(FrameHeader) + sizeof(FrameIndexEntry) * frameCount;
+        for (auto& frame : frames)
+            length += frame.size();
+        output.reserve(output.size() + length);
+
+        auto append = [&output](const void* data, size_t size) {
+            auto bytes = (const uint8_t*)data;
+            output.insert(output.end(), &bytes[0], &bytes[size]);
+        };
+        append(&header, sizeof(header));
+        for (size_t i = 0; i < frameCount; ++i) {
+            FrameIndexEntry entry = {
+                frames[i].size(),
+                std::min(frameSize, input.size() - i * frameSize)
+            };
+            append(&entry, sizeof(entry));
+        }
+        for (auto& frame : frames)
+            append(frame.data(), frame.size());
+        return CompressionResult::Success;
+    }
+
+    CompressionResult FVCORE_API readFrameIndex(std::span<const uint8_t> input, std::vector<CompressionFrameInfo>& frames) {
+        FrameHeader header = {};
+        if (input.size() < sizeof(header))
+            return CompressionResult::UnknownFormat;
+        memcpy(&header, input.data(), sizeof(header));
+        if (memcmp(header.magic, frameMagic, sizeof(frameMagic)) != 0 || header.version != frameVersion)
+            return CompressionResult::UnknownFormat;
+
+        const uint64_t indexLength = uint64_t(header.frameCount) * sizeof(FrameIndexEntry);
+        if (input.size() - sizeof(header) < indexLength)
+            return CompressionResult::DataError;
+
+        const auto algo = (DKCompressionAlgorithm)header.algorithm;
+        if (decompressedLengthBound(algo, 1) == 0)
+            return CompressionResult::UnknownFormat;
+
+        frames.clear();
+        frames.reserve(header.frameCount);
+        uint64_t offset = sizeof(header) + indexLength;
+        uint64_t decompressedOffset = 0;
+        for (uint32_t i = 0; i < header.frameCount; ++i) {
+            FrameIndexEntry entry;
+            memcpy(&entry, &input[sizeof(header) + i * sizeof(FrameIndexEntry)], sizeof(entry));
+            if (entry.length > input.size() - offset)
+                return CompressionResult::DataError;
+            if (entry.decompressedLength > decompressedLengthBound(algo, entry.length) ||
+                entry.decompressedLength > std::numeric_limits<uint64_t>::max() - decompressedOffset)
+                return CompressionResult::DataError;
+            frames.push_back({ offset, entry.length, decompressedOffset, entry.decompressedLength });
+            offset += entry.length;
+            decompressedOffset += entry.decompressedLength;
+        }
+        if (decompressedOffset != header.decompressedLength)
+            return CompressionResult::DataError;
+        return CompressionResult::Success;
+    }
+
+    CompressionResult FVCORE_API decompressFrames(std::span<const uint8_t> input, std::vector<uint8_t>& output) {
+        return decompressFrames(input, 0, size_t(-1), output);
+    }
+
+    CompressionResult FVCORE_API decompressFrames(std::span<const uint8_t> input, uint64_t offset, size_t length, std::vector<uint8_t>& output) {
+        std::vector<CompressionFrameInfo> frames;
+        auto result = readFrameIndex(input, frames);
+        if (result != CompressionResult::Success)
+            return result;
+
+        FrameHeader header;
+        memcpy(&header, input.data(), sizeof(header));
+        const uint64_t total = header.decompressedLength;
+        if (offset > total)
+            return CompressionResult::InvalidParameter;
+        length = size_t(std::min(uint64_t(length), total - offset));
+        if (length == 0)
+            return CompressionResult::Success;
+
+        // frames overlapping [offset, offset + length)
+        auto first = std::upper_bound(frames.begin(), frames.end(), offset,
+                                      [](uint64_t value, const CompressionFrameInfo& frame) {
+                                          return value < frame.decompressedOffset;
+                                      }) - 1;
+        auto last = std::lower_bound(frames.begin(), frames.end(), offset + length,
+                                     [](const CompressionFrameInfo& frame, uint64_t value) {
+                                         return frame.decompressedOffset < value;
+                                     });
+        const size_t count = last - first;
+        const uint64_t begin = first->decompressedOffset;
+        const uint64_t end = (last - 1)->decompressedOffset + (last - 1)->decompressedLength;
+        const auto algo = (DKCompressionAlgorithm)header.algorithm;
+
+        // decode whole frames in place, then trim the partial frames at both ends.
+        const size_t base = output.size();
+        output.resize(base + size_t(end - begin));
+        uint8_t* buffer = output.data() + base;
+        std::vector<CompressionResult> results(count, CompressionResult::Success);
+        dispatchApply(count, [&](size_t index) {
+            auto& frame = first[index];
+            results[index] = decodeFrame(algo, input.data(), frame,
+                                         buffer + (frame.decompressedOffset - begin));
+        });
+        for (auto r : results) {
+            if (r != CompressionResult::Success) {
+                output.resize(base);
+                return r;
+            }
+        }
+        if (offset > begin)
+            output.erase(output.begin() + base, output.begin() + base + size_t(offset - begin));
+        output.resize(base + length);
+        return CompressionResult::Success;
+    }
+
+    CompressionDictionary::CompressionDictionary(std::vector<uint8_t>&& data, void* dict)
+        : dictData(std::move(data))
+        , dictionary(dict) {
+    }
+
+    CompressionDictionary::~CompressionDictionary() {
+        DKCompressionDestroyDictionary((DKCompressionDictionary)dictionary);
+    }
+
+    std::shared_ptr<CompressionDictionary> CompressionDictionary::train(const std::vector<std::span<const uint8_t>>& samples, size_t maxLength, int level) {
+        std::vector<uint8_t> buffer;
+        std::vector<size_t> sampleSizes;
+        sampleSizes.reserve(samples.size());
+        for (auto& sample : samples) {
+            buffer.insert(buffer.end(), sample.begin(), sample.end());
+            sampleSizes.push_back(sample.size());
+        }
+        std::vector<uint8_t> data(maxLength);
+        size_t length = DKCompressionTrainDictionary(data.data(), data.size(),
+                                                     buffer.data(), sampleSizes.data(),
+                                                     uint32_t(sampleSizes.size()));
+        if (length == 0) {
+            Log::error("Failed to train compression dictionary. ({} samples)", samples.size());
+            return nullptr;
+        }
+        data.resize(length);
+        return makeDictionary(data, level);
+    }
+
+    std::shared_ptr<CompressionDictionary> CompressionDictionary::makeDictionary(std::span<const uint8_t> data, int level) {
+        auto dict = DKCompressionCreateDictionary(data.data(), data.size(), level);
+        if (dict == nullptr) {
+            Log::error("Failed to create compression dictionary.");
+            return nullptr;
+        }
+        return std::shared_ptr<CompressionDictionary>(
+            new CompressionDictionary(std::vector<uint8_t>(data.begin(), data.end()), dict));
+    }
+
+    uint32_t CompressionDictionary::id() const {
+        return DKCompressionDictionaryID((DKCompressionDictionary)dictionary);
+    }
+
+    CompressionResult FVCORE_API compress(std::span<const uint8_t> input, std::vector<uint8_t>& output, const CompressionDictionary& dictionary) {
+        const size_t base = output.size();
+        size_t length = DKCompressionDictionaryEncodeBound(input.size());
+        output.resize(base + length);
+        auto result = (CompressionResult)DKCompressionEncodeWithDictionary(
+            (DKCompressionDictionary)dictionary.dictionary,
+            input.data(), input.size(), output.data() + base, &length);
+        output.resize(result == CompressionResult::Success ? base + length : base);
+        return result;
+    }
+
+    CompressionResult FVCORE_API decompress(std::span<const uint8_t> input, std::vector<uint8_t>& output, const CompressionDictionary& dictionary) {
+        uint64_t decodedLength = DKCompressionDictionaryDecodedLength(input.data(), input.size());
+        if (decodedLength == ~uint64_t(0))
+            return CompressionResult::DataError;
+        // dictionaries are of zstd.
+        if (decodedLength > decompressedLengthBound(DKCompressionAlgorithm_Zstd, input.size()) ||
+            decodedLength > std::numeric_limits<size_t>::max() - output.size())
+            return CompressionResult::DataError;
+
+        const size_t base = output.size();
+        size_t length = size_t(decodedLength);
+        output.resize(base + length);
+        auto result = (CompressionResult)DKCompressionDecodeWithDictionary(
+            (DKCompressionDictionary)dictionary.dictionary,
+            input.data(), input.size(), output.data() + base, &length);
+        output.resize(result == CompressionResult::Success ? base + length : base);
+        return result;
+    }
+
+    uint32_t FVCORE_API compressionDictionaryID(std::span<const uint8_t> compressed) {
+        return DKCompressionDictionaryIDFromFrame(compressed.data(), compressed.size());
+    }
 }
@@ -2,6 +2,9 @@
 #include "../include.h"
 #include <istream>
 #include <ostream>
+#include <span>
+#include <vector>
+#include <memory>
 
 namespace FV {
     enum class CompressionAlgorithm {
@@ -36,4 +39,56 @@ namespace FV {
 
     CompressionResult FVCORE_API compress(std::istream& input, std::ostream&, CompressionMethod method = CompressionMethod::automatic, size_t inputBytes = size_t(-1));
     CompressionResult FVCORE_API decompress(std::istream& input, std::ostream&, CompressionAlgorithm algorithm = CompressionAlgorithm::Automatic);
+
+    // In-memory variants, the result is appended to output.
+    CompressionResult FVCORE_API compress(std::span<const uint8_t> input, std::vector<uint8_t>& output, CompressionMethod method = CompressionMethod::automatic);
+    CompressionResult FVCORE_API decompress(std::span<const uint8_t> input, std::vector<uint8_t>& output, CompressionAlgorithm algorithm = CompressionAlgorithm::Automatic);
+
+    // Framed format: the input is split into independent frames which are
+    // compressed concurrently on the global DispatchQueue. A frame index
+    // follows the header, so any byte range can be decompressed without
+    // decoding the frames before it.
+    constexpr size_t compressionDefaultFrameSize = 1 << 20;
+
+    struct CompressionFrameInfo {
+        uint64_t offset;            // offset of the compressed frame in the framed data
+        uint64_t length;            // compressed length
+        uint64_t decompressedOffset;
+        uint64_t decompressedLength;
+    };
+
+    CompressionResult FVCORE_API compressFrames(std::span<const uint8_t> input, std::vector<uint8_t>& output, CompressionMethod method = CompressionMethod::automatic, size_t frameSize = compressionDefaultFrameSize);
+    CompressionResult FVCORE_API decompressFrames(std::span<const uint8_t> input, std::vector<uint8_t>& output);
+    CompressionResult FVCORE_API decompressFrames(std::span<const uint8_t> input, uint64_t offset, size_t length, std::vector<uint8_t>& output);
+    // returns DataError or UnknownFormat if the input is not framed data.
+    CompressionResult FVCORE_API readFrameIndex(std::span<const uint8_t> input, std::vector<CompressionFrameInfo>& frames);
+
+    class CompressionDictionary;
+    CompressionResult FVCORE_API compress(std::span<const uint8_t> input, std::vector<uint8_t>& output, const CompressionDictionary& dictionary);
+    CompressionResult FVCORE_API decompress(std::span<const uint8_t> input, std::vector<uint8_t>& output, const CompressionDictionary& dictionary);
+
+    // Zstd dictionary trained from sample records, for small payloads.
+    // The dictionary ID is written to every compressed record, so readers
+    // can find the dictionary with compressionDictionaryID().
+    class FVCORE_API CompressionDictionary {
+    public:
+        ~CompressionDictionary();
+
+        static std::shared_ptr<CompressionDictionary> train(const std::vector<std::span<const uint8_t>>& samples, size_t maxLength = 112640, int level = 3);
+        static std::shared_ptr<CompressionDictionary> makeDictionary(std::span<const uint8_t> data, int level = 3);
+
+        uint32_t id() const;
+        // raw dictionary data, to be stored alongside the compressed records.
+        const std::vector<uint8_t>& data() const { return dictData; }
+
+    private:
+        CompressionDictionary(std::vector<uint8_t>&&, void*);
+        std::vector<uint8_t> dictData;
+        void* dictionary;
+        friend CompressionResult compress(std::span<const uint8_t>, std::vector<uint8_t>&, const CompressionDictionary&);
+        friend CompressionResult decompress(std::span<const uint8_t>, std::vector<uint8_t>&, const CompressionDictionary&);
+    };
+
+    // returns 0 if the record was compressed without a dictionary.
+    uint32_t FVCORE_API compressionDictionaryID(std::span<const uint8_t> compressed);
 }
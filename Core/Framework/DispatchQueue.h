@@ -1,6 +1,7 @@
 #pragma once
 #include "../include.h"
 #include <vector>
+#include <atomic>
 #include <mutex>
 #include <thread>
 #include <condition_variable>
@@ -485,6 +486,51 @@ namespace FV {
         co_return;
     }
 
+    // Calls fn(index) for every index in [0, count) on the queue's threads and
+    // waits until all calls have returned. The calling thread takes part in
+    // the work, so this can also be called from a thread of the same queue.
+    template <typename Fn> requires std::invocable<Fn&, size_t>
+    inline void dispatchApply(size_t count, Fn&& fn, DispatchQueue& queue = dispatchGlobal()) {
+        if (count == 0)
+            return;
+
+        struct State {
+            std::function<void(size_t)> fn;
+            size_t count;
+            std::atomic<size_t> next = 0;
+            std::atomic<size_t> completed = 0;
+            std::mutex mutex;
+            std::condition_variable cv;
+
+            void run() {
+                for (size_t index = next++; index < count; index = next++) {
+                    fn(index);
+                    if (++completed == count) {
+                        std::scoped_lock lock(mutex);
+                        cv.notify_all();
+                    }
+                }
+            }
+        };
+        auto state = std::make_shared<State>();
+        state->fn = std::ref(fn);
+        state->count = count;
+
+        // helper tasks which start after all indices are taken return
+        // without touching 'fn', so they may outlive this call.
+        size_t helpers = std::min(size_t(queue.numThreads()), count - 1);
+        for (size_t i = 0; i < helpers; ++i) {
+            detachedTask([](std::shared_ptr<State> state)->Task<> {
+                state->run();
+                co_return;
+            }(state), queue);
+        }
+        state->run();
+
+        std::unique_lock lock(state->mutex);
+        state->cv.wait(lock, [&] { return state->completed == count; });
+    }
+
     template <typename _Task> struct _TaskGroup {
         std::vector<_Task> tasks;
 
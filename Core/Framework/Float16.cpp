@@ -1,7 +1,180 @@
+#include <bit>
 #include "Float16.h"
+#include "Private/CPUFeatures.h"
 
 using namespace FV;
 
+namespace {
+    // Lookup tables from "Fast Half Float Conversions", Jeroen van der Zijp.
+    struct HalfToFloatTable {
+        uint32_t mantissa[2048];
+        uint32_t exponent[64];
+        uint16_t offset[64];
+    };
+    constexpr HalfToFloatTable halfToFloatTable = [] {
+        HalfToFloatTable table = {};
+        for (uint32_t i = 1; i < 1024; ++i) {  // subnormals, normalized
+            uint32_t m = i << 13;
+            uint32_t e = 0;
+            while ((m & 0x00800000U) == 0) {
+                e -= 0x00800000U;
+                m <<= 1;
+            }
+            table.mantissa[i] = (m & ~0x00800000U) | (e + 0x38800000U);
+        }
+        for (uint32_t i = 1024; i < 2048; ++i)
+            table.mantissa[i] = 0x38000000U + ((i - 1024) << 13);
+        for (uint32_t i = 1; i < 31; ++i) {
+            table.exponent[i] = i << 23;
+            table.exponent[i + 32] = 0x80000000U + (i << 23);
+        }
+        table.exponent[31] = 0x47800000U;
+        table.exponent[32] = 0x80000000U;
+        table.exponent[63] = 0xc7800000U;
+        for (uint32_t i = 0; i < 64; ++i)
+            table.offset[i] = (i == 0 || i == 32) ? 0 : 1024;
+        return table;
+    }();
+
+    struct FloatToHalfTable {
+        uint16_t base[512];
+        uint8_t shift[512];
+    };
+    constexpr FloatToHalfTable floatToHalfTable = [] {
+        FloatToHalfTable table = {};
+        for (int i = 0; i < 256; ++i) {
+            int e = i - 127;
+            uint16_t base;
+            uint8_t shift;
+            if (e < -25) {          // zero, the shift leaves no rounding bit either
+                base = 0x0000U;
+                shift = 25;
+            } else if (e < -14) {   // subnormal
+                base = uint16_t(0x0400U >> (-e - 14));
+                shift = uint8_t(-e - 1);
+            } else if (e <= 15) {   // normal
+                base = uint16_t((e + 15) << 10);
+                shift = 13;
+            } else if (e < 128) {   // overflow
+                base = 0x7c00U;
+                shift = 24;
+            } else {                // Inf, NaN
+                base = 0x7c00U;
+                shift = 13;
+            }
+            table.base[i] = base;
+            table.base[i | 0x100] = base | 0x8000U;
+            table.shift[i] = shift;
+            table.shift[i | 0x100] = shift;
+        }
+        return table;
+    }();
+
+    FORCEINLINE uint32_t halfToFloatBits(uint16_t h) {
+        uint32_t e = h >> 10;
+        uint32_t n = halfToFloatTable.mantissa[halfToFloatTable.offset[e] + (h & 0x3ffU)] + halfToFloatTable.exponent[e];
+        if ((h & 0x7fffU) > 0x7c00U)  // NaN, fill the low bits of the payload
+            n |= 0x1fffU;
+        return n;
+    }
+
+    FORCEINLINE uint16_t floatToHalfBits(uint32_t n, Float16::Rounding rounding) {
+        uint32_t index = n >> 23;
+        uint32_t exponent = index & 0xffU;
+        uint32_t mantissa = n & 0x007fffffU;
+        uint32_t shift = floatToHalfTable.shift[index];
+        uint32_t h = floatToHalfTable.base[index] + (mantissa >> shift);
+        if (exponent == 0xffU) {
+            if (mantissa && (h & 0x3ffU) == 0) // NaN must not become Inf
+                h |= 1;
+        } else if (rounding == Float16::Rounding::ToNearestEven && exponent < 143) {
+            // the implicit bit is below the last place of subnormal results.
+            uint32_t significand = exponent < 113 ? (mantissa | 0x00800000U) : mantissa;
+            uint32_t round = (significand >> (shift - 1)) & 1;
+            uint32_t sticky = (significand & ((1U << (shift - 1)) - 1)) != 0;
+            h += round & (sticky | (h & 1)); // may carry into the exponent
+        }
+        return uint16_t(h);
+    }
+
+#if FVCORE_ARCH_X86
+    // Lanes of Inf, NaN or beyond the half range go through the tables to
+    // keep the overflow and NaN results of the scalar conversion.
+    template <int mode> FVCORE_TARGET("avx,f16c")
+    size_t floatToHalfF16C(const float* input, uint16_t* output, size_t count, Float16::Rounding rounding) {
+        const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+        const __m256 limit = _mm256_set1_ps(65536.0f);
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            __m256 v = _mm256_loadu_ps(input + i);
+            __m256 special = _mm256_cmp_ps(_mm256_and_ps(v, absMask), limit, _CMP_NLT_UQ);
+            if (_mm256_movemask_ps(special) == 0) {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), _mm256_cvtps_ph(v, mode));
+            } else {
+                for (size_t k = i; k < i + 8; ++k)
+                    output[k] = floatToHalfBits(std::bit_cast<uint32_t>(input[k]), rounding);
+            }
+        }
+        return i;
+    }
+
+    FVCORE_TARGET("avx,f16c")
+    size_t halfToFloatF16C(const uint16_t* input, float* output, size_t count) {
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+            __m128i nan = _mm_cmpgt_epi16(_mm_and_si128(h, _mm_set1_epi16(0x7fff)), _mm_set1_epi16(0x7c00));
+            if (_mm_movemask_epi8(nan) == 0) {
+                _mm256_storeu_ps(output + i, _mm256_cvtph_ps(h));
+            } else {
+                for (size_t k = i; k < i + 8; ++k)
+                    output[k] = std::bit_cast<float>(halfToFloatBits(input[k]));
+            }
+        }
+        return i;
+    }
+#elif FVCORE_ARCH_ARM64
+    // vcvt rounds by FPCR, which is round to nearest even by default.
+    // Toward zero steps back one unit where rounding increased the magnitude.
+    size_t floatToHalfNEON(const float* input, uint16_t* output, size_t count, Float16::Rounding rounding) {
+        const float32x4_t limit = vdupq_n_f32(65536.0f);
+        const bool towardZero = rounding == Float16::Rounding::TowardZero;
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            float32x4_t v = vld1q_f32(input + i);
+            uint32x4_t inRange = vcaltq_f32(v, limit); // false for NaN
+            if (vminvq_u32(inRange) != 0) {
+                float16x4_t h = vcvt_f16_f32(v);
+                uint16x4_t bits = vreinterpret_u16_f16(h);
+                if (towardZero) {
+                    uint32x4_t up = vcagtq_f32(vcvt_f32_f16(h), v);
+                    bits = vadd_u16(bits, vmovn_u32(up)); // -1 where rounded up
+                }
+                vst1_u16(output + i, bits);
+            } else {
+                for (size_t k = i; k < i + 4; ++k)
+                    output[k] = floatToHalfBits(std::bit_cast<uint32_t>(input[k]), rounding);
+            }
+        }
+        return i;
+    }
+
+    size_t halfToFloatNEON(const uint16_t* input, float* output, size_t count) {
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            uint16x4_t h = vld1_u16(input + i);
+            if (vmaxv_u16(vand_u16(h, vdup_n_u16(0x7fff))) <= 0x7c00) {
+                vst1q_f32(output + i, vcvt_f32_f16(vreinterpret_f16_u16(h)));
+            } else {
+                for (size_t k = i; k < i + 4; ++k)
+                    output[k] = std::bit_cast<float>(halfToFloatBits(input[k]));
+            }
+        }
+        return i;
+    }
+#endif
+}
+
 static inline Float16 uint16ToFloat16(uint16_t val) {
     return reinterpret_cast<Float16&>(val);
 }
@@ -23,75 +196,12 @@ Float16::Float16(const Float16& f)
     : binary16(f.binary16) {
 }
 
-Float16::Float16(float val) {
-    uint32_t n = reinterpret_cast<uint32_t&>(val);
-
-    uint16_t sign = uint16_t((n >> 16) & 0x00008000U);
-    uint32_t exponent = n & 0x7f800000U;
-    uint32_t mantissa = n & 0x007fffffU;
-
-    if (exponent >= 0x47800000U) // overflow / NaN
-    {
-        if (exponent == 0x7f800000U && mantissa) // NaN
-        {
-            mantissa >>= 13;
-            if (mantissa == 0) mantissa = 1;
-
-            binary16 = sign | uint16_t(0x7c00U) | uint16_t(mantissa);
-        } else // Inf / Overflow
-        {
-            binary16 = sign | uint16_t(0x7c00U);
-        }
-    } else if (exponent <= 0x38000000U) // underflow
-    {
-        if (exponent < 0x33000000U) {
-            binary16 = sign;
-        } else {
-            exponent >>= 23;
-            mantissa |= 0x00800000U;
-            mantissa >>= (113 - exponent);
-            mantissa |= 0x00001000U;
-            binary16 = sign | uint16_t(mantissa >> 13);
-        }
-    } else // regular
-    {
-        exponent = exponent - 0x38000000U;
-        mantissa |= 0x00001000U;
-        binary16 = sign | uint16_t(exponent >> 13) | uint16_t(mantissa >> 13);
-    }
+Float16::Float16(float val)
+    : binary16(floatToHalfBits(std::bit_cast<uint32_t>(val), Rounding::TowardZero)) {
 }
 
 Float16::operator float() const {
-    uint32_t sign = (binary16 >> 15) & 0x1U;
-    uint32_t exponent = (binary16 >> 10) & 0x1fU;
-    uint32_t mantissa = binary16 & 0x3ffU;
-
-    if (exponent == 0) {
-        if (mantissa)	// subnormal
-        {
-            exponent = 0x70U;
-            mantissa <<= 1;
-            while ((mantissa & 0x400U) == 0) {
-                mantissa <<= 1;
-                exponent -= 1;
-            }
-            mantissa &= 0x3ff;	// Clamp to 10 bits.
-            mantissa = mantissa << 13;
-        }
-    } else if (exponent == 0x1fU)	// NaN or Inf
-    {
-        exponent = 0xffU;
-        if (mantissa)	// NaN
-            mantissa = mantissa << 13 | 0x1fffU;
-    } else // Normalized
-    {
-        exponent = exponent + 0x70;
-        mantissa = mantissa << 13;
-    }
-
-    union { float f; uint32_t n; };
-    n = (sign << 31) | (exponent << 23) | mantissa;
-    return f;
+    return std::bit_cast<float>(halfToFloatBits(binary16));
 }
 
 Float16& Float16::operator = (const Float16& v) {
@@ -189,3 +299,39 @@ std::partial_ordering Float16::operator <=> (const Float16& rhs) const {
     }
     return std::partial_ordering::unordered;
 }
+
+void FV::toFloat16(std::span<const float> input, std::span<Float16> output, Float16::Rounding rounding) {
+    const size_t count = std::min(input.size(), output.size());
+    const float* s = input.data();
+    uint16_t* d = reinterpret_cast<uint16_t*>(output.data());
+    size_t i = 0;
+#if FVCORE_ARCH_X86
+    static const bool f16c = CPUFeatures::current().f16c;
+    if (f16c) {
+        if (rounding == Float16::Rounding::TowardZero)
+            i = floatToHalfF16C<_MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC>(s, d, count, rounding);
+        else
+            i = floatToHalfF16C<_MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC>(s, d, count, rounding);
+    }
+#elif FVCORE_ARCH_ARM64
+    i = floatToHalfNEON(s, d, count, rounding);
+#endif
+    for (; i < count; ++i)
+        d[i] = floatToHalfBits(std::bit_cast<uint32_t>(s[i]), rounding);
+}
+
+void FV::toFloat(std::span<const Float16> input, std::span<float> output) {
+    const size_t count = std::min(input.size(), output.size());
+    const uint16_t* s = reinterpret_cast<const uint16_t*>(input.data());
+    float* d = output.data();
+    size_t i = 0;
+#if FVCORE_ARCH_X86
+    static const bool f16c = CPUFeatures::current().f16c;
+    if (f16c)
+        i = halfToFloatF16C(s, d, count);
+#elif FVCORE_ARCH_ARM64
+    i = halfToFloatNEON(s, d, count);
+#endif
+    for (; i < count; ++i)
+        d[i] = std::bit_cast<float>(halfToFloatBits(s[i]));
+}
@@ -1,5 +1,6 @@
 #pragma once
 #include "../include.h"
+#include <span>
 
 #pragma pack(push, 2)
 namespace FV {
@@ -17,6 +18,11 @@ namespace FV {
      */
     class FVCORE_API Float16 {
     public:
+        enum class Rounding {
+            TowardZero,     ///< Float16(float), values from 65536 become infinity
+            ToNearestEven,  ///< IEEE 754 default, same as GPUs
+        };
+
         Float16();
         Float16(const Float16&);
         explicit Float16(float);
@@ -52,6 +58,13 @@ namespace FV {
 
     static_assert(sizeof(Float16) == 2, "float16 should be 2 bytes!");
 
+    /// Converts min(input.size(), output.size()) values with F16C or NEON if
+    /// available. Results are the same on every instruction set, including
+    /// NaN payloads, and TowardZero matches Float16(float).
+    FVCORE_API void toFloat16(std::span<const float> input, std::span<Float16> output,
+                              Float16::Rounding rounding = Float16::Rounding::TowardZero);
+    FVCORE_API void toFloat(std::span<const Float16> input, std::span<float> output);
+
     //inline Float16 abs(Float16 f) { return f.abs(); }
 }
 #pragma pack(pop)
@@ -14,6 +14,7 @@ namespace FV {
 
         virtual void* contents() = 0;
         virtual void flush() = 0;
+        virtual void flush(size_t offset, size_t length) { flush(); }
         virtual size_t length() const = 0;
 
         virtual std::shared_ptr<GraphicsDevice> device() const = 0;
@@ -155,10 +155,13 @@ std::shared_ptr<GPUBuffer> GraphicsDeviceContext::makeCPUAccessible(
     }
 
     auto pixelFormat = texture->pixelFormat();
-    uint32_t bpp = pixelFormatBytesPerPixel(pixelFormat);
     uint32_t width = texture->width();
     uint32_t height = texture->height();
-    auto bufferLength = width * height * bpp;
+    auto bufferLength = pixelFormatBufferLength(pixelFormat, width, height);
+    // buffer rows of compressed formats are measured in whole blocks.
+    uint32_t blockSize = pixelFormatBlockSize(pixelFormat);
+    uint32_t bufferWidth = (width + blockSize - 1) / blockSize * blockSize;
+    uint32_t bufferHeight = (height + blockSize - 1) / blockSize * blockSize;
 
     auto queue = copyQueue();
     if (queue == nullptr) {
@@ -177,7 +180,7 @@ std::shared_ptr<GPUBuffer> GraphicsDeviceContext::makeCPUAccessible(
         auto encoder = cbuffer->makeCopyCommandEncoder();
 
         encoder->copy(texture, TextureOrigin{ 0, 0, 0, 0, 0 },
-                      buffer, BufferImageOrigin{ 0, width, height },
+                      buffer, BufferImageOrigin{ 0, bufferWidth, bufferHeight },
                       TextureSize{ width, height, 1 });
         encoder->endEncoding();
         cbuffer->addCompletedHandler(
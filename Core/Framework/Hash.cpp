@@ -1,57 +1,16 @@
 #include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
 #include "Hash.h"
+#include "Private/CPUFeatures.h"
+#if FVCORE_ARCH_ARM64 && !defined(_MSC_VER)
+#include <arm_acle.h>
+#endif
 
 using namespace FV;
 
 namespace {
-    void init(_Hash32& hash) {
-        hash.low = 0;
-        hash.data.clear();
-        hash.data.reserve(128); // 2 blocks of hash (64 bytes per one)
-    }
-
-    template <typename HashFunction>
-    void update(_Hash32& hash, HashFunction&& func, const uint8_t* data, size_t length) {
-        hash.low += length << 3;
-
-        size_t start = 0;
-        while (start < length) {
-            size_t offset = std::min(length - start, size_t(64));
-            size_t range = start + offset;
-            hash.data.insert(hash.data.end(), &data[start], &data[range]);
-
-            while (hash.data.size() >= 64) {
-                func(reinterpret_cast<uint32_t*>(hash.data.data()));
-                hash.data.erase(hash.data.begin(), hash.data.begin() + 64);
-            }
-            start = range;
-        }
-    }
-
-    template <typename HashFunction>
-    void finalize(_Hash32& hash, HashFunction&& func) {
-        FVASSERT_DEBUG(hash.data.size() < 64);
-        hash.data.push_back(0x80);
-        if (hash.data.size() > 56) {
-            while (hash.data.size() < 120)
-                hash.data.push_back(0);
-        } else {
-            while (hash.data.size() < 56)
-                hash.data.push_back(0);
-        }
-
-        uint64_t low = hash.low;
-        for (int i = 0; i < 8; ++i)
-            hash.data.push_back(uint8_t((low >> ((7 - i) * 8)) & 0xff));
-        FVASSERT_DEBUG(hash.data.size() % 64 == 0);
-
-        while (hash.data.size() >= 64) {
-            func(reinterpret_cast<uint32_t*>(hash.data.data()));
-            hash.data.erase(hash.data.begin(), hash.data.begin() + 64);
-        }
-        FVASSERT_DEBUG(hash.data.empty());
-    }
-
     constexpr uint32_t crc32Table[256] = {
         0x00000000, 0x77073096, 0xEE0E612C, 0x990951BA, 0x076DC419, 0x706AF48F, 0xE963A535, 0x9E6495A3,
         0x0EDB8832, 0x79DCB8A4, 0xE0D5E91E, 0x97D2D988, 0x09B64C2B, 0x7EB17CBD, 0xE7B82D07, 0x90BF1D91,
@@ -87,6 +46,183 @@ namespace {
         0xB3667A2E, 0xC4614AB8, 0x5D681B02, 0x2A6F2B94, 0xB40BBE37, 0xC30C8EA1, 0x5A05DF1B, 0x2D02EF8D,
     };
 
+    // crc32SliceTable[k][n]: CRC of byte n followed by k zero bytes.
+    constexpr auto crc32SliceTable = [] {
+        std::array<std::array<uint32_t, 256>, 8> table = {};
+        for (int n = 0; n < 256; ++n)
+            table[0][n] = crc32Table[n];
+        for (int k = 1; k < 8; ++k) {
+            for (int n = 0; n < 256; ++n) {
+                uint32_t crc = table[k - 1][n];
+                table[k][n] = crc32Table[crc & 0xff] ^ (crc >> 8);
+            }
+        }
+        return table;
+    }();
+
+    // slicing-by-8, crc is not inverted.
+    uint32_t crc32Slice8(uint32_t crc, const uint8_t* data, size_t length) {
+        auto& t = crc32SliceTable;
+        while (length >= 8) {
+            uint32_t one = crc ^ (uint32_t(data[0]) | uint32_t(data[1]) << 8 |
+                                  uint32_t(data[2]) << 16 | uint32_t(data[3]) << 24);
+            uint32_t two = uint32_t(data[4]) | uint32_t(data[5]) << 8 |
+                           uint32_t(data[6]) << 16 | uint32_t(data[7]) << 24;
+            crc = t[7][one & 0xff] ^ t[6][(one >> 8) & 0xff] ^
+                  t[5][(one >> 16) & 0xff] ^ t[4][one >> 24] ^
+                  t[3][two & 0xff] ^ t[2][(two >> 8) & 0xff] ^
+                  t[1][(two >> 16) & 0xff] ^ t[0][two >> 24];
+            data += 8;
+            length -= 8;
+        }
+        while (length--) {
+            crc = crc32Table[(crc ^ *data++) & 0xff] ^ (crc >> 8);
+        }
+        return crc;
+    }
+
+#if FVCORE_ARCH_X86
+    // Carry-less multiplication folding, 64 bytes per iteration.
+    // length must be at least 64 and a multiple of 16.
+    FVCORE_TARGET("pclmul,sse4.1")
+    uint32_t crc32CLMul(uint32_t crc, const uint8_t* data, size_t length) {
+        alignas(16) static const uint64_t k1k2[] = { 0x0154442bd4, 0x01c6e41596 };
+        alignas(16) static const uint64_t k3k4[] = { 0x01751997d0, 0x00ccaa009e };
+        alignas(16) static const uint64_t k5k0[] = { 0x0163cd6124, 0x0000000000 };
+        alignas(16) static const uint64_t poly[] = { 0x01db710641, 0x01f7011641 };
+
+        __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+        x1 = _mm_loadu_si128((const __m128i*)(data + 0x00));
+        x2 = _mm_loadu_si128((const __m128i*)(data + 0x10));
+        x3 = _mm_loadu_si128((const __m128i*)(data + 0x20));
+        x4 = _mm_loadu_si128((const __m128i*)(data + 0x30));
+        x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(int(crc)));
+        x0 = _mm_load_si128((const __m128i*)k1k2);
+        data += 64;
+        length -= 64;
+
+        while (length >= 64) {
+            x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+            x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+            x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+            x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+            x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+            x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+            x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+            x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+            y5 = _mm_loadu_si128((const __m128i*)(data + 0x00));
+            y6 = _mm_loadu_si128((const __m128i*)(data + 0x10));
+            y7 = _mm_loadu_si128((const __m128i*)(data + 0x20));
+            y8 = _mm_loadu_si128((const __m128i*)(data + 0x30));
+            x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+            x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+            x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+            x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+            data += 64;
+            length -= 64;
+        }
+
+        // fold into 128 bits
+        x0 = _mm_load_si128((const __m128i*)k3k4);
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+        while (length >= 16) {
+            x2 = _mm_loadu_si128((const __m128i*)data);
+            x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+            x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+            x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+            data += 16;
+            length -= 16;
+        }
+
+        // fold 128 bits to 64 bits
+        x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+        x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+        x1 = _mm_srli_si128(x1, 8);
+        x1 = _mm_xor_si128(x1, x2);
+        x0 = _mm_loadl_epi64((const __m128i*)k5k0);
+        x2 = _mm_srli_si128(x1, 4);
+        x1 = _mm_and_si128(x1, x3);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_xor_si128(x1, x2);
+
+        // Barrett reduction to 32 bits
+        x0 = _mm_load_si128((const __m128i*)poly);
+        x2 = _mm_and_si128(x1, x3);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+        x2 = _mm_and_si128(x2, x3);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x1 = _mm_xor_si128(x1, x2);
+        return uint32_t(_mm_extract_epi32(x1, 1));
+    }
+#endif
+
+#if FVCORE_ARCH_ARM64
+    FVCORE_TARGET("arch=armv8-a+crc")
+    uint32_t crc32ARMv8(uint32_t crc, const uint8_t* data, size_t length) {
+        while (length >= 8) {
+            uint64_t value;
+            memcpy(&value, data, 8);
+            crc = __crc32d(crc, value);
+            data += 8;
+            length -= 8;
+        }
+        while (length--) {
+            crc = __crc32b(crc, *data++);
+        }
+        return crc;
+    }
+#endif
+
+    // GF(2) polynomial arithmetic modulo the CRC polynomial, for combine().
+    constexpr uint32_t crc32Polynomial = 0xedb88320;
+
+    constexpr uint32_t crc32MultModP(uint32_t a, uint32_t b) {
+        uint32_t m = 1U << 31;
+        uint32_t p = 0;
+        for (;;) {
+            if (a & m) {
+                p ^= b;
+                if ((a & (m - 1)) == 0)
+                    break;
+            }
+            m >>= 1;
+            b = (b & 1) ? (b >> 1) ^ crc32Polynomial : b >> 1;
+        }
+        return p;
+    }
+
+    // crc32X2NTable[k] = x^(2^k) mod p(x)
+    constexpr auto crc32X2NTable = [] {
+        std::array<uint32_t, 32> table = {};
+        uint32_t p = 1U << 30;  // x^1
+        table[0] = p;
+        for (int n = 1; n < 32; ++n)
+            table[n] = p = crc32MultModP(p, p);
+        return table;
+    }();
+
+    // x^(n * 2^k) mod p(x)
+    uint32_t crc32X2NModP(uint64_t n, int k) {
+        uint32_t p = 1U << 31;  // x^0
+        while (n) {
+            if (n & 1)
+                p = crc32MultModP(crc32X2NTable[k & 31], p);
+            n >>= 1;
+            k++;
+        }
+        return p;
+    }
+
     constexpr uint32_t sha256Table[64] = {
         0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
         0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
@@ -122,6 +258,26 @@ namespace {
     };
 
 
+    constexpr uint32_t sha1IV[5] = {
+        0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0
+    };
+    constexpr uint32_t sha224IV[8] = {
+        0xc1059ed8, 0x367cd507, 0x3070dd17, 0xf70e5939,
+        0xffc00b31, 0x68581511, 0x64f98fa7, 0xbefa4fa4
+    };
+    constexpr uint32_t sha256IV[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    constexpr uint64_t sha384IV[8] = {
+        0xcbbb9d5dc1059ed8, 0x629a292a367cd507, 0x9159015a3070dd17, 0x152fecd8f70e5939,
+        0x67332667ffc00b31, 0x8eb44a8768581511, 0xdb0c2e0d64f98fa7, 0x47b5481dbefa4fa4
+    };
+    constexpr uint64_t sha512IV[8] = {
+        0x6a09e667f3bcc908, 0xbb67ae8584caa73b, 0x3c6ef372fe94f82b, 0xa54ff53a5f1d36f1,
+        0x510e527fade682d1, 0x9b05688c2b3e6c1f, 0x1f83d9abfb41bd6b, 0x5be0cd19137e2179
+    };
+
     FORCEINLINE auto leftRotate(uint32_t x, int c) -> uint32_t {
         return (((x) << (c)) | ((x) >> (32 - (c))));
     }
@@ -155,17 +311,1066 @@ namespace {
 
     template <typename T>
     FORCEINLINE auto bigEndian(T x) -> T {
-#ifdef __LITTLE_ENDIAN__
-        return switchByteOrder(x);
-#endif
+        if constexpr (std::endian::native == std::endian::little)
+            return switchByteOrder(x);
         return x;
     }
     template <typename T>
-    FORCEINLINE auto littleEndian(T x) -> T {
-#ifdef __BIG_ENDIAN__
-        return switchByteOrder(x);
+    FORCEINLINE auto loadBigEndian(const uint8_t* p) -> T {
+        T x;
+        memcpy(&x, p, sizeof(T));
+        return bigEndian(x);
+    }
+
+    // Block functions compress `blocks` consecutive blocks into state.
+    using SHA32Blocks = void (*)(uint32_t* state, const uint8_t* data, size_t blocks);
+    using SHA64Blocks = void (*)(uint64_t* state, const uint8_t* data, size_t blocks);
+
+    void sha1BlocksPortable(uint32_t* state, const uint8_t* data, size_t blocks) {
+        uint32_t W[80];
+        for (; blocks > 0; --blocks, data += 64) {
+            uint32_t A = state[0];
+            uint32_t B = state[1];
+            uint32_t C = state[2];
+            uint32_t D = state[3];
+            uint32_t E = state[4];
+
+            for (int x = 0; x < 16; ++x) {
+                W[x] = loadBigEndian<uint32_t>(data + x * 4);
+            }
+            for (int x = 16; x < 80; ++x) {
+                W[x] = leftRotate(W[x - 3] ^ W[x - 8] ^ W[x - 14] ^ W[x - 16], 1);
+            }
+            uint32_t T = 0;
+
+            for (int n = 0; n < 20; ++n) {
+                T = leftRotate(A, 5) + ((B & C) | ((~B) & D)) + E + W[n] + 0x5A827999;
+                E = D;
+                D = C;
+                C = leftRotate(B, 30);
+                B = A;
+                A = T;
+            }
+            for (int n = 20; n < 40; ++n) {
+                T = leftRotate(A, 5) + (B ^ C ^ D) + E + W[n] + 0x6ED9EBA1;
+                E = D;
+                D = C;
+                C = leftRotate(B, 30);
+                B = A;
+                A = T;
+            }
+            for (int n = 40; n < 60; ++n) {
+                T = leftRotate(A, 5) + ((B & C) | (B & D) | (C & D)) + E + W[n] + 0x8F1BBCDC;
+                E = D;
+                D = C;
+                C = leftRotate(B, 30);
+                B = A;
+                A = T;
+            }
+            for (int n = 60; n < 80; ++n) {
+                T = leftRotate(A, 5) + (B ^ C ^ D) + E + W[n] + 0xCA62C1D6;
+                E = D;
+                D = C;
+                C = leftRotate(B, 30);
+                B = A;
+                A = T;
+            }
+            state[0] += A;
+            state[1] += B;
+            state[2] += C;
+            state[3] += D;
+            state[4] += E;
+        }
+    }
+
+    void sha256BlocksPortable(uint32_t* state, const uint8_t* data, size_t blocks) {
+        uint32_t W[64];
+        for (; blocks > 0; --blocks, data += 64) {
+            uint32_t A = state[0];
+            uint32_t B = state[1];
+            uint32_t C = state[2];
+            uint32_t D = state[3];
+            uint32_t E = state[4];
+            uint32_t F = state[5];
+            uint32_t G = state[6];
+            uint32_t H = state[7];
+
+            for (int x = 0; x < 16; ++x) {
+                W[x] = loadBigEndian<uint32_t>(data + x * 4);
+            }
+            for (int x = 16; x < 64; ++x) {
+                uint32_t s0 = rightRotate(W[x - 15], 7) ^ rightRotate(W[x - 15], 18) ^ (W[x - 15] >> 3);
+                uint32_t s1 = rightRotate(W[x - 2], 17) ^ rightRotate(W[x - 2], 19) ^ (W[x - 2] >> 10);
+                W[x] = W[x - 16] + s0 + W[x - 7] + s1;
+            }
+
+            for (int n = 0; n < 64; ++n) {
+                uint32_t s0 = rightRotate(A, 2) ^ rightRotate(A, 13) ^ rightRotate(A, 22);
+                uint32_t maj = (A & B) ^ (A & C) ^ (B & C);
+                uint32_t t2 = s0 + maj;
+                uint32_t s1 = rightRotate(E, 6) ^ rightRotate(E, 11) ^ rightRotate(E, 25);
+                uint32_t ch = (E & F) ^ ((~E) & G);
+                uint32_t t1 = H + s1 + ch + sha256Table[n] + W[n];
+
+                H = G;
+                G = F;
+                F = E;
+                E = D + t1;
+                D = C;
+                C = B;
+                B = A;
+                A = t1 + t2;
+            }
+            state[0] += A;
+            state[1] += B;
+            state[2] += C;
+            state[3] += D;
+            state[4] += E;
+            state[5] += F;
+            state[6] += G;
+            state[7] += H;
+        }
+    }
+
+    void sha512BlocksPortable(uint64_t* state, const uint8_t* data, size_t blocks) {
+        uint64_t W[80];
+        for (; blocks > 0; --blocks, data += 128) {
+            uint64_t A = state[0];
+            uint64_t B = state[1];
+            uint64_t C = state[2];
+            uint64_t D = state[3];
+            uint64_t E = state[4];
+            uint64_t F = state[5];
+            uint64_t G = state[6];
+            uint64_t H = state[7];
+
+            for (int x = 0; x < 16; ++x) {
+                W[x] = loadBigEndian<uint64_t>(data + x * 8);
+            }
+            for (int x = 16; x < 80; ++x) {
+                uint64_t s0 = rightRotate(W[x - 15], 1) ^ rightRotate(W[x - 15], 8) ^ (W[x - 15] >> 7);
+                uint64_t s1 = rightRotate(W[x - 2], 19) ^ rightRotate(W[x - 2], 61) ^ (W[x - 2] >> 6);
+                W[x] = W[x - 16] + s0 + W[x - 7] + s1;
+            }
+
+            for (int n = 0; n < 80; ++n) {
+                uint64_t s0 = rightRotate(A, 28) ^ rightRotate(A, 34) ^ rightRotate(A, 39);
+                uint64_t maj = (A & B) ^ (A & C) ^ (B & C);
+                uint64_t t2 = s0 + maj;
+                uint64_t s1 = rightRotate(E, 14) ^ rightRotate(E, 18) ^ rightRotate(E, 41);
+                uint64_t ch = (E & F) ^ ((~E) & G);
+                uint64_t t1 = H + s1 + ch + sha512Table[n] + W[n];
+
+                H = G;
+                G = F;
+                F = E;
+                E = D + t1;
+                D = C;
+                C = B;
+                B = A;
+                A = t1 + t2;
+            }
+            state[0] += A;
+            state[1] += B;
+            state[2] += C;
+            state[3] += D;
+            state[4] += E;
+            state[5] += F;
+            state[6] += G;
+            state[7] += H;
+        }
+    }
+
+#if FVCORE_ARCH_X86
+    // 4 rounds of message group g, the group index is a template argument
+    // so that the rounds are unrolled and use immediate operands.
+    template <int g> FVCORE_TARGET("sha,ssse3,sse4.1") FORCEINLINE
+    void sha1RoundsSHANI(__m128i& abcd, __m128i& e0, __m128i& e1, __m128i* m, const uint8_t* data) {
+        __m128i& cur = (g & 1) ? e1 : e0;
+        __m128i& other = (g & 1) ? e0 : e1;
+        if constexpr (g < 4) {
+            const __m128i mask = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+            m[g] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + g * 16)), mask);
+        }
+        if constexpr (g == 0)
+            cur = _mm_add_epi32(cur, m[0]);
+        else
+            cur = _mm_sha1nexte_epu32(cur, m[g & 3]);
+        other = abcd;
+        if constexpr (g >= 3 && g <= 18)
+            m[(g + 1) & 3] = _mm_sha1msg2_epu32(m[(g + 1) & 3], m[g & 3]);
+        abcd = _mm_sha1rnds4_epu32(abcd, cur, g / 5);
+        if constexpr (g >= 1 && g <= 16)
+            m[(g + 3) & 3] = _mm_sha1msg1_epu32(m[(g + 3) & 3], m[g & 3]);
+        if constexpr (g >= 2 && g <= 17)
+            m[(g + 2) & 3] = _mm_xor_si128(m[(g + 2) & 3], m[g & 3]);
+    }
+
+    template <int... g> FVCORE_TARGET("sha,ssse3,sse4.1") FORCEINLINE
+    void sha1BlockSHANI(__m128i& abcd, __m128i& e0, const uint8_t* data, std::integer_sequence<int, g...>) {
+        __m128i e1;
+        __m128i m[4];
+        (sha1RoundsSHANI<g>(abcd, e0, e1, m, data), ...);
+    }
+
+    FVCORE_TARGET("sha,ssse3,sse4.1")
+    void sha1BlocksSHANI(uint32_t* state, const uint8_t* data, size_t blocks) {
+        __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state)), 0x1B);
+        __m128i e0 = _mm_set_epi32(int(state[4]), 0, 0, 0);
+
+        for (; blocks > 0; --blocks, data += 64) {
+            const __m128i abcdSaved = abcd;
+            const __m128i e0Saved = e0;
+            sha1BlockSHANI(abcd, e0, data, std::make_integer_sequence<int, 20>());
+            e0 = _mm_sha1nexte_epu32(e0, e0Saved);
+            abcd = _mm_add_epi32(abcd, abcdSaved);
+        }
+        abcd = _mm_shuffle_epi32(abcd, 0x1B);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(state), abcd);
+        state[4] = uint32_t(_mm_extract_epi32(e0, 3));
+    }
+
+    template <int g> FVCORE_TARGET("sha,ssse3,sse4.1") FORCEINLINE
+    void sha256RoundsSHANI(__m128i& state0, __m128i& state1, __m128i* m, const uint8_t* data) {
+        if constexpr (g < 4) {
+            const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+            m[g] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + g * 16)), mask);
+        } else {
+            __m128i w = _mm_add_epi32(_mm_sha256msg1_epu32(m[g & 3], m[(g + 1) & 3]),
+                                      _mm_alignr_epi8(m[(g + 3) & 3], m[(g + 2) & 3], 4));
+            m[g & 3] = _mm_sha256msg2_epu32(w, m[(g + 3) & 3]);
+        }
+        __m128i msg = _mm_add_epi32(m[g & 3], _mm_loadu_si128(reinterpret_cast<const __m128i*>(&sha256Table[g * 4])));
+        state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+        state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(msg, 0x0E));
+    }
+
+    template <int... g> FVCORE_TARGET("sha,ssse3,sse4.1") FORCEINLINE
+    void sha256BlockSHANI(__m128i& state0, __m128i& state1, const uint8_t* data, std::integer_sequence<int, g...>) {
+        __m128i m[4];
+        (sha256RoundsSHANI<g>(state0, state1, m, data), ...);
+    }
+
+    FVCORE_TARGET("sha,ssse3,sse4.1")
+    void sha256BlocksSHANI(uint32_t* state, const uint8_t* data, size_t blocks) {
+        __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[0])), 0xB1); // CDAB
+        __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[4])), 0x1B); // EFGH
+        __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);     // ABEF
+        state1 = _mm_blend_epi16(state1, tmp, 0xF0);          // CDGH
+
+        for (; blocks > 0; --blocks, data += 64) {
+            const __m128i abefSaved = state0;
+            const __m128i cdghSaved = state1;
+            sha256BlockSHANI(state0, state1, data, std::make_integer_sequence<int, 16>());
+            state0 = _mm_add_epi32(state0, abefSaved);
+            state1 = _mm_add_epi32(state1, cdghSaved);
+        }
+        tmp = _mm_shuffle_epi32(state0, 0x1B);                // FEBA
+        state1 = _mm_shuffle_epi32(state1, 0xB1);             // DCHG
+        state0 = _mm_blend_epi16(tmp, state1, 0xF0);          // DCBA
+        state1 = _mm_alignr_epi8(state1, tmp, 8);             // HGFE
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[0]), state0);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[4]), state1);
+    }
+
+    // Multi-buffer functions compress one block for each of N messages,
+    // state is transposed: state[word][lane].
+    FVCORE_TARGET("avx2") FORCEINLINE
+    __m256i rotateLeft32x8(__m256i x, int c) {
+        return _mm256_or_si256(_mm256_slli_epi32(x, c), _mm256_srli_epi32(x, 32 - c));
+    }
+    FVCORE_TARGET("avx2") FORCEINLINE
+    __m256i rotateRight32x8(__m256i x, int c) {
+        return _mm256_or_si256(_mm256_srli_epi32(x, c), _mm256_slli_epi32(x, 32 - c));
+    }
+    FVCORE_TARGET("avx2") FORCEINLINE
+    __m256i rotateRight64x4(__m256i x, int c) {
+        return _mm256_or_si256(_mm256_srli_epi64(x, c), _mm256_slli_epi64(x, 64 - c));
+    }
+
+    // Loads 8 big-endian words at offset from 8 blocks, one lane per block.
+    FVCORE_TARGET("avx2") FORCEINLINE
+    void loadWords32x8(__m256i* W, const uint8_t* const* blocks, size_t offset) {
+        const __m256i bswap = _mm256_set_epi8(
+            12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+            12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+        __m256i r[8], t[8], u[8];
+        for (int i = 0; i < 8; ++i)
+            r[i] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(blocks[i] + offset));
+        for (int i = 0; i < 8; i += 2) {
+            t[i] = _mm256_unpacklo_epi32(r[i], r[i + 1]);
+            t[i + 1] = _mm256_unpackhi_epi32(r[i], r[i + 1]);
+        }
+        for (int i = 0; i < 8; i += 4) {
+            u[i] = _mm256_unpacklo_epi64(t[i], t[i + 2]);
+            u[i + 1] = _mm256_unpackhi_epi64(t[i], t[i + 2]);
+            u[i + 2] = _mm256_unpacklo_epi64(t[i + 1], t[i + 3]);
+            u[i + 3] = _mm256_unpackhi_epi64(t[i + 1], t[i + 3]);
+        }
+        for (int i = 0; i < 4; ++i) {
+            W[i] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(u[i], u[i + 4], 0x20), bswap);
+            W[i + 4] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(u[i], u[i + 4], 0x31), bswap);
+        }
+    }
+
+    // Loads 4 big-endian words at offset from 4 blocks, one lane per block.
+    FVCORE_TARGET("avx2") FORCEINLINE
+    void loadWords64x4(__m256i* W, const uint8_t* const* blocks, size_t offset) {
+        const __m256i bswap = _mm256_set_epi8(
+            8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7,
+            8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7);
+        __m256i r[4], t[4];
+        for (int i = 0; i < 4; ++i)
+            r[i] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(blocks[i] + offset));
+        t[0] = _mm256_unpacklo_epi64(r[0], r[1]);
+        t[1] = _mm256_unpackhi_epi64(r[0], r[1]);
+        t[2] = _mm256_unpacklo_epi64(r[2], r[3]);
+        t[3] = _mm256_unpackhi_epi64(r[2], r[3]);
+        W[0] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(t[0], t[2], 0x20), bswap);
+        W[1] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(t[1], t[3], 0x20), bswap);
+        W[2] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(t[0], t[2], 0x31), bswap);
+        W[3] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(t[1], t[3], 0x31), bswap);
+    }
+
+    FVCORE_TARGET("avx2")
+    void sha1BlocksAVX2x8(uint32_t (*state)[8], const uint8_t* const* blocks) {
+        __m256i W[16];
+        loadWords32x8(&W[0], blocks, 0);
+        loadWords32x8(&W[8], blocks, 32);
+
+        __m256i A = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(state[0]));
+        __m256i B = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(state[1]));
+        __m256i C = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(state[2]));
+        __m256i D = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(state[3]));
+        __m256i E = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(state[4]));
+
+        for (int n = 0; n < 80; ++n) {
+            if (n >= 16) {
+                __m256i w = _mm256_xor_si256(_mm256_xor_si256(W[(n - 3) & 15], W[(n - 8) & 15]),
+                                             _mm256_xor_si256(W[(n - 14) & 15], W[n & 15]));
+                W[n & 15] = rotateLeft32x8(w, 1);
+            }
+            __m256i f, k;
+            if (n < 20) {
+                f = _mm256_xor_si256(D, _mm256_and_si256(B, _mm256_xor_si256(C, D)));
+                k = _mm256_set1_epi32(0x5A827999);
+            } else if (n < 40) {
+                f = _mm256_xor_si256(_mm256_xor_si256(B, C), D);
+                k = _mm256_set1_epi32(0x6ED9EBA1);
+            } else if (n < 60) {
+                f = _mm256_or_si256(_mm256_and_si256(B, C), _mm256_and_si256(D, _mm256_or_si256(B, C)));
+                k = _mm256_set1_epi32(int(0x8F1BBCDC));
+            } else {
+                f = _mm256_xor_si256(_mm256_xor_si256(B, C), D);
+                k = _mm256_set1_epi32(int(0xCA62C1D6));
+            }
+            __m256i T = _mm256_add_epi32(_mm256_add_epi32(rotateLeft32x8(A, 5), f),
+                                         _mm256_add_epi32(_mm256_add_epi32(E, k), W[n & 15]));
+            E = D;
+            D = C;
+            C = rotateLeft32x8(B, 30);
+            B = A;
+            A = T;
+        }
+        __m256i* s = reinterpret_cast<__m256i*>(state);
+        _mm256_storeu_si256(&s[0], _mm256_add_epi32(_mm256_loadu_si256(&s[0]), A));
+        _mm256_storeu_si256(&s[1], _mm256_add_epi32(_mm256_loadu_si256(&s[1]), B));
+        _mm256_storeu_si256(&s[2], _mm256_add_epi32(_mm256_loadu_si256(&s[2]), C));
+        _mm256_storeu_si256(&s[3], _mm256_add_epi32(_mm256_loadu_si256(&s[3]), D));
+        _mm256_storeu_si256(&s[4], _mm256_add_epi32(_mm256_loadu_si256(&s[4]), E));
+    }
+
+    FVCORE_TARGET("avx2")
+    void sha256BlocksAVX2x8(uint32_t (*state)[8], const uint8_t* const* blocks) {
+        __m256i W[16];
+        loadWords32x8(&W[0], blocks, 0);
+        loadWords32x8(&W[8], blocks, 32);
+
+        __m256i* s = reinterpret_cast<__m256i*>(state);
+        __m256i v[8];
+        for (int i = 0; i < 8; ++i)
+            v[i] = _mm256_loadu_si256(&s[i]);
+
+        for (int n = 0; n < 64; ++n) {
+            if (n >= 16) {
+                __m256i w15 = W[(n - 15) & 15];
+                __m256i w2 = W[(n - 2) & 15];
+                __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(rotateRight32x8(w15, 7), rotateRight32x8(w15, 18)),
+                                              _mm256_srli_epi32(w15, 3));
+                __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(rotateRight32x8(w2, 17), rotateRight32x8(w2, 19)),
+                                              _mm256_srli_epi32(w2, 10));
+                W[n & 15] = _mm256_add_epi32(_mm256_add_epi32(W[n & 15], s0),
+                                             _mm256_add_epi32(W[(n - 7) & 15], s1));
+            }
+            const __m256i A = v[(8 - n % 8) % 8];
+            const __m256i B = v[(9 - n % 8) % 8];
+            const __m256i C = v[(10 - n % 8) % 8];
+            __m256i& D = v[(11 - n % 8) % 8];
+            const __m256i E = v[(12 - n % 8) % 8];
+            const __m256i F = v[(13 - n % 8) % 8];
+            const __m256i G = v[(14 - n % 8) % 8];
+            __m256i& H = v[(15 - n % 8) % 8];
+
+            __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(rotateRight32x8(E, 6), rotateRight32x8(E, 11)),
+                                          rotateRight32x8(E, 25));
+            __m256i ch = _mm256_xor_si256(_mm256_and_si256(E, F), _mm256_andnot_si256(E, G));
+            __m256i t1 = _mm256_add_epi32(_mm256_add_epi32(H, s1),
+                                          _mm256_add_epi32(_mm256_add_epi32(ch, W[n & 15]),
+                                                           _mm256_set1_epi32(int(sha256Table[n]))));
+            __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(rotateRight32x8(A, 2), rotateRight32x8(A, 13)),
+                                          rotateRight32x8(A, 22));
+            __m256i maj = _mm256_or_si256(_mm256_and_si256(A, B), _mm256_and_si256(C, _mm256_or_si256(A, B)));
+            D = _mm256_add_epi32(D, t1);
+            H = _mm256_add_epi32(t1, _mm256_add_epi32(s0, maj));
+        }
+        for (int i = 0; i < 8; ++i)
+            _mm256_storeu_si256(&s[i], _mm256_add_epi32(_mm256_loadu_si256(&s[i]), v[i]));
+    }
+
+    FVCORE_TARGET("avx2")
+    void sha512BlocksAVX2x4(uint64_t (*state)[4], const uint8_t* const* blocks) {
+        __m256i W[16];
+        for (int i = 0; i < 4; ++i)
+            loadWords64x4(&W[i * 4], blocks, i * 32);
+
+        __m256i* s = reinterpret_cast<__m256i*>(state);
+        __m256i v[8];
+        for (int i = 0; i < 8; ++i)
+            v[i] = _mm256_loadu_si256(&s[i]);
+
+        for (int n = 0; n < 80; ++n) {
+            if (n >= 16) {
+                __m256i w15 = W[(n - 15) & 15];
+                __m256i w2 = W[(n - 2) & 15];
+                __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(rotateRight64x4(w15, 1), rotateRight64x4(w15, 8)),
+                                              _mm256_srli_epi64(w15, 7));
+                __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(rotateRight64x4(w2, 19), rotateRight64x4(w2, 61)),
+                                              _mm256_srli_epi64(w2, 6));
+                W[n & 15] = _mm256_add_epi64(_mm256_add_epi64(W[n & 15], s0),
+                                             _mm256_add_epi64(W[(n - 7) & 15], s1));
+            }
+            const __m256i A = v[(8 - n % 8) % 8];
+            const __m256i B = v[(9 - n % 8) % 8];
+            const __m256i C = v[(10 - n % 8) % 8];
+            __m256i& D = v[(11 - n % 8) % 8];
+            const __m256i E = v[(12 - n % 8) % 8];
+            const __m256i F = v[(13 - n % 8) % 8];
+            const __m256i G = v[(14 - n % 8) % 8];
+            __m256i& H = v[(15 - n % 8) % 8];
+
+            __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(rotateRight64x4(E, 14), rotateRight64x4(E, 18)),
+                                          rotateRight64x4(E, 41));
+            __m256i ch = _mm256_xor_si256(_mm256_and_si256(E, F), _mm256_andnot_si256(E, G));
+            __m256i t1 = _mm256_add_epi64(_mm256_add_epi64(H, s1),
+                                          _mm256_add_epi64(_mm256_add_epi64(ch, W[n & 15]),
+                                                           _mm256_set1_epi64x(int64_t(sha512Table[n]))));
+            __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(rotateRight64x4(A, 28), rotateRight64x4(A, 34)),
+                                          rotateRight64x4(A, 39));
+            __m256i maj = _mm256_or_si256(_mm256_and_si256(A, B), _mm256_and_si256(C, _mm256_or_si256(A, B)));
+            D = _mm256_add_epi64(D, t1);
+            H = _mm256_add_epi64(t1, _mm256_add_epi64(s0, maj));
+        }
+        for (int i = 0; i < 8; ++i)
+            _mm256_storeu_si256(&s[i], _mm256_add_epi64(_mm256_loadu_si256(&s[i]), v[i]));
+    }
 #endif
-        return x;
+
+#if FVCORE_ARCH_ARM64
+    FVCORE_TARGET("arch=armv8-a+crypto")
+    void sha1BlocksARMv8(uint32_t* state, const uint8_t* data, size_t blocks) {
+        uint32x4_t abcd = vld1q_u32(state);
+        uint32_t e0 = state[4];
+
+        for (; blocks > 0; --blocks, data += 64) {
+            const uint32x4_t abcdSaved = abcd;
+            const uint32_t e0Saved = e0;
+            uint32x4_t m[4];
+            for (int i = 0; i < 4; ++i)
+                m[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + i * 16)));
+
+            for (int g = 0; g < 20; ++g) {
+                uint32x4_t k;
+                if (g < 5)          k = vdupq_n_u32(0x5A827999);
+                else if (g < 10)    k = vdupq_n_u32(0x6ED9EBA1);
+                else if (g < 15)    k = vdupq_n_u32(0x8F1BBCDC);
+                else                k = vdupq_n_u32(0xCA62C1D6);
+                uint32x4_t msg = vaddq_u32(m[g & 3], k);
+                uint32_t e1 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+                if (g < 5)
+                    abcd = vsha1cq_u32(abcd, e0, msg);
+                else if (g < 10 || g >= 15)
+                    abcd = vsha1pq_u32(abcd, e0, msg);
+                else
+                    abcd = vsha1mq_u32(abcd, e0, msg);
+                e0 = e1;
+                if (g < 16)
+                    m[g & 3] = vsha1su1q_u32(vsha1su0q_u32(m[g & 3], m[(g + 1) & 3], m[(g + 2) & 3]), m[(g + 3) & 3]);
+            }
+            e0 += e0Saved;
+            abcd = vaddq_u32(abcd, abcdSaved);
+        }
+        vst1q_u32(state, abcd);
+        state[4] = e0;
+    }
+
+    FVCORE_TARGET("arch=armv8-a+crypto")
+    void sha256BlocksARMv8(uint32_t* state, const uint8_t* data, size_t blocks) {
+        uint32x4_t state0 = vld1q_u32(&state[0]);
+        uint32x4_t state1 = vld1q_u32(&state[4]);
+
+        for (; blocks > 0; --blocks, data += 64) {
+            const uint32x4_t state0Saved = state0;
+            const uint32x4_t state1Saved = state1;
+            uint32x4_t m[4];
+            for (int i = 0; i < 4; ++i)
+                m[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + i * 16)));
+
+            for (int g = 0; g < 16; ++g) {
+                if (g >= 4)
+                    m[g & 3] = vsha256su1q_u32(vsha256su0q_u32(m[g & 3], m[(g + 1) & 3]), m[(g + 2) & 3], m[(g + 3) & 3]);
+                uint32x4_t msg = vaddq_u32(m[g & 3], vld1q_u32(&sha256Table[g * 4]));
+                uint32x4_t tmp = state0;
+                state0 = vsha256hq_u32(state0, state1, msg);
+                state1 = vsha256h2q_u32(state1, tmp, msg);
+            }
+            state0 = vaddq_u32(state0, state0Saved);
+            state1 = vaddq_u32(state1, state1Saved);
+        }
+        vst1q_u32(&state[0], state0);
+        vst1q_u32(&state[4], state1);
+    }
+#endif
+
+    SHA32Blocks sha1Blocks() {
+        static const SHA32Blocks fn = [] {
+            const auto& cpu = CPUFeatures::current();
+#if FVCORE_ARCH_X86
+            if (cpu.sha && cpu.sse41)
+                return sha1BlocksSHANI;
+#elif FVCORE_ARCH_ARM64
+            if (cpu.armSHA1)
+                return sha1BlocksARMv8;
+#endif
+            return sha1BlocksPortable;
+        }();
+        return fn;
+    }
+
+    SHA32Blocks sha256Blocks() {
+        static const SHA32Blocks fn = [] {
+            const auto& cpu = CPUFeatures::current();
+#if FVCORE_ARCH_X86
+            if (cpu.sha && cpu.sse41)
+                return sha256BlocksSHANI;
+#elif FVCORE_ARCH_ARM64
+            if (cpu.armSHA2)
+                return sha256BlocksARMv8;
+#endif
+            return sha256BlocksPortable;
+        }();
+        return fn;
+    }
+
+    // Buffers input into whole blocks, whole blocks of the input
+    // are compressed in place.
+    template <size_t blockSize, typename Word>
+    void updateBlocks(Word* state, uint8_t* buffer, uint32_t& buffered,
+                      void (*compress)(Word*, const uint8_t*, size_t),
+                      const uint8_t* data, size_t length) {
+        if (buffered > 0) {
+            size_t n = std::min(length, blockSize - buffered);
+            memcpy(buffer + buffered, data, n);
+            buffered += uint32_t(n);
+            data += n;
+            length -= n;
+            if (buffered < blockSize)
+                return;
+            compress(state, buffer, 1);
+            buffered = 0;
+        }
+        if (size_t blocks = length / blockSize; blocks > 0) {
+            compress(state, data, blocks);
+            data += blocks * blockSize;
+            length -= blocks * blockSize;
+        }
+        if (length > 0)
+            memcpy(buffer, data, length);
+        buffered = uint32_t(length);
+    }
+
+    // Writes the last partial block with padding and the message length
+    // in bits into padded[2 * blockSize], returns the number of blocks.
+    template <size_t blockSize>
+    size_t paddingBlocks(uint8_t* padded, const uint8_t* rest, size_t restLength,
+                         uint64_t bitsHigh, uint64_t bitsLow) {
+        constexpr size_t lengthSize = blockSize / 8;
+        FVASSERT_DEBUG(restLength < blockSize);
+        memset(padded, 0, blockSize * 2);
+        if (restLength > 0)
+            memcpy(padded, rest, restLength);
+        padded[restLength] = 0x80;
+        size_t blocks = (restLength + 1 + lengthSize > blockSize) ? 2 : 1;
+        uint8_t* end = padded + blocks * blockSize;
+        for (int i = 0; i < 8; ++i)
+            end[-1 - i] = uint8_t(bitsLow >> (i * 8));
+        if constexpr (lengthSize > 8) {
+            for (int i = 0; i < 8; ++i)
+                end[-9 - i] = uint8_t(bitsHigh >> (i * 8));
+        }
+        return blocks;
+    }
+
+    template <size_t blockSize, size_t stateWords, typename Word, typename Output>
+    void hashEach(const Word* iv, std::span<const std::span<const uint8_t>> messages,
+                  void (*compress)(Word*, const uint8_t*, size_t), Output&& output) {
+        uint8_t padded[blockSize * 2];
+        for (size_t i = 0; i < messages.size(); ++i) {
+            const auto& msg = messages[i];
+            Word state[stateWords];
+            std::copy_n(iv, stateWords, state);
+            size_t blocks = msg.size() / blockSize;
+            compress(state, msg.data(), blocks);
+            size_t tail = paddingBlocks<blockSize>(padded, msg.data() + blocks * blockSize,
+                                                   msg.size() % blockSize,
+                                                   uint64_t(msg.size()) >> 61, uint64_t(msg.size()) << 3);
+            compress(state, padded, tail);
+            output(i, state);
+        }
+    }
+
+    // Runs messages through a function that compresses one block for each
+    // of `lanes` messages at once. A lane is refilled with the next message
+    // as soon as it finishes, the last few messages are completed with the
+    // single-buffer function once too few lanes are busy.
+    template <size_t blockSize, size_t stateWords, size_t lanes, typename Word, typename Output>
+    void hashLanes(const Word* iv, std::span<const std::span<const uint8_t>> messages,
+                   void (*compressLanes)(Word (*)[lanes], const uint8_t* const*),
+                   void (*compress)(Word*, const uint8_t*, size_t), Output&& output) {
+        constexpr size_t idle = ~size_t(0);
+        struct Lane {
+            size_t message;
+            const uint8_t* data;
+            size_t blocks;          // whole message blocks left
+            const uint8_t* tail;
+            size_t tailBlocks;      // padding blocks left
+            uint8_t padded[blockSize * 2];
+        };
+        alignas(32) Word state[stateWords][lanes];
+        alignas(32) static const uint8_t zero[blockSize] = {};
+        Lane lane[lanes];
+        size_t next = 0;
+        size_t active = 0;
+
+        auto start = [&](size_t l) {
+            Lane& ln = lane[l];
+            if (next >= messages.size()) {
+                ln.message = idle;
+                return false;
+            }
+            const auto& msg = messages[next];
+            ln.message = next++;
+            ln.data = msg.data();
+            ln.blocks = msg.size() / blockSize;
+            ln.tail = ln.padded;
+            ln.tailBlocks = paddingBlocks<blockSize>(ln.padded, msg.data() + ln.blocks * blockSize,
+                                                     msg.size() % blockSize,
+                                                     uint64_t(msg.size()) >> 61, uint64_t(msg.size()) << 3);
+            for (size_t w = 0; w < stateWords; ++w)
+                state[w][l] = iv[w];
+            return true;
+        };
+        auto digest = [&](size_t l, Word* out) {
+            for (size_t w = 0; w < stateWords; ++w)
+                out[w] = state[w][l];
+        };
+
+        for (size_t l = 0; l < lanes; ++l) {
+            if (start(l))
+                active++;
+        }
+        while (active > lanes / 4) {
+            const uint8_t* blocks[lanes];
+            for (size_t l = 0; l < lanes; ++l) {
+                const Lane& ln = lane[l];
+                if (ln.message == idle)
+                    blocks[l] = zero;
+                else
+                    blocks[l] = ln.blocks > 0 ? ln.data : ln.tail;
+            }
+            compressLanes(state, blocks);
+
+            for (size_t l = 0; l < lanes; ++l) {
+                Lane& ln = lane[l];
+                if (ln.message == idle)
+                    continue;
+                if (ln.blocks > 0) {
+                    ln.data += blockSize;
+                    ln.blocks--;
+                } else {
+                    ln.tail += blockSize;
+                    ln.tailBlocks--;
+                }
+                if (ln.blocks == 0 && ln.tailBlocks == 0) {
+                    Word out[stateWords];
+                    digest(l, out);
+                    output(ln.message, out);
+                    if (start(l) == false)
+                        active--;
+                }
+            }
+        }
+        for (size_t l = 0; l < lanes; ++l) {
+            const Lane& ln = lane[l];
+            if (ln.message == idle)
+                continue;
+            Word out[stateWords];
+            digest(l, out);
+            compress(out, ln.data, ln.blocks);
+            compress(out, ln.tail, ln.tailBlocks);
+            output(ln.message, out);
+        }
+    }
+
+    template <typename Output>
+    void sha1Each(std::span<const std::span<const uint8_t>> messages, Output&& output) {
+#if FVCORE_ARCH_X86
+        static const bool lanes = CPUFeatures::current().avx2 && !CPUFeatures::current().sha;
+        if (lanes && messages.size() > 2)
+            return hashLanes<64, 5, 8>(sha1IV, messages, sha1BlocksAVX2x8, sha1Blocks(), output);
+#endif
+        hashEach<64, 5>(sha1IV, messages, sha1Blocks(), output);
+    }
+
+    template <typename Output>
+    void sha256Each(const uint32_t* iv, std::span<const std::span<const uint8_t>> messages, Output&& output) {
+#if FVCORE_ARCH_X86
+        static const bool lanes = CPUFeatures::current().avx2 && !CPUFeatures::current().sha;
+        if (lanes && messages.size() > 2)
+            return hashLanes<64, 8, 8>(iv, messages, sha256BlocksAVX2x8, sha256Blocks(), output);
+#endif
+        hashEach<64, 8>(iv, messages, sha256Blocks(), output);
+    }
+
+    template <typename Output>
+    void sha512Each(const uint64_t* iv, std::span<const std::span<const uint8_t>> messages, Output&& output) {
+#if FVCORE_ARCH_X86
+        static const bool lanes = CPUFeatures::current().avx2;
+        if (lanes && messages.size() > 1)
+            return hashLanes<128, 8, 4>(iv, messages, sha512BlocksAVX2x4, sha512BlocksPortable, output);
+#endif
+        hashEach<128, 8>(iv, messages, sha512BlocksPortable, output);
+    }
+
+    // XXH3 long input: accumulate stripes of 64 bytes, the secret advances
+    // 8 bytes per stripe. SSE2/NEON are baseline, AVX2 is chosen at runtime.
+    using XXH3Accumulate = void (*)(uint64_t* acc, const uint8_t* data, const uint8_t* secret, size_t stripes);
+    using XXH3Scramble = void (*)(uint64_t* acc, const uint8_t* secret);
+
+    [[maybe_unused]] void xxh3AccumulatePortable(uint64_t* acc, const uint8_t* data, const uint8_t* secret, size_t stripes) {
+        for (size_t n = 0; n < stripes; ++n)
+            _XXH3::accumulate512(acc, data + n * _XXH3::stripeLength, secret + n * 8);
+    }
+    [[maybe_unused]] void xxh3ScramblePortable(uint64_t* acc, const uint8_t* secret) {
+        _XXH3::scramble(acc, secret);
+    }
+
+#if FVCORE_ARCH_X86
+    FVCORE_TARGET("sse2")
+    void xxh3AccumulateSSE2(uint64_t* acc, const uint8_t* data, const uint8_t* secret, size_t stripes) {
+        __m128i* xacc = reinterpret_cast<__m128i*>(acc);
+        __m128i a[4];
+        for (int i = 0; i < 4; ++i)
+            a[i] = _mm_load_si128(&xacc[i]);
+        for (size_t n = 0; n < stripes; ++n) {
+            const uint8_t* p = data + n * _XXH3::stripeLength;
+            const uint8_t* s = secret + n * 8;
+            for (int i = 0; i < 4; ++i) {
+                __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p) + i);
+                __m128i k = _mm_xor_si128(d, _mm_loadu_si128(reinterpret_cast<const __m128i*>(s) + i));
+                __m128i product = _mm_mul_epu32(k, _mm_shuffle_epi32(k, _MM_SHUFFLE(0, 3, 0, 1)));
+                __m128i swapped = _mm_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2));
+                a[i] = _mm_add_epi64(a[i], _mm_add_epi64(product, swapped));
+            }
+        }
+        for (int i = 0; i < 4; ++i)
+            _mm_store_si128(&xacc[i], a[i]);
+    }
+
+    FVCORE_TARGET("sse2")
+    void xxh3ScrambleSSE2(uint64_t* acc, const uint8_t* secret) {
+        __m128i* xacc = reinterpret_cast<__m128i*>(acc);
+        const __m128i prime = _mm_set1_epi32(int(_XXH3::prime32_1));
+        for (int i = 0; i < 4; ++i) {
+            __m128i a = _mm_load_si128(&xacc[i]);
+            a = _mm_xor_si128(a, _mm_srli_epi64(a, 47));
+            a = _mm_xor_si128(a, _mm_loadu_si128(reinterpret_cast<const __m128i*>(secret) + i));
+            __m128i low = _mm_mul_epu32(a, prime);
+            __m128i high = _mm_mul_epu32(_mm_shuffle_epi32(a, _MM_SHUFFLE(0, 3, 0, 1)), prime);
+            _mm_store_si128(&xacc[i], _mm_add_epi64(low, _mm_slli_epi64(high, 32)));
+        }
+    }
+
+    FVCORE_TARGET("avx2")
+    void xxh3AccumulateAVX2(uint64_t* acc, const uint8_t* data, const uint8_t* secret, size_t stripes) {
+        __m256i* xacc = reinterpret_cast<__m256i*>(acc);
+        __m256i a0 = _mm256_load_si256(&xacc[0]);
+        __m256i a1 = _mm256_load_si256(&xacc[1]);
+        for (size_t n = 0; n < stripes; ++n) {
+            const __m256i* p = reinterpret_cast<const __m256i*>(data + n * _XXH3::stripeLength);
+            const __m256i* s = reinterpret_cast<const __m256i*>(secret + n * 8);
+            __m256i d0 = _mm256_loadu_si256(p);
+            __m256i d1 = _mm256_loadu_si256(p + 1);
+            __m256i k0 = _mm256_xor_si256(d0, _mm256_loadu_si256(s));
+            __m256i k1 = _mm256_xor_si256(d1, _mm256_loadu_si256(s + 1));
+            __m256i p0 = _mm256_mul_epu32(k0, _mm256_srli_epi64(k0, 32));
+            __m256i p1 = _mm256_mul_epu32(k1, _mm256_srli_epi64(k1, 32));
+            a0 = _mm256_add_epi64(a0, _mm256_add_epi64(p0, _mm256_shuffle_epi32(d0, _MM_SHUFFLE(1, 0, 3, 2))));
+            a1 = _mm256_add_epi64(a1, _mm256_add_epi64(p1, _mm256_shuffle_epi32(d1, _MM_SHUFFLE(1, 0, 3, 2))));
+        }
+        _mm256_store_si256(&xacc[0], a0);
+        _mm256_store_si256(&xacc[1], a1);
+    }
+
+    FVCORE_TARGET("avx2")
+    void xxh3ScrambleAVX2(uint64_t* acc, const uint8_t* secret) {
+        __m256i* xacc = reinterpret_cast<__m256i*>(acc);
+        const __m256i prime = _mm256_set1_epi32(int(_XXH3::prime32_1));
+        for (int i = 0; i < 2; ++i) {
+            __m256i a = _mm256_load_si256(&xacc[i]);
+            a = _mm256_xor_si256(a, _mm256_srli_epi64(a, 47));
+            a = _mm256_xor_si256(a, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(secret) + i));
+            __m256i low = _mm256_mul_epu32(a, prime);
+            __m256i high = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), prime);
+            _mm256_store_si256(&xacc[i], _mm256_add_epi64(low, _mm256_slli_epi64(high, 32)));
+        }
+    }
+#elif FVCORE_ARCH_ARM64
+    void xxh3AccumulateNEON(uint64_t* acc, const uint8_t* data, const uint8_t* secret, size_t stripes) {
+        uint64x2_t a[4];
+        for (int i = 0; i < 4; ++i)
+            a[i] = vld1q_u64(acc + i * 2);
+        for (size_t n = 0; n < stripes; ++n) {
+            const uint8_t* p = data + n * _XXH3::stripeLength;
+            const uint8_t* s = secret + n * 8;
+            for (int i = 0; i < 4; ++i) {
+                uint64x2_t d = vreinterpretq_u64_u8(vld1q_u8(p + i * 16));
+                uint64x2_t k = veorq_u64(d, vreinterpretq_u64_u8(vld1q_u8(s + i * 16)));
+                a[i] = vaddq_u64(a[i], vextq_u64(d, d, 1));
+                a[i] = vmlal_u32(a[i], vmovn_u64(k), vshrn_n_u64(k, 32));
+            }
+        }
+        for (int i = 0; i < 4; ++i)
+            vst1q_u64(acc + i * 2, a[i]);
+    }
+
+    void xxh3ScrambleNEON(uint64_t* acc, const uint8_t* secret) {
+        const uint32x2_t prime = vdup_n_u32(uint32_t(_XXH3::prime32_1));
+        for (int i = 0; i < 4; ++i) {
+            uint64x2_t a = vld1q_u64(acc + i * 2);
+            a = veorq_u64(a, vshrq_n_u64(a, 47));
+            a = veorq_u64(a, vreinterpretq_u64_u8(vld1q_u8(secret + i * 16)));
+            uint64x2_t high = vshlq_n_u64(vmull_u32(vshrn_n_u64(a, 32), prime), 32);
+            vst1q_u64(acc + i * 2, vmlal_u32(high, vmovn_u64(a), prime));
+        }
+    }
+#endif
+
+    struct XXH3Functions {
+        XXH3Accumulate accumulate;
+        XXH3Scramble scramble;
+    };
+    const XXH3Functions& xxh3Functions() {
+        static const XXH3Functions fn = [] {
+#if FVCORE_ARCH_X86
+            if (CPUFeatures::current().avx2)
+                return XXH3Functions{ xxh3AccumulateAVX2, xxh3ScrambleAVX2 };
+            return XXH3Functions{ xxh3AccumulateSSE2, xxh3ScrambleSSE2 };
+#elif FVCORE_ARCH_ARM64
+            return XXH3Functions{ xxh3AccumulateNEON, xxh3ScrambleNEON };
+#else
+            return XXH3Functions{ xxh3AccumulatePortable, xxh3ScramblePortable };
+#endif
+        }();
+        return fn;
+    }
+
+    constexpr size_t xxh3StripesPerBlock = (_XXH3::secretSize - _XXH3::stripeLength) / 8;
+    constexpr size_t xxh3BufferStripes = sizeof(_XXH3State::buffer) / _XXH3::stripeLength;
+
+    // accumulators after all stripes but the last one, for inputs longer than 240 bytes.
+    void xxh3HashLong(uint64_t* acc, const uint8_t* data, size_t length, const uint8_t* secret) {
+        const auto& fn = xxh3Functions();
+        constexpr size_t blockLength = _XXH3::stripeLength * xxh3StripesPerBlock;
+        _XXH3::initAccumulators(acc);
+
+        const size_t blocks = (length - 1) / blockLength;
+        for (size_t n = 0; n < blocks; ++n) {
+            fn.accumulate(acc, data + n * blockLength, secret, xxh3StripesPerBlock);
+            fn.scramble(acc, secret + _XXH3::secretSize - _XXH3::stripeLength);
+        }
+        const size_t stripes = ((length - 1) - blockLength * blocks) / _XXH3::stripeLength;
+        fn.accumulate(acc, data + blocks * blockLength, secret, stripes);
+        fn.accumulate(acc, data + length - _XXH3::stripeLength,
+                      secret + _XXH3::secretSize - _XXH3::stripeLength - 7, 1);
+    }
+
+    // stripes of a stream, scrambles whenever a block of stripes is complete.
+    void xxh3ConsumeStripes(uint64_t* acc, uint32_t& stripesSoFar, const uint8_t* data, size_t stripes, const uint8_t* secret) {
+        const auto& fn = xxh3Functions();
+        while (stripes > 0) {
+            size_t n = std::min(stripes, xxh3StripesPerBlock - stripesSoFar);
+            fn.accumulate(acc, data, secret + stripesSoFar * 8, n);
+            data += n * _XXH3::stripeLength;
+            stripes -= n;
+            stripesSoFar += uint32_t(n);
+            if (stripesSoFar == xxh3StripesPerBlock) {
+                fn.scramble(acc, secret + _XXH3::secretSize - _XXH3::stripeLength);
+                stripesSoFar = 0;
+            }
+        }
+    }
+
+    void xxh3Reset(_XXH3State& state, uint64_t seed) {
+        _XXH3::initAccumulators(state.acc);
+        _XXH3::initSecret(state.secret, seed);
+        state.totalLength = 0;
+        state.seed = seed;
+        state.bufferedSize = 0;
+        state.stripesSoFar = 0;
+    }
+
+    void xxh3Update(_XXH3State& state, const uint8_t* data, size_t length) {
+        constexpr size_t bufferSize = sizeof(state.buffer);
+        state.totalLength += length;
+        if (state.bufferedSize + length <= bufferSize) {
+            if (length > 0)
+                memcpy(state.buffer + state.bufferedSize, data, length);
+            state.bufferedSize += uint32_t(length);
+            return;
+        }
+        // at least one byte always stays buffered, so that the last
+        // stripe can be processed by finalize.
+        if (state.bufferedSize > 0) {
+            size_t fill = bufferSize - state.bufferedSize;
+            memcpy(state.buffer + state.bufferedSize, data, fill);
+            data += fill;
+            length -= fill;
+            xxh3ConsumeStripes(state.acc, state.stripesSoFar, state.buffer, xxh3BufferStripes, state.secret);
+            state.bufferedSize = 0;
+        }
+        if (length > bufferSize) {
+            size_t stripes = (length - 1) / _XXH3::stripeLength;
+            xxh3ConsumeStripes(state.acc, state.stripesSoFar, data, stripes, state.secret);
+            data += stripes * _XXH3::stripeLength;
+            length -= stripes * _XXH3::stripeLength;
+            // keep the last consumed stripe for finalize.
+            memcpy(state.buffer + bufferSize - _XXH3::stripeLength, data - _XXH3::stripeLength, _XXH3::stripeLength);
+        }
+        memcpy(state.buffer, data, length);
+        state.bufferedSize = uint32_t(length);
+    }
+
+    // accumulators of a stream including the last stripe, total length is longer than 240 bytes.
+    void xxh3FinalizeLong(const _XXH3State& state, uint64_t* acc) {
+        memcpy(acc, state.acc, sizeof(state.acc));
+        uint32_t stripesSoFar = state.stripesSoFar;
+        const uint8_t* lastStripe;
+        uint8_t stripe[_XXH3::stripeLength];
+        if (state.bufferedSize >= _XXH3::stripeLength) {
+            size_t stripes = (state.bufferedSize - 1) / _XXH3::stripeLength;
+            xxh3ConsumeStripes(acc, stripesSoFar, state.buffer, stripes, state.secret);
+            lastStripe = state.buffer + state.bufferedSize - _XXH3::stripeLength;
+        } else {
+            // the last stripe overlaps data that was already consumed.
+            size_t catchup = _XXH3::stripeLength - state.bufferedSize;
+            memcpy(stripe, state.buffer + sizeof(state.buffer) - catchup, catchup);
+            memcpy(stripe + catchup, state.buffer, state.bufferedSize);
+            lastStripe = stripe;
+        }
+        xxh3Functions().accumulate(acc, lastStripe, state.secret + _XXH3::secretSize - _XXH3::stripeLength - 7, 1);
+    }
+
+    // XXH3 128-bit, inputs of 0 to 240 bytes.
+    _XXH3::UInt128 xxh3Mix32B(_XXH3::UInt128 acc, const uint8_t* p1, const uint8_t* p2, const uint8_t* s, uint64_t seed) {
+        acc.low += _XXH3::mix16B(p1, s, seed);
+        acc.low ^= _XXH3::read64(p2) + _XXH3::read64(p2 + 8);
+        acc.high += _XXH3::mix16B(p2, s + 16, seed);
+        acc.high ^= _XXH3::read64(p1) + _XXH3::read64(p1 + 8);
+        return acc;
+    }
+
+    XXH3_128Digest xxh3Hash128Short(const uint8_t* p, size_t length, uint64_t seed) {
+        using namespace _XXH3;
+        const uint8_t* s = _XXH3::secret;
+        if (length <= 16) {
+            if (length > 8) {
+                uint64_t bitflipLow = (read64(s + 32) ^ read64(s + 40)) - seed;
+                uint64_t bitflipHigh = (read64(s + 48) ^ read64(s + 56)) + seed;
+                uint64_t inputLow = read64(p);
+                uint64_t inputHigh = read64(p + length - 8);
+                UInt128 m = multiply128(inputLow ^ inputHigh ^ bitflipLow, prime64_1);
+                m.low += uint64_t(length - 1) << 54;
+                inputHigh ^= bitflipHigh;
+                m.high += inputHigh + uint64_t(uint32_t(inputHigh)) * (prime32_2 - 1);
+                m.low ^= swap64(m.high);
+                UInt128 h = multiply128(m.low, prime64_2);
+                h.high += m.high * prime64_2;
+                return { avalanche(h.low), avalanche(h.high) };
+            }
+            if (length >= 4) {
+                seed ^= uint64_t(swap32(uint32_t(seed))) << 32;
+                uint64_t input = read32(p) + (uint64_t(read32(p + length - 4)) << 32);
+                uint64_t bitflip = (read64(s + 16) ^ read64(s + 24)) + seed;
+                UInt128 m = multiply128(input ^ bitflip, prime64_1 + (length << 2));
+                m.high += m.low << 1;
+                m.low ^= m.high >> 3;
+                m.low ^= m.low >> 35;
+                m.low *= primeMX2;
+                m.low ^= m.low >> 28;
+                return { m.low, avalanche(m.high) };
+            }
+            if (length > 0) {
+                uint32_t combinedLow = uint32_t(p[0]) << 16 | uint32_t(p[length >> 1]) << 24 |
+                                       uint32_t(p[length - 1]) | uint32_t(length) << 8;
+                uint32_t combinedHigh = std::rotl(swap32(combinedLow), 13);
+                uint64_t bitflipLow = (read32(s) ^ read32(s + 4)) + seed;
+                uint64_t bitflipHigh = (read32(s + 8) ^ read32(s + 12)) - seed;
+                return { xxh64Avalanche(combinedLow ^ bitflipLow), xxh64Avalanche(combinedHigh ^ bitflipHigh) };
+            }
+            return { xxh64Avalanche(seed ^ read64(s + 64) ^ read64(s + 72)),
+                     xxh64Avalanche(seed ^ read64(s + 80) ^ read64(s + 88)) };
+        }
+        UInt128 acc = { length * prime64_1, 0 };
+        if (length <= 128) {
+            if (length > 32) {
+                if (length > 64) {
+                    if (length > 96)
+                        acc = xxh3Mix32B(acc, p + 48, p + length - 64, s + 96, seed);
+                    acc = xxh3Mix32B(acc, p + 32, p + length - 48, s + 64, seed);
+                }
+                acc = xxh3Mix32B(acc, p + 16, p + length - 32, s + 32, seed);
+            }
+            acc = xxh3Mix32B(acc, p, p + length - 16, s, seed);
+        } else {
+            for (size_t i = 0; i < 4; ++i)
+                acc = xxh3Mix32B(acc, p + 32 * i, p + 32 * i + 16, s + 32 * i, seed);
+            acc.low = avalanche(acc.low);
+            acc.high = avalanche(acc.high);
+            for (size_t i = 4; i < length / 32; ++i)
+                acc = xxh3Mix32B(acc, p + 32 * i, p + 32 * i + 16, s + 3 + 32 * (i - 4), seed);
+            acc = xxh3Mix32B(acc, p + length - 16, p + length - 32, s + 136 - 17 - 16, 0 - seed);
+        }
+        uint64_t low = acc.low + acc.high;
+        uint64_t high = acc.low * prime64_1 + acc.high * prime64_4 + (length - seed) * prime64_2;
+        return { avalanche(low), 0 - avalanche(high) };
+    }
+
+    XXH3_128Digest xxh3Merge128(const uint64_t* acc, const uint8_t* secret, uint64_t length) {
+        return {
+            _XXH3::mergeAccumulators(acc, secret + 11, length * _XXH3::prime64_1),
+            _XXH3::mergeAccumulators(acc, secret + _XXH3::secretSize - _XXH3::stripeLength - 11,
+                                     ~(length * _XXH3::prime64_2))
+        };
     }
 }
 
@@ -176,11 +1381,22 @@ void CRC32::update(const void* ptr, size_t length) {
     const uint8_t* data = reinterpret_cast<const uint8_t*>(ptr);
 
     uint32_t crc = ~state;
-    for (size_t i = 0; i < length; ++i) {
-        int idx = (crc ^ uint32_t(data[i])) & 0xff;
-        crc = crc32Table[idx] ^ (crc >> 8);
+#if FVCORE_ARCH_X86
+    static const bool clmul = CPUFeatures::current().pclmul && CPUFeatures::current().sse41;
+    if (clmul && length >= 64) {
+        size_t chunk = length & ~size_t(15);
+        crc = crc32CLMul(crc, data, chunk);
+        data += chunk;
+        length -= chunk;
     }
-    state = ~crc;
+#elif FVCORE_ARCH_ARM64
+    static const bool armCRC32 = CPUFeatures::current().armCRC32;
+    if (armCRC32) {
+        state = ~crc32ARMv8(crc, data, length);
+        return;
+    }
+#endif
+    state = ~crc32Slice8(crc, data, length);
 }
 
 CRC32::Digest CRC32::finalize() {
@@ -193,77 +1409,27 @@ CRC32::Digest CRC32::hash(const void* data, size_t length) {
     return hash.finalize();
 }
 
-SHA1::SHA1()
-    : W{ 0 } {
-    init(_hash);
-    state[0] = 0x67452301;
-    state[1] = 0xefcdab89;
-    state[2] = 0x98badcfe;
-    state[3] = 0x10325476;
-    state[4] = 0xc3d2e1f0;
-}
-
-void SHA1::_update(const uint32_t* data) {
-    uint32_t A = state[0];
-    uint32_t B = state[1];
-    uint32_t C = state[2];
-    uint32_t D = state[3];
-    uint32_t E = state[4];
-
-    for (int x = 0; x < 16; ++x) {
-        W[x] = bigEndian(data[x]);
-    }
-    for (int x = 16; x < 80; ++x) {
-        W[x] = leftRotate(W[x - 3] ^ W[x - 8] ^ W[x - 14] ^ W[x - 16], 1);
-    }
-    uint32_t T = 0;
-
-    for (int n = 0; n < 20; ++n) {
-        T = leftRotate(A, 5) & +((B & C) | ((~B) & D)) & +E & +W[n] & +0x5A827999;
-        E = D;
-        D = C;
-        C = leftRotate(B, 30);
-        B = A;
-        A = T;
-    }
-    for (int n = 20; n < 40; ++n) {
-        T = leftRotate(A, 5) & +(B ^ C ^ D) & +E & +W[n] & +0x6ED9EBA1;
-        E = D;
-        D = C;
-        C = leftRotate(B, 30);
-        B = A;
-        A = T;
-    }
-    for (int n = 40; n < 60; ++n) {
-        T = leftRotate(A, 5) & +((B & C) | (B & D) | (C & D)) & +E & +W[n] & +0x8F1BBCDC;
-        E = D;
-        D = C;
-        C = leftRotate(B, 30);
-        B = A;
-        A = T;
-    }
-    for (int n = 60; n < 80; ++n) {
-        T = leftRotate(A, 5) & +(B ^ C ^ D) & +E & +W[n] & +0xCA62C1D6;
-        E = D;
-        D = C;
-        C = leftRotate(B, 30);
-        B = A;
-        A = T;
-    }
-    state[0] += A;
-    state[1] += B;
-    state[2] += C;
-    state[3] += D;
-    state[4] += E;
+CRC32::Digest CRC32::combine(Digest first, Digest second, uint64_t secondLength) {
+    return { crc32MultModP(crc32X2NModP(secondLength, 3), first.hash) ^ second.hash };
+}
+
+SHA1::SHA1() {
+    std::copy_n(sha1IV, 5, state);
+    _hash.low = 0;
+    _hash.length = 0;
 }
 
 void SHA1::update(const void* data, size_t length) {
-    ::update(_hash, [this](const uint32_t* data) {_update(data); },
-             reinterpret_cast<const uint8_t*>(data), length);
+    _hash.low += uint64_t(length) << 3;
+    updateBlocks<64>(state, _hash.buffer, _hash.length, sha1Blocks(),
+                     reinterpret_cast<const uint8_t*>(data), length);
 }
 
 SHA1::Digest SHA1::finalize() {
-    ::finalize(_hash, [this](const uint32_t* data) {_update(data); });
+    uint8_t padded[128];
+    size_t blocks = paddingBlocks<64>(padded, _hash.buffer, _hash.length, 0, _hash.low);
+    sha1Blocks()(state, padded, blocks);
+    _hash.length = 0;
     return *reinterpret_cast<Digest*>(&state);
 }
 
@@ -273,77 +1439,29 @@ SHA1::Digest SHA1::hash(const void* data, size_t length) {
     return hash.finalize();
 }
 
-SHA256::SHA256()
-    : W{ 0 } {
-    init(_hash);
-    state[0] = 0x6a09e667;
-    state[1] = 0xbb67ae85;
-    state[2] = 0x3c6ef372;
-    state[3] = 0xa54ff53a;
-    state[4] = 0x510e527f;
-    state[5] = 0x9b05688c;
-    state[6] = 0x1f83d9ab;
-    state[7] = 0x5be0cd19;
-}
-
-void SHA256::_update(const uint32_t* data) {
-    uint32_t A = state[0];
-    uint32_t B = state[1];
-    uint32_t C = state[2];
-    uint32_t D = state[3];
-    uint32_t E = state[4];
-    uint32_t F = state[5];
-    uint32_t G = state[6];
-    uint32_t H = state[7];
-
-    for (int x = 0; x < 16; ++x) {
-        W[x] = bigEndian(data[x]);
-    }
-    for (int x = 16; x < 64; ++x) {
-        uint32_t s0 = rightRotate(W[x - 15], 7) ^ rightRotate(W[x - 15], 18) ^ (W[x - 15] >> 3);
-        uint32_t s1 = rightRotate(W[x - 2], 17) ^ rightRotate(W[x - 2], 19) ^ (W[x - 2] >> 10);
-        W[x] = W[x - 16] + s0 + W[x - 7] + s1;
-    }
-
-    uint32_t s0, s1;
-    uint32_t maj;
-    uint32_t t1, t2;
-    uint32_t ch;
-
-    for (int n = 0; n < 64; ++n) {
-        s0 = rightRotate(A, 2) ^ rightRotate(A, 13) ^ rightRotate(A, 22);
-        maj = (A & B) ^ (A & C) ^ (B & C);
-        t2 = s0 + maj;
-        s1 = rightRotate(E, 6) ^ rightRotate(E, 11) ^ rightRotate(E, 25);
-        ch = (E & F) ^ ((~E) & G);
-        t1 = H & +s1 + ch + sha256Table[n] + W[n];
-
-        H = G;
-        G = F;
-        F = E;
-        E = D + t1;
-        D = C;
-        C = B;
-        B = A;
-        A = t1 + t2;
-    }
-    state[0] += A;
-    state[1] += B;
-    state[2] += C;
-    state[3] += D;
-    state[4] += E;
-    state[5] += F;
-    state[6] += G;
-    state[7] += H;
+void SHA1::hash(std::span<const std::span<const uint8_t>> messages, Digest* digests) {
+    sha1Each(messages, [digests](size_t index, const uint32_t* state) {
+        std::copy_n(state, 5, digests[index].hash);
+    });
+}
+
+SHA256::SHA256() {
+    std::copy_n(sha256IV, 8, state);
+    _hash.low = 0;
+    _hash.length = 0;
 }
 
 void SHA256::update(const void* data, size_t length) {
-    ::update(_hash, [this](const uint32_t* data) {_update(data); },
-             reinterpret_cast<const uint8_t*>(data), length);
+    _hash.low += uint64_t(length) << 3;
+    updateBlocks<64>(state, _hash.buffer, _hash.length, sha256Blocks(),
+                     reinterpret_cast<const uint8_t*>(data), length);
 }
 
 SHA256::Digest SHA256::finalize() {
-    ::finalize(_hash, [this](const uint32_t* data) {_update(data); });
+    uint8_t padded[128];
+    size_t blocks = paddingBlocks<64>(padded, _hash.buffer, _hash.length, 0, _hash.low);
+    sha256Blocks()(state, padded, blocks);
+    _hash.length = 0;
     return *reinterpret_cast<Digest*>(&state);
 }
 
@@ -353,121 +1471,33 @@ SHA256::Digest SHA256::hash(const void* data, size_t length) {
     return hash.finalize();
 }
 
+void SHA256::hash(std::span<const std::span<const uint8_t>> messages, Digest* digests) {
+    sha256Each(sha256IV, messages, [digests](size_t index, const uint32_t* state) {
+        std::copy_n(state, 8, digests[index].hash);
+    });
+}
+
 SHA512::SHA512()
-    : W{ 0 }
-    , low(0), high(0) {
-    data.reserve(256); // 2 blocks of hash (128 bytes per one)
-    state[0] = 0x6a09e667f3bcc908;
-    state[1] = 0xbb67ae8584caa73b;
-    state[2] = 0x3c6ef372fe94f82b;
-    state[3] = 0xa54ff53a5f1d36f1;
-    state[4] = 0x510e527fade682d1;
-    state[5] = 0x9b05688c2b3e6c1f;
-    state[6] = 0x1f83d9abfb41bd6b;
-    state[7] = 0x5be0cd19137e2179;
-}
-
-void SHA512::_update(const uint64_t* data) {
-    uint64_t A = state[0];
-    uint64_t B = state[1];
-    uint64_t C = state[2];
-    uint64_t D = state[3];
-    uint64_t E = state[4];
-    uint64_t F = state[5];
-    uint64_t G = state[6];
-    uint64_t H = state[7];
-
-    for (int x = 0; x < 16; ++x) {
-        W[x] = bigEndian(data[x]);
-    }
-
-    for (int x = 16; x < 80; ++x) {
-        uint64_t s0 = rightRotate(W[x - 15], 1) ^ rightRotate(W[x - 15], 8) ^ (W[x - 15] >> 7);
-        uint64_t s1 = rightRotate(W[x - 2], 19) ^ rightRotate(W[x - 2], 61) ^ (W[x - 2] >> 6);
-        W[x] = W[x - 16] + s0 + W[x - 7] + s1;
-    }
-
-    uint64_t s0, s1;
-    uint64_t maj;
-    uint64_t t1, t2;
-    uint64_t ch;
-
-    for (int n = 0; n < 80; ++n) {
-        s0 = rightRotate(A, 28) ^ rightRotate(A, 34) ^ rightRotate(A, 39);
-        maj = (A & B) ^ (A & C) ^ (B & C);
-        t2 = s0 + maj;
-        s1 = rightRotate(E, 14) ^ rightRotate(E, 18) ^ rightRotate(E, 41);
-        ch = (E & F) ^ ((~E) & G);
-        t1 = H + s1 + ch + sha512Table[n] + W[n];
-
-        H = G;
-        G = F;
-        F = E;
-        E = D + t1;
-        D = C;
-        C = B;
-        B = A;
-        A = t1 + t2;
-    }
-    state[0] += A;
-    state[1] += B;
-    state[2] += C;
-    state[3] += D;
-    state[4] += E;
-    state[5] += F;
-    state[6] += G;
-    state[7] += H;
+    : low(0), high(0), length(0) {
+    std::copy_n(sha512IV, 8, state);
 }
 
 void SHA512::update(const void* ptr, size_t length) {
-    const uint8_t* data = reinterpret_cast<const uint8_t*>(ptr);
-
     uint64_t low = this->low + (uint64_t(length) << 3);
     if (low < this->low) // overflow
         this->high += 1;
+    this->high += uint64_t(length) >> 61;
     this->low = low;
 
-    size_t start = 0;
-    while (start < length) {
-        size_t offset = std::min(length - start, size_t(128));
-        size_t range = start + offset;
-        this->data.insert(this->data.end(), &data[start], &data[range]);
-
-        while (this->data.size() >= 64) {
-            _update(reinterpret_cast<const uint64_t*>(this->data.data()));
-            this->data.erase(this->data.begin(), this->data.begin() + 128);
-        }
-        start = range;
-    }
+    updateBlocks<128>(state, buffer, this->length, sha512BlocksPortable,
+                      reinterpret_cast<const uint8_t*>(ptr), length);
 }
 
 SHA512::Digest SHA512::finalize() {
-    FVASSERT_DEBUG(this->data.size() < 128);
-    this->data.push_back(0x80);
-    if (this->data.size() > 112) {
-        while (this->data.size() < 240)
-            this->data.push_back(0);
-    } else {
-        while (this->data.size() < 112)
-            this->data.push_back(0);
-    }
-
-    uint64_t high = this->high;
-    for (int i = 0; i < 8; ++i) {
-        this->data.push_back(uint8_t((high >> ((7 - i) * 8)) & 0xff));
-    }
-    uint64_t low = this->low;
-    for (int i = 0; i < 8; ++i) {
-        this->data.push_back(uint8_t((low >> ((7 - i) * 8)) & 0xff));
-    }
-    FVASSERT_DEBUG(this->data.size() % 128 == 0); // 128 or 256 (1~2 pass)
-
-    while (this->data.size() >= 128) {
-        _update(reinterpret_cast<const uint64_t*>(this->data.data()));
-        this->data.erase(this->data.begin(), this->data.begin() + 128);
-    }
-    FVASSERT_DEBUG(this->data.empty());
-
+    uint8_t padded[256];
+    size_t blocks = paddingBlocks<128>(padded, buffer, length, high, low);
+    sha512BlocksPortable(state, padded, blocks);
+    length = 0;
     return *reinterpret_cast<Digest*>(&state);
 }
 
@@ -477,15 +1507,14 @@ SHA512::Digest SHA512::hash(const void* data, size_t size) {
     return hash.finalize();
 }
 
+void SHA512::hash(std::span<const std::span<const uint8_t>> messages, Digest* digests) {
+    sha512Each(sha512IV, messages, [digests](size_t index, const uint64_t* state) {
+        std::copy_n(state, 8, digests[index].hash);
+    });
+}
+
 SHA224::SHA224() {
-    _hash.state[0] = 0xc1059ed8;
-    _hash.state[1] = 0x367cd507;
-    _hash.state[2] = 0x3070dd17;
-    _hash.state[3] = 0xf70e5939;
-    _hash.state[4] = 0xffc00b31;
-    _hash.state[5] = 0x68581511;
-    _hash.state[6] = 0x64f98fa7;
-    _hash.state[7] = 0xbefa4fa4;
+    std::copy_n(sha224IV, 8, _hash.state);
 }
 
 void SHA224::update(const void* data, size_t size) {
@@ -503,15 +1532,14 @@ SHA224::Digest SHA224::hash(const void* data, size_t size) {
     return hash.finalize();
 }
 
+void SHA224::hash(std::span<const std::span<const uint8_t>> messages, Digest* digests) {
+    sha256Each(sha224IV, messages, [digests](size_t index, const uint32_t* state) {
+        std::copy_n(state, 7, digests[index].hash);
+    });
+}
+
 SHA384::SHA384() {
-    _hash.state[0] = 0xcbbb9d5dc1059ed8;
-    _hash.state[1] = 0x629a292a367cd507;
-    _hash.state[2] = 0x9159015a3070dd17;
-    _hash.state[3] = 0x152fecd8f70e5939;
-    _hash.state[4] = 0x67332667ffc00b31;
-    _hash.state[5] = 0x8eb44a8768581511;
-    _hash.state[6] = 0xdb0c2e0d64f98fa7;
-    _hash.state[7] = 0x47b5481dbefa4fa4;
+    std::copy_n(sha384IV, 8, _hash.state);
 }
 
 void SHA384::update(const void* data, size_t size) {
@@ -528,3 +1556,75 @@ SHA384::Digest SHA384::hash(const void* data, size_t size) {
     hash.update(data, size);
     return hash.finalize();
 }
+
+void SHA384::hash(std::span<const std::span<const uint8_t>> messages, Digest* digests) {
+    sha512Each(sha384IV, messages, [digests](size_t index, const uint64_t* state) {
+        std::copy_n(state, 6, digests[index].hash);
+    });
+}
+
+XXH3::XXH3(uint64_t seed) {
+    xxh3Reset(state, seed);
+}
+
+void XXH3::update(const void* data, size_t size) {
+    xxh3Update(state, reinterpret_cast<const uint8_t*>(data), size);
+}
+
+XXH3::Digest XXH3::finalize() const {
+    if (state.totalLength <= _XXH3::midSizeMax)
+        return { _XXH3::hash64Short(state.buffer, size_t(state.totalLength), state.seed) };
+
+    alignas(32) uint64_t acc[8];
+    xxh3FinalizeLong(state, acc);
+    return { _XXH3::mergeAccumulators(acc, state.secret + 11, state.totalLength * _XXH3::prime64_1) };
+}
+
+XXH3::Digest XXH3::hash(const void* data, size_t size, uint64_t seed) {
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
+    if (size <= _XXH3::midSizeMax)
+        return { _XXH3::hash64Short(p, size, seed) };
+
+    alignas(32) uint8_t custom[_XXH3::secretSize];
+    const uint8_t* secret = _XXH3::secret;
+    if (seed) {
+        _XXH3::initSecret(custom, seed);
+        secret = custom;
+    }
+    alignas(32) uint64_t acc[8];
+    xxh3HashLong(acc, p, size, secret);
+    return { _XXH3::mergeAccumulators(acc, secret + 11, size * _XXH3::prime64_1) };
+}
+
+XXH3_128::XXH3_128(uint64_t seed) {
+    xxh3Reset(state, seed);
+}
+
+void XXH3_128::update(const void* data, size_t size) {
+    xxh3Update(state, reinterpret_cast<const uint8_t*>(data), size);
+}
+
+XXH3_128::Digest XXH3_128::finalize() const {
+    if (state.totalLength <= _XXH3::midSizeMax)
+        return xxh3Hash128Short(state.buffer, size_t(state.totalLength), state.seed);
+
+    alignas(32) uint64_t acc[8];
+    xxh3FinalizeLong(state, acc);
+    return xxh3Merge128(acc, state.secret, state.totalLength);
+}
+
+XXH3_128::Digest XXH3_128::hash(const void* data, size_t size, uint64_t seed) {
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
+    if (size <= _XXH3::midSizeMax)
+        return xxh3Hash128Short(p, size, seed);
+
+    alignas(32) uint8_t custom[_XXH3::secretSize];
+    const uint8_t* secret = _XXH3::secret;
+    if (seed) {
+        _XXH3::initSecret(custom, seed);
+        secret = custom;
+    }
+    alignas(32) uint64_t acc[8];
+    xxh3HashLong(acc, p, size, secret);
+    return xxh3Merge128(acc, secret, size);
+}
@@ -1,6 +1,13 @@
 #pragma once
 #include "../include.h"
 #include <vector>
+#include <span>
+#include <string_view>
+#include <bit>
+#include <cstring>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
 
 namespace FV {
     struct CRC32Digest {
@@ -59,9 +66,27 @@ namespace FV {
         }
     };
 
-    struct _Hash32 {
+    struct XXH3Digest {
+        uint64_t hash;
+        std::string string() {
+            return std::format("{:016x}", hash);
+        }
+        bool operator == (const XXH3Digest&) const = default;
+    };
+
+    struct XXH3_128Digest {
         uint64_t low;
-        std::vector<uint8_t> data;
+        uint64_t high;
+        std::string string() {
+            return std::format("{:016x}{:016x}", high, low);
+        }
+        bool operator == (const XXH3_128Digest&) const = default;
+    };
+
+    struct _Hash32 {
+        uint64_t low;           // message length in bits
+        uint32_t length;        // bytes in buffer
+        uint8_t buffer[64];
     };
 
     struct FVCORE_API CRC32 {
@@ -72,6 +97,9 @@ namespace FV {
         Digest finalize();
 
         static Digest hash(const void* data, size_t size);
+        // CRC of the concatenation of two blocks, from their CRCs and the
+        // length of the second one. Blocks can be hashed in parallel.
+        static Digest combine(Digest first, Digest second, uint64_t secondLength);
     private:
         uint32_t state;
     };
@@ -84,10 +112,11 @@ namespace FV {
         Digest finalize();
 
         static Digest hash(const void* data, size_t size);
+        // Hashes independent messages together, several per compression
+        // pass where the CPU allows it. digests[i] is hash(messages[i]).
+        static void hash(std::span<const std::span<const uint8_t>> messages, Digest* digests);
     private:
-        void _update(const uint32_t*);
         uint32_t state[5];
-        uint32_t W[80];
         _Hash32 _hash;
     };
 
@@ -99,10 +128,9 @@ namespace FV {
         Digest finalize();
 
         static Digest hash(const void* data, size_t size);
+        static void hash(std::span<const std::span<const uint8_t>> messages, Digest* digests);
     private:
-        void _update(const uint32_t*);
         uint32_t state[8];
-        uint32_t W[64];
         _Hash32 _hash;
         friend struct SHA224;
     };
@@ -115,13 +143,13 @@ namespace FV {
         Digest finalize();
 
         static Digest hash(const void* data, size_t size);
+        static void hash(std::span<const std::span<const uint8_t>> messages, Digest* digests);
     private:
-        void _update(const uint64_t*);
         uint64_t low;
         uint64_t high;
-        uint64_t W[80];
         uint64_t state[8];
-        std::vector<uint8_t> data;
+        uint32_t length;        // bytes in buffer
+        uint8_t buffer[128];
         friend struct SHA384;
     };
 
@@ -133,6 +161,7 @@ namespace FV {
         Digest finalize();
 
         static Digest hash(const void* data, size_t size);
+        static void hash(std::span<const std::span<const uint8_t>> messages, Digest* digests);
     private:
         SHA256 _hash;
     };
@@ -145,7 +174,318 @@ namespace FV {
         Digest finalize();
 
         static Digest hash(const void* data, size_t size);
+        static void hash(std::span<const std::span<const uint8_t>> messages, Digest* digests);
     private:
         SHA512 _hash;
     };
+
+    // XXH3 primitives. The short-input path and a scalar long-input path
+    // are constexpr, so keys can be hashed at compile time; at run time
+    // XXH3::hash uses SIMD for inputs longer than 240 bytes.
+    namespace _XXH3 {
+        constexpr uint64_t prime32_1 = 0x9E3779B1U;
+        constexpr uint64_t prime32_2 = 0x85EBCA77U;
+        constexpr uint64_t prime32_3 = 0xC2B2AE3DU;
+        constexpr uint64_t prime64_1 = 0x9E3779B185EBCA87ULL;
+        constexpr uint64_t prime64_2 = 0xC2B2AE3D27D4EB4FULL;
+        constexpr uint64_t prime64_3 = 0x165667B19E3779F9ULL;
+        constexpr uint64_t prime64_4 = 0x85EBCA77C2B2AE63ULL;
+        constexpr uint64_t prime64_5 = 0x27D4EB2F165667C5ULL;
+        constexpr uint64_t primeMX1 = 0x165667919E3779F9ULL;
+        constexpr uint64_t primeMX2 = 0x9FB21C651E98DF25ULL;
+
+        constexpr size_t secretSize = 192;
+        constexpr size_t stripeLength = 64;
+        constexpr size_t midSizeMax = 240;
+
+        alignas(64) constexpr uint8_t secret[secretSize] = {
+            0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+            0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+            0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+            0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+            0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+            0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+            0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+            0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+            0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+            0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+            0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+            0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+        };
+
+        // little-endian loads, Byte is char or uint8_t.
+        template <typename Byte>
+        constexpr uint32_t read32(const Byte* p) {
+            if (std::is_constant_evaluated() || std::endian::native != std::endian::little) {
+                return uint32_t(uint8_t(p[0])) | uint32_t(uint8_t(p[1])) << 8 |
+                       uint32_t(uint8_t(p[2])) << 16 | uint32_t(uint8_t(p[3])) << 24;
+            }
+            uint32_t v;
+            memcpy(&v, p, sizeof(v));
+            return v;
+        }
+        template <typename Byte>
+        constexpr uint64_t read64(const Byte* p) {
+            if (std::is_constant_evaluated() || std::endian::native != std::endian::little) {
+                return uint64_t(read32(p)) | uint64_t(read32(p + 4)) << 32;
+            }
+            uint64_t v;
+            memcpy(&v, p, sizeof(v));
+            return v;
+        }
+
+        constexpr uint32_t swap32(uint32_t x) {
+            return ((x << 24) & 0xff000000) | ((x << 8) & 0x00ff0000) |
+                   ((x >> 8) & 0x0000ff00) | ((x >> 24) & 0x000000ff);
+        }
+        constexpr uint64_t swap64(uint64_t x) {
+            return uint64_t(swap32(uint32_t(x))) << 32 | swap32(uint32_t(x >> 32));
+        }
+
+        struct UInt128 {
+            uint64_t low;
+            uint64_t high;
+        };
+        constexpr UInt128 multiply128(uint64_t a, uint64_t b) {
+            if (!std::is_constant_evaluated()) {
+#if defined(__SIZEOF_INT128__)
+                __uint128_t p = __uint128_t(a) * b;
+                return { uint64_t(p), uint64_t(p >> 64) };
+#elif defined(_MSC_VER) && defined(_M_X64)
+                uint64_t high = 0;
+                uint64_t low = _umul128(a, b, &high);
+                return { low, high };
+#elif defined(_MSC_VER) && defined(_M_ARM64)
+                return { a * b, __umulh(a, b) };
+#endif
+            }
+            uint64_t lolo = (a & 0xffffffff) * (b & 0xffffffff);
+            uint64_t hilo = (a >> 32) * (b & 0xffffffff);
+            uint64_t lohi = (a & 0xffffffff) * (b >> 32);
+            uint64_t hihi = (a >> 32) * (b >> 32);
+            uint64_t cross = (lolo >> 32) + (hilo & 0xffffffff) + lohi;
+            uint64_t upper = (hilo >> 32) + (cross >> 32) + hihi;
+            uint64_t lower = (cross << 32) | (lolo & 0xffffffff);
+            return { lower, upper };
+        }
+        constexpr uint64_t multiplyFold64(uint64_t a, uint64_t b) {
+            UInt128 p = multiply128(a, b);
+            return p.low ^ p.high;
+        }
+
+        constexpr uint64_t xxh64Avalanche(uint64_t h) {
+            h ^= h >> 33;
+            h *= prime64_2;
+            h ^= h >> 29;
+            h *= prime64_3;
+            return h ^ (h >> 32);
+        }
+        constexpr uint64_t avalanche(uint64_t h) {
+            h ^= h >> 37;
+            h *= primeMX1;
+            return h ^ (h >> 32);
+        }
+        constexpr uint64_t rrmxmx(uint64_t h, uint64_t length) {
+            h ^= std::rotl(h, 49) ^ std::rotl(h, 24);
+            h *= primeMX2;
+            h ^= (h >> 35) + length;
+            h *= primeMX2;
+            return h ^ (h >> 28);
+        }
+
+        template <typename Byte>
+        constexpr uint64_t mix16B(const Byte* p, const uint8_t* s, uint64_t seed) {
+            return multiplyFold64(read64(p) ^ (read64(s) + seed),
+                                  read64(p + 8) ^ (read64(s + 8) - seed));
+        }
+
+        // 64-bit hash of 0 to 240 bytes with the default secret.
+        template <typename Byte>
+        constexpr uint64_t hash64Short(const Byte* p, size_t length, uint64_t seed) {
+            const uint8_t* s = secret;
+            if (length <= 16) {
+                if (length > 8) {
+                    uint64_t bitflip1 = (read64(s + 24) ^ read64(s + 32)) + seed;
+                    uint64_t bitflip2 = (read64(s + 40) ^ read64(s + 48)) - seed;
+                    uint64_t low = read64(p) ^ bitflip1;
+                    uint64_t high = read64(p + length - 8) ^ bitflip2;
+                    uint64_t acc = length + swap64(low) + high + multiplyFold64(low, high);
+                    return avalanche(acc);
+                }
+                if (length >= 4) {
+                    seed ^= uint64_t(swap32(uint32_t(seed))) << 32;
+                    uint64_t bitflip = (read64(s + 8) ^ read64(s + 16)) - seed;
+                    uint64_t input = read32(p + length - 4) + (uint64_t(read32(p)) << 32);
+                    return rrmxmx(input ^ bitflip, length);
+                }
+                if (length > 0) {
+                    uint32_t combined = uint32_t(uint8_t(p[0])) << 16 | uint32_t(uint8_t(p[length >> 1])) << 24 |
+                                        uint32_t(uint8_t(p[length - 1])) | uint32_t(length) << 8;
+                    uint64_t bitflip = (read32(s) ^ read32(s + 4)) + seed;
+                    return xxh64Avalanche(uint64_t(combined) ^ bitflip);
+                }
+                return xxh64Avalanche(seed ^ (read64(s + 56) ^ read64(s + 64)));
+            }
+            uint64_t acc = length * prime64_1;
+            if (length <= 128) {
+                if (length > 32) {
+                    if (length > 64) {
+                        if (length > 96) {
+                            acc += mix16B(p + 48, s + 96, seed);
+                            acc += mix16B(p + length - 64, s + 112, seed);
+                        }
+                        acc += mix16B(p + 32, s + 64, seed);
+                        acc += mix16B(p + length - 48, s + 80, seed);
+                    }
+                    acc += mix16B(p + 16, s + 32, seed);
+                    acc += mix16B(p + length - 32, s + 48, seed);
+                }
+                acc += mix16B(p, s, seed);
+                acc += mix16B(p + length - 16, s + 16, seed);
+                return avalanche(acc);
+            }
+            for (size_t i = 0; i < 8; ++i)
+                acc += mix16B(p + 16 * i, s + 16 * i, seed);
+            acc = avalanche(acc);
+            for (size_t i = 8; i < length / 16; ++i)
+                acc += mix16B(p + 16 * i, s + 16 * (i - 8) + 3, seed);
+            acc += mix16B(p + length - 16, s + 136 - 17, seed);
+            return avalanche(acc);
+        }
+
+        constexpr void initAccumulators(uint64_t* acc) {
+            acc[0] = prime32_3; acc[1] = prime64_1; acc[2] = prime64_2; acc[3] = prime64_3;
+            acc[4] = prime64_4; acc[5] = prime32_2; acc[6] = prime64_5; acc[7] = prime32_1;
+        }
+        // secret for a non-zero seed, used for inputs longer than 240 bytes.
+        constexpr void initSecret(uint8_t* custom, uint64_t seed) {
+            for (size_t i = 0; i < secretSize; i += 16) {
+                uint64_t low = read64(secret + i) + seed;
+                uint64_t high = read64(secret + i + 8) - seed;
+                for (int n = 0; n < 8; ++n) {
+                    custom[i + n] = uint8_t(low >> (n * 8));
+                    custom[i + 8 + n] = uint8_t(high >> (n * 8));
+                }
+            }
+        }
+        template <typename Byte>
+        constexpr void accumulate512(uint64_t* acc, const Byte* p, const uint8_t* s) {
+            for (int i = 0; i < 8; ++i) {
+                uint64_t data = read64(p + 8 * i);
+                uint64_t key = data ^ read64(s + 8 * i);
+                acc[i ^ 1] += data;
+                acc[i] += (key & 0xffffffff) * (key >> 32);
+            }
+        }
+        constexpr void scramble(uint64_t* acc, const uint8_t* s) {
+            for (int i = 0; i < 8; ++i) {
+                uint64_t a = acc[i];
+                a ^= a >> 47;
+                a ^= read64(s + 8 * i);
+                acc[i] = a * prime32_1;
+            }
+        }
+        constexpr uint64_t mergeAccumulators(const uint64_t* acc, const uint8_t* s, uint64_t start) {
+            uint64_t result = start;
+            for (int i = 0; i < 4; ++i)
+                result += multiplyFold64(acc[2 * i] ^ read64(s + 16 * i), acc[2 * i + 1] ^ read64(s + 16 * i + 8));
+            return avalanche(result);
+        }
+
+        // 64-bit hash of any length without SIMD.
+        template <typename Byte>
+        constexpr uint64_t hash64(const Byte* p, size_t length, uint64_t seed) {
+            if (length <= midSizeMax)
+                return hash64Short(p, length, seed);
+
+            uint8_t custom[secretSize] = {};
+            initSecret(custom, seed);
+            uint64_t acc[8] = {};
+            initAccumulators(acc);
+
+            constexpr size_t stripesPerBlock = (secretSize - stripeLength) / 8;
+            constexpr size_t blockLength = stripeLength * stripesPerBlock;
+            const size_t blocks = (length - 1) / blockLength;
+            for (size_t n = 0; n < blocks; ++n) {
+                for (size_t i = 0; i < stripesPerBlock; ++i)
+                    accumulate512(acc, p + n * blockLength + i * stripeLength, custom + i * 8);
+                scramble(acc, custom + secretSize - stripeLength);
+            }
+            const size_t stripes = ((length - 1) - blockLength * blocks) / stripeLength;
+            for (size_t i = 0; i < stripes; ++i)
+                accumulate512(acc, p + blocks * blockLength + i * stripeLength, custom + i * 8);
+            accumulate512(acc, p + length - stripeLength, custom + secretSize - stripeLength - 7);
+            return mergeAccumulators(acc, custom + 11, length * prime64_1);
+        }
+    }
+
+    struct _XXH3State {
+        alignas(32) uint64_t acc[8];
+        alignas(32) uint8_t secret[_XXH3::secretSize];
+        alignas(32) uint8_t buffer[256];
+        uint64_t totalLength;
+        uint64_t seed;
+        uint32_t bufferedSize;
+        uint32_t stripesSoFar;
+    };
+
+    // XXH3 64-bit, compatible with the reference implementation.
+    // Not cryptographic: use it for hash tables, cache keys and content
+    // addressing, use SHA where collisions must be hard to produce.
+    struct FVCORE_API XXH3 {
+        using Digest = XXH3Digest;
+
+        XXH3(uint64_t seed = 0);
+        void update(const void* data, size_t size);
+        Digest finalize() const;
+
+        static Digest hash(const void* data, size_t size, uint64_t seed = 0);
+        static constexpr Digest hash(std::string_view key, uint64_t seed = 0) {
+            if (std::is_constant_evaluated() || key.size() <= _XXH3::midSizeMax)
+                return { _XXH3::hash64(key.data(), key.size(), seed) };
+            return hash(key.data(), key.size(), seed);
+        }
+    private:
+        _XXH3State state;
+    };
+
+    struct FVCORE_API XXH3_128 {
+        using Digest = XXH3_128Digest;
+
+        XXH3_128(uint64_t seed = 0);
+        void update(const void* data, size_t size);
+        Digest finalize() const;
+
+        static Digest hash(const void* data, size_t size, uint64_t seed = 0);
+    private:
+        _XXH3State state;
+    };
+
+    // Hash functor for unordered containers, for strings, byte spans and
+    // types without padding bits.
+    struct XXH3Hasher {
+        size_t operator () (std::string_view key) const {
+            return size_t(XXH3::hash(key).hash);
+        }
+        size_t operator () (std::span<const uint8_t> key) const {
+            return size_t(XXH3::hash(key.data(), key.size()).hash);
+        }
+        template <typename T> requires std::has_unique_object_representations_v<T>
+        size_t operator () (const T& key) const {
+            return size_t(XXH3::hash(&key, sizeof(T)).hash);
+        }
+    };
+}
+
+namespace std {
+    template <> struct hash<FV::XXH3Digest> {
+        size_t operator()(const FV::XXH3Digest& digest) const {
+            return size_t(digest.hash);
+        }
+    };
+    template <> struct hash<FV::XXH3_128Digest> {
+        size_t operator()(const FV::XXH3_128Digest& digest) const {
+            return size_t(digest.low);
+        }
+    };
 }
@@ -11,6 +11,8 @@
 #include "Logger.h"
 #include "GraphicsDevice.h"
 #include "Float16.h"
+#include "CompressedImage.h"
+#include "Private/CPUFeatures.h"
 
 namespace {
     std::vector<uint8_t> ifstreamVector(const std::filesystem::path& path) {
@@ -102,6 +104,149 @@ namespace {
     inline double ufloatToDouble(uint32_t value) {
         return ufloatToDouble<E, M>(value >> M, value);
     }
+
+    // Pixel conversion kernels, used for pixel-format conversion without
+    // resizing. Each kernel converts 'count' pixels in one pass, instead of
+    // the generic per-pixel read/write path through RawColorValue.
+    template <typename T> requires std::is_arithmetic_v<T>
+    constexpr T componentMaxValue() {
+        if constexpr (std::is_floating_point_v<T>)
+            return T(1);
+        else
+            return std::numeric_limits<T>::max();
+    }
+
+    // S = source component type, D = target component type
+    template <typename S, typename D>
+    FORCEINLINE D convertComponent(S value) {
+        constexpr auto maxS = componentMaxValue<S>();
+        constexpr auto maxD = componentMaxValue<D>();
+        if constexpr (std::is_same_v<S, D> && std::is_integral_v<S>) {
+            return value;
+        } else if constexpr (std::is_floating_point_v<S>) {
+            // saturate, NaN becomes zero. float to float too, as writePixel.
+            S v = value > S(0) ? (value < S(1) ? value : S(1)) : S(0);
+            if constexpr (std::is_floating_point_v<D>)
+                return D(v);
+            else if constexpr (sizeof(D) < 4)
+                return D(float(v) * float(maxD));
+            else
+                return D(double(v) * double(maxD));
+        } else if constexpr (std::is_floating_point_v<D>) {
+            if constexpr (sizeof(S) < 4)
+                return D(float(value) * (1.0f / float(maxS)));
+            else
+                return D(double(value) * (1.0 / double(maxS)));
+        } else if constexpr (sizeof(S) < sizeof(D)) {
+            // widening: 0xff -> 0xffff (x257), 0xff -> 0xffffffff (x16843009) ...
+            return D(D(value) * D(maxD / D(maxS)));
+        } else {
+            // narrowing: same as truncating (value / maxS * maxD)
+            return D(value / S(maxS / S(maxD)));
+        }
+    }
+
+    // SN, DN = number of components of the source and target pixels.
+    // Missing color components are filled with zero, missing alpha with one.
+    template <typename S, int SN, typename D, int DN>
+    void convertPixels(const void* source, void* target, size_t count) {
+        auto s = reinterpret_cast<const S*>(source);
+        auto d = reinterpret_cast<D*>(target);
+        for (size_t i = 0; i < count; ++i, s += SN, d += DN) {
+            for (int c = 0; c < DN; ++c) {
+                if (c < SN)
+                    d[c] = convertComponent<S, D>(s[c]);
+                else
+                    d[c] = (c == 3) ? componentMaxValue<D>() : D(0);
+            }
+        }
+    }
+
+    // float texels are clamped to [0, 1] like Image::writePixel.
+    template <int N>
+    void saturateFloatPixels(const void* source, void* target, size_t count) {
+        auto s = reinterpret_cast<const float*>(source);
+        auto d = reinterpret_cast<float*>(target);
+        for (size_t i = 0, n = count * N; i < n; ++i)
+            d[i] = s[i] > 0.0f ? (s[i] < 1.0f ? s[i] : 1.0f) : 0.0f;
+    }
+
+    // half-float texels are stored as uint16 normalized.
+    template <int N>
+    void convertFloat16Pixels(const void* source, void* target, size_t count) {
+        auto s = reinterpret_cast<const FV::Float16*>(source);
+        auto d = reinterpret_cast<uint16_t*>(target);
+        float buffer[256];
+        for (size_t i = 0, n = count * N; i < n; i += std::size(buffer)) {
+            size_t length = std::min(n - i, std::size(buffer));
+            FV::toFloat({ s + i, length }, { buffer, length });
+            for (size_t k = 0; k < length; ++k)
+                d[i + k] = convertComponent<float, uint16_t>(buffer[k]);
+        }
+    }
+
+    void swizzleBGRA8Pixels(const void* source, void* target, size_t count) {
+        auto s = reinterpret_cast<const uint8_t*>(source);
+        auto d = reinterpret_cast<uint8_t*>(target);
+        size_t i = 0;
+#if FVCORE_ARCH_ARM64
+        for (; i + 16 <= count; i += 16) {
+            uint8x16x4_t bgra = vld4q_u8(s + i * 4);
+            uint8x16x4_t rgba = { bgra.val[2], bgra.val[1], bgra.val[0], bgra.val[3] };
+            vst4q_u8(d + i * 4, rgba);
+        }
+#endif
+        for (; i < count; ++i) {
+            const uint8_t* p = s + i * 4;
+            uint8_t* q = d + i * 4;
+            uint8_t b = p[0], g = p[1], r = p[2], a = p[3];
+            q[0] = r; q[1] = g; q[2] = b; q[3] = a;
+        }
+    }
+
+#if FVCORE_ARCH_X86
+    FVCORE_TARGET("ssse3")
+    void swizzleBGRA8PixelsSSSE3(const void* source, void* target, size_t count) {
+        auto s = reinterpret_cast<const uint8_t*>(source);
+        auto d = reinterpret_cast<uint8_t*>(target);
+        const __m128i mask = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i * 4));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(d + i * 4), _mm_shuffle_epi8(v, mask));
+        }
+        swizzleBGRA8Pixels(s + i * 4, d + i * 4, count - i);
+    }
+
+    FVCORE_TARGET("ssse3")
+    void convertRGB8ToRGBA8PixelsSSSE3(const void* source, void* target, size_t count) {
+        auto s = reinterpret_cast<const uint8_t*>(source);
+        auto d = reinterpret_cast<uint8_t*>(target);
+        const __m128i mask = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+        const __m128i alpha = _mm_set1_epi32(int(0xff000000U));
+        size_t i = 0;
+        // each load reads 16 bytes but uses 12 (4 pixels),
+        // stop early so that the last load stays in bounds.
+        for (; i + 6 <= count; i += 4) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i * 3));
+            v = _mm_or_si128(_mm_shuffle_epi8(v, mask), alpha);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(d + i * 4), v);
+        }
+        convertPixels<uint8_t, 3, uint8_t, 4>(s + i * 3, d + i * 4, count - i);
+    }
+#elif FVCORE_ARCH_ARM64
+    void convertRGB8ToRGBA8PixelsNEON(const void* source, void* target, size_t count) {
+        auto s = reinterpret_cast<const uint8_t*>(source);
+        auto d = reinterpret_cast<uint8_t*>(target);
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16) {
+            uint8x16x3_t rgb = vld3q_u8(s + i * 3);
+            uint8x16x4_t rgba = { rgb.val[0], rgb.val[1], rgb.val[2], vdupq_n_u8(0xff) };
+            vst4q_u8(d + i * 4, rgba);
+        }
+        convertPixels<uint8_t, 3, uint8_t, 4>(s + i * 3, d + i * 4, count - i);
+    }
+#endif
 }
 
 namespace FV {
@@ -156,6 +301,149 @@ namespace FV {
         }
         return writePixel;
     }
+
+    using ConvertFunction = void (*)(const void*, void*, size_t);
+    template <typename S, int SN>
+    ConvertFunction getConvertFunction(ImagePixelFormat target) {
+        ConvertFunction convert = nullptr;
+        switch (target) {
+        case ImagePixelFormat::R8:      convert = convertPixels<S, SN, uint8_t, 1>;     break;
+        case ImagePixelFormat::RG8:     convert = convertPixels<S, SN, uint8_t, 2>;     break;
+        case ImagePixelFormat::RGB8:    convert = convertPixels<S, SN, uint8_t, 3>;     break;
+        case ImagePixelFormat::RGBA8:   convert = convertPixels<S, SN, uint8_t, 4>;     break;
+        case ImagePixelFormat::R16:     convert = convertPixels<S, SN, uint16_t, 1>;    break;
+        case ImagePixelFormat::RG16:    convert = convertPixels<S, SN, uint16_t, 2>;    break;
+        case ImagePixelFormat::RGB16:   convert = convertPixels<S, SN, uint16_t, 3>;    break;
+        case ImagePixelFormat::RGBA16:  convert = convertPixels<S, SN, uint16_t, 4>;    break;
+        case ImagePixelFormat::R32:     convert = convertPixels<S, SN, uint32_t, 1>;    break;
+        case ImagePixelFormat::RG32:    convert = convertPixels<S, SN, uint32_t, 2>;    break;
+        case ImagePixelFormat::RGB32:   convert = convertPixels<S, SN, uint32_t, 3>;    break;
+        case ImagePixelFormat::RGBA32:  convert = convertPixels<S, SN, uint32_t, 4>;    break;
+        case ImagePixelFormat::R32F:    convert = convertPixels<S, SN, float, 1>;       break;
+        case ImagePixelFormat::RG32F:   convert = convertPixels<S, SN, float, 2>;       break;
+        case ImagePixelFormat::RGB32F:  convert = convertPixels<S, SN, float, 3>;       break;
+        case ImagePixelFormat::RGBA32F: convert = convertPixels<S, SN, float, 4>;       break;
+        }
+        return convert;
+    }
+
+    ConvertFunction getConvertFunction(ImagePixelFormat source, ImagePixelFormat target) {
+        if (source == ImagePixelFormat::RGB8 && target == ImagePixelFormat::RGBA8) {
+#if FVCORE_ARCH_X86
+            if (CPUFeatures::current().ssse3)
+                return convertRGB8ToRGBA8PixelsSSSE3;
+#elif FVCORE_ARCH_ARM64
+            return convertRGB8ToRGBA8PixelsNEON;
+#endif
+        }
+        ConvertFunction convert = nullptr;
+        switch (source) {
+        case ImagePixelFormat::R8:      convert = getConvertFunction<uint8_t, 1>(target);   break;
+        case ImagePixelFormat::RG8:     convert = getConvertFunction<uint8_t, 2>(target);   break;
+        case ImagePixelFormat::RGB8:    convert = getConvertFunction<uint8_t, 3>(target);   break;
+        case ImagePixelFormat::RGBA8:   convert = getConvertFunction<uint8_t, 4>(target);   break;
+        case ImagePixelFormat::R16:     convert = getConvertFunction<uint16_t, 1>(target);  break;
+        case ImagePixelFormat::RG16:    convert = getConvertFunction<uint16_t, 2>(target);  break;
+        case ImagePixelFormat::RGB16:   convert = getConvertFunction<uint16_t, 3>(target);  break;
+        case ImagePixelFormat::RGBA16:  convert = getConvertFunction<uint16_t, 4>(target);  break;
+        case ImagePixelFormat::R32:     convert = getConvertFunction<uint32_t, 1>(target);  break;
+        case ImagePixelFormat::RG32:    convert = getConvertFunction<uint32_t, 2>(target);  break;
+        case ImagePixelFormat::RGB32:   convert = getConvertFunction<uint32_t, 3>(target);  break;
+        case ImagePixelFormat::RGBA32:  convert = getConvertFunction<uint32_t, 4>(target);  break;
+        case ImagePixelFormat::R32F:    convert = getConvertFunction<float, 1>(target);     break;
+        case ImagePixelFormat::RG32F:   convert = getConvertFunction<float, 2>(target);     break;
+        case ImagePixelFormat::RGB32F:  convert = getConvertFunction<float, 3>(target);     break;
+        case ImagePixelFormat::RGBA32F: convert = getConvertFunction<float, 4>(target);     break;
+        }
+        return convert;
+    }
+
+    // Texture formats that have the same memory layout as (or a single
+    // kernel conversion to) an image pixel format.
+    ConvertFunction getConvertFunction(PixelFormat source, ImagePixelFormat& target) {
+        ConvertFunction convert = nullptr;
+        switch (source) {
+        case PixelFormat::R8Unorm:
+        case PixelFormat::R8Uint:
+            target = ImagePixelFormat::R8;
+            convert = convertPixels<uint8_t, 1, uint8_t, 1>;
+            break;
+        case PixelFormat::RG8Unorm:
+        case PixelFormat::RG8Uint:
+            target = ImagePixelFormat::RG8;
+            convert = convertPixels<uint8_t, 2, uint8_t, 2>;
+            break;
+        case PixelFormat::RGBA8Unorm:
+        case PixelFormat::RGBA8Unorm_srgb:
+        case PixelFormat::RGBA8Uint:
+            target = ImagePixelFormat::RGBA8;
+            convert = convertPixels<uint8_t, 4, uint8_t, 4>;
+            break;
+        case PixelFormat::BGRA8Unorm:
+        case PixelFormat::BGRA8Unorm_srgb:
+            target = ImagePixelFormat::RGBA8;
+            convert = swizzleBGRA8Pixels;
+#if FVCORE_ARCH_X86
+            if (CPUFeatures::current().ssse3)
+                convert = swizzleBGRA8PixelsSSSE3;
+#endif
+            break;
+        case PixelFormat::R16Unorm:
+        case PixelFormat::R16Uint:
+            target = ImagePixelFormat::R16;
+            convert = convertPixels<uint16_t, 1, uint16_t, 1>;
+            break;
+        case PixelFormat::RG16Unorm:
+        case PixelFormat::RG16Uint:
+            target = ImagePixelFormat::RG16;
+            convert = convertPixels<uint16_t, 2, uint16_t, 2>;
+            break;
+        case PixelFormat::RGBA16Unorm:
+        case PixelFormat::RGBA16Uint:
+            target = ImagePixelFormat::RGBA16;
+            convert = convertPixels<uint16_t, 4, uint16_t, 4>;
+            break;
+        case PixelFormat::R16Float:
+            target = ImagePixelFormat::R16;
+            convert = convertFloat16Pixels<1>;
+            break;
+        case PixelFormat::RG16Float:
+            target = ImagePixelFormat::RG16;
+            convert = convertFloat16Pixels<2>;
+            break;
+        case PixelFormat::RGBA16Float:
+            target = ImagePixelFormat::RGBA16;
+            convert = convertFloat16Pixels<4>;
+            break;
+        case PixelFormat::R32Uint:
+            target = ImagePixelFormat::R32;
+            convert = convertPixels<uint32_t, 1, uint32_t, 1>;
+            break;
+        case PixelFormat::RG32Uint:
+            target = ImagePixelFormat::RG32;
+            convert = convertPixels<uint32_t, 2, uint32_t, 2>;
+            break;
+        case PixelFormat::RGBA32Uint:
+            target = ImagePixelFormat::RGBA32;
+            convert = convertPixels<uint32_t, 4, uint32_t, 4>;
+            break;
+        case PixelFormat::R32Float:
+            target = ImagePixelFormat::R32F;
+            convert = saturateFloatPixels<1>;
+            break;
+        case PixelFormat::RG32Float:
+            target = ImagePixelFormat::RG32F;
+            convert = saturateFloatPixels<2>;
+            break;
+        case PixelFormat::RGBA32Float:
+            target = ImagePixelFormat::RGBA32F;
+            convert = saturateFloatPixels<4>;
+            break;
+        default:
+            break;
+        }
+        return convert;
+    }
 }
 
 using namespace FV;
@@ -275,10 +563,14 @@ std::shared_ptr<Image> Image::resample(uint32_t width, uint32_t height,
     FVASSERT_DEBUG(bufferLength == image->data.size());
 
     if (this->width == width && this->height == height) {
-        for (uint32_t ny = 0; ny < height; ++ny) {
-            for (uint32_t nx = 0; nx < width; ++nx) {
-                auto color = readPixel(nx, ny);
-                image->writePixel(nx, ny, color);
+        if (auto convert = getConvertFunction(this->pixelFormat, format)) {
+            convert(data.data(), image->data.data(), size_t(width) * size_t(height));
+        } else {
+            for (uint32_t ny = 0; ny < height; ++ny) {
+                for (uint32_t nx = 0; nx < width; ++nx) {
+                    auto color = readPixel(nx, ny);
+                    image->writePixel(nx, ny, color);
+                }
             }
         }
     } else {
@@ -510,6 +802,17 @@ std::shared_ptr<Texture> Image::makeTexture(CommandQueue* queue, uint32_t usage)
     if (queue == nullptr)
         return nullptr;
 
+    auto uploads = queue->uploadManager();
+    auto texture = makeTexture(uploads, usage);
+    if (texture)
+        uploads->flush();
+    return texture;
+}
+
+std::shared_ptr<Texture> Image::makeTexture(UploadManager* uploads, uint32_t usage) const {
+    if (uploads == nullptr)
+        return nullptr;
+
     PixelFormat textureFormat = PixelFormat::Invalid;
     ImagePixelFormat imageFormat = this->pixelFormat;
 
@@ -567,13 +870,20 @@ std::shared_ptr<Texture> Image::makeTexture(CommandQueue* queue, uint32_t usage)
         Log::error("Invalid pixel format");
         return nullptr;
     }
+    // RGB formats are expanded to RGBA while copying into the staging buffer.
+    ConvertFunction convert = nullptr;
     if (imageFormat != this->pixelFormat) {
-        if (auto image = resample(imageFormat))
-            return image->makeTexture(queue);
-        return nullptr;
+        convert = getConvertFunction(this->pixelFormat, imageFormat);
+        if (convert == nullptr) {
+            if (auto image = resample(imageFormat))
+                return image->makeTexture(uploads, usage);
+            return nullptr;
+        }
     }
+    const size_t bufferLength = size_t(DKImagePixelFormatBytesPerPixel((DKImagePixelFormat)imageFormat))
+                                * size_t(width) * size_t(height);
 
-    auto device = queue->device();
+    auto device = uploads->queue->device();
 
     // create texture
     auto texture = device->makeTexture(
@@ -588,47 +898,21 @@ std::shared_ptr<Texture> Image::makeTexture(CommandQueue* queue, uint32_t usage)
     if (texture == nullptr)
         return nullptr;
 
-    // create buffer for staging
-    auto stgBuffer = device->makeBuffer(data.size(),
-                                        GPUBuffer::StorageModeShared,
-                                        CPUCacheModeWriteCombined);
-    if (stgBuffer == nullptr) {
-        Log::error("Failed to make buffer object.");
-        return nullptr;
-    }
-
-    auto p = stgBuffer->contents();
-    if (p == nullptr) {
-        Log::error("Buffer memory mapping failed.");
-        return nullptr;
-    }
-
-    memcpy(p, data.data(), data.size());
-    stgBuffer->flush();
-
-    auto commandBuffer = queue->makeCommandBuffer();
-    if (commandBuffer == nullptr) {
-        Log::error("Failed to make command buffer.");
-        return nullptr;
-    }
-
-    auto encoder = commandBuffer->makeCopyCommandEncoder();
-    if (encoder == nullptr) {
-        Log::error("Failed to make copy command encoder.");
+    bool staged = uploads->upload(bufferLength, [&](void* p) {
+        if (convert)
+            convert(data.data(), p, size_t(width) * size_t(height));
+        else
+            memcpy(p, data.data(), data.size());
+    }, texture, TextureOrigin{ 0 }, TextureSize{ width, height, 1 }, width, height);
+    if (staged == false)
         return nullptr;
-    }
-
-    encoder->copy(stgBuffer,
-                  BufferImageOrigin{ 0, width, height },
-                  texture,
-                  TextureOrigin{ 0 },
-                  TextureSize{ width, height, 1 });
-
-    encoder->endEncoding();
-    commandBuffer->commit();
     return texture;
 }
 
+std::shared_ptr<CompressedImage> Image::compress(PixelFormat format, ImageCompressionQuality quality) const {
+    return CompressedImage::encode(*this, format, quality);
+}
+
 std::shared_ptr<Image> Image::fromTextureBuffer(std::shared_ptr<GPUBuffer> buffer,
                                                 uint32_t width, uint32_t height,
                                                 PixelFormat pixelFormat) {
@@ -641,7 +925,34 @@ std::shared_ptr<Image> Image::fromTextureBuffer(std::shared_ptr<GPUBuffer> buffe
         return nullptr;
     }
 
+    if (isCompressedFormat(pixelFormat)) {
+        auto bufferLength = pixelFormatBufferLength(pixelFormat, width, height);
+        if (buffer->length() >= bufferLength) {
+            if (auto p = (const uint8_t*)buffer->contents()) {
+                auto image = CompressedImage(width, height, pixelFormat,
+                                             std::vector<uint8_t>(&p[0], &p[bufferLength]));
+                return image.decode();
+            }
+            Log::error("Buffer is not accessible!");
+        }
+        return nullptr;
+    }
+
     ImagePixelFormat imageFormat = ImagePixelFormat::Invalid;
+    if (auto convert = getConvertFunction(pixelFormat, imageFormat)) {
+        uint32_t bpp = pixelFormatBytesPerPixel(pixelFormat);
+        auto bufferLength = size_t(width) * size_t(height) * bpp;
+        if (buffer->length() >= bufferLength) {
+            if (auto p = buffer->contents()) {
+                auto image = std::make_shared<Image>(width, height, imageFormat);
+                convert(p, image->data.data(), size_t(width) * size_t(height));
+                return image;
+            }
+            Log::error("Buffer is not accessible!");
+        }
+        return nullptr;
+    }
+
     std::function<RawColorValue(const void*)> getPixel = nullptr;
     switch (pixelFormat) {
     case PixelFormat::R8Unorm:
@@ -931,3 +1242,36 @@ std::shared_ptr<Image> Image::fromTextureBuffer(std::shared_ptr<GPUBuffer> buffe
     }
     return nullptr;
 }
+
+std::shared_ptr<Image> Image::fromPixels(uint32_t width, uint32_t height,
+                                         uint32_t components, uint32_t bitsPerComponent,
+                                         const void* data, size_t length) {
+    constexpr ImagePixelFormat formats[4][3] = {
+        { ImagePixelFormat::R8, ImagePixelFormat::R16, ImagePixelFormat::R32 },
+        { ImagePixelFormat::RG8, ImagePixelFormat::RG16, ImagePixelFormat::RG32 },
+        { ImagePixelFormat::RGB8, ImagePixelFormat::RGB16, ImagePixelFormat::RGB32 },
+        { ImagePixelFormat::RGBA8, ImagePixelFormat::RGBA16, ImagePixelFormat::RGBA32 },
+    };
+    ImagePixelFormat imageFormat = ImagePixelFormat::Invalid;
+    if (components >= 1 && components <= 4) {
+        switch (bitsPerComponent) {
+        case 8:     imageFormat = formats[components - 1][0];   break;
+        case 16:    imageFormat = formats[components - 1][1];   break;
+        case 32:    imageFormat = formats[components - 1][2];   break;
+        }
+    }
+    if (imageFormat == ImagePixelFormat::Invalid) {
+        Log::error("Unsupported image pixel format.");
+        return nullptr;
+    }
+    if (width < 1 || height < 1) {
+        Log::error("Invalid image dimensions");
+        return nullptr;
+    }
+    size_t reqLength = size_t(bitsPerComponent >> 3) * width * height * components;
+    if (data == nullptr || length < reqLength) {
+        Log::error("invalid image pixel data.");
+        return nullptr;
+    }
+    return std::make_shared<Image>(width, height, imageFormat, data);
+}
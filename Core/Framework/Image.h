@@ -4,6 +4,7 @@
 #include <filesystem>
 #include "Texture.h"
 #include "CommandQueue.h"
+#include "UploadManager.h"
 #include "Rect.h"
 
 namespace FV {
@@ -43,6 +44,13 @@ namespace FV {
         Quadratic,
     };
 
+    enum class ImageCompressionQuality {
+        Fast,       // bounding-box endpoints
+        Normal,     // principal-axis endpoints
+        High,       // principal-axis endpoints with least-squares refinement
+    };
+
+    class CompressedImage;
     class FVCORE_API Image : public std::enable_shared_from_this<Image> {
     public:
         Image(uint32_t width, uint32_t height, ImagePixelFormat, const void* data = nullptr);
@@ -64,7 +72,14 @@ namespace FV {
         std::shared_ptr<Image> resample(uint32_t width, uint32_t height, ImagePixelFormat format, ImageInterpolation interpolation) const;
 
         std::shared_ptr<Texture> makeTexture(CommandQueue*, uint32_t usage = TextureUsageSampled) const;
+        // stages the pixels in the manager, the copy is committed by its next flush().
+        std::shared_ptr<Texture> makeTexture(UploadManager*, uint32_t usage = TextureUsageSampled) const;
+        std::shared_ptr<CompressedImage> compress(PixelFormat, ImageCompressionQuality = ImageCompressionQuality::Normal) const;
         static std::shared_ptr<Image> fromTextureBuffer(std::shared_ptr<GPUBuffer>, uint32_t width, uint32_t height, PixelFormat);
+        // pixels of 1 to 4 components of 8, 16 or 32 bits, as decoded by loaders.
+        static std::shared_ptr<Image> fromPixels(uint32_t width, uint32_t height,
+                                                 uint32_t components, uint32_t bitsPerComponent,
+                                                 const void* data, size_t length);
 
         struct Pixel { double r, g, b, a; };
         Pixel readPixel(uint32_t x, uint32_t y) const;
@@ -77,5 +92,6 @@ namespace FV {
 
         struct _DecodeContext;
         Image(_DecodeContext);
+        friend class CompressedImage;
     };
 }
@@ -3,6 +3,18 @@
 #include <map>
 #include <set>
 #include <vector>
+#include <thread>
+#include <condition_variable>
+#include <exception>
+#include <csignal>
+#include <cstdio>
+#include <bit>
+#include <new>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 #include "Logger.h"
 
 using namespace FV;
@@ -92,3 +104,314 @@ void Logger::broadcast(Level level, const std::string& mesg) {
                       logger->log(level, mesg);
                   });
 }
+
+namespace {
+    // Asynchronous mode, the drain thread is the only consumer of the rings.
+    struct AsyncLog {
+        std::mutex ringsLock;
+        std::vector<std::shared_ptr<_LogRing>> rings;
+        std::atomic<bool> enabled = false;
+        std::atomic<uint32_t> generation = 0;
+        size_t ringSize = 0;
+
+        std::atomic<uint32_t> writers = 0;  // between _LogRing::acquire and release
+
+        std::mutex stateLock;       // begin, end
+        std::timed_mutex drainLock;
+        std::condition_variable wake;
+        std::mutex wakeLock;
+        std::atomic<bool> pending = false;  // committed since the last drain
+        std::thread thread;
+        bool running = false;
+        uint64_t dropped = 0;
+
+        std::terminate_handler previousTerminate = nullptr;
+        using SignalHandler = void (*)(int);
+        static constexpr int fatalSignals[] = { SIGABRT, SIGSEGV, SIGILL, SIGFPE };
+        SignalHandler previousSignals[std::size(fatalSignals)] = {};
+
+        ~AsyncLog() {
+            Logger::endAsync();
+        }
+
+        // writes everything that was committed before the call.
+        void drain() {
+            std::scoped_lock guard(drainLock);
+            drainLocked(false);
+        }
+
+        // On emergency, gives up if another thread holds the rings.
+        void drainLocked(bool emergency) {
+            auto lockRings = [&](std::unique_lock<std::mutex>& guard) {
+                if (emergency)
+                    return guard.try_lock();
+                guard.lock();
+                return true;
+            };
+            std::vector<std::shared_ptr<_LogRing>> active;
+            do {
+                std::unique_lock guard(ringsLock, std::defer_lock);
+                if (lockRings(guard) == false)
+                    return;
+                active = rings;
+            } while (false);
+
+            // merge the rings by sequence to keep the order between threads.
+            std::vector<_LogRecord*> fronts(active.size());
+            for (size_t i = 0; i < active.size(); ++i)
+                fronts[i] = active[i]->front();
+
+            std::string mesg;
+            while (true) {
+                size_t next = active.size();
+                for (size_t i = 0; i < active.size(); ++i) {
+                    if (fronts[i] && (next == active.size() || fronts[i]->sequence < fronts[next]->sequence))
+                        next = i;
+                }
+                if (next == active.size())
+                    break;
+                _LogRecord* record = fronts[next];
+                Logger::Level level = record->level;
+                bool formatted = true;
+                try {
+                    record->format(record + 1, mesg);
+                } catch (const std::exception& e) {
+                    mesg = std::format("Log format error: {}", e.what());
+                    level = Logger::Level::Error;
+                } catch (...) {
+                    formatted = false;
+                }
+                active[next]->pop(record);
+                fronts[next] = active[next]->front();
+                if (formatted)
+                    Logger::broadcast(level, mesg);
+            }
+
+            uint64_t dropped = 0;
+            for (auto& ring : active)
+                dropped += ring->dropped.exchange(0, std::memory_order_relaxed);
+            if (dropped > 0) {
+                this->dropped += dropped;
+                Logger::broadcast(Logger::Level::Warning,
+                                  std::format("{} log messages dropped, the log buffer is full.", dropped));
+            }
+
+            std::unique_lock guard(ringsLock, std::defer_lock);
+            if (lockRings(guard)) {
+                std::erase_if(rings, [](auto& ring) {
+                    return ring->retired.load(std::memory_order_acquire) && ring->front() == nullptr;
+                });
+            }
+        }
+
+        // Best effort from std::terminate, the process is going down.
+        // Never called from a signal handler.
+        void emergencyDrain() {
+            if (drainLock.try_lock_for(std::chrono::milliseconds(200))) {
+                drainLocked(true);
+                drainLock.unlock();
+            }
+            fflush(stdout);
+        }
+
+        // Only the first writer after a drain notifies. The lock makes
+        // sure the drain thread is either waiting or sees the flag.
+        void notify() {
+            if (pending.exchange(true) == false) {
+                do {
+                    std::scoped_lock lock(wakeLock);
+                } while (false);
+                wake.notify_one();
+            }
+        }
+
+        void run() {
+            std::unique_lock lock(wakeLock);
+            while (true) {
+                wake.wait(lock, [this] { return pending.load() || running == false; });
+                if (running == false)
+                    break;
+                lock.unlock();
+                pending.exchange(false);
+                drain();
+                lock.lock();
+            }
+        }
+
+        static void onTerminate();
+        static void onSignal(int);
+    } asyncLog;
+
+    void AsyncLog::onTerminate() {
+        asyncLog.emergencyDrain();
+        if (asyncLog.previousTerminate)
+            asyncLog.previousTerminate();
+        std::abort();
+    }
+
+    // Only async-signal-safe calls here, a thread may have died holding
+    // the ring or heap locks. Pending records can not be formatted.
+    void AsyncLog::onSignal(int sig) {
+        constexpr char mesg[] = "Fatal signal, pending asynchronous log messages are lost.\n";
+#ifdef _WIN32
+        _write(2, mesg, unsigned(sizeof(mesg) - 1));
+#else
+        (void)!write(2, mesg, sizeof(mesg) - 1);
+#endif
+        for (size_t i = 0; i < std::size(fatalSignals); ++i) {
+            if (fatalSignals[i] == sig) {
+                auto previous = asyncLog.previousSignals[i];
+                std::signal(sig, previous ? previous : SIG_DFL);
+                break;
+            }
+        }
+        std::raise(sig);
+    }
+
+    struct ThreadRing {
+        std::shared_ptr<_LogRing> ring;
+        uint32_t generation = 0;
+        ~ThreadRing() {
+            if (ring)
+                ring->retired.store(true, std::memory_order_release);
+        }
+    };
+    thread_local ThreadRing threadRing;
+}
+
+_LogRing::_LogRing(size_t size)
+    : capacity(std::bit_ceil(std::max(size, size_t(4096))))
+    , dropped(0)
+    , retired(false)
+    , mask(capacity - 1)
+    , data(static_cast<uint8_t*>(::operator new(capacity, std::align_val_t(64))))
+    , head(0)
+    , pendingHead(0)
+    , cachedTail(0)
+    , tail(0) {
+}
+
+_LogRing::~_LogRing() {
+    // destroy the arguments of records that were never written.
+    std::string discard;
+    while (auto record = front()) {
+        try {
+            record->format(record + 1, discard);
+        } catch (...) {}
+        pop(record);
+    }
+    ::operator delete(data, std::align_val_t(64));
+}
+
+_LogRing* _LogRing::acquire() {
+    // pairs with endAsync, which clears enabled and then waits for writers.
+    asyncLog.writers.fetch_add(1);
+    if (asyncLog.enabled.load() == false) {
+        release();
+        return nullptr;
+    }
+    uint32_t generation = asyncLog.generation.load(std::memory_order_acquire);
+    if (threadRing.ring && threadRing.generation == generation)
+        return threadRing.ring.get();
+
+    // first message of this thread (or after beginAsync was called again)
+    try {
+        if (threadRing.ring)
+            threadRing.ring->retired.store(true, std::memory_order_release);
+        auto ring = std::make_shared<_LogRing>(asyncLog.ringSize);
+        do {
+            std::scoped_lock guard(asyncLog.ringsLock);
+            asyncLog.rings.push_back(ring);
+        } while (false);
+        threadRing.ring = ring;
+        threadRing.generation = generation;
+        return ring.get();
+    } catch (...) {
+        release();
+        throw;
+    }
+}
+
+void _LogRing::release() {
+    asyncLog.writers.fetch_sub(1, std::memory_order_release);
+}
+
+_LogRecord* _LogRing::front() {
+    uint64_t tail = this->tail.load(std::memory_order_relaxed);
+    uint64_t head = this->head.load(std::memory_order_acquire);
+    while (tail != head) {
+        auto record = reinterpret_cast<_LogRecord*>(data + (tail & mask));
+        if (record->format)
+            return record;
+        tail += record->size;
+        this->tail.store(tail, std::memory_order_release);
+    }
+    return nullptr;
+}
+
+void _LogRing::pop(_LogRecord* record) {
+    FVASSERT_DEBUG(record == front());
+    tail.store(tail.load(std::memory_order_relaxed) + record->size, std::memory_order_release);
+}
+
+void _LogRing::wakeDrain() {
+    asyncLog.notify();
+}
+
+void Logger::beginAsync(size_t bufferSizePerThread) {
+    std::scoped_lock guard(asyncLog.stateLock);
+    if (asyncLog.running)
+        return;
+    asyncLog.ringSize = bufferSizePerThread;
+    asyncLog.generation.fetch_add(1, std::memory_order_release);
+    asyncLog.running = true;
+    asyncLog.thread = std::thread([] { asyncLog.run(); });
+
+    asyncLog.previousTerminate = std::set_terminate(AsyncLog::onTerminate);
+    for (size_t i = 0; i < std::size(AsyncLog::fatalSignals); ++i) {
+        auto previous = std::signal(AsyncLog::fatalSignals[i], AsyncLog::onSignal);
+        asyncLog.previousSignals[i] = previous == SIG_ERR ? nullptr : previous;
+    }
+    asyncLog.enabled.store(true, std::memory_order_release);
+}
+
+void Logger::endAsync() {
+    std::scoped_lock guard(asyncLog.stateLock);
+    if (asyncLog.running == false)
+        return;
+    asyncLog.enabled.store(false);
+    do {
+        std::scoped_lock lock(asyncLog.wakeLock);
+        asyncLog.running = false;
+    } while (false);
+    asyncLog.wake.notify_one();
+    asyncLog.thread.join();
+    // writers which saw enabled before it was cleared may still commit.
+    while (asyncLog.writers.load(std::memory_order_acquire) != 0)
+        std::this_thread::yield();
+    // messages committed after the last pass of the thread.
+    asyncLog.drain();
+
+    std::set_terminate(asyncLog.previousTerminate);
+    for (size_t i = 0; i < std::size(AsyncLog::fatalSignals); ++i) {
+        auto previous = asyncLog.previousSignals[i];
+        std::signal(AsyncLog::fatalSignals[i], previous ? previous : SIG_DFL);
+    }
+}
+
+bool Logger::isAsync() {
+    return asyncLog.enabled.load(std::memory_order_relaxed);
+}
+
+void Logger::flush() {
+    asyncLog.drain();
+}
+
+uint64_t Logger::droppedMessages() {
+    std::scoped_lock guard(asyncLog.drainLock);
+    uint64_t dropped = asyncLog.dropped;
+    std::scoped_lock lock(asyncLog.ringsLock);
+    for (auto& ring : asyncLog.rings)
+        dropped += ring->dropped.load(std::memory_order_relaxed);
+    return dropped;
+}
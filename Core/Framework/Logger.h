@@ -2,6 +2,8 @@
 #include "../include.h"
 #include <map>
 #include <vector>
+#include <tuple>
+#include <atomic>
 
 namespace FV {
     class Logger : public std::enable_shared_from_this<Logger> {
@@ -23,10 +25,140 @@ namespace FV {
 
         static Logger* defaultLogger();
 
+        // Asynchronous mode: Log functions copy their arguments into a
+        // ring buffer of the calling thread, a background thread formats
+        // and broadcasts them. Messages that do not fit are dropped and
+        // reported. Pending messages are written by flush, endAsync, at
+        // exit and on std::terminate. They are lost on a fatal signal,
+        // formatting is not safe in a signal handler.
+        static void beginAsync(size_t bufferSizePerThread = 256 * 1024);
+        static void endAsync();
+        static bool isAsync();
+        static void flush();
+        static uint64_t droppedMessages();
+
     private:
         const std::string category;
     };
 
+    struct _LogRecord {
+        uint64_t sequence;
+        void (*format)(void* arguments, std::string& out); // nullptr: padding to the end of the ring
+        uint32_t size;          // bytes including this header
+        Logger::Level level;
+        uint8_t reserved[8];
+    };
+    static_assert(sizeof(_LogRecord) == 32);
+
+    // Single-producer single-consumer ring of log records, one per thread.
+    // The owning thread writes records, the drain thread consumes them.
+    class _LogRing {
+    public:
+        static constexpr size_t granularity = sizeof(_LogRecord);
+
+        _LogRing(size_t capacity);
+        ~_LogRing();
+
+        // Ring of the calling thread, nullptr if the async mode is off.
+        // A writer holds it until release, endAsync waits for writers.
+        static _LogRing* acquire();
+        static void release();
+
+        _LogRecord* reserve(uint32_t size) {
+            FVASSERT_DEBUG(size % granularity == 0);
+            uint64_t head = this->head.load(std::memory_order_relaxed);
+            size_t offset = size_t(head & mask);
+            size_t contiguous = capacity - offset;
+            size_t required = contiguous < size ? size + contiguous : size;
+            if (required > capacity - size_t(head - cachedTail)) {
+                cachedTail = tail.load(std::memory_order_acquire);
+                if (required > capacity - size_t(head - cachedTail)) {
+                    dropped.fetch_add(1, std::memory_order_relaxed);
+                    return nullptr;
+                }
+            }
+            if (contiguous < size) {
+                auto padding = reinterpret_cast<_LogRecord*>(data + offset);
+                padding->format = nullptr;
+                padding->size = uint32_t(contiguous);
+                head += contiguous;
+                offset = 0;
+            }
+            pendingHead = head + size;
+            return reinterpret_cast<_LogRecord*>(data + offset);
+        }
+
+        void commit() {
+            head.store(pendingHead, std::memory_order_release);
+            wakeDrain();
+        }
+
+        // consumer
+        _LogRecord* front();
+        void pop(_LogRecord*);
+
+        const size_t capacity;
+        std::atomic<uint64_t> dropped;
+        std::atomic<bool> retired;
+
+    private:
+        static void wakeDrain();
+
+        const uint64_t mask;
+        uint8_t* const data;
+
+        alignas(64) std::atomic<uint64_t> head;
+        uint64_t pendingHead;
+        uint64_t cachedTail;
+        alignas(64) std::atomic<uint64_t> tail;
+    };
+
+    inline std::atomic<uint64_t> _logSequence = 0;
+
+    // Arguments are formatted later on another thread: character pointers
+    // and string views are copied into strings, everything else by value.
+    template <typename T> struct _LogArgument { using Type = T; };
+    template <> struct _LogArgument<const char*> { using Type = std::string; };
+    template <> struct _LogArgument<char*> { using Type = std::string; };
+    template <> struct _LogArgument<std::string_view> { using Type = std::string; };
+
+    template <typename... Types>
+    bool _logAsync(Logger::Level level, std::string_view fmt, Types&&... args) {
+        using Arguments = std::tuple<typename _LogArgument<std::decay_t<Types>>::Type...>;
+        struct Record {
+            std::string_view fmt;
+            Arguments args;
+        };
+        if constexpr (alignof(Record) > _LogRing::granularity) {
+            return false;
+        } else {
+            _LogRing* ring = _LogRing::acquire();
+            if (ring == nullptr)
+                return false;
+            struct Release { ~Release() { _LogRing::release(); } } release;
+
+            constexpr size_t g = _LogRing::granularity;
+            constexpr uint32_t size = uint32_t((sizeof(_LogRecord) + sizeof(Record) + g - 1) / g * g);
+            _LogRecord* record = ring->reserve(size);
+            if (record == nullptr)
+                return true; // dropped, the drain thread reports it.
+
+            new (record + 1) Record{ fmt, Arguments(std::forward<Types>(args)...) };
+            record->format = [](void* p, std::string& out) {
+                Record* r = static_cast<Record*>(p);
+                struct Destroy { Record* r; ~Destroy() { r->~Record(); } } destroy{ r };
+                std::apply([&](auto&... a) {
+                    out = std::vformat(r->fmt, std::make_format_args(a...));
+                }, r->args);
+            };
+            record->size = size;
+            record->level = level;
+            record->sequence = _logSequence.fetch_add(1, std::memory_order_relaxed);
+            ring->commit();
+            return true;
+        }
+    }
+
     struct Log {
         using Level = Logger::Level;
 
@@ -37,6 +169,8 @@ namespace FV {
         }
 
         static void log(Level level, const std::string& mesg) {
+            if (_logAsync(level, "{}", mesg))
+                return;
             Logger* d = Logger::defaultLogger();
             Logger::broadcast(level, mesg);
         }
@@ -47,9 +181,16 @@ namespace FV {
         static void warning(const std::string& mesg) { log(Level::Warning, mesg); }
         static void error(const std::string& mesg)   { log(Level::Error, mesg); }
 
+        template <typename... Types>
+        static void log(Level level, const std::format_string<Types...> fmt, Types&&... args) {
+            if (_logAsync(level, fmt.get(), std::forward<Types>(args)...))
+                return;
+            Logger::broadcast(level, std::format(fmt, std::forward<Types>(args)...));
+        }
+
         template <typename... Types>
         static void debug(const std::format_string<Types...> fmt, Types&&... args) {
-            debug(std::format(fmt, std::forward<Types>(args)...));
+            log(Level::Debug, fmt, std::forward<Types>(args)...);
         }
         template <typename... Types>
         static void debug(const std::locale& loc, const std::format_string<Types...> fmt, Types&&... args) {
@@ -57,7 +198,7 @@ namespace FV {
         }
         template <typename... Types>
         static void verbose(const std::format_string<Types...> fmt, Types&&... args) {
-            verbose(std::format(fmt, std::forward<Types>(args)...));
+            log(Level::Verbose, fmt, std::forward<Types>(args)...);
         }
         template <typename... Types>
         static void verbose(const std::locale& loc, const std::format_string<Types...> fmt, Types&&... args) {
@@ -65,7 +206,7 @@ namespace FV {
         }
         template <typename... Types>
         static void info(const std::format_string<Types...> fmt, Types&&... args) {
-            info(std::format(fmt, std::forward<Types>(args)...));
+            log(Level::Info, fmt, std::forward<Types>(args)...);
         }
         template <typename... Types>
         static void info(const std::locale& loc, const std::format_string<Types...> fmt, Types&&... args) {
@@ -73,7 +214,7 @@ namespace FV {
         }
         template <typename... Types>
         static void warning(const std::format_string<Types...> fmt, Types&&... args) {
-            warning(std::format(fmt, std::forward<Types>(args)...));
+            log(Level::Warning, fmt, std::forward<Types>(args)...);
         }
         template <typename... Types>
         static void warning(const std::locale& loc, const std::format_string<Types...> fmt, Types&&... args) {
@@ -81,7 +222,7 @@ namespace FV {
         }
         template <typename... Types>
         static void error(const std::format_string<Types...> fmt, Types&&... args) {
-            error(std::format(fmt, std::forward<Types>(args)...));
+            log(Level::Error, fmt, std::forward<Types>(args)...);
         }
         template <typename... Types>
         static void error(const std::locale& loc, const std::format_string<Types...> fmt, Types&&... args) {
@@ -1,6 +1,7 @@
 #include <vector>
 #include <optional>
 #include <tuple>
+#include <cmath>
 #include <functional>
 #include <algorithm>
 #include <numeric>
@@ -12,6 +13,23 @@
 
 using namespace FV;
 
+namespace {
+    std::shared_ptr<const uint8_t> makeContent(std::vector<uint8_t>&& data) {
+        auto content = std::make_shared<std::vector<uint8_t>>(std::move(data));
+        return std::shared_ptr<const uint8_t>(content, content->data());
+    }
+
+    std::pair<std::shared_ptr<const uint8_t>, IndexType>
+    makeIndexContent(std::vector<uint32_t>&& indices, size_t vertexCount) {
+        if (vertexCount <= 0x10000) {
+            auto content = std::make_shared<std::vector<uint16_t>>(indices.begin(), indices.end());
+            return { std::shared_ptr<const uint8_t>(content, (const uint8_t*)content->data()), IndexType::UInt16 };
+        }
+        auto content = std::make_shared<std::vector<uint32_t>>(std::move(indices));
+        return { std::shared_ptr<const uint8_t>(content, (const uint8_t*)content->data()), IndexType::UInt32 };
+    }
+}
+
 VertexDescriptor Mesh::vertexDescriptor() const {
     if (material == nullptr)
         return {};
@@ -925,9 +943,7 @@ uint32_t Mesh::bindShaderUniformBuffer(ShaderUniformSemantic semantic,
     return 0;
 }
 
-bool Mesh::encodeRenderCommand(RenderCommandEncoder* encoder,
-                               uint32_t numInstances,
-                               uint32_t baseInstance) const {
+bool Mesh::setRenderStates(RenderCommandEncoder* encoder) const {
     if (pipelineState && vertexBuffers.empty() == false && material) {
         encoder->setRenderPipelineState(pipelineState);
         encoder->setFrontFacing(material->frontFace);
@@ -967,6 +983,15 @@ bool Mesh::encodeRenderCommand(RenderCommandEncoder* encoder,
             auto& buffer = vertexBuffers.at(index);
             encoder->setVertexBuffer(buffer.buffer, buffer.byteOffset, index);
         }
+        return true;
+    }
+    return false;
+}
+
+bool Mesh::encodeRenderCommand(RenderCommandEncoder* encoder,
+                               uint32_t numInstances,
+                               uint32_t baseInstance) const {
+    if (setRenderStates(encoder)) {
         auto vertexCount = std::reduce(vertexBuffers.begin(),
                                        vertexBuffers.end(),
                                        vertexBuffers.front().vertexCount,
@@ -990,6 +1015,263 @@ bool Mesh::encodeRenderCommand(RenderCommandEncoder* encoder,
     return false;
 }
 
+bool Mesh::encodeRenderCommand(RenderCommandEncoder* encoder,
+                               uint32_t numInstances,
+                               uint32_t baseInstance,
+                               const std::vector<uint32_t>& visibleMeshlets) const {
+    if (meshlets == nullptr || indexBuffer == nullptr ||
+        meshlets->triangles.size() != indexCount)
+        return encodeRenderCommand(encoder, numInstances, baseInstance);
+
+    if (setRenderStates(encoder)) {
+        const uint32_t indexSize = indexType == IndexType::UInt16 ? 2 : 4;
+        for (size_t i = 0; i < visibleMeshlets.size(); ) {
+            const Meshlet& meshlet = meshlets->meshlets.at(visibleMeshlets.at(i));
+            uint32_t begin = meshlet.triangleOffset;
+            uint32_t end = begin + meshlet.triangleCount;
+            // merge the meshlets which follow in the index buffer.
+            for (++i; i < visibleMeshlets.size(); ++i) {
+                const Meshlet& next = meshlets->meshlets.at(visibleMeshlets.at(i));
+                if (next.triangleOffset != end)
+                    break;
+                end += next.triangleCount;
+            }
+            encoder->drawIndexed((end - begin) * 3, indexType, indexBuffer,
+                                 indexBufferByteOffset + begin * 3 * indexSize,
+                                 numInstances,
+                                 indexBufferBaseVertexIndex,
+                                 baseInstance);
+        }
+        return true;
+    }
+    return false;
+}
+
+bool Mesh::triangleListContent(std::vector<uint32_t>& indices, std::vector<Vector3>& positions) const {
+    if (primitiveType != PrimitiveType::Triangle)
+        return false;
+
+    auto positionStream = vertexStream(VertexAttributeSemantic::Position);
+    if (positionStream.has_value() == false || positionStream->format != VertexFormat::Float3)
+        return false;
+
+    const auto view = positionStream->view<Vector3>();
+    positions.clear();
+    positions.reserve(view.count);
+    for (uint32_t i = 0; i < view.count; ++i)
+        positions.push_back(view[i]);
+
+    indices.clear();
+    if (auto stream = indexStream(); stream.has_value()) {
+        indices.reserve(stream->count);
+        for (uint32_t i = 0; i < stream->count; ++i) {
+            uint32_t index = (*stream)[i];
+            if (index >= positions.size())
+                return false;
+            indices.push_back(index);
+        }
+    } else if (indexBuffer == nullptr) {
+        if (vertexStart >= positions.size())
+            return false;
+        indices.resize(positions.size() - vertexStart);
+        std::iota(indices.begin(), indices.end(), vertexStart);
+    } else {
+        return false;
+    }
+    indices.resize(indices.size() / 3 * 3);
+    return true;
+}
+
+std::optional<std::pair<MeshOptimizer::Statistics, MeshOptimizer::Statistics>> Mesh::optimize() {
+    if (primitiveType != PrimitiveType::Triangle || vertexBuffers.empty())
+        return {};
+
+    uint32_t vertexCount = vertexBuffers.front().vertexCount;
+    for (auto& vb : vertexBuffers) {
+        if (vb.content == nullptr)
+            return {};
+        vertexCount = std::min(vertexCount, vb.vertexCount);
+    }
+
+    std::vector<uint32_t> indices;
+    if (auto stream = indexStream(); stream.has_value()) {
+        indices.reserve(stream->count);
+        for (uint32_t i = 0; i < stream->count; ++i) {
+            uint32_t index = (*stream)[i];
+            if (index >= vertexCount)
+                return {};
+            indices.push_back(index);
+        }
+    } else if (indexBuffer == nullptr) {
+        if (vertexStart >= vertexCount)
+            return {};
+        indices.resize(vertexCount - vertexStart);
+        std::iota(indices.begin(), indices.end(), vertexStart);
+    } else {
+        return {};
+    }
+
+    MeshOptimizer optimizer(std::move(indices), vertexCount);
+    std::vector<VertexAttribute> attributes;
+    for (auto& vb : vertexBuffers) {
+        for (auto& attribute : vb.attributes) {
+            const uint32_t size = uint32_t(VertexFormatInfo(attribute.format).bytes());
+            const uint32_t elementSize = (size + 3) & ~3U; // 4-byte aligned vertices
+            std::vector<uint8_t> data(size_t(elementSize) * vertexCount, 0);
+            const uint8_t* src = vb.content.get() + vb.byteOffset + attribute.offset;
+            for (uint32_t i = 0; i < vertexCount; ++i)
+                memcpy(&data[size_t(i) * elementSize], src + size_t(i) * vb.byteStride, size);
+
+            optimizer.addStream({ std::move(data), elementSize });
+            if (attribute.semantic == VertexAttributeSemantic::Position &&
+                attribute.format == VertexFormat::Float3)
+                optimizer.setPositionStream(uint32_t(attributes.size()));
+            attributes.push_back(attribute);
+        }
+    }
+
+    auto before = optimizer.analyze();
+    optimizer.optimize();
+    auto after = optimizer.analyze();
+
+    vertexBuffers.clear();
+    for (size_t i = 0; i < attributes.size(); ++i) {
+        auto& stream = optimizer.streams().at(i);
+        VertexAttribute attribute = attributes.at(i);
+        attribute.offset = 0;
+        VertexBuffer vb = {
+            0, stream.elementSize, optimizer.vertexCount(),
+            nullptr, { attribute }
+        };
+        vb.content = makeContent(std::vector<uint8_t>(stream.data));
+        vertexBuffers.push_back(vb);
+    }
+
+    const auto& optimized = optimizer.indices();
+    std::tie(indexContent, indexType) = makeIndexContent(std::vector<uint32_t>(optimized), optimizer.vertexCount());
+    indexBuffer = nullptr;
+    indexBufferByteOffset = 0;
+    indexBufferBaseVertexIndex = 0;
+    indexCount = uint32_t(optimized.size());
+    vertexStart = 0;
+    meshlets = nullptr;
+    levelsOfDetail.clear();
+    return std::make_pair(before, after);
+}
+
+bool Mesh::buildMeshlets() {
+    std::vector<uint32_t> indices;
+    std::vector<Vector3> positions;
+    if (triangleListContent(indices, positions) == false || indices.empty())
+        return false;
+
+    auto set = std::make_shared<MeshletSet>(MeshletSet::build(indices, positions));
+    std::tie(indexContent, indexType) = makeIndexContent(set->indices(), positions.size());
+    indexBuffer = nullptr;
+    indexBufferByteOffset = 0;
+    indexBufferBaseVertexIndex = 0;
+    indexCount = uint32_t(set->triangles.size());
+    meshlets = set;
+    levelsOfDetail.clear();
+    return true;
+}
+
+void Mesh::cullMeshlets(const ViewFrustum& frustum, std::vector<uint32_t>& visible) const {
+    if (meshlets == nullptr)
+        return;
+
+    bool backfaceCulling = false;
+    if (material && material->cullMode != CullMode::None) {
+        // The viewport is flipped, triangles whose cross(p1 - p0, p2 - p0)
+        // faces away are clockwise on the screen, unless mirrored.
+        bool cullsClockwise = (material->cullMode == CullMode::Back) ==
+                              (material->frontFace == Winding::CounterClockwise);
+        bool mirrored = frustum.view.matrix.determinant() < 0.0f;
+        backfaceCulling = cullsClockwise != mirrored;
+    }
+    meshlets->cull(frustum, visible, backfaceCulling);
+}
+
+bool Mesh::encodeRenderCommand(RenderCommandEncoder* encoder,
+                               uint32_t numInstances,
+                               uint32_t baseInstance,
+                               const LevelOfDetail& level) const {
+    if (indexBuffer == nullptr)
+        return encodeRenderCommand(encoder, numInstances, baseInstance);
+
+    if (setRenderStates(encoder)) {
+        const uint32_t indexSize = indexType == IndexType::UInt16 ? 2 : 4;
+        encoder->drawIndexed(level.indexCount, indexType, indexBuffer,
+                             indexBufferByteOffset + level.indexOffset * indexSize,
+                             numInstances,
+                             indexBufferBaseVertexIndex,
+                             baseInstance);
+        return true;
+    }
+    return false;
+}
+
+bool Mesh::buildLevelsOfDetail(uint32_t maxLevels, float maxError) {
+    std::vector<uint32_t> indices;
+    std::vector<Vector3> positions;
+    if (triangleListContent(indices, positions) == false)
+        return false;
+    return setLevelsOfDetail(MeshSimplifier::buildLevels(indices, positions, maxLevels, maxError));
+}
+
+bool Mesh::setLevelsOfDetail(const std::vector<MeshSimplifier::Level>& levels) {
+    std::vector<uint32_t> indices;
+    std::vector<Vector3> positions;
+    if (triangleListContent(indices, positions) == false)
+        return false;
+
+    const uint32_t numIndices = uint32_t(indices.size());
+    std::vector<LevelOfDetail> lods;
+    lods.reserve(levels.size());
+    for (auto& level : levels) {
+        lods.push_back({ uint32_t(indices.size()), uint32_t(level.indices.size()), level.error });
+        for (uint32_t index : level.indices) {
+            if (index >= positions.size()) {
+                Log::error("Level of detail index {} out of range.", index);
+                return false;
+            }
+            indices.push_back(index);
+        }
+    }
+    // the full mesh is copied as it is, meshlets are kept.
+    std::tie(indexContent, indexType) = makeIndexContent(std::move(indices), positions.size());
+    indexBuffer = nullptr;
+    indexBufferByteOffset = 0;
+    indexBufferBaseVertexIndex = 0;
+    indexCount = numIndices;
+    levelsOfDetail = std::move(lods);
+    return true;
+}
+
+uint32_t Mesh::levelOfDetail(const ViewFrustum& frustum, float viewportHeight, float maxScreenError) const {
+    if (levelsOfDetail.empty() || aabb.isNull())
+        return 0;
+
+    // pixels per unit of the mesh, at the nearest point of the bounds.
+    const auto& projection = frustum.projection;
+    float scale = projection.matrix._22 * viewportHeight * 0.5f;
+    if (projection.isPerspective()) {
+        float radius = (aabb.max - aabb.min).magnitude() * 0.5f;
+        float distance = (frustum.view.position() - aabb.center()).magnitude() - radius;
+        if (distance <= 0.0f)
+            return 0;
+        scale = scale / distance;
+    } else {
+        scale = scale * cbrtf(fabsf(frustum.view.matrix.determinant()));
+    }
+
+    uint32_t level = 0;
+    while (level < levelsOfDetail.size() &&
+           levelsOfDetail.at(level).error * scale <= maxScreenError)
+        level++;
+    return level;
+}
+
 bool Mesh::enumerateVertexBufferContent(VertexAttributeSemantic semantic,
                                         GraphicsDeviceContext* context,
                                         std::function<bool(const void*, VertexFormat, uint32_t)> handler) const {
@@ -1032,6 +1314,36 @@ bool Mesh::enumerateVertexBufferContent(VertexAttributeSemantic semantic,
     return false;
 }
 
+std::optional<Mesh::VertexStream> Mesh::vertexStream(VertexAttributeSemantic semantic) const {
+    for (auto& vb : vertexBuffers) {
+        for (auto& attr : vb.attributes) {
+            if (attr.semantic == semantic) {
+                if (vb.content == nullptr)
+                    return {};
+                return VertexStream {
+                    vb.content.get() + vb.byteOffset + attr.offset,
+                    vb.byteStride,
+                    vb.vertexCount,
+                    attr.format
+                };
+            }
+        }
+    }
+    return {};
+}
+
+std::optional<Mesh::IndexStream> Mesh::indexStream() const {
+    if (indexContent) {
+        return IndexStream {
+            indexContent.get() + indexBufferByteOffset,
+            indexCount,
+            indexType,
+            indexBufferBaseVertexIndex
+        };
+    }
+    return {};
+}
+
 bool Mesh::enumerateIndexBufferContent(GraphicsDeviceContext* context,
                                        std::function<bool(uint32_t index)> handler) const {
     if (indexBuffer) {
@@ -1,12 +1,17 @@
 #pragma once
 #include "../include.h"
 #include <vector>
+#include <optional>
+#include <cstring>
 #include "Material.h"
 #include "PipelineReflection.h"
 #include "RenderCommandEncoder.h"
 #include "VertexDescriptor.h"
 #include "GraphicsDeviceContext.h"
 #include "AABB.h"
+#include "Meshlet.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
 
 namespace FV {
     struct SceneState;
@@ -27,10 +32,13 @@ namespace FV {
             uint32_t vertexCount;
             std::shared_ptr<GPUBuffer> buffer;
             std::vector<VertexAttribute> attributes;
+            // optional CPU copy of the buffer contents, with the same layout.
+            std::shared_ptr<const uint8_t> content;
         };
         std::vector<VertexBuffer> vertexBuffers;
 
         std::shared_ptr<GPUBuffer> indexBuffer;
+        std::shared_ptr<const uint8_t> indexContent; // optional, as content of VertexBuffer
         uint32_t indexBufferByteOffset;
         uint32_t indexBufferBaseVertexIndex;
         uint32_t vertexStart;
@@ -39,6 +47,18 @@ namespace FV {
 
         PrimitiveType primitiveType;
 
+        // optional, clusters of the triangles in the index buffer.
+        std::shared_ptr<const MeshletSet> meshlets;
+
+        // optional, simplified levels in the index buffer after the
+        // indexCount indices of the full mesh.
+        struct LevelOfDetail {
+            uint32_t indexOffset;   // in indices, from indexBufferByteOffset
+            uint32_t indexCount;
+            float error;            // from the full mesh, in units of the positions
+        };
+        std::vector<LevelOfDetail> levelsOfDetail;
+
         VertexDescriptor vertexDescriptor() const;
 
         enum class BufferUsagePolicy {
@@ -53,6 +73,37 @@ namespace FV {
         void updateShadingProperties(const SceneState*);
 
         bool encodeRenderCommand(RenderCommandEncoder* encoder, uint32_t numInstances, uint32_t baseInstance) const;
+        // draws the given meshlets only, adjacent ones with a single call.
+        bool encodeRenderCommand(RenderCommandEncoder* encoder, uint32_t numInstances, uint32_t baseInstance,
+                                 const std::vector<uint32_t>& visibleMeshlets) const;
+        bool encodeRenderCommand(RenderCommandEncoder* encoder, uint32_t numInstances, uint32_t baseInstance,
+                                 const LevelOfDetail&) const;
+
+        // Copies the triangle list and the positions from the CPU content.
+        bool triangleListContent(std::vector<uint32_t>& indices, std::vector<Vector3>& positions) const;
+
+        // Reorders the triangle list for the vertex cache and overdraw,
+        // from the CPU contents. Each attribute is copied to its own
+        // vertex buffer, the buffers must be made again. Returns the
+        // statistics before and after, or nothing if the mesh was not changed.
+        std::optional<std::pair<MeshOptimizer::Statistics, MeshOptimizer::Statistics>> optimize();
+
+        // Splits the triangle list into meshlets, from the CPU content of
+        // positions and indices. The indices are rewritten in meshlet
+        // order to indexContent, the index buffer must be made again.
+        // Levels of detail are removed, they can be built after this.
+        bool buildMeshlets();
+        // Meshlets which may be visible, the frustum is in the space of
+        // the mesh. Backfacing meshlets are culled if the material does.
+        void cullMeshlets(const ViewFrustum&, std::vector<uint32_t>& visible) const;
+
+        // Appends simplified levels to indexContent, as buildMeshlets.
+        bool buildLevelsOfDetail(uint32_t maxLevels, float maxError);
+        bool setLevelsOfDetail(const std::vector<MeshSimplifier::Level>&);
+        // The coarsest level whose error projects to at most maxScreenError
+        // pixels, 0 for the full mesh, N for levelsOfDetail[N-1].
+        // The frustum is in the space of the mesh.
+        uint32_t levelOfDetail(const ViewFrustum&, float viewportHeight, float maxScreenError) const;
 
         // Enumerates the vertex buffer contents, and for each vertex,
         // the given handler is called, with a vertex attribute as an argument.
@@ -63,6 +114,75 @@ namespace FV {
 
         bool enumerateIndexBufferContent(GraphicsDeviceContext* context,
                                          std::function<bool(uint32_t index)> handler) const;
+
+        // Views of the CPU contents, which do not read the GPU buffers back.
+        // Elements are copied out, the content does not need to be aligned.
+        template <typename T>
+        struct StridedView {
+            const uint8_t* data;
+            uint32_t stride;
+            uint32_t count;
+
+            T operator [] (uint32_t index) const {
+                T value;
+                memcpy(&value, data + size_t(index) * stride, sizeof(T));
+                return value;
+            }
+        };
+        struct VertexStream {
+            const uint8_t* data;
+            uint32_t stride;
+            uint32_t count;
+            VertexFormat format;
+
+            template <typename T> StridedView<T> view() const {
+                FVASSERT_DEBUG(sizeof(T) <= VertexFormatInfo(format).bytes());
+                return { data, stride, count };
+            }
+        };
+        struct IndexStream {
+            const uint8_t* data;
+            uint32_t count;
+            IndexType type;
+            uint32_t base;
+
+            uint32_t operator [] (uint32_t index) const {
+                if (type == IndexType::UInt16)
+                    return StridedView<uint16_t>{ data, 2, count }[index] + base;
+                return StridedView<uint32_t>{ data, 4, count }[index] + base;
+            }
+        };
+        // returns nothing if the mesh does not have CPU content for them.
+        std::optional<VertexStream> vertexStream(VertexAttributeSemantic) const;
+        std::optional<IndexStream> indexStream() const;
+
+        // Same as the enumerate functions above, but uses the CPU content
+        // if there is, without calling through std::function.
+        template <typename Handler>
+        bool forEachVertexAttribute(VertexAttributeSemantic semantic,
+                                    GraphicsDeviceContext* context,
+                                    Handler&& handler) const {
+            if (auto stream = vertexStream(semantic); stream.has_value()) {
+                const uint8_t* p = stream->data;
+                for (uint32_t i = 0; i < stream->count; ++i, p += stream->stride) {
+                    if (handler((const void*)p, stream->format, i) == false)
+                        break;
+                }
+                return true;
+            }
+            return enumerateVertexBufferContent(semantic, context, handler);
+        }
+        template <typename Handler>
+        bool forEachIndex(GraphicsDeviceContext* context, Handler&& handler) const {
+            if (auto stream = indexStream(); stream.has_value()) {
+                for (uint32_t i = 0; i < stream->count; ++i) {
+                    if (handler((*stream)[i]) == false)
+                        break;
+                }
+                return true;
+            }
+            return enumerateIndexBufferContent(context, handler);
+        }
     private:
         struct ResourceBinding {
             ShaderResource resource;    // from spir-v
@@ -78,6 +198,8 @@ namespace FV {
             std::vector<uint8_t> data;
         };
 
+        bool setRenderStates(RenderCommandEncoder*) const;
+
         std::shared_ptr<RenderPipelineState> pipelineState;
         std::optional<PipelineReflection> pipelineReflection;
 
@@ -0,0 +1,390 @@
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include "MeshOptimizer.h"
+#include "Logger.h"
+
+using namespace FV;
+
+namespace {
+    // Tom Forsyth, "Linear-Speed Vertex Cache Optimisation"
+    constexpr uint32_t scoringCacheSize = 32;
+    constexpr float cacheDecayPower = 1.5f;
+    constexpr float lastTriangleScore = 0.75f;
+    constexpr float valenceBoostScale = 2.0f;
+    constexpr float valenceBoostPower = 0.5f;
+
+    float vertexScore(int cachePosition, uint32_t remainingTriangles) {
+        if (remainingTriangles == 0)
+            return -1.0f;
+
+        float score = 0.0f;
+        if (cachePosition >= 0) {
+            if (cachePosition < 3) {
+                // the vertices of the last triangle get a fixed score,
+                // so the next triangle does not favor any of them.
+                score = lastTriangleScore;
+            } else {
+                const float scale = 1.0f / float(scoringCacheSize - 3);
+                score = powf(1.0f - float(cachePosition - 3) * scale, cacheDecayPower);
+            }
+        }
+        // prefer vertices with few triangles left, to finish them off.
+        score += valenceBoostScale * powf(float(remainingTriangles), -valenceBoostPower);
+        return score;
+    }
+
+    // FIFO cache simulation, a vertex hits if it was transformed within
+    // the last cacheSize misses.
+    struct FIFOCache {
+        std::vector<uint32_t> timestamps;
+        uint32_t time;
+        uint32_t cacheSize;
+
+        FIFOCache(uint32_t vertexCount, uint32_t size)
+            : timestamps(vertexCount, 0)
+            , time(size + 1)
+            , cacheSize(size) {
+        }
+        bool access(uint32_t vertex) {
+            if (time - timestamps[vertex] > cacheSize) {
+                timestamps[vertex] = time++;
+                return false;
+            }
+            return true;
+        }
+    };
+}
+
+MeshOptimizer::MeshOptimizer(std::vector<uint32_t> indices, uint32_t vertexCount)
+    : _indices(std::move(indices))
+    , _vertexCount(vertexCount)
+    , _positionStream(-1) {
+    FVASSERT_DEBUG(_indices.size() % 3 == 0);
+    _indices.resize(_indices.size() - _indices.size() % 3);
+    FVASSERT_DEBUG(std::all_of(_indices.begin(), _indices.end(),
+                               [&](uint32_t index) { return index < _vertexCount; }));
+}
+
+void MeshOptimizer::addStream(Stream stream) {
+    FVASSERT(stream.elementSize > 0);
+    FVASSERT(stream.data.size() == size_t(stream.elementSize) * _vertexCount);
+    _streams.push_back(std::move(stream));
+}
+
+void MeshOptimizer::setPositionStream(uint32_t streamIndex) {
+    FVASSERT(streamIndex < _streams.size());
+    FVASSERT(_streams.at(streamIndex).elementSize >= sizeof(Vector3));
+    _positionStream = int(streamIndex);
+}
+
+Vector3 MeshOptimizer::position(uint32_t vertex) const {
+    const Stream& stream = _streams.at(_positionStream);
+    Vector3 p;
+    memcpy(&p, &stream.data[size_t(vertex) * stream.elementSize], sizeof(Vector3));
+    return p;
+}
+
+void MeshOptimizer::remapVertices(const std::vector<uint32_t>& remap, uint32_t newVertexCount) {
+    for (uint32_t& index : _indices)
+        index = remap[index];
+
+    for (Stream& stream : _streams) {
+        const size_t elementSize = stream.elementSize;
+        std::vector<uint8_t> data(elementSize * newVertexCount);
+        for (uint32_t v = 0; v < _vertexCount; ++v) {
+            if (remap[v] != uint32_t(-1))
+                memcpy(&data[remap[v] * elementSize], &stream.data[v * elementSize], elementSize);
+        }
+        stream.data = std::move(data);
+    }
+    _vertexCount = newVertexCount;
+}
+
+void MeshOptimizer::weldVertices() {
+    if (_vertexCount == 0)
+        return;
+
+    auto vertexHash = [this](uint32_t v) {
+        uint64_t hash = 0xcbf29ce484222325ULL; // FNV-1a
+        for (const Stream& stream : _streams) {
+            const uint8_t* p = &stream.data[size_t(v) * stream.elementSize];
+            for (uint32_t i = 0; i < stream.elementSize; ++i) {
+                hash ^= p[i];
+                hash *= 0x100000001b3ULL;
+            }
+        }
+        return hash;
+    };
+    auto isEqual = [this](uint32_t v1, uint32_t v2) {
+        for (const Stream& stream : _streams) {
+            if (memcmp(&stream.data[size_t(v1) * stream.elementSize],
+                       &stream.data[size_t(v2) * stream.elementSize],
+                       stream.elementSize) != 0)
+                return false;
+        }
+        return true;
+    };
+
+    std::vector<uint64_t> hashes(_vertexCount);
+    for (uint32_t v = 0; v < _vertexCount; ++v)
+        hashes[v] = vertexHash(v);
+
+    // vertices with the same hash are adjacent, in the order of their index.
+    std::vector<uint32_t> order(_vertexCount);
+    std::iota(order.begin(), order.end(), 0U);
+    std::stable_sort(order.begin(), order.end(),
+                     [&](uint32_t a, uint32_t b) { return hashes[a] < hashes[b]; });
+
+    // each vertex is merged into the first vertex equal to it.
+    std::vector<uint32_t> representative(_vertexCount);
+    std::vector<uint32_t> candidates;
+    for (size_t begin = 0; begin < order.size();) {
+        size_t end = begin + 1;
+        while (end < order.size() && hashes[order[end]] == hashes[order[begin]])
+            ++end;
+
+        candidates.clear();
+        for (size_t i = begin; i < end; ++i) {
+            uint32_t v = order[i];
+            auto it = std::find_if(candidates.begin(), candidates.end(),
+                                   [&](uint32_t c) { return isEqual(c, v); });
+            if (it != candidates.end()) {
+                representative[v] = *it;
+            } else {
+                representative[v] = v;
+                candidates.push_back(v);
+            }
+        }
+        begin = end;
+    }
+
+    std::vector<uint32_t> remap(_vertexCount);
+    uint32_t newVertexCount = 0;
+    for (uint32_t v = 0; v < _vertexCount; ++v) {
+        if (representative[v] == v)
+            remap[v] = newVertexCount++;
+        else
+            remap[v] = remap[representative[v]];
+    }
+    if (newVertexCount < _vertexCount)
+        remapVertices(remap, newVertexCount);
+}
+
+void MeshOptimizer::optimizeVertexCache() {
+    const uint32_t numTriangles = uint32_t(_indices.size() / 3);
+    if (numTriangles == 0)
+        return;
+
+    // triangles using each vertex, the live ones at the front.
+    std::vector<uint32_t> offsets(_vertexCount + 1, 0);
+    for (uint32_t index : _indices)
+        offsets[index + 1]++;
+    for (uint32_t v = 0; v < _vertexCount; ++v)
+        offsets[v + 1] += offsets[v];
+
+    std::vector<uint32_t> adjacency(_indices.size());
+    std::vector<uint32_t> remaining(_vertexCount, 0);
+    for (uint32_t t = 0; t < numTriangles; ++t) {
+        for (int k = 0; k < 3; ++k) {
+            uint32_t v = _indices[t * 3 + k];
+            adjacency[offsets[v] + remaining[v]++] = t;
+        }
+    }
+
+    std::vector<int> cachePosition(_vertexCount, -1);
+    std::vector<float> vertexScores(_vertexCount);
+    for (uint32_t v = 0; v < _vertexCount; ++v)
+        vertexScores[v] = vertexScore(-1, remaining[v]);
+
+    std::vector<float> triangleScores(numTriangles);
+    for (uint32_t t = 0; t < numTriangles; ++t) {
+        triangleScores[t] = vertexScores[_indices[t * 3]] +
+                            vertexScores[_indices[t * 3 + 1]] +
+                            vertexScores[_indices[t * 3 + 2]];
+    }
+    std::vector<bool> emitted(numTriangles, false);
+
+    uint32_t bestTriangle = uint32_t(std::max_element(triangleScores.begin(), triangleScores.end()) - triangleScores.begin());
+    uint32_t deadEndCursor = 0;
+
+    std::vector<uint32_t> output;
+    output.reserve(_indices.size());
+    std::vector<uint32_t> cache, newCache;
+    cache.reserve(scoringCacheSize + 3);
+    newCache.reserve(scoringCacheSize + 3);
+
+    auto updateScore = [&](uint32_t v, int position) {
+        cachePosition[v] = position;
+        float score = vertexScore(position, remaining[v]);
+        float delta = score - vertexScores[v];
+        vertexScores[v] = score;
+        for (uint32_t i = 0; i < remaining[v]; ++i)
+            triangleScores[adjacency[offsets[v] + i]] += delta;
+    };
+
+    for (uint32_t n = 0; n < numTriangles; ++n) {
+        if (bestTriangle == uint32_t(-1)) {
+            // no triangle uses a cached vertex, continue in input order.
+            while (emitted[deadEndCursor])
+                ++deadEndCursor;
+            bestTriangle = deadEndCursor;
+        }
+        const uint32_t t = bestTriangle;
+        const uint32_t tri[3] = { _indices[t * 3], _indices[t * 3 + 1], _indices[t * 3 + 2] };
+        emitted[t] = true;
+        output.insert(output.end(), std::begin(tri), std::end(tri));
+
+        for (uint32_t v : tri) {
+            uint32_t* begin = &adjacency[offsets[v]];
+            uint32_t* end = begin + remaining[v];
+            uint32_t* it = std::find(begin, end, t);
+            FVASSERT_DEBUG(it != end);
+            std::iter_swap(it, end - 1);
+            remaining[v]--;
+        }
+
+        // LRU cache, the vertices of the triangle move to the front.
+        newCache.clear();
+        for (uint32_t v : tri) {
+            if (std::find(newCache.begin(), newCache.end(), v) == newCache.end())
+                newCache.push_back(v);
+        }
+        for (uint32_t v : cache) {
+            if (v != tri[0] && v != tri[1] && v != tri[2])
+                newCache.push_back(v);
+        }
+        for (size_t i = scoringCacheSize; i < newCache.size(); ++i)
+            updateScore(newCache[i], -1);
+        if (newCache.size() > scoringCacheSize)
+            newCache.resize(scoringCacheSize);
+        cache.swap(newCache);
+
+        bestTriangle = uint32_t(-1);
+        float bestScore = -1.0f;
+        for (size_t i = 0; i < cache.size(); ++i)
+            updateScore(cache[i], int(i));
+        for (uint32_t v : cache) {
+            for (uint32_t i = 0; i < remaining[v]; ++i) {
+                uint32_t candidate = adjacency[offsets[v] + i];
+                float score = triangleScores[candidate];
+                if (score > bestScore || (score == bestScore && candidate < bestTriangle)) {
+                    bestScore = score;
+                    bestTriangle = candidate;
+                }
+            }
+        }
+    }
+    _indices = std::move(output);
+}
+
+void MeshOptimizer::optimizeOverdraw() {
+    const uint32_t numTriangles = uint32_t(_indices.size() / 3);
+    if (_positionStream < 0 || numTriangles < 2)
+        return;
+
+    // clusters start where all vertices of a triangle miss the cache.
+    std::vector<uint32_t> clusters;
+    FIFOCache cache(_vertexCount, defaultCacheSize);
+    for (uint32_t t = 0; t < numTriangles; ++t) {
+        int misses = 0;
+        for (int k = 0; k < 3; ++k) {
+            if (cache.access(_indices[t * 3 + k]) == false)
+                misses++;
+        }
+        if (t == 0 || misses == 3)
+            clusters.push_back(t);
+    }
+    if (clusters.size() < 2)
+        return;
+
+    struct Cluster {
+        uint32_t begin, end;
+        Vector3 centroid;
+        Vector3 normal;
+        float area;
+    };
+    std::vector<Cluster> clusterInfo(clusters.size());
+    Vector3 meshCentroid = Vector3::zero;
+    float meshArea = 0.0f;
+    for (size_t c = 0; c < clusters.size(); ++c) {
+        Cluster& cluster = clusterInfo[c];
+        cluster.begin = clusters[c];
+        cluster.end = (c + 1 < clusters.size()) ? clusters[c + 1] : numTriangles;
+        cluster.area = 0.0f;
+        for (uint32_t t = cluster.begin; t < cluster.end; ++t) {
+            Vector3 p0 = position(_indices[t * 3]);
+            Vector3 p1 = position(_indices[t * 3 + 1]);
+            Vector3 p2 = position(_indices[t * 3 + 2]);
+            Vector3 n = Vector3::cross(p1 - p0, p2 - p0);
+            float area = n.magnitude();
+            cluster.centroid += (p0 + p1 + p2) * (area / 3.0f);
+            cluster.normal += n;
+            cluster.area += area;
+        }
+        meshCentroid += cluster.centroid;
+        meshArea += cluster.area;
+    }
+    if (meshArea > 0.0f)
+        meshCentroid = meshCentroid * (1.0f / meshArea);
+
+    // clusters facing away from the center are more likely to occlude others.
+    std::vector<float> keys(clusterInfo.size());
+    for (size_t c = 0; c < clusterInfo.size(); ++c) {
+        const Cluster& cluster = clusterInfo[c];
+        if (cluster.area > 0.0f) {
+            Vector3 centroid = cluster.centroid * (1.0f / cluster.area);
+            keys[c] = Vector3::dot(centroid - meshCentroid, cluster.normal.normalized());
+        } else {
+            keys[c] = 0.0f;
+        }
+    }
+    std::vector<uint32_t> order(clusterInfo.size());
+    std::iota(order.begin(), order.end(), 0U);
+    std::stable_sort(order.begin(), order.end(),
+                     [&](uint32_t a, uint32_t b) { return keys[a] > keys[b]; });
+
+    std::vector<uint32_t> output;
+    output.reserve(_indices.size());
+    for (uint32_t c : order) {
+        const Cluster& cluster = clusterInfo[c];
+        output.insert(output.end(),
+                      _indices.begin() + cluster.begin * 3,
+                      _indices.begin() + cluster.end * 3);
+    }
+    _indices = std::move(output);
+}
+
+void MeshOptimizer::optimizeVertexFetch() {
+    std::vector<uint32_t> remap(_vertexCount, uint32_t(-1));
+    uint32_t newVertexCount = 0;
+    for (uint32_t index : _indices) {
+        if (remap[index] == uint32_t(-1))
+            remap[index] = newVertexCount++;
+    }
+    remapVertices(remap, newVertexCount);
+}
+
+void MeshOptimizer::optimize() {
+    weldVertices();
+    optimizeVertexCache();
+    optimizeOverdraw();
+    optimizeVertexFetch();
+}
+
+MeshOptimizer::Statistics MeshOptimizer::analyze(uint32_t cacheSize) const {
+    Statistics stats = {};
+    stats.vertexCount = _vertexCount;
+    stats.triangleCount = uint32_t(_indices.size() / 3);
+
+    FIFOCache cache(_vertexCount, cacheSize);
+    for (uint32_t index : _indices) {
+        if (cache.access(index) == false)
+            stats.transformedVertices++;
+    }
+    if (stats.triangleCount > 0)
+        stats.acmr = float(stats.transformedVertices) / float(stats.triangleCount);
+    if (stats.vertexCount > 0)
+        stats.atvr = float(stats.transformedVertices) / float(stats.vertexCount);
+    return stats;
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include "../include.h"
+#include <vector>
+#include "Vector3.h"
+
+namespace FV {
+    // Reorders the triangles and vertices of an indexed triangle list for
+    // the post-transform vertex cache and for early depth rejection.
+    // Each vertex attribute is a stream of tightly packed elements. The
+    // results only depend on the input, the same mesh is always ordered
+    // the same way.
+    class FVCORE_API MeshOptimizer {
+    public:
+        struct Stream {
+            std::vector<uint8_t> data;
+            uint32_t elementSize;
+        };
+        struct Statistics {
+            uint32_t vertexCount;
+            uint32_t triangleCount;
+            uint32_t transformedVertices;   // misses of a FIFO cache
+            float acmr;                     // transformed vertices per triangle
+            float atvr;                     // transformed vertices per vertex
+        };
+
+        static constexpr uint32_t defaultCacheSize = 16;
+
+        MeshOptimizer(std::vector<uint32_t> indices, uint32_t vertexCount);
+
+        // streams must have vertexCount elements.
+        void addStream(Stream);
+        // a stream of Vector3 positions, used by optimizeOverdraw.
+        void setPositionStream(uint32_t streamIndex);
+
+        // merges vertices which are equal in all streams.
+        void weldVertices();
+        // Forsyth's linear-speed vertex cache optimization.
+        void optimizeVertexCache();
+        // Splits the triangles into clusters where the vertex cache is
+        // cold, then draws clusters facing outwards from the center first,
+        // so the cache efficiency is mostly kept.
+        void optimizeOverdraw();
+        // orders vertices by their first use and removes unused vertices.
+        void optimizeVertexFetch();
+        // all of the above, in order.
+        void optimize();
+
+        Statistics analyze(uint32_t cacheSize = defaultCacheSize) const;
+
+        const std::vector<uint32_t>& indices() const { return _indices; }
+        const std::vector<Stream>& streams() const { return _streams; }
+        uint32_t vertexCount() const { return _vertexCount; }
+
+    private:
+        void remapVertices(const std::vector<uint32_t>& remap, uint32_t newVertexCount);
+        Vector3 position(uint32_t vertex) const;
+
+        std::vector<uint32_t> _indices;
+        std::vector<Stream> _streams;
+        uint32_t _vertexCount;
+        int _positionStream;
+    };
+}
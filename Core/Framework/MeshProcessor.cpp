@@ -0,0 +1,280 @@
+#include <algorithm>
+#include <numeric>
+#include <fstream>
+#include <optional>
+#include <unordered_map>
+#include "MeshProcessor.h"
+#include "GraphicsDevice.h"
+#include "DispatchQueue.h"
+#include "Hash.h"
+#include "Logger.h"
+
+using namespace FV;
+
+namespace {
+    std::shared_ptr<GPUBuffer> makeBuffer(UploadManager* uploads, size_t length, const void* data) {
+        FVASSERT(length > 0);
+
+        FVASSERT(uploads);
+        auto device = uploads->queue->device();
+
+        auto buffer = device->makeBuffer(length, GPUBuffer::StorageModePrivate, CPUCacheModeDefault);
+        FVASSERT(buffer);
+        if (uploads->upload(data, length, buffer) == false) {
+            FVERROR_ABORT("GPUBuffer upload failed.");
+            return nullptr;
+        }
+        return buffer;
+    }
+
+    struct LevelOfDetailResult {
+        uint64_t key;
+        bool built;
+        std::vector<MeshSimplifier::Level> levels;  // if built
+    };
+
+    // Sets the levels of detail of a mesh from the cache, or builds them.
+    // Returns the key of the mesh and the levels built, to be cached.
+    std::optional<LevelOfDetailResult>
+    buildLevelsOfDetail(Mesh& mesh, const LevelOfDetailCache& cache, const MeshProcessor::Options& options) {
+        std::vector<uint32_t> indices;
+        std::vector<Vector3> positions;
+        if (mesh.triangleListContent(indices, positions) == false || indices.empty())
+            return {};
+
+        const float size = mesh.aabb.isNull() ? 0.0f : (mesh.aabb.max - mesh.aabb.min).magnitude();
+        const float maxError = options.lodMaxError * size;
+        const uint64_t key = LevelOfDetailCache::key(indices, positions, options.lodMaxLevels, maxError);
+        if (auto it = cache.entries.find(key); it != cache.entries.end()) {
+            if (mesh.setLevelsOfDetail(it->second))
+                return LevelOfDetailResult{ key, false };
+            // a collision or a stale entry, built again.
+        }
+        auto levels = MeshSimplifier::buildLevels(indices, positions, options.lodMaxLevels, maxError);
+        mesh.setLevelsOfDetail(levels);
+        return LevelOfDetailResult{ key, true, std::move(levels) };
+    }
+
+    constexpr char lodFileMagic[8] = { 'F', 'V', 'L', 'O', 'D', 0, 0, 0 };
+    constexpr uint32_t lodFileVersion = 1;
+}
+
+uint64_t LevelOfDetailCache::key(const std::vector<uint32_t>& indices,
+                                 const std::vector<Vector3>& positions,
+                                 uint32_t maxLevels, float maxError) {
+    XXH3 hasher(lodFileVersion);
+    hasher.update(indices.data(), indices.size() * sizeof(uint32_t));
+    hasher.update(positions.data(), positions.size() * sizeof(Vector3));
+    hasher.update(&maxLevels, sizeof(maxLevels));
+    hasher.update(&maxError, sizeof(maxError));
+    return hasher.finalize().hash;
+}
+
+void LevelOfDetailCache::read() {
+    std::ifstream fs(path, std::ifstream::binary | std::ifstream::in | std::ifstream::ate);
+    if (fs.good() == false)
+        return;
+    const uint64_t fileSize = uint64_t(fs.tellg());
+    fs.seekg(0, std::ifstream::beg);
+
+    auto readValue = [&fs](auto& value) {
+        fs.read(reinterpret_cast<char*>(&value), sizeof(value));
+        return fs.good();
+    };
+    // lengths are checked before anything is allocated for them.
+    auto remaining = [&fs, fileSize] {
+        return fileSize - std::min(fileSize, uint64_t(fs.tellg()));
+    };
+    constexpr uint64_t levelHeaderSize = sizeof(float) + sizeof(uint32_t);
+    char magic[sizeof(lodFileMagic)] = {};
+    uint32_t version = 0, numEntries = 0;
+    if (readValue(magic) == false || memcmp(magic, lodFileMagic, sizeof(lodFileMagic)) != 0 ||
+        readValue(version) == false || version != lodFileVersion ||
+        readValue(numEntries) == false) {
+        Log::warning("Invalid level of detail cache file: {}", path.generic_u8string());
+        return;
+    }
+    for (uint32_t i = 0; i < numEntries; ++i) {
+        uint64_t key = 0;
+        uint32_t numLevels = 0;
+        if (readValue(key) == false || readValue(numLevels) == false)
+            break;
+        if (uint64_t(numLevels) * levelHeaderSize > remaining()) {
+            fs.setstate(std::ifstream::failbit);
+        } else {
+            std::vector<MeshSimplifier::Level> levels(numLevels);
+            for (auto& level : levels) {
+                uint32_t numIndices = 0;
+                if (readValue(level.error) == false || readValue(numIndices) == false)
+                    break;
+                if (uint64_t(numIndices) * sizeof(uint32_t) > remaining()) {
+                    fs.setstate(std::ifstream::failbit);
+                    break;
+                }
+                level.indices.resize(numIndices);
+                fs.read(reinterpret_cast<char*>(level.indices.data()), std::streamsize(numIndices * sizeof(uint32_t)));
+            }
+            if (fs.good())
+                entries[key] = std::move(levels);
+        }
+        if (fs.good() == false) {
+            Log::warning("Truncated level of detail cache file: {}", path.generic_u8string());
+            break;
+        }
+    }
+}
+
+bool LevelOfDetailCache::write() const {
+    // write to a temporary file first, readers never see a partial file.
+    auto tmpPath = path;
+    tmpPath += ".tmp";
+    if (true) {
+        std::ofstream fs(tmpPath, std::ofstream::binary | std::ofstream::out | std::ofstream::trunc);
+        if (fs.good() == false) {
+            Log::error("Failed to open file: {}", tmpPath.generic_u8string());
+            return false;
+        }
+        auto writeValue = [&fs](const auto& value) {
+            fs.write(reinterpret_cast<const char*>(&value), sizeof(value));
+        };
+        writeValue(lodFileMagic);
+        writeValue(lodFileVersion);
+        writeValue(uint32_t(entries.size()));
+        for (auto& [key, levels] : entries) {
+            writeValue(key);
+            writeValue(uint32_t(levels.size()));
+            for (auto& level : levels) {
+                writeValue(level.error);
+                writeValue(uint32_t(level.indices.size()));
+                fs.write(reinterpret_cast<const char*>(level.indices.data()),
+                         std::streamsize(level.indices.size() * sizeof(uint32_t)));
+            }
+        }
+        if (fs.good() == false) {
+            Log::error("Failed to write file: {}", tmpPath.generic_u8string());
+            return false;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmpPath, path, ec);
+    if (ec) {
+        Log::error("Failed to rename file: {}, error: {}", path.generic_u8string(), ec.message());
+        std::filesystem::remove(tmpPath, ec);
+        return false;
+    }
+    return true;
+}
+
+void MeshProcessor::process(std::span<Mesh* const> meshes) const {
+    if (options.optimize == false && options.buildMeshlets == false && options.buildLevelsOfDetail == false)
+        return;
+
+    // meshes are independent, the results do not depend on the order.
+    std::vector<std::optional<std::pair<MeshOptimizer::Statistics, MeshOptimizer::Statistics>>> results(meshes.size());
+    std::vector<uint32_t> numMeshlets(meshes.size(), 0);
+    std::optional<LevelOfDetailCache> lodCache;
+    std::vector<std::optional<LevelOfDetailResult>> lodResults(meshes.size());
+    if (options.buildLevelsOfDetail) {
+        lodCache.emplace(options.lodCachePath);
+        if (options.lodCachePath.empty() == false)
+            lodCache->read();
+    }
+    dispatchApply(meshes.size(), [&](size_t index) {
+        Mesh& mesh = *meshes[index];
+        if (options.optimize)
+            results.at(index) = mesh.optimize();
+        if (options.buildMeshlets && mesh.buildMeshlets())
+            numMeshlets.at(index) = uint32_t(mesh.meshlets->meshlets.size());
+        if (lodCache)
+            lodResults.at(index) = buildLevelsOfDetail(mesh, *lodCache, options);
+    });
+
+    uint32_t numOptimized = 0;
+    uint64_t numTriangles = 0, transformedBefore = 0, transformedAfter = 0;
+    for (auto& result : results) {
+        if (result.has_value()) {
+            numOptimized++;
+            numTriangles += result->first.triangleCount;
+            transformedBefore += result->first.transformedVertices;
+            transformedAfter += result->second.transformedVertices;
+        }
+    }
+    if (numTriangles > 0) {
+        Log::info("Optimized {} of {} primitives, ACMR {:.3f} -> {:.3f}",
+                  numOptimized, meshes.size(),
+                  double(transformedBefore) / double(numTriangles),
+                  double(transformedAfter) / double(numTriangles));
+    }
+    if (auto total = std::reduce(numMeshlets.begin(), numMeshlets.end(), uint64_t(0)); total > 0)
+        Log::info("Built {} meshlets of {} primitives", total, meshes.size());
+
+    if (lodCache.has_value() == false)
+        return;
+
+    // only the entries of these meshes are kept, the others are of meshes
+    // which are not in the model anymore.
+    decltype(lodCache->entries) entries;
+    uint32_t numBuilt = 0;
+    for (auto& result : lodResults) {
+        if (result.has_value() == false)
+            continue;
+        if (result->built) {
+            entries[result->key] = std::move(result->levels);
+            numBuilt++;
+        } else if (auto it = lodCache->entries.find(result->key); it != lodCache->entries.end()) {
+            entries[result->key] = std::move(it->second);
+            lodCache->entries.erase(it);
+        }
+    }
+    const size_t numRemoved = lodCache->entries.size();
+    lodCache->entries = std::move(entries);
+    if (numBuilt > 0)
+        Log::info("Built levels of detail of {} primitives", numBuilt);
+    if (numRemoved > 0)
+        Log::debug("Removed {} unused levels of detail from the cache", numRemoved);
+    if ((numBuilt > 0 || numRemoved > 0) && options.lodCachePath.empty() == false) {
+        if (lodCache->write() == false)
+            Log::warning("Failed to write level of detail cache: {}", lodCache->path.generic_u8string());
+    }
+}
+
+void MeshProcessor::makeBuffers(std::span<Mesh* const> meshes,
+                                UploadManager* uploads,
+                                std::span<SharedContent> sharedContents,
+                                bool keepContent) {
+    std::unordered_map<const uint8_t*, SharedContent*> shared;
+    for (auto& sc : sharedContents)
+        shared[sc.content.get()] = &sc;
+
+    auto makeMeshBuffer = [&](const std::shared_ptr<const uint8_t>& content, size_t length) {
+        // shared contents are made once, of their whole length.
+        if (auto it = shared.find(content.get()); it != shared.end()) {
+            SharedContent* sc = it->second;
+            if (sc->buffer == nullptr)
+                sc->buffer = makeBuffer(uploads, sc->length, content.get());
+            return sc->buffer;
+        }
+        return makeBuffer(uploads, length, content.get());
+    };
+
+    for (Mesh* mesh : meshes) {
+        for (auto& vb : mesh->vertexBuffers) {
+            size_t length = vb.byteOffset + size_t(vb.byteStride) * vb.vertexCount;
+            if (vb.buffer == nullptr && vb.content && length > 0)
+                vb.buffer = makeMeshBuffer(vb.content, length);
+            if (keepContent == false)
+                vb.content = nullptr;
+        }
+        if (mesh->indexBuffer == nullptr && mesh->indexContent) {
+            size_t indexSize = mesh->indexType == IndexType::UInt16 ? 2 : 4;
+            size_t indexCount = mesh->indexCount;
+            for (auto& level : mesh->levelsOfDetail)
+                indexCount = std::max(indexCount, size_t(level.indexOffset) + level.indexCount);
+            size_t length = mesh->indexBufferByteOffset + indexSize * indexCount;
+            if (length > 0)
+                mesh->indexBuffer = makeMeshBuffer(mesh->indexContent, length);
+        }
+        if (keepContent == false)
+            mesh->indexContent = nullptr;
+    }
+}
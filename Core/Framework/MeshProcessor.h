@@ -0,0 +1,66 @@
+#pragma once
+#include "../include.h"
+#include <vector>
+#include <span>
+#include <filesystem>
+#include <unordered_map>
+#include "Mesh.h"
+#include "MeshSimplifier.h"
+#include "UploadManager.h"
+
+namespace FV {
+    // Levels of detail of all meshes of a model, in a file next to it.
+    // The entries are found by the hash of the geometry and the options.
+    // MeshProcessor writes back only the entries of the meshes it was
+    // given, entries of meshes removed from the model are dropped.
+    class FVCORE_API LevelOfDetailCache {
+    public:
+        LevelOfDetailCache(const std::filesystem::path& path) : path(path) {}
+
+        const std::filesystem::path path;
+        std::unordered_map<uint64_t, std::vector<MeshSimplifier::Level>> entries;
+
+        static uint64_t key(const std::vector<uint32_t>& indices,
+                            const std::vector<Vector3>& positions,
+                            uint32_t maxLevels, float maxError);
+
+        // entries of a missing or invalid file are not loaded, nor the
+        // entries after a length which does not fit in the file.
+        void read();
+        bool write() const;
+    };
+
+    // Prepares the meshes of a loaded model for rendering, from their CPU
+    // contents. The meshes are independent, they are processed in parallel.
+    class FVCORE_API MeshProcessor {
+    public:
+        struct Options {
+            bool optimize = true;
+            bool buildMeshlets = true;          // for culling meshlets in the renderer
+            bool buildLevelsOfDetail = true;
+            uint32_t lodMaxLevels = 4;
+            float lodMaxError = 0.01f;          // relative to the size of a mesh
+            std::filesystem::path lodCachePath; // levels are not cached if empty
+        };
+
+        MeshProcessor(const Options& options) : options(options) {}
+        const Options options;
+
+        // optimizes the meshes, builds meshlets and levels of detail of them.
+        void process(std::span<Mesh* const>) const;
+
+        // A content shared by meshes, as a buffer of a glTF file. The GPU
+        // buffer is made once, of the whole length, if a mesh uses it.
+        struct SharedContent {
+            std::shared_ptr<const uint8_t> content;
+            size_t length;
+            std::shared_ptr<GPUBuffer> buffer;
+        };
+        // makes buffers of the contents which do not have one. The contents
+        // are released unless keepContent is true.
+        static void makeBuffers(std::span<Mesh* const>,
+                                UploadManager*,
+                                std::span<SharedContent>,
+                                bool keepContent);
+    };
+}
@@ -0,0 +1,284 @@
+#include <algorithm>
+#include <numeric>
+#include <unordered_map>
+#include <tuple>
+#include <cmath>
+#include "MeshSimplifier.h"
+#include "MeshOptimizer.h"
+#include "Logger.h"
+
+using namespace FV;
+
+MeshSimplifier::Quadric& MeshSimplifier::Quadric::operator += (const Quadric& q) {
+    a2 += q.a2; b2 += q.b2; c2 += q.c2; d2 += q.d2;
+    ab += q.ab; ac += q.ac; ad += q.ad;
+    bc += q.bc; bd += q.bd; cd += q.cd;
+    weight += q.weight;
+    return *this;
+}
+
+double MeshSimplifier::Quadric::evaluate(const Vector3& p) const {
+    const double x = p.x, y = p.y, z = p.z;
+    return a2 * x * x + b2 * y * y + c2 * z * z + d2
+        + 2.0 * (ab * x * y + ac * x * z + bc * y * z)
+        + 2.0 * (ad * x + bd * y + cd * z);
+}
+
+MeshSimplifier::MeshSimplifier(std::vector<uint32_t> indices, std::span<const Vector3> positions)
+    : _indices(std::move(indices))
+    , _positions(positions.begin(), positions.end())
+    , _error(0.0f) {
+    const uint32_t vertexCount = uint32_t(_positions.size());
+
+    // degenerate triangles are removed first.
+    size_t numIndices = 0;
+    for (size_t t = 0; t + 2 < _indices.size(); t += 3) {
+        uint32_t a = _indices[t], b = _indices[t + 1], c = _indices[t + 2];
+        FVASSERT_DEBUG(a < vertexCount && b < vertexCount && c < vertexCount);
+        if (a != b && b != c && a != c) {
+            _indices[numIndices++] = a;
+            _indices[numIndices++] = b;
+            _indices[numIndices++] = c;
+        }
+    }
+    _indices.resize(numIndices);
+
+    // vertices at the same position are copies with other attributes.
+    std::vector<uint32_t> order(vertexCount);
+    std::iota(order.begin(), order.end(), 0U);
+    std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+        const Vector3& p = _positions[a];
+        const Vector3& q = _positions[b];
+        return std::tie(p.x, p.y, p.z, a) < std::tie(q.x, q.y, q.z, b);
+    });
+    _positionGroups.resize(vertexCount);
+    std::vector<uint32_t> groupSizes(vertexCount, 0);
+    for (uint32_t i = 0; i < vertexCount; ++i) {
+        uint32_t v = order[i];
+        if (i > 0 && _positions[order[i - 1]] == _positions[v])
+            _positionGroups[v] = _positionGroups[order[i - 1]];
+        else
+            _positionGroups[v] = v;
+        groupSizes[_positionGroups[v]]++;
+    }
+    _locked.resize(vertexCount, false);
+    for (uint32_t v = 0; v < vertexCount; ++v)
+        _locked[v] = groupSizes[_positionGroups[v]] > 1;
+
+    // Edges are counted between positions, so seams are not borders.
+    // An edge not shared by exactly two triangles is a border.
+    auto edgeKey = [this](uint32_t a, uint32_t b) {
+        a = _positionGroups[a];
+        b = _positionGroups[b];
+        return (uint64_t(std::min(a, b)) << 32) | uint64_t(std::max(a, b));
+    };
+    std::unordered_map<uint64_t, uint32_t> edges;
+    edges.reserve(_indices.size());
+    for (size_t t = 0; t < _indices.size(); t += 3) {
+        for (int k = 0; k < 3; ++k)
+            edges[edgeKey(_indices[t + k], _indices[t + (k + 1) % 3])]++;
+    }
+    for (size_t t = 0; t < _indices.size(); t += 3) {
+        for (int k = 0; k < 3; ++k) {
+            uint32_t a = _indices[t + k], b = _indices[t + (k + 1) % 3];
+            if (edges[edgeKey(a, b)] != 2) {
+                _locked[a] = true;
+                _locked[b] = true;
+            }
+        }
+    }
+
+    // plane quadrics of the triangles, weighted by area.
+    _quadrics.resize(vertexCount, Quadric{});
+    for (size_t t = 0; t < _indices.size(); t += 3) {
+        const Vector3& p0 = _positions[_indices[t]];
+        const Vector3& p1 = _positions[_indices[t + 1]];
+        const Vector3& p2 = _positions[_indices[t + 2]];
+        Vector3 n = Vector3::cross(p1 - p0, p2 - p0);
+        float length = n.magnitude();
+        if (length <= 0.0f)
+            continue;
+        n = n * (1.0f / length);
+        const double a = n.x, b = n.y, c = n.z;
+        const double d = -Vector3::dot(n, p0);
+        const double w = length * 0.5;
+        const Quadric q = {
+            w * a * a, w * b * b, w * c * c, w * d * d,
+            w * a * b, w * a * c, w * a * d,
+            w * b * c, w * b * d, w * c * d,
+            w
+        };
+        for (int k = 0; k < 3; ++k)
+            _quadrics[_positionGroups[_indices[t + k]]] += q;
+    }
+}
+
+bool MeshSimplifier::canCollapse(uint32_t from, uint32_t to,
+                                 const std::vector<uint32_t>& offsets,
+                                 const std::vector<uint32_t>& adjacency) const {
+    const Vector3& target = _positions[to];
+    std::vector<uint32_t> fromNeighbours, toNeighbours;
+    uint32_t sharedTriangles = 0;
+
+    for (uint32_t i = offsets[from]; i < offsets[from + 1]; ++i) {
+        const uint32_t* tri = &_indices[size_t(adjacency[i]) * 3];
+        if (tri[0] == to || tri[1] == to || tri[2] == to) {
+            sharedTriangles++;
+            continue;
+        }
+        Vector3 p[3] = { _positions[tri[0]], _positions[tri[1]], _positions[tri[2]] };
+        Vector3 n0 = Vector3::cross(p[1] - p[0], p[2] - p[0]);
+        for (int k = 0; k < 3; ++k) {
+            if (tri[k] == from)
+                p[k] = target;
+            else
+                fromNeighbours.push_back(_positionGroups[tri[k]]);
+        }
+        Vector3 n1 = Vector3::cross(p[1] - p[0], p[2] - p[0]);
+        // flipped, or turned more than about 75 degrees.
+        if (Vector3::dot(n0, n1) <= 0.25f * n0.magnitude() * n1.magnitude())
+            return false;
+    }
+    for (uint32_t i = offsets[to]; i < offsets[to + 1]; ++i) {
+        const uint32_t* tri = &_indices[size_t(adjacency[i]) * 3];
+        if (tri[0] == from || tri[1] == from || tri[2] == from)
+            continue;
+        for (int k = 0; k < 3; ++k) {
+            if (tri[k] != to)
+                toNeighbours.push_back(_positionGroups[tri[k]]);
+        }
+    }
+    // Only the vertices across the edge can be next to both, or the
+    // collapse makes a fold.
+    std::sort(fromNeighbours.begin(), fromNeighbours.end());
+    fromNeighbours.erase(std::unique(fromNeighbours.begin(), fromNeighbours.end()), fromNeighbours.end());
+    std::sort(toNeighbours.begin(), toNeighbours.end());
+    toNeighbours.erase(std::unique(toNeighbours.begin(), toNeighbours.end()), toNeighbours.end());
+
+    std::vector<uint32_t> common;
+    std::set_intersection(fromNeighbours.begin(), fromNeighbours.end(),
+                          toNeighbours.begin(), toNeighbours.end(),
+                          std::back_inserter(common));
+    return common.size() <= sharedTriangles;
+}
+
+void MeshSimplifier::simplify(uint32_t targetTriangleCount, float maxError) {
+    const uint32_t vertexCount = uint32_t(_positions.size());
+    const double maxErrorSq = double(maxError) * double(maxError);
+
+    struct Collapse {
+        double cost;
+        uint32_t from;
+        uint32_t to;
+    };
+    std::vector<Collapse> collapses;
+
+    // Each pass collapses the cheapest edges which do not touch each
+    // other, then the adjacency is made again.
+    while (triangleCount() > targetTriangleCount) {
+        const uint32_t numTriangles = triangleCount();
+
+        std::vector<uint32_t> offsets(vertexCount + 1, 0);
+        for (uint32_t index : _indices)
+            offsets[index + 1]++;
+        for (uint32_t v = 0; v < vertexCount; ++v)
+            offsets[v + 1] += offsets[v];
+        std::vector<uint32_t> adjacency(_indices.size());
+        std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for (uint32_t t = 0; t < numTriangles; ++t) {
+            for (int k = 0; k < 3; ++k)
+                adjacency[fill[_indices[t * 3 + k]]++] = t;
+        }
+
+        collapses.clear();
+        for (uint32_t t = 0; t < numTriangles; ++t) {
+            for (int k = 0; k < 3; ++k) {
+                const uint32_t a = _indices[t * 3 + k];
+                const uint32_t b = _indices[t * 3 + (k + 1) % 3];
+                for (auto [from, to] : { std::pair{ a, b }, std::pair{ b, a } }) {
+                    if (_locked[from])
+                        continue;
+                    Quadric q = _quadrics[_positionGroups[from]];
+                    q += _quadrics[_positionGroups[to]];
+                    double cost = q.weight > 0.0 ? std::max(q.evaluate(_positions[to]) / q.weight, 0.0) : 0.0;
+                    if (cost <= maxErrorSq)
+                        collapses.push_back({ cost, from, to });
+                }
+            }
+        }
+        if (collapses.empty())
+            break;
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) {
+            return std::tie(a.cost, a.from, a.to) < std::tie(b.cost, b.from, b.to);
+        });
+
+        std::vector<uint32_t> remap(vertexCount);
+        std::iota(remap.begin(), remap.end(), 0U);
+        std::vector<bool> touched(vertexCount, false);
+        const uint32_t goal = numTriangles - targetTriangleCount;
+        uint32_t removed = 0;
+        uint32_t numCollapsed = 0;
+        for (const Collapse& collapse : collapses) {
+            if (removed >= goal)
+                break;
+            const uint32_t from = collapse.from;
+            const uint32_t to = collapse.to;
+            if (touched[from] || touched[to])
+                continue;
+            if (canCollapse(from, to, offsets, adjacency) == false)
+                continue;
+
+            for (uint32_t i = offsets[from]; i < offsets[from + 1]; ++i) {
+                const uint32_t* tri = &_indices[size_t(adjacency[i]) * 3];
+                if (tri[0] == to || tri[1] == to || tri[2] == to)
+                    removed++;
+                touched[tri[0]] = true;
+                touched[tri[1]] = true;
+                touched[tri[2]] = true;
+            }
+            touched[to] = true;
+            remap[from] = to;
+            _quadrics[_positionGroups[to]] += _quadrics[_positionGroups[from]];
+            _error = std::max(_error, float(sqrt(collapse.cost)));
+            numCollapsed++;
+        }
+        if (numCollapsed == 0)
+            break;
+
+        // triangles on the collapsed edges become degenerate.
+        size_t numIndices = 0;
+        for (size_t t = 0; t < _indices.size(); t += 3) {
+            uint32_t a = remap[_indices[t]];
+            uint32_t b = remap[_indices[t + 1]];
+            uint32_t c = remap[_indices[t + 2]];
+            if (a != b && b != c && a != c) {
+                _indices[numIndices++] = a;
+                _indices[numIndices++] = b;
+                _indices[numIndices++] = c;
+            }
+        }
+        _indices.resize(numIndices);
+    }
+}
+
+std::vector<MeshSimplifier::Level> MeshSimplifier::buildLevels(std::span<const uint32_t> indices,
+                                                               std::span<const Vector3> positions,
+                                                               uint32_t maxLevels,
+                                                               float maxError) {
+    std::vector<Level> levels;
+    MeshSimplifier simplifier({ indices.begin(), indices.end() }, positions);
+    uint32_t numTriangles = simplifier.triangleCount();
+    while (levels.size() < maxLevels) {
+        simplifier.simplify(numTriangles / 2, maxError);
+        const uint32_t result = simplifier.triangleCount();
+        // not worth another level.
+        if (result == 0 || result * 4 > numTriangles * 3)
+            break;
+
+        MeshOptimizer optimizer(simplifier.indices(), uint32_t(positions.size()));
+        optimizer.optimizeVertexCache();
+        levels.push_back({ optimizer.indices(), simplifier.error() });
+        numTriangles = result;
+    }
+    return levels;
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include "../include.h"
+#include <vector>
+#include <span>
+#include "Vector3.h"
+
+namespace FV {
+    // Simplifies an indexed triangle list by collapsing edges in order of
+    // their quadric error (Garland and Heckbert). Each collapse merges a
+    // vertex into a neighbour without moving it, so the vertex buffers
+    // are kept as they are and only the indices change.
+    // Vertices on a border of the triangle list, where the mesh meets
+    // other primitives with different materials, and vertices on seams
+    // of the attributes, where vertices share a position, are never
+    // collapsed.
+    class FVCORE_API MeshSimplifier {
+    public:
+        struct Level {
+            std::vector<uint32_t> indices;
+            float error;
+        };
+
+        MeshSimplifier(std::vector<uint32_t> indices, std::span<const Vector3> positions);
+
+        // Collapses edges until there are at most targetTriangleCount
+        // triangles, or until the next collapse would be more than
+        // maxError away from the original surface. Can be called again
+        // with a smaller target, errors are measured from the original.
+        void simplify(uint32_t targetTriangleCount, float maxError);
+
+        const std::vector<uint32_t>& indices() const { return _indices; }
+        uint32_t triangleCount() const { return uint32_t(_indices.size() / 3); }
+        // estimated distance from the original surface, in units of the
+        // positions, from the quadrics of the collapses.
+        float error() const { return _error; }
+
+        // A chain of levels, each with about half the triangles of the
+        // previous one, ordered for the vertex cache. Stops at maxLevels,
+        // or when a level can not be reduced enough within maxError.
+        static std::vector<Level> buildLevels(std::span<const uint32_t> indices,
+                                              std::span<const Vector3> positions,
+                                              uint32_t maxLevels,
+                                              float maxError);
+
+    private:
+        struct Quadric {
+            double a2, b2, c2, d2;
+            double ab, ac, ad, bc, bd, cd;
+            double weight;
+
+            Quadric& operator += (const Quadric&);
+            double evaluate(const Vector3&) const;
+        };
+
+        // false if the collapse would flip a triangle or make the mesh
+        // non-manifold.
+        bool canCollapse(uint32_t from, uint32_t to,
+                         const std::vector<uint32_t>& offsets,
+                         const std::vector<uint32_t>& adjacency) const;
+
+        std::vector<uint32_t> _indices;
+        std::vector<Vector3> _positions;
+        std::vector<uint32_t> _positionGroups;  // first vertex at the same position
+        std::vector<Quadric> _quadrics;         // of each position group
+        std::vector<bool> _locked;
+        float _error;
+    };
+}
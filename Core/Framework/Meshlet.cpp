@@ -0,0 +1,162 @@
+#include <algorithm>
+#include <cmath>
+#include "Meshlet.h"
+#include "Logger.h"
+
+using namespace FV;
+
+namespace {
+    void computeBounds(Meshlet& meshlet,
+                       const uint32_t* vertices,
+                       const uint8_t* triangles,
+                       std::span<const Vector3> positions) {
+        AABB aabb = AABB::null;
+        for (uint32_t i = 0; i < meshlet.vertexCount; ++i)
+            aabb.expand(positions[vertices[i]]);
+
+        Vector3 center = (aabb.min + aabb.max) * 0.5f;
+        float radiusSq = 0.0f;
+        for (uint32_t i = 0; i < meshlet.vertexCount; ++i)
+            radiusSq = std::max(radiusSq, (positions[vertices[i]] - center).magnitudeSquared());
+
+        meshlet.aabb = aabb;
+        meshlet.boundingSphere = { center, sqrtf(radiusSq) };
+
+        // normal cone of the triangles, degenerate ones are ignored.
+        std::vector<Vector3> normals;
+        normals.reserve(meshlet.triangleCount);
+        Vector3 axis = Vector3::zero;
+        for (uint32_t t = 0; t < meshlet.triangleCount; ++t) {
+            const uint8_t* tri = &triangles[t * 3];
+            const Vector3& p0 = positions[vertices[tri[0]]];
+            const Vector3& p1 = positions[vertices[tri[1]]];
+            const Vector3& p2 = positions[vertices[tri[2]]];
+            Vector3 n = Vector3::cross(p1 - p0, p2 - p0);
+            float length = n.magnitude();
+            if (length > 0.0f) {
+                n = n * (1.0f / length);
+                normals.push_back(n);
+                axis += n;
+            }
+        }
+        float axisLength = axis.magnitude();
+        meshlet.coneApex = center;
+        meshlet.coneAxis = Vector3::zero;
+        meshlet.coneCutoff = 2.0f;
+        if (normals.empty() || axisLength <= 0.0f)
+            return;
+        axis = axis * (1.0f / axisLength);
+
+        float minDot = 1.0f;
+        for (const Vector3& n : normals)
+            minDot = std::min(minDot, Vector3::dot(axis, n));
+        // wider than about 84 degrees, can not be culled.
+        if (minDot <= 0.1f)
+            return;
+
+        // move the apex back along the axis until it is behind the plane
+        // of every triangle, only concave meshlets need this.
+        float maxt = 0.0f;
+        size_t n = 0;
+        for (uint32_t t = 0; t < meshlet.triangleCount; ++t) {
+            const uint8_t* tri = &triangles[t * 3];
+            const Vector3& p0 = positions[vertices[tri[0]]];
+            const Vector3& p1 = positions[vertices[tri[1]]];
+            const Vector3& p2 = positions[vertices[tri[2]]];
+            if (Vector3::cross(p1 - p0, p2 - p0).magnitude() <= 0.0f)
+                continue;
+            const Vector3& normal = normals[n++];
+            float dc = Vector3::dot(center - p0, normal);
+            float dn = Vector3::dot(axis, normal);
+            maxt = std::max(maxt, dc / dn);
+        }
+        meshlet.coneApex = center - axis * maxt;
+        meshlet.coneAxis = axis;
+        meshlet.coneCutoff = sqrtf(1.0f - minDot * minDot);
+    }
+}
+
+MeshletSet MeshletSet::build(std::span<const uint32_t> indices, std::span<const Vector3> positions) {
+    static_assert(maxVertices < 0xff);
+
+    MeshletSet set;
+    const size_t numTriangles = indices.size() / 3;
+    set.triangles.reserve(numTriangles * 3);
+    set.vertices.reserve(std::min(indices.size(), positions.size() * 2));
+
+    // position of each vertex in the current meshlet
+    std::vector<uint8_t> localIndices(positions.size(), 0xff);
+
+    Meshlet meshlet = {};
+    auto finish = [&] {
+        if (meshlet.triangleCount == 0)
+            return;
+        computeBounds(meshlet,
+                      &set.vertices[meshlet.vertexOffset],
+                      &set.triangles[size_t(meshlet.triangleOffset) * 3],
+                      positions);
+        for (uint32_t i = 0; i < meshlet.vertexCount; ++i)
+            localIndices[set.vertices[meshlet.vertexOffset + i]] = 0xff;
+        set.meshlets.push_back(meshlet);
+
+        meshlet = {};
+        meshlet.vertexOffset = uint32_t(set.vertices.size());
+        meshlet.triangleOffset = uint32_t(set.triangles.size() / 3);
+    };
+
+    for (size_t t = 0; t < numTriangles; ++t) {
+        const uint32_t tri[3] = { indices[t * 3], indices[t * 3 + 1], indices[t * 3 + 2] };
+        FVASSERT_DEBUG(tri[0] < positions.size() && tri[1] < positions.size() && tri[2] < positions.size());
+
+        uint32_t newVertices = 0;
+        if (localIndices[tri[0]] == 0xff)
+            newVertices++;
+        if (localIndices[tri[1]] == 0xff && tri[1] != tri[0])
+            newVertices++;
+        if (localIndices[tri[2]] == 0xff && tri[2] != tri[0] && tri[2] != tri[1])
+            newVertices++;
+        if (meshlet.vertexCount + newVertices > maxVertices ||
+            meshlet.triangleCount + 1 > maxTriangles)
+            finish();
+
+        for (uint32_t v : tri) {
+            if (localIndices[v] == 0xff) {
+                localIndices[v] = uint8_t(meshlet.vertexCount++);
+                set.vertices.push_back(v);
+            }
+            set.triangles.push_back(localIndices[v]);
+        }
+        meshlet.triangleCount++;
+    }
+    finish();
+    return set;
+}
+
+std::vector<uint32_t> MeshletSet::indices() const {
+    std::vector<uint32_t> output;
+    output.reserve(triangles.size());
+    for (const Meshlet& meshlet : meshlets) {
+        FVASSERT_DEBUG(meshlet.triangleOffset * 3 == output.size());
+        const uint8_t* tri = &triangles[size_t(meshlet.triangleOffset) * 3];
+        for (uint32_t i = 0; i < meshlet.triangleCount * 3; ++i)
+            output.push_back(vertices[meshlet.vertexOffset + tri[i]]);
+    }
+    return output;
+}
+
+void MeshletSet::cull(const ViewFrustum& frustum, std::vector<uint32_t>& visible, bool backfaceCulling) const {
+    const Vector3 eye = frustum.view.position();
+    for (uint32_t index = 0; index < meshlets.size(); ++index) {
+        const Meshlet& meshlet = meshlets[index];
+        if (frustum.intersects(meshlet.boundingSphere) == false)
+            continue;
+        if (frustum.intersects(meshlet.aabb) == false)
+            continue;
+        if (backfaceCulling && meshlet.coneCutoff <= 1.0f) {
+            Vector3 dir = (meshlet.coneApex - eye).normalized();
+            if (Vector3::dot(dir, meshlet.coneAxis) >= meshlet.coneCutoff)
+                continue;
+        }
+        visible.push_back(index);
+    }
+}
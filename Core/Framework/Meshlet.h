@@ -0,0 +1,51 @@
+#pragma once
+#include "../include.h"
+#include <vector>
+#include <span>
+#include "Vector3.h"
+#include "Sphere.h"
+#include "AABB.h"
+#include "ViewProjection.h"
+
+namespace FV {
+    struct Meshlet {
+        uint32_t vertexOffset;      // first element in MeshletSet::vertices
+        uint32_t triangleOffset;    // first triangle in MeshletSet::triangles
+        uint32_t vertexCount;
+        uint32_t triangleCount;
+
+        Sphere boundingSphere;
+        AABB aabb;
+        // All triangles face away from a viewer at p if
+        // dot(normalize(coneApex - p), coneAxis) >= coneCutoff.
+        // The cutoff is greater than 1 if the normals are too spread.
+        Vector3 coneApex;
+        Vector3 coneAxis;
+        float coneCutoff;
+    };
+
+    // Splits a triangle list into clusters of nearby triangles, each with
+    // bounds for culling. The triangles are split in order, so a list
+    // optimized for the vertex cache gives compact meshlets.
+    class FVCORE_API MeshletSet {
+    public:
+        static constexpr uint32_t maxVertices = 64;
+        static constexpr uint32_t maxTriangles = 124;
+
+        std::vector<Meshlet> meshlets;
+        std::vector<uint32_t> vertices;     // vertex indices of the mesh
+        std::vector<uint8_t> triangles;     // 3 indices into the vertices of a meshlet
+
+        // positions are indexed by the vertex indices.
+        static MeshletSet build(std::span<const uint32_t> indices, std::span<const Vector3> positions);
+
+        // Triangle list of the mesh in meshlet order, the triangles of a
+        // meshlet are the indices from triangleOffset * 3.
+        std::vector<uint32_t> indices() const;
+
+        // Appends the indices of meshlets which may be visible in
+        // ascending order. The frustum must be in the space of the mesh.
+        // Backface culling treats cross(p1 - p0, p2 - p0) as the front.
+        void cull(const ViewFrustum&, std::vector<uint32_t>& visible, bool backfaceCulling = false) const;
+    };
+}
@@ -75,6 +75,16 @@ namespace FV {
         // Depth Stencil
         Depth24Unorm_stencil8, // 24-bit normalized uint depth, 8-bit uint stencil
         Depth32Float_stencil8, // 32-bit float depth, 8-bit uint stencil, 24-bit unused.
+
+        // Block compressed formats (4x4 texel blocks)
+        BC1RGBAUnorm,       //  8 bytes per block, RGB565 endpoints, 1-bit alpha
+        BC1RGBAUnorm_srgb,
+        BC3RGBAUnorm,       // 16 bytes per block, BC1 color + BC4 alpha
+        BC3RGBAUnorm_srgb,
+        BC4RUnorm,          //  8 bytes per block, single channel
+        BC5RGUnorm,         // 16 bytes per block, two BC4 channels
+        BC7RGBAUnorm,       // 16 bytes per block
+        BC7RGBAUnorm_srgb,
     };
 
     constexpr bool isColorFormat(PixelFormat f) {
@@ -111,6 +121,21 @@ namespace FV {
         return false;
     }
 
+    constexpr bool isCompressedFormat(PixelFormat f) {
+        switch (f) {
+        case PixelFormat::BC1RGBAUnorm:
+        case PixelFormat::BC1RGBAUnorm_srgb:
+        case PixelFormat::BC3RGBAUnorm:
+        case PixelFormat::BC3RGBAUnorm_srgb:
+        case PixelFormat::BC4RUnorm:
+        case PixelFormat::BC5RGUnorm:
+        case PixelFormat::BC7RGBAUnorm:
+        case PixelFormat::BC7RGBAUnorm_srgb:
+            return true;
+        }
+        return false;
+    }
+
     constexpr uint32_t pixelFormatBytesPerPixel(PixelFormat f) {
         switch (f) {
             // 8 bit formats
@@ -185,4 +210,35 @@ namespace FV {
         }
         return 0; // unsupported
     }
+
+    // width and height of a texel block, 1 for uncompressed formats.
+    constexpr uint32_t pixelFormatBlockSize(PixelFormat f) {
+        if (isCompressedFormat(f))
+            return 4;
+        return 1;
+    }
+
+    constexpr uint32_t pixelFormatBytesPerBlock(PixelFormat f) {
+        switch (f) {
+        case PixelFormat::BC1RGBAUnorm:
+        case PixelFormat::BC1RGBAUnorm_srgb:
+        case PixelFormat::BC4RUnorm:
+            return 8;
+        case PixelFormat::BC3RGBAUnorm:
+        case PixelFormat::BC3RGBAUnorm_srgb:
+        case PixelFormat::BC5RGUnorm:
+        case PixelFormat::BC7RGBAUnorm:
+        case PixelFormat::BC7RGBAUnorm_srgb:
+            return 16;
+        }
+        return pixelFormatBytesPerPixel(f);
+    }
+
+    // number of bytes for width x height x depth texels, rounded up to whole blocks.
+    constexpr size_t pixelFormatBufferLength(PixelFormat f, uint32_t width, uint32_t height, uint32_t depth = 1) {
+        const uint32_t blockSize = pixelFormatBlockSize(f);
+        const size_t blocksWide = (width + blockSize - 1) / blockSize;
+        const size_t blocksHigh = (height + blockSize - 1) / blockSize;
+        return blocksWide * blocksHigh * size_t(depth) * pixelFormatBytesPerBlock(f);
+    }
 }
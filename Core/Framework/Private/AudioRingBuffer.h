@@ -0,0 +1,99 @@
+#pragma once
+#include "../../include.h"
+#include <atomic>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <stop_token>
+#include <condition_variable>
+
+namespace FV {
+    // Single-producer single-consumer ring of fixed-size PCM slots.
+    // The decoder thread fills slots ahead of playback and the mixer
+    // thread copies them into the source queue, neither side locks.
+    class AudioRingBuffer {
+    public:
+        struct Slot {
+            uint8_t* data;
+            size_t bytes;
+            double timestamp;       // stream position of the first sample
+            double position;        // stream position after the last sample
+            uint32_t generation;    // player generation the data was decoded for
+        };
+
+        AudioRingBuffer(size_t slotCount, size_t slotBytes)
+            : slotBytes(slotBytes)
+            , storage(slotCount * slotBytes)
+            , slots(slotCount)
+            , head(0)
+            , tail(0) {
+            FVASSERT_DEBUG(slotCount > 0);
+            for (size_t i = 0; i < slotCount; ++i)
+                slots[i] = { storage.data() + i * slotBytes, 0, 0.0, 0.0, 0 };
+        }
+
+        const size_t slotBytes;
+
+        // producer
+        Slot* beginWrite() {
+            size_t h = head.load(std::memory_order_relaxed);
+            if (h - tail.load(std::memory_order_acquire) >= slots.size())
+                return nullptr;
+            return &slots[h % slots.size()];
+        }
+        void endWrite() {
+            head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        // consumer
+        Slot* front() {
+            size_t t = tail.load(std::memory_order_relaxed);
+            if (t == head.load(std::memory_order_acquire))
+                return nullptr;
+            return &slots[t % slots.size()];
+        }
+        void pop() {
+            tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        bool isEmpty() const {
+            return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+        }
+
+    private:
+        std::vector<uint8_t> storage;
+        std::vector<Slot> slots;
+        alignas(64) std::atomic<size_t> head;
+        alignas(64) std::atomic<size_t> tail;
+    };
+
+    // Auto-reset event, a notification is kept until the next wait.
+    class AudioEvent {
+    public:
+        void notify() {
+            if (true) {
+                std::scoped_lock guard(lock);
+                signaled = true;
+            }
+            cond.notify_one();
+        }
+
+        void wait(std::stop_token stopToken) {
+            std::unique_lock guard(lock);
+            cond.wait(guard, stopToken, [this] { return signaled; });
+            signaled = false;
+        }
+
+        template <typename Clock, typename Duration>
+        void waitUntil(std::stop_token stopToken, const std::chrono::time_point<Clock, Duration>& t) {
+            std::unique_lock guard(lock);
+            cond.wait_until(guard, stopToken, t, [this] { return signaled; });
+            signaled = false;
+        }
+
+    private:
+        std::mutex lock;
+        std::condition_variable_any cond;
+        bool signaled = false;
+    };
+}
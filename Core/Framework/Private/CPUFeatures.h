@@ -0,0 +1,117 @@
+#pragma once
+#include "../../include.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#   define FVCORE_ARCH_X86 1
+#   ifdef _MSC_VER
+#       include <intrin.h>
+#   else
+#       include <cpuid.h>
+#   endif
+#   include <immintrin.h>
+#elif defined(_M_ARM64) || defined(__aarch64__)
+#   define FVCORE_ARCH_ARM64 1
+#   include <arm_neon.h>
+#   if defined(_WIN32)
+#       include <windows.h>
+#   elif defined(__linux__)
+#       include <sys/auxv.h>
+#   endif
+#endif
+
+// Enables instruction set extensions for a single function on GCC/Clang.
+// MSVC allows any intrinsics without per-function target attributes.
+#if defined(__GNUC__) || defined(__clang__)
+#   define FVCORE_TARGET(isa) __attribute__((target(isa)))
+#else
+#   define FVCORE_TARGET(isa)
+#endif
+
+namespace FV {
+    struct CPUFeatures {
+        // x86
+        bool sse41 = false;
+        bool sse42 = false;
+        bool ssse3 = false;
+        bool avx = false;
+        bool avx2 = false;
+        bool f16c = false;
+        bool pclmul = false;
+        bool sha = false;
+        // ARMv8
+        bool neon = false;
+        bool armCRC32 = false;
+        bool armSHA1 = false;
+        bool armSHA2 = false;
+        bool armSHA512 = false;
+
+        static const CPUFeatures& current() {
+            static const CPUFeatures features = detect();
+            return features;
+        }
+
+    private:
+        static CPUFeatures detect() {
+            CPUFeatures features = {};
+#if FVCORE_ARCH_X86
+            auto cpuid = [](uint32_t leaf, uint32_t subleaf, uint32_t reg[4]) {
+#ifdef _MSC_VER
+                __cpuidex(reinterpret_cast<int*>(reg), int(leaf), int(subleaf));
+#else
+                __cpuid_count(leaf, subleaf, reg[0], reg[1], reg[2], reg[3]);
+#endif
+            };
+            uint32_t reg[4] = {};
+            cpuid(0, 0, reg);
+            const uint32_t maxLeaf = reg[0];
+            if (maxLeaf >= 1) {
+                cpuid(1, 0, reg);
+                features.ssse3 = (reg[2] & (1U << 9)) != 0;
+                features.sse41 = (reg[2] & (1U << 19)) != 0;
+                features.sse42 = (reg[2] & (1U << 20)) != 0;
+                features.pclmul = (reg[2] & (1U << 1)) != 0;
+
+                // AVX requires the OS to save YMM state (OSXSAVE + XCR0).
+                const bool osxsave = (reg[2] & (1U << 27)) != 0;
+                bool ymmEnabled = false;
+                if (osxsave) {
+#ifdef _MSC_VER
+                    uint64_t xcr0 = _xgetbv(0);
+#else
+                    uint32_t eax, edx;
+                    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+                    uint64_t xcr0 = (uint64_t(edx) << 32) | eax;
+#endif
+                    ymmEnabled = (xcr0 & 0x6) == 0x6;
+                }
+                features.avx = ymmEnabled && (reg[2] & (1U << 28)) != 0;
+                features.f16c = features.avx && (reg[2] & (1U << 29)) != 0;
+            }
+            if (maxLeaf >= 7) {
+                cpuid(7, 0, reg);
+                features.avx2 = features.avx && (reg[1] & (1U << 5)) != 0;
+                features.sha = (reg[1] & (1U << 29)) != 0;
+            }
+#elif FVCORE_ARCH_ARM64
+            features.neon = true;
+#   if defined(_WIN32)
+            features.armCRC32 = IsProcessorFeaturePresent(PF_ARM_V8_CRC32_INSTRUCTIONS_AVAILABLE) != 0;
+            features.armSHA1 = IsProcessorFeaturePresent(PF_ARM_V8_CRYPTO_INSTRUCTIONS_AVAILABLE) != 0;
+            features.armSHA2 = features.armSHA1;
+#   elif defined(__APPLE__)
+            features.armCRC32 = true;
+            features.armSHA1 = true;
+            features.armSHA2 = true;
+            features.armSHA512 = true;
+#   elif defined(__linux__)
+            unsigned long hwcap = getauxval(AT_HWCAP);
+            features.armCRC32 = (hwcap & (1UL << 7)) != 0;  // HWCAP_CRC32
+            features.armSHA1 = (hwcap & (1UL << 5)) != 0;   // HWCAP_SHA1
+            features.armSHA2 = (hwcap & (1UL << 6)) != 0;   // HWCAP_SHA2
+            features.armSHA512 = (hwcap & (1UL << 21)) != 0;// HWCAP_SHA512
+#   endif
+#endif
+            return features;
+        }
+    };
+}
@@ -0,0 +1,68 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+using namespace FV;
+
+MappedFile::MappedFile(const std::filesystem::path& path)
+    : _data(nullptr)
+    , _size(0) {
+#ifdef _WIN32
+    _file = nullptr;
+    _mapping = nullptr;
+    HANDLE file = ::CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
+                                nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return;
+    LARGE_INTEGER size = {};
+    if (::GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+        HANDLE mapping = ::CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping) {
+            void* p = ::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            if (p) {
+                _data = reinterpret_cast<const uint8_t*>(p);
+                _size = size_t(size.QuadPart);
+                _file = file;
+                _mapping = mapping;
+                return;
+            }
+            ::CloseHandle(mapping);
+        }
+    }
+    ::CloseHandle(file);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return;
+    struct stat st = {};
+    if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* p = ::mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            _data = reinterpret_cast<const uint8_t*>(p);
+            _size = size_t(st.st_size);
+        }
+    }
+    ::close(fd); // the mapping stays valid.
+#endif
+}
+
+MappedFile::~MappedFile() {
+#ifdef _WIN32
+    if (_data)
+        ::UnmapViewOfFile(_data);
+    if (_mapping)
+        ::CloseHandle(_mapping);
+    if (_file)
+        ::CloseHandle(_file);
+#else
+    if (_data)
+        ::munmap(const_cast<uint8_t*>(_data), _size);
+#endif
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include "../../include.h"
+#include <filesystem>
+
+namespace FV {
+    // Read-only memory mapping of a whole file.
+    class MappedFile {
+    public:
+        MappedFile(const std::filesystem::path&);
+        ~MappedFile();
+
+        const uint8_t* data() const { return _data; }
+        size_t size() const { return _size; }
+        bool isValid() const { return _data != nullptr; }
+
+    private:
+        const uint8_t* _data;
+        size_t _size;
+#ifdef _WIN32
+        void* _file;
+        void* _mapping;
+#endif
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator = (const MappedFile&) = delete;
+    };
+}
@@ -0,0 +1,207 @@
+#include <bit>
+#include "TLSFAllocator.h"
+
+using namespace FV;
+
+TLSFAllocator::TLSFAllocator(uint64_t capacity)
+    : flBitmap(0)
+    , slBitmap{}
+    , totalSize(capacity)
+    , usedSize(0)
+    , allocations(0) {
+    for (auto& list : freeLists) {
+        for (auto& head : list)
+            head = invalidNode;
+    }
+    if (capacity > 0) {
+        uint32_t node = makeNode();
+        nodes[node].offset = 0;
+        nodes[node].size = capacity;
+        insertFreeNode(node);
+    }
+}
+
+void TLSFAllocator::mapping(uint64_t size, uint32_t& fl, uint32_t& sl) {
+    if (size < slCount) {
+        fl = 0;
+        sl = uint32_t(size);
+    } else {
+        uint32_t msb = uint32_t(std::bit_width(size)) - 1;
+        fl = msb - slLog2 + 1;
+        sl = uint32_t(size >> (msb - slLog2)) ^ slCount;
+    }
+}
+
+uint32_t TLSFAllocator::findFreeNode(uint64_t size) const {
+    // round up to the next list, every node in it is large enough.
+    if (size >= slCount) {
+        uint64_t round = (uint64_t(1) << (std::bit_width(size) - 1 - slLog2)) - 1;
+        if (size > ~uint64_t(0) - round)
+            return invalidNode;
+        size += round;
+    }
+    uint32_t fl, sl;
+    mapping(size, fl, sl);
+
+    uint32_t slMap = slBitmap[fl] & (~uint32_t(0) << sl);
+    if (slMap == 0) {
+        if (fl + 1 >= flCount)
+            return invalidNode;
+        uint64_t flMap = flBitmap & (~uint64_t(0) << (fl + 1));
+        if (flMap == 0)
+            return invalidNode;
+        fl = uint32_t(std::countr_zero(flMap));
+        slMap = slBitmap[fl];
+        FVASSERT_DEBUG(slMap != 0);
+    }
+    sl = uint32_t(std::countr_zero(slMap));
+    return freeLists[fl][sl];
+}
+
+void TLSFAllocator::insertFreeNode(uint32_t index) {
+    auto& node = nodes[index];
+    uint32_t fl, sl;
+    mapping(node.size, fl, sl);
+
+    node.free = true;
+    node.prevFree = invalidNode;
+    node.nextFree = freeLists[fl][sl];
+    if (node.nextFree != invalidNode)
+        nodes[node.nextFree].prevFree = index;
+    freeLists[fl][sl] = index;
+    flBitmap |= uint64_t(1) << fl;
+    slBitmap[fl] |= 1U << sl;
+}
+
+void TLSFAllocator::removeFreeNode(uint32_t index) {
+    auto& node = nodes[index];
+    FVASSERT_DEBUG(node.free);
+    uint32_t fl, sl;
+    mapping(node.size, fl, sl);
+
+    if (node.prevFree != invalidNode)
+        nodes[node.prevFree].nextFree = node.nextFree;
+    else
+        freeLists[fl][sl] = node.nextFree;
+    if (node.nextFree != invalidNode)
+        nodes[node.nextFree].prevFree = node.prevFree;
+
+    if (freeLists[fl][sl] == invalidNode) {
+        slBitmap[fl] &= ~(1U << sl);
+        if (slBitmap[fl] == 0)
+            flBitmap &= ~(uint64_t(1) << fl);
+    }
+    node.free = false;
+    node.prevFree = node.nextFree = invalidNode;
+}
+
+uint32_t TLSFAllocator::makeNode() {
+    uint32_t index;
+    if (unusedNodes.empty() == false) {
+        index = unusedNodes.back();
+        unusedNodes.pop_back();
+    } else {
+        index = uint32_t(nodes.size());
+        nodes.push_back({});
+    }
+    nodes[index] = { 0, 0, invalidNode, invalidNode, invalidNode, invalidNode, false };
+    return index;
+}
+
+void TLSFAllocator::releaseNode(uint32_t index) {
+    unusedNodes.push_back(index);
+}
+
+uint32_t TLSFAllocator::splitFront(uint32_t index, uint64_t size) {
+    FVASSERT_DEBUG(nodes[index].size > size);
+    uint32_t front = makeNode();
+    auto& node = nodes[index];
+    auto& f = nodes[front];
+    f.offset = node.offset;
+    f.size = size;
+    f.prevPhysical = node.prevPhysical;
+    f.nextPhysical = index;
+    if (f.prevPhysical != invalidNode)
+        nodes[f.prevPhysical].nextPhysical = front;
+    node.prevPhysical = front;
+    node.offset += size;
+    node.size -= size;
+    return front;
+}
+
+std::optional<TLSFAllocator::Allocation> TLSFAllocator::alloc(uint64_t size, uint64_t alignment) {
+    if (size == 0)
+        return {};
+    if (alignment == 0)
+        alignment = 1;
+    FVASSERT_DEBUG(std::has_single_bit(alignment));
+
+    // a node of size + alignment - 1 can always hold an aligned range.
+    uint32_t index = findFreeNode(size + alignment - 1);
+    if (index == invalidNode) {
+        // the rounded-up search can miss an exact fit, try the node
+        // for the unaligned size which may still be suitably aligned.
+        index = findFreeNode(size);
+        if (index == invalidNode)
+            return {};
+        const auto& node = nodes[index];
+        uint64_t padding = (alignment - (node.offset & (alignment - 1))) & (alignment - 1);
+        if (node.size < size + padding)
+            return {};
+    }
+    removeFreeNode(index);
+
+    uint64_t padding = (alignment - (nodes[index].offset & (alignment - 1))) & (alignment - 1);
+    if (padding > 0) {
+        uint32_t front = splitFront(index, padding);
+        insertFreeNode(front);
+    }
+    if (nodes[index].size > size) {
+        // keep the allocated part at the front, the rest goes back to the free lists.
+        uint32_t used = splitFront(index, size);
+        insertFreeNode(index);
+        index = used;
+    }
+    auto& node = nodes[index];
+    node.free = false;
+    usedSize += node.size;
+    allocations++;
+    return Allocation{ node.offset, node.size, index };
+}
+
+void TLSFAllocator::free(const Allocation& allocation) {
+    uint32_t index = allocation.node;
+    FVASSERT_DEBUG(index < nodes.size());
+    FVASSERT_DEBUG(nodes[index].free == false);
+    FVASSERT_DEBUG(nodes[index].offset == allocation.offset);
+    FVASSERT_DEBUG(allocations > 0);
+
+    usedSize -= nodes[index].size;
+    allocations--;
+
+    // merge with free neighbours
+    uint32_t prev = nodes[index].prevPhysical;
+    if (prev != invalidNode && nodes[prev].free) {
+        removeFreeNode(prev);
+        auto& p = nodes[prev];
+        auto& node = nodes[index];
+        node.offset = p.offset;
+        node.size += p.size;
+        node.prevPhysical = p.prevPhysical;
+        if (node.prevPhysical != invalidNode)
+            nodes[node.prevPhysical].nextPhysical = index;
+        releaseNode(prev);
+    }
+    uint32_t next = nodes[index].nextPhysical;
+    if (next != invalidNode && nodes[next].free) {
+        removeFreeNode(next);
+        auto& n = nodes[next];
+        auto& node = nodes[index];
+        node.size += n.size;
+        node.nextPhysical = n.nextPhysical;
+        if (node.nextPhysical != invalidNode)
+            nodes[node.nextPhysical].prevPhysical = index;
+        releaseNode(next);
+    }
+    insertFreeNode(index);
+}
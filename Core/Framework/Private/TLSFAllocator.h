@@ -0,0 +1,65 @@
+#pragma once
+#include "../../include.h"
+#include <vector>
+#include <optional>
+
+namespace FV {
+    // Two-level segregated fit allocator over an abstract address range.
+    // It only manages offsets, so it can back any kind of memory
+    // (device memory chunks, staging rings) and runs without a GPU.
+    // alloc and free are O(1); adjacent free ranges are merged on free.
+    class TLSFAllocator {
+    public:
+        struct Allocation {
+            uint64_t offset;
+            uint64_t size;
+            uint32_t node;      // used by free()
+        };
+
+        TLSFAllocator(uint64_t capacity);
+        ~TLSFAllocator() = default;
+
+        std::optional<Allocation> alloc(uint64_t size, uint64_t alignment = 1);
+        void free(const Allocation&);
+
+        uint64_t capacity() const { return totalSize; }
+        uint64_t sizeInUse() const { return usedSize; }
+        uint64_t numAllocations() const { return allocations; }
+        bool isEmpty() const { return allocations == 0; }
+
+    private:
+        static constexpr uint32_t slLog2 = 4;
+        static constexpr uint32_t slCount = 1U << slLog2;
+        static constexpr uint32_t flCount = 64 - slLog2 + 1;
+        static constexpr uint32_t invalidNode = ~uint32_t(0);
+
+        struct Node {
+            uint64_t offset;
+            uint64_t size;
+            uint32_t prevPhysical;
+            uint32_t nextPhysical;
+            uint32_t prevFree;
+            uint32_t nextFree;
+            bool free;
+        };
+
+        static void mapping(uint64_t size, uint32_t& fl, uint32_t& sl);
+        uint32_t findFreeNode(uint64_t size) const;
+        void insertFreeNode(uint32_t);
+        void removeFreeNode(uint32_t);
+        uint32_t makeNode();
+        void releaseNode(uint32_t);
+        // splits [offset, offset + size) off the front of a node, returns the new node.
+        uint32_t splitFront(uint32_t, uint64_t size);
+
+        std::vector<Node> nodes;
+        std::vector<uint32_t> unusedNodes;
+        uint64_t flBitmap;
+        uint32_t slBitmap[flCount];
+        uint32_t freeLists[flCount][slCount];
+
+        uint64_t totalSize;
+        uint64_t usedSize;
+        uint64_t allocations;
+    };
+}
@@ -21,6 +21,9 @@ namespace FV {
         void flush() override {
             buffer->flush(0, VK_WHOLE_SIZE);
         }
+        void flush(size_t offset, size_t length) override {
+            buffer->flush(offset, length);
+        }
         size_t length() const override {
             return buffer->length();
         }
@@ -10,7 +10,8 @@ using namespace FV;
 
 VulkanCommandBuffer::VulkanCommandBuffer(std::shared_ptr<VulkanCommandQueue> q, VkCommandPool p)
     : cpool(p)
-    , cqueue(q) {
+    , cqueue(q)
+    , transientDescriptors(q->gdevice.get()) {
     FVASSERT_DEBUG(cpool);
 }
 
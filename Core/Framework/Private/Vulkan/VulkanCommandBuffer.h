@@ -8,6 +8,7 @@
 #if FVCORE_ENABLE_VULKAN
 #include <vulkan/vulkan.h>
 #include "VulkanQueueFamily.h"
+#include "VulkanDescriptorAllocator.h"
 
 namespace FV {
     class VulkanCommandBuffer;
@@ -65,9 +66,13 @@ namespace FV {
 
         void endEncoder(CommandEncoder*, std::shared_ptr<VulkanCommandEncoder>);
 
+        // descriptor sets which live until the command buffer is released.
+        VulkanDescriptorAllocator* descriptorAllocator() { return &transientDescriptors; }
+
     private:
         VkCommandPool cpool;
         std::shared_ptr<VulkanCommandQueue> cqueue;
+        VulkanDescriptorAllocator transientDescriptors;
         std::vector<std::shared_ptr<VulkanCommandEncoder>> encoders;
 
         std::vector<VkSubmitInfo2>              submitInfos;
@@ -1,3 +1,4 @@
+#include "../../DispatchQueue.h"
 #include "VulkanCommandQueue.h"
 #include "VulkanCommandBuffer.h"
 #include "VulkanGraphicsDevice.h"
@@ -9,11 +10,36 @@ using namespace FV;
 VulkanCommandQueue::VulkanCommandQueue(std::shared_ptr<VulkanGraphicsDevice> d, VulkanQueueFamily* f, VkQueue q)
     : gdevice(d)
     , family(f)
-    , queue(q) {
+    , queue(q)
+    , timeline(VK_NULL_HANDLE)
+    , timelineValue(0) {
+    VkSemaphoreTypeCreateInfo typeCreateInfo = { VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO };
+    typeCreateInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    typeCreateInfo.initialValue = 0;
+    VkSemaphoreCreateInfo createInfo = { VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+    createInfo.pNext = &typeCreateInfo;
+    VkResult err = vkCreateSemaphore(gdevice->device, &createInfo, gdevice->allocationCallbacks(), &timeline);
+    if (err != VK_SUCCESS) {
+        Log::error("vkCreateSemaphore failed: {}", err);
+        FVASSERT(err == VK_SUCCESS);
+    }
+
+    this->completionThread = std::jthread(
+        [this](std::stop_token stopToken) {
+            completionThreadProc(stopToken);
+        });
 }
 
 VulkanCommandQueue::~VulkanCommandQueue() {
     vkQueueWaitIdle(queue);
+
+    // every signaled value is reached, the thread is not blocked in a wait.
+    completionThread.request_stop();
+    completionThread.join();
+    // pending handlers keep their command buffers and this queue alive.
+    FVASSERT_DEBUG(completionHandlers.empty());
+
+    vkDestroySemaphore(gdevice->device, timeline, gdevice->allocationCallbacks());
     family->recycleQueue(queue);
 }
 
@@ -49,24 +75,86 @@ std::shared_ptr<SwapChain> VulkanCommandQueue::makeSwapChain(std::shared_ptr<Win
 }
 
 bool VulkanCommandQueue::submit(const VkSubmitInfo2* submits, uint32_t submitCount, std::function<void()> callback) {
-    VkFence fence = VK_NULL_HANDLE;
-    if (callback)
-        fence = gdevice->fence();
+    std::vector<VkSubmitInfo2> submitInfos(submits, submits + submitCount);
+
+    // an extra batch signals the timeline after all commands submitted before it.
+    VkSemaphoreSubmitInfo timelineSignal = { VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO };
+    timelineSignal.semaphore = timeline;
+    timelineSignal.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+    timelineSignal.deviceIndex = 0;
+    if (callback) {
+        VkSubmitInfo2 submitInfo = { VK_STRUCTURE_TYPE_SUBMIT_INFO_2 };
+        submitInfo.signalSemaphoreInfoCount = 1;
+        submitInfo.pSignalSemaphoreInfos = &timelineSignal;
+        submitInfos.push_back(submitInfo);
+    }
 
     std::unique_lock guard(lock);
-    VkResult err = vkQueueSubmit2(queue, submitCount, submits, fence);
+    timelineSignal.value = timelineValue + 1;
+    VkResult err = vkQueueSubmit2(queue, (uint32_t)submitInfos.size(), submitInfos.data(), VK_NULL_HANDLE);
+    if (err == VK_SUCCESS && callback) {
+        timelineValue = timelineSignal.value;
+        // pushed under the queue lock, the values stay in order.
+        std::scoped_lock completionGuard(completionLock);
+        completionHandlers.push_back({ timelineValue, std::move(callback) });
+        completionCond.notify_all();
+    }
     guard.unlock();
 
     if (err != VK_SUCCESS) {
         Log::error("vkQueueSubmit2 failed: {}", err);
         FVASSERT(err == VK_SUCCESS);
     }
-    if (fence)
-        gdevice->addFenceCompletionHandler(fence, callback);
-
     return err == VK_SUCCESS;
 }
 
+void VulkanCommandQueue::completionThreadProc(std::stop_token stopToken) {
+    std::vector<std::function<void()>> handlers;
+
+    std::unique_lock guard(completionLock);
+    while (stopToken.stop_requested() == false) {
+        if (completionCond.wait(guard, stopToken, [this] {
+            return completionHandlers.empty() == false;
+        }) == false)
+            break;
+
+        uint64_t value = completionHandlers.front().value;
+        guard.unlock();
+
+        // block until the oldest pending submission is done, then take
+        // every handler up to the current value of the timeline.
+        VkSemaphoreWaitInfo waitInfo = { VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO };
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores = &timeline;
+        waitInfo.pValues = &value;
+        VkResult err = vkWaitSemaphores(gdevice->device, &waitInfo, UINT64_MAX);
+        if (err == VK_SUCCESS)
+            err = vkGetSemaphoreCounterValue(gdevice->device, timeline, &value);
+        if (err != VK_SUCCESS) {
+            Log::error("vkWaitSemaphores failed: {}", err);
+            FVERROR_ABORT("vkWaitSemaphores failed");
+        }
+
+        guard.lock();
+        while (completionHandlers.empty() == false && completionHandlers.front().value <= value) {
+            handlers.push_back(std::move(completionHandlers.front().handler));
+            completionHandlers.pop_front();
+        }
+        guard.unlock();
+
+        // handlers can block or release the last reference to this queue,
+        // they are run by the dispatch queue instead of this thread.
+        detachedTask([](std::vector<std::function<void()>> handlers)->Task<> {
+            for (auto& handler : handlers)
+                handler();
+            co_return;
+        }(std::move(handlers)));
+        handlers.clear();
+
+        guard.lock();
+    }
+}
+
 bool VulkanCommandQueue::waitIdle() {
     std::unique_lock guard(lock);
     return vkQueueWaitIdle(queue) == VK_SUCCESS;
@@ -1,6 +1,10 @@
 #pragma once
 #include <memory>
 #include <mutex>
+#include <deque>
+#include <thread>
+#include <functional>
+#include <condition_variable>
 #include "../../CommandQueue.h"
 
 #if FVCORE_ENABLE_VULKAN
@@ -35,6 +39,21 @@ namespace FV {
     private:
         std::mutex lock;
         VkQueue queue;
+
+        // Submissions with a callback signal the timeline semaphore with
+        // increasing values, the completion thread waits for them and
+        // dispatches the callbacks of completed values together.
+        VkSemaphore timeline;
+        uint64_t timelineValue;     // last signaled value, guarded by lock
+        struct CompletionHandler {
+            uint64_t value;
+            std::function<void()> handler;
+        };
+        std::deque<CompletionHandler> completionHandlers;
+        std::mutex completionLock;
+        std::condition_variable_any completionCond;
+        std::jthread completionThread;
+        void completionThreadProc(std::stop_token);
     };
 }
 #endif //#if FVCORE_ENABLE_VULKAN
@@ -104,7 +104,7 @@ void VulkanComputeCommandEncoder::setResource(uint32_t index, std::shared_ptr<Sh
     std::shared_ptr<VulkanDescriptorSet> descriptorSet = nullptr;
     if (set) {
         auto bindingSet = std::dynamic_pointer_cast<VulkanShaderBindingSet>(set);
-        descriptorSet = bindingSet->makeDescriptorSet();
+        descriptorSet = bindingSet->makeDescriptorSet(encoder->cbuffer->descriptorAllocator());
         FVASSERT_DEBUG(descriptorSet);
         encoder->descriptorSets.push_back(descriptorSet);
     }
@@ -164,10 +164,10 @@ void VulkanCopyCommandEncoder::copy(
 
     PixelFormat pixelFormat = image->pixelFormat();
     size_t bufferLength = buffer->length();
-    size_t bytesPerPixel = pixelFormatBytesPerPixel(pixelFormat);
-    FVASSERT_DEBUG(bytesPerPixel > 0);      // Unsupported texture format!
+    size_t bytesPerBlock = pixelFormatBytesPerBlock(pixelFormat);
+    FVASSERT_DEBUG(bytesPerBlock > 0);      // Unsupported texture format!
 
-    size_t requiredBufferLengthForCopy = size_t(srcOffset.imageWidth) * size_t(srcOffset.imageHeight) * size.depth * bytesPerPixel + srcOffset.bufferOffset;
+    size_t requiredBufferLengthForCopy = pixelFormatBufferLength(pixelFormat, srcOffset.imageWidth, srcOffset.imageHeight, size.depth) + srcOffset.bufferOffset;
     if (requiredBufferLengthForCopy > bufferLength) {
         Log::error("CopyCommandEncoder::copy failed: buffer is too small!");
         return;
@@ -237,10 +237,10 @@ void VulkanCopyCommandEncoder::copy(std::shared_ptr<Texture> src,
 
     PixelFormat pixelFormat = image->pixelFormat();
     size_t bufferLength = buffer->length();
-    size_t bytesPerPixel = pixelFormatBytesPerPixel(pixelFormat);
-    FVASSERT_DEBUG(bytesPerPixel > 0);      // Unsupported texture format!
+    size_t bytesPerBlock = pixelFormatBytesPerBlock(pixelFormat);
+    FVASSERT_DEBUG(bytesPerBlock > 0);      // Unsupported texture format!
 
-    size_t requiredBufferLengthForCopy = size_t(dstOffset.imageWidth) * size_t(dstOffset.imageHeight) * size.depth * bytesPerPixel + dstOffset.bufferOffset;
+    size_t requiredBufferLengthForCopy = pixelFormatBufferLength(pixelFormat, dstOffset.imageWidth, dstOffset.imageHeight, size.depth) + dstOffset.bufferOffset;
     if (requiredBufferLengthForCopy > bufferLength) {
         Log::error("CopyCommandEncoder::copy failed: buffer is too small!");
         return;
@@ -315,13 +315,13 @@ void VulkanCopyCommandEncoder::copy(std::shared_ptr<Texture> src,
 
     PixelFormat srcPixelFormat = srcImage->pixelFormat();
     PixelFormat dstPixelFormat = dstImage->pixelFormat();
-    size_t srcBytesPerPixel = pixelFormatBytesPerPixel(srcPixelFormat);
-    size_t dstBytesPerPixel = pixelFormatBytesPerPixel(dstPixelFormat);
+    size_t srcBytesPerBlock = pixelFormatBytesPerBlock(srcPixelFormat);
+    size_t dstBytesPerBlock = pixelFormatBytesPerBlock(dstPixelFormat);
 
-    FVASSERT_DEBUG(srcBytesPerPixel > 0);      // Unsupported texture format!
-    FVASSERT_DEBUG(dstBytesPerPixel > 0);      // Unsupported texture format!
+    FVASSERT_DEBUG(srcBytesPerBlock > 0);      // Unsupported texture format!
+    FVASSERT_DEBUG(dstBytesPerBlock > 0);      // Unsupported texture format!
 
-    if (srcBytesPerPixel != dstBytesPerPixel) {
+    if (srcBytesPerBlock != dstBytesPerBlock) {
         Log::error("CopyCommandEncoder::copy failed: Incompatible pixel formats");
         return;
     }
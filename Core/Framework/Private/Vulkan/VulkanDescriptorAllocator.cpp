@@ -0,0 +1,59 @@
+#include "VulkanExtensions.h"
+#include "VulkanGraphicsDevice.h"
+#include "VulkanDescriptorAllocator.h"
+
+#if FVCORE_ENABLE_VULKAN
+using namespace FV;
+
+VulkanDescriptorAllocator::VulkanDescriptorAllocator(VulkanGraphicsDevice* dev)
+    : gdevice(dev) {
+    FVASSERT_DEBUG(gdevice);
+}
+
+VulkanDescriptorAllocator::~VulkanDescriptorAllocator() {
+    if (pools.empty() == false)
+        gdevice->recycleTransientDescriptorPools(pools);
+}
+
+VkDescriptorSet VulkanDescriptorAllocator::allocateDescriptorSet(VkDescriptorSetLayout layout, const VulkanDescriptorPoolID& poolID) {
+    FVASSERT_DEBUG(layout != VK_NULL_HANDLE);
+
+    // inline uniform blocks need pools made for them.
+    constexpr auto inlineUniformBlockIndex = numDescriptorTypes - 1;
+    static_assert(descriptorTypes[inlineUniformBlockIndex] == VK_DESCRIPTOR_TYPE_INLINE_UNIFORM_BLOCK);
+    if (poolID.typeSize[inlineUniformBlockIndex] > 0)
+        return VK_NULL_HANDLE;
+    for (uint32_t i = 0; i < numDescriptorTypes; ++i) {
+        if (poolID.typeSize[i] > poolDescriptorCount)
+            return VK_NULL_HANDLE;
+    }
+
+    std::scoped_lock guard(lock);
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        if (pools.empty() || attempt > 0) {
+            VkDescriptorPool pool = gdevice->transientDescriptorPool();
+            if (pool == VK_NULL_HANDLE)
+                return VK_NULL_HANDLE;
+            pools.push_back(pool);
+        }
+
+        VkDescriptorSetAllocateInfo allocateInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
+        allocateInfo.descriptorPool = pools.back();
+        allocateInfo.descriptorSetCount = 1;
+        allocateInfo.pSetLayouts = &layout;
+
+        VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+        VkResult err = vkAllocateDescriptorSets(gdevice->device, &allocateInfo, &descriptorSet);
+        if (err == VK_SUCCESS) {
+            FVASSERT_DEBUG(descriptorSet != VK_NULL_HANDLE);
+            return descriptorSet;
+        }
+        if (err != VK_ERROR_OUT_OF_POOL_MEMORY && err != VK_ERROR_FRAGMENTED_POOL) {
+            Log::error("vkAllocateDescriptorSets failed: {}", err);
+            break;
+        }
+    }
+    return VK_NULL_HANDLE;
+}
+
+#endif //#if FVCORE_ENABLE_VULKAN
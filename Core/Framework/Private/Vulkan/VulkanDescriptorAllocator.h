@@ -0,0 +1,35 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include <mutex>
+
+#if FVCORE_ENABLE_VULKAN
+#include <vulkan/vulkan.h>
+#include "VulkanDescriptorPool.h"
+
+namespace FV {
+    class VulkanGraphicsDevice;
+    // Linear allocator of descriptor sets which live as long as a command
+    // buffer. Sets are never freed one by one, the pools are reset at once
+    // and given back to the device when the allocator is destroyed, which
+    // is after the command buffer has completed.
+    class VulkanDescriptorAllocator {
+    public:
+        VulkanDescriptorAllocator(VulkanGraphicsDevice*);
+        ~VulkanDescriptorAllocator();
+
+        // sizes of a pool shared by all layouts.
+        static constexpr uint32_t poolMaxSets = 256;
+        static constexpr uint32_t poolDescriptorCount = 1024; // for each type
+
+        // returns VK_NULL_HANDLE if the layout does not fit in a pool.
+        VkDescriptorSet allocateDescriptorSet(VkDescriptorSetLayout, const VulkanDescriptorPoolID&);
+
+        VulkanGraphicsDevice* const gdevice;
+
+    private:
+        std::vector<VkDescriptorPool> pools; // allocates from the last one
+        std::mutex lock;
+    };
+}
+#endif //#if FVCORE_ENABLE_VULKAN
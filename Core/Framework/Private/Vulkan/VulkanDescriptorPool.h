@@ -45,10 +45,7 @@ namespace FV {
         uint32_t typeSize[numDescriptorTypes] = { 0 };
 
         uint32_t hash() const {
-            CRC32 crc32;
-            crc32.update(&mask, sizeof(mask));
-            crc32.update(&typeSize, sizeof(typeSize));
-            return crc32.finalize().hash;
+            return uint32_t(XXH3Hasher{}(*this));
         }
 
         VulkanDescriptorPoolID() = default;
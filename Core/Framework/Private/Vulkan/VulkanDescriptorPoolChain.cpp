@@ -30,8 +30,7 @@ bool VulkanDescriptorPoolChain::allocateDescriptorSet(VkDescriptorSetLayout layo
 
             if (it != descriptorPools.begin()) {
                 // bring pool to front.
-                descriptorPools.erase(it);
-                descriptorPools.insert(descriptorPools.begin(), pool);
+                std::rotate(descriptorPools.begin(), it, it + 1);
             }
             return true;
         }
@@ -2,6 +2,8 @@
 #include "VulkanGraphicsDevice.h"
 #include "VulkanDescriptorSet.h"
 #include "VulkanDescriptorPool.h"
+#include "VulkanDescriptorAllocator.h"
+#include "VulkanShaderBindingSet.h"
 
 #if FVCORE_ENABLE_VULKAN
 using namespace FV;
@@ -11,11 +13,81 @@ VulkanDescriptorSet::VulkanDescriptorSet(std::shared_ptr<VulkanGraphicsDevice> d
                              VkDescriptorSet ds)
     : gdevice(dev)
     , descriptorSet(ds)
-    , descriptorPool(pool) {
+    , descriptorPool(pool)
+    , allocator(nullptr) {
+}
+
+VulkanDescriptorSet::VulkanDescriptorSet(std::shared_ptr<VulkanDescriptorSet> cached,
+                                         std::shared_ptr<VulkanShaderBindingSet> owner,
+                                         VulkanDescriptorAllocator* alloc)
+    : gdevice(cached->gdevice)
+    , descriptorSet(cached->descriptorSet)
+    , cachedSet(cached)
+    , bindingSet(owner)
+    , allocator(alloc) {
+    setBindings(cached->bindings, false);
 }
 
 VulkanDescriptorSet::~VulkanDescriptorSet() {
-    gdevice->releaseDescriptorSets(descriptorPool.get(), &descriptorSet, 1);
+    if (descriptorPool)
+        gdevice->releaseDescriptorSets(descriptorPool.get(), &descriptorSet, 1);
+}
+
+void VulkanDescriptorSet::setBindings(const std::vector<Binding>& source, bool write) {
+    this->bindings = source;
+
+    std::vector<VkWriteDescriptorSet> descriptorWrites;
+    descriptorWrites.reserve(bindings.size());
+
+    for (Binding& binding : bindings) {
+        if (!binding.valueSet)
+            continue;
+
+        VkWriteDescriptorSet& write = binding.write;
+        write.dstSet = descriptorSet;
+        if (write.pImageInfo)
+            write.pImageInfo = binding.imageInfos.data();
+        if (write.pBufferInfo)
+            write.pBufferInfo = binding.bufferInfos.data();
+        if (write.pTexelBufferView)
+            write.pTexelBufferView = binding.texelBufferViews.data();
+
+        descriptorWrites.push_back(write);
+    }
+
+    if (write && descriptorWrites.empty() == false) {
+        vkUpdateDescriptorSets(gdevice->device,
+                               (uint32_t)descriptorWrites.size(),
+                               descriptorWrites.data(),
+                               0,
+                               nullptr);
+    }
+}
+
+bool VulkanDescriptorSet::detachCachedSet() {
+    FVASSERT_DEBUG(cachedSet && bindingSet);
+
+    VkDescriptorSetLayout layout = bindingSet->descriptorSetLayout;
+    VkDescriptorSet ds = VK_NULL_HANDLE;
+    if (allocator)
+        ds = allocator->allocateDescriptorSet(layout, bindingSet->poolID);
+    if (ds != VK_NULL_HANDLE) {
+        cachedSet = nullptr;
+    } else {
+        cachedSet = gdevice->makeDescriptorSet(layout, bindingSet->poolID);
+        if (cachedSet == nullptr)
+            return false;
+        ds = cachedSet->descriptorSet;
+    }
+    descriptorSet = ds;
+    // all bindings are written to the new set.
+    for (Binding& binding : bindings) {
+        binding.write.dstSet = descriptorSet;
+        if (binding.valueSet)
+            vkUpdateDescriptorSets(gdevice->device, 1, &binding.write, 0, nullptr);
+    }
+    bindingSet = nullptr;
+    return true;
 }
 
 void VulkanDescriptorSet::collectImageViewLayouts(ImageLayoutMap& imageLayouts, ImageViewLayoutMap& viewLayouts) {
@@ -96,6 +168,12 @@ void VulkanDescriptorSet::updateImageViewLayouts(const ImageViewLayoutMap& image
                 descriptorWrites.push_back(write);
         }
     }
+    if (descriptorWrites.size() > 0 && bindingSet) {
+        // the cached set cannot be changed, it is copied with the new layouts.
+        if (detachCachedSet() == false)
+            Log::error("Failed to copy the descriptor set");
+        descriptorWrites.clear();
+    }
     if (descriptorWrites.size() > 0) {
         vkUpdateDescriptorSets(gdevice->device,
                                (uint32_t)descriptorWrites.size(),
@@ -12,9 +12,18 @@
 namespace FV {
     class VulkanGraphicsDevice;
     class VulkanDescriptorPool;
+    class VulkanDescriptorAllocator;
+    class VulkanShaderBindingSet;
     class VulkanDescriptorSet {
     public:
+        // the pool is null for a set of a VulkanDescriptorAllocator.
         VulkanDescriptorSet(std::shared_ptr<VulkanGraphicsDevice>, std::shared_ptr<VulkanDescriptorPool>, VkDescriptorSet);
+        // uses the descriptors of the cached set of a binding set, which may
+        // be in use by other command buffers. If an image layout has to be
+        // changed, the bindings are written to a new set of the allocator.
+        VulkanDescriptorSet(std::shared_ptr<VulkanDescriptorSet> cached,
+                            std::shared_ptr<VulkanShaderBindingSet>,
+                            VulkanDescriptorAllocator*);
         virtual ~VulkanDescriptorSet();
 
         using BufferViewObject = std::shared_ptr<VulkanBufferView>;
@@ -46,12 +55,21 @@ namespace FV {
         using ImageLayoutMap = std::map<VulkanImage*, VkImageLayout>;
         using ImageViewLayoutMap = std::map<VkImageView, VkImageLayout>;
 
+        // copies the bindings for this set, writes them if 'write' is true.
+        void setBindings(const std::vector<Binding>&, bool write);
+
         void collectImageViewLayouts(ImageLayoutMap&, ImageViewLayoutMap&);
         void updateImageViewLayouts(const ImageViewLayoutMap&);
 
         VkDescriptorSet descriptorSet;
         std::shared_ptr<VulkanDescriptorPool> descriptorPool;
         std::shared_ptr<VulkanGraphicsDevice> gdevice;
+
+    private:
+        bool detachCachedSet();
+        std::shared_ptr<VulkanDescriptorSet> cachedSet; // owner of descriptorSet, if shared
+        std::shared_ptr<VulkanShaderBindingSet> bindingSet;
+        VulkanDescriptorAllocator* allocator;
     };
 }
 #endif //#if FVCORE_ENABLE_VULKAN
@@ -6,27 +6,8 @@
 #if FVCORE_ENABLE_VULKAN
 
 namespace {
-    constexpr struct {
-        uint64_t blockSize;
-        uint64_t numBlocks;
-    } memoryChunkSizeBlocks[] = {
-    { 1024, 512 },
-    { 2048, 512 },
-    { 4096, 512 },
-    { 8192, 512 },
-    { 16384, 256 },
-    { 32768, 256 },
-    { 65536, 256 },
-    { 131072, 256 },
-    { 262144, 256 },
-    { 524288, 256 },
-    { 1048576, 128 },
-    { 2097152, 64 },
-    { 4194304, 32 },
-    { 8388608, 16 },
-    { 16777216, 8 },
-    { 33554432, 4 },
-    };
+    // device memory is allocated in chunks of this size, or 1/8 of a small heap.
+    constexpr uint64_t preferredChunkSize = 64ULL << 20;
 }
 
 using namespace FV;
@@ -37,19 +18,16 @@ VulkanMemoryChunk::VulkanMemoryChunk(VulkanGraphicsDevice* dev,
                                      VkDeviceMemory mem,
                                      VkMemoryPropertyFlags flags,
                                      uint64_t chunkSize,
-                                     uint64_t blockSize,
-                                     uint64_t totalBlocks,
                                      bool dedicated)
     : gdevice(dev)
     , propertyFlags(flags)
     , memory(mem)
     , chunkSize(chunkSize)
-    , blockSize(blockSize)
-    , totalBlocks(totalBlocks)
     , dedicated(dedicated)
     , mapped(nullptr)
     , pool(pool)
-    , allocator(allocator) {
+    , allocator(allocator)
+    , blocks(chunkSize) {
 
     FVASSERT_DEBUG(memory != VK_NULL_HANDLE);
 
@@ -63,47 +41,32 @@ VulkanMemoryChunk::VulkanMemoryChunk(VulkanGraphicsDevice* dev,
             Log::error("vkMapMemory failed: {}", err);
         }
     }
-
-    freeBlocks.reserve(totalBlocks);
-    uint64_t offset = 0;
-    for (uint64_t i = 0; i < totalBlocks; ++i) {
-        auto block = VulkanMemoryBlock{ offset, blockSize, this };
-        freeBlocks.push_back(block);
-        offset += blockSize;
-    }
 }
 
 VulkanMemoryChunk::~VulkanMemoryChunk() {
     auto device = gdevice->device;
     auto allocationCallbacks = gdevice->allocationCallbacks();
 
-    FVASSERT_DEBUG(freeBlocks.size() == totalBlocks);
+    FVASSERT_DEBUG(blocks.isEmpty());
     FVASSERT_DEBUG(memory != VK_NULL_HANDLE);
     if (mapped)
         vkUnmapMemory(device, memory);
     vkFreeMemory(device, memory, allocationCallbacks);
 }
 
-void VulkanMemoryChunk::push(const VulkanMemoryBlock& block) {
-    FVASSERT_DEBUG(block.chunk == this);
-    FVASSERT_DEBUG(block.size <= blockSize);
-    FVASSERT_DEBUG(block.offset < chunkSize);
-
-    auto copy = block;
-    copy.size = blockSize;
-    freeBlocks.push_back(copy);
-    FVASSERT_DEBUG(freeBlocks.size() <= totalBlocks);
-}
-
-std::optional<VulkanMemoryBlock> VulkanMemoryChunk::pop() {
-    if (freeBlocks.empty() == false) {
-        auto block = freeBlocks.back();
-        freeBlocks.pop_back();
-        return block;
+std::optional<VulkanMemoryBlock> VulkanMemoryChunk::alloc(uint64_t size, uint64_t alignment) {
+    if (auto allocation = blocks.alloc(size, alignment)) {
+        return VulkanMemoryBlock{ allocation->offset, allocation->size, this, allocation->node };
     }
     return {};
 }
 
+void VulkanMemoryChunk::dealloc(const VulkanMemoryBlock& block) {
+    FVASSERT_DEBUG(block.chunk == this);
+    FVASSERT_DEBUG(block.offset < chunkSize);
+    blocks.free({ block.offset, block.size, block.allocationNode });
+}
+
 bool VulkanMemoryChunk::invalidate(uint64_t offset, uint64_t size) const {
     auto device = gdevice->device;
     FVASSERT_DEBUG(memory != VK_NULL_HANDLE);
@@ -119,14 +82,15 @@ bool VulkanMemoryChunk::invalidate(uint64_t offset, uint64_t size) const {
             VkMappedMemoryRange range = { VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE };
             range.memory = memory;
             // VUID-VkMappedMemoryRange-offset-00687
-            range.offset = alignUp(offset);
+            // blocks are sub-allocated, round the start down to cover the whole block.
+            range.offset = offset - (offset % atomSize);
             if (size == VK_WHOLE_SIZE)
                 range.size = size;
             else {
                 // VUID-VkMappedMemoryRange-size-01390
-                auto begin = alignUp(offset);
-                auto end = alignUp(offset + size);
-                range.size = std::min(end - begin, chunkSize - begin);
+                uint64_t begin = range.offset;
+                uint64_t end = alignUp(offset + size);
+                range.size = std::min(end, chunkSize) - begin;
             }
             VkResult err = vkInvalidateMappedMemoryRanges(device, 1, &range);
             if (err == VK_SUCCESS) {
@@ -156,14 +120,15 @@ bool VulkanMemoryChunk::flush(uint64_t offset, uint64_t size) const {
             VkMappedMemoryRange range = { VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE };
             range.memory = memory;
             // VUID-VkMappedMemoryRange-offset-00687
-            range.offset = alignUp(offset);
+            // blocks are sub-allocated, round the start down to cover the whole block.
+            range.offset = offset - (offset % atomSize);
             if (size == VK_WHOLE_SIZE)
                 range.size = size;
             else {
                 // VUID-VkMappedMemoryRange-size-01390
                 uint64_t begin = range.offset;
                 uint64_t end = alignUp(offset + size);
-                range.size = std::min(end - begin, chunkSize - begin);
+                range.size = std::min(end, chunkSize) - begin;
             }
             VkResult err = vkFlushMappedMemoryRanges(device, 1, &range);
             if (err == VK_SUCCESS) {
@@ -178,10 +143,8 @@ bool VulkanMemoryChunk::flush(uint64_t offset, uint64_t size) const {
     return false;
 }
 
-VulkanMemoryAllocator::VulkanMemoryAllocator(VulkanMemoryPool* pool,
-                                             uint64_t s, uint64_t n)
-    : blockSize(s)
-    , blocksPerChunk(n)
+VulkanMemoryAllocator::VulkanMemoryAllocator(VulkanMemoryPool* pool, uint64_t chunkSize)
+    : chunkSize(chunkSize)
     , pool(pool) {
 }
 
@@ -195,9 +158,7 @@ uint64_t VulkanMemoryAllocator::numAllocations() const {
     uint64_t blocks = 0;
     std::scoped_lock lock(mutex);
     for (auto chunk : chunks) {
-        uint64_t n = chunk->totalBlocks - chunk->numFreeBlocks();
-        FVASSERT_DEBUG(n <= chunk->totalBlocks);
-        blocks += n;
+        blocks += chunk->numAllocations();
     }
     return blocks;
 }
@@ -217,24 +178,22 @@ uint64_t VulkanMemoryAllocator::totalMemorySize() const {
 }
 
 uint64_t VulkanMemoryAllocator::memorySizeInUse() const {
+    uint64_t size = 0;
     std::scoped_lock lock(mutex);
-    return memoryInUse;
+    for (auto chunk : chunks) {
+        size += chunk->memorySizeInUse();
+    }
+    return size;
 }
 
-std::optional<VulkanMemoryBlock> VulkanMemoryAllocator::alloc(uint64_t size) {
-    if (size > blockSize)
+std::optional<VulkanMemoryBlock> VulkanMemoryAllocator::alloc(uint64_t size, uint64_t alignment) {
+    if (size > chunkSize)
         return {};
 
     std::scoped_lock lock(mutex);
     for (auto chunk : chunks) {
-        if (chunk->numFreeBlocks() > 0) {
-            auto item = chunk->pop();
-            FVASSERT_DEBUG(item);
-            FVASSERT_DEBUG(item.value().size >= size);
-            item.value().size = size;
-            memoryInUse += size;
-            return item;
-        }
+        if (auto block = chunk->alloc(size, alignment))
+            return block;
     }
     // allocate new chunk
     auto gdevice = pool->gdevice;
@@ -243,8 +202,6 @@ std::optional<VulkanMemoryBlock> VulkanMemoryAllocator::alloc(uint64_t size) {
     auto memoryPropertyFlags = pool->memoryPropertyFlags;
     auto allocationCallbacks = gdevice->allocationCallbacks();
 
-    uint64_t chunkSize = blockSize * blocksPerChunk;
-
     VkMemoryAllocateInfo memAllocInfo = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
     memAllocInfo.allocationSize = chunkSize;
     memAllocInfo.memoryTypeIndex = memoryTypeIndex;
@@ -257,14 +214,10 @@ std::optional<VulkanMemoryBlock> VulkanMemoryAllocator::alloc(uint64_t size) {
 
     auto chunk = new VulkanMemoryChunk(gdevice, pool, this,
                                        memory, memoryPropertyFlags,
-                                       chunkSize, blockSize, blocksPerChunk,
-                                       false);
+                                       chunkSize, false);
     chunks.push_back(chunk);
-    auto block = chunk->pop();
+    auto block = chunk->alloc(size, alignment);
     FVASSERT_DEBUG(block);
-    FVASSERT_DEBUG(block.value().size >= size);
-    block.value().size = size;
-    memoryInUse += size;
     return block;
 }
 
@@ -272,32 +225,20 @@ void VulkanMemoryAllocator::dealloc(VulkanMemoryBlock& block) {
     if (block.chunk) {
         auto chunk = block.chunk;
         std::scoped_lock lock(mutex);
-        FVASSERT_DEBUG(chunk);
         FVASSERT_DEBUG(chunk->allocator == this);
-        FVASSERT_DEBUG(chunk->blockSize == this->blockSize);
-        FVASSERT_DEBUG(memoryInUse >= block.size);
-        memoryInUse -= block.size;
-        chunk->push(block);
+        chunk->dealloc(block);
         block = {};
 
-        if (chunk->numFreeBlocks() == chunk->totalBlocks) {
-            size_t freeBlocks = 0;
-            for (VulkanMemoryChunk* c : chunks)
-                freeBlocks += c->numFreeBlocks();
-            if (freeBlocks > blocksPerChunk + (blocksPerChunk >> 2)) {
-                for (auto it = chunks.begin(); it != chunks.end(); ++it) {
-                    if (*it == chunk) {
-                        chunks.erase(it);
-                        break;
-                    }
-                }
+        // keep one empty chunk to avoid allocating device memory again for
+        // resources that are recreated every frame, release the others.
+        if (chunk->isEmpty()) {
+            auto emptyChunks = std::count_if(chunks.begin(), chunks.end(),
+                                             [](auto c) { return c->isEmpty(); });
+            if (emptyChunks > 1) {
+                chunks.erase(std::find(chunks.begin(), chunks.end(), chunk));
                 delete chunk;
             }
         }
-        std::sort(
-            chunks.begin(), chunks.end(), [](auto a, auto b) {
-                return a->numFreeBlocks() < b->numFreeBlocks();
-            });
     }
 }
 
@@ -308,7 +249,7 @@ uint64_t VulkanMemoryAllocator::purge() {
         auto iter = std::find_if(
             chunks.begin(), chunks.end(),
             [](auto chunk) {
-                return chunk->numFreeBlocks() == chunk->totalBlocks;
+                return chunk->isEmpty();
             });
         if (iter == chunks.end())
             break;
@@ -330,59 +271,33 @@ VulkanMemoryPool::VulkanMemoryPool(VulkanGraphicsDevice* device,
     , memoryHeap(heap)
     , gdevice(device) {
 
-    allocators.reserve(std::size(memoryChunkSizeBlocks));
-    for (const auto& chunk : memoryChunkSizeBlocks) {
-        auto allocator = new VulkanMemoryAllocator(this,
-                                                   chunk.blockSize,
-                                                   chunk.numBlocks);
-
-        allocators.push_back(allocator);
-    }
-
-    FVASSERT_DEBUG(std::is_sorted(allocators.begin(), allocators.end(),
-                                  [](auto& a, auto& b) {
-                                      return a->blockSize < b->blockSize;
-                                  }));
+    uint64_t chunkSize = std::min(preferredChunkSize, heap.size / 8);
+    linearAllocator = new VulkanMemoryAllocator(this, chunkSize);
+    optimalAllocator = new VulkanMemoryAllocator(this, chunkSize);
 }
 
 VulkanMemoryPool::~VulkanMemoryPool() {
-    for (auto alloc : allocators) {
-        delete alloc;
-    }
+    delete linearAllocator;
+    delete optimalAllocator;
     FVASSERT_DEBUG(dedicatedAllocations.empty());
 }
 
-std::optional<VulkanMemoryBlock> VulkanMemoryPool::alloc(uint64_t size) {
+std::optional<VulkanMemoryBlock> VulkanMemoryPool::alloc(uint64_t size, uint64_t alignment, bool linear) {
     FVASSERT_DEBUG(size > 0);
-    //if (auto iter = std::lower_bound(allocators.begin(), allocators.end(),
-    //                                 size,
-    //                                 [](VulkanMemoryAllocator* a, uint64_t value) {
-    //    return a->blockSize < value;
-    //}); iter != allocators.end()) {
-    //    FVASSERT_DEBUG((*iter)->blockSize >= size);
-    //    return (*iter)->alloc(size);
-    //}
-
-    auto device = gdevice->device;
-    auto allocationCallbacks = gdevice->allocationCallbacks();
-
-    VkMemoryAllocateInfo memAllocInfo = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
-    memAllocInfo.allocationSize = size;
-    memAllocInfo.memoryTypeIndex = memoryTypeIndex;
-    VkDeviceMemory memory = VK_NULL_HANDLE;
-    VkResult err = vkAllocateMemory(device, &memAllocInfo, allocationCallbacks, &memory);
-    if (err != VK_SUCCESS) {
-        Log::error("vkAllocateMemory failed: {}", err);
-        return {};
+    auto allocator = linear ? linearAllocator : optimalAllocator;
+    if ((memoryPropertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) &&
+        (memoryPropertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) == 0) {
+        // flush and invalidate ranges must not touch neighbouring blocks.
+        auto atomSize = gdevice->physicalDevice.properties.limits.nonCoherentAtomSize;
+        alignment = std::max(alignment, atomSize);
+        size = (size + atomSize - 1) / atomSize * atomSize;
     }
-    auto chunk = new VulkanMemoryChunk(gdevice, this, nullptr,
-                                       memory, memoryPropertyFlags,
-                                       size, size, 1,
-                                       false);
-    std::unique_lock lock(mutex);
-    auto it = dedicatedAllocations.insert(chunk);
-    FVASSERT_DEBUG(it.second);
-    return chunk->pop();
+    // large resources get their own device memory.
+    if (size <= allocator->chunkSize / 2) {
+        if (auto block = allocator->alloc(size, alignment))
+            return block;
+    }
+    return allocSingle(size, VK_NULL_HANDLE, VK_NULL_HANDLE);
 }
 
 std::optional<VulkanMemoryBlock> VulkanMemoryPool::allocDedicated(uint64_t size, VkImage image, VkBuffer buffer) {
@@ -391,7 +306,10 @@ std::optional<VulkanMemoryBlock> VulkanMemoryPool::allocDedicated(uint64_t size,
         return {};
     }
     FVASSERT_DEBUG(size > 0);
+    return allocSingle(size, image, buffer);
+}
 
+std::optional<VulkanMemoryBlock> VulkanMemoryPool::allocSingle(uint64_t size, VkImage image, VkBuffer buffer) {
     auto device = gdevice->device;
     auto allocationCallbacks = gdevice->allocationCallbacks();
 
@@ -399,12 +317,15 @@ std::optional<VulkanMemoryBlock> VulkanMemoryPool::allocDedicated(uint64_t size,
     memAllocInfo.allocationSize = size;
     memAllocInfo.memoryTypeIndex = memoryTypeIndex;
 
+    const bool dedicated = image != VK_NULL_HANDLE || buffer != VK_NULL_HANDLE;
     VkMemoryDedicatedAllocateInfo memoryDedicatedAllocateInfo = {
             VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO
     };
-    memoryDedicatedAllocateInfo.image = image;
-    memoryDedicatedAllocateInfo.buffer = buffer;
-    memAllocInfo.pNext = &memoryDedicatedAllocateInfo;
+    if (dedicated) {
+        memoryDedicatedAllocateInfo.image = image;
+        memoryDedicatedAllocateInfo.buffer = buffer;
+        memAllocInfo.pNext = &memoryDedicatedAllocateInfo;
+    }
 
     VkDeviceMemory memory = VK_NULL_HANDLE;
     VkResult err = vkAllocateMemory(device, &memAllocInfo, allocationCallbacks, &memory);
@@ -414,12 +335,11 @@ std::optional<VulkanMemoryBlock> VulkanMemoryPool::allocDedicated(uint64_t size,
     }
     auto chunk = new VulkanMemoryChunk(gdevice, this, nullptr,
                                        memory, memoryPropertyFlags,
-                                       size, size, 1,
-                                       true);
+                                       size, dedicated);
     std::unique_lock lock(mutex);
     auto it = dedicatedAllocations.insert(chunk);
     FVASSERT_DEBUG(it.second);
-    return chunk->pop();
+    return chunk->alloc(size, 1);
 }
 
 void VulkanMemoryPool::dealloc(VulkanMemoryBlock& block) {
@@ -439,7 +359,7 @@ void VulkanMemoryPool::dealloc(VulkanMemoryBlock& block) {
             dedicatedAllocations.erase(chunk);
             lock.unlock();
 
-            chunk->push(block);
+            chunk->dealloc(block);
             delete chunk;
 
             block = {};
@@ -448,31 +368,23 @@ void VulkanMemoryPool::dealloc(VulkanMemoryBlock& block) {
 }
 
 uint64_t VulkanMemoryPool::purge() {
-    return std::reduce(
-        allocators.begin(), allocators.end(), uint64_t(0),
-        [](uint64_t result, auto alloc) { return result + alloc->purge(); });
+    return linearAllocator->purge() + optimalAllocator->purge();
 }
 
 uint64_t VulkanMemoryPool::numAllocations() const {
-    uint64_t count = 0;
-    for (auto alloc : allocators)
-        count += alloc->numAllocations();
+    uint64_t count = linearAllocator->numAllocations() + optimalAllocator->numAllocations();
     std::unique_lock lock(mutex);
     return count + dedicatedAllocations.size();
 }
 
 uint64_t VulkanMemoryPool::numDeviceAllocations() const {
-    uint64_t count = 0;
-    for (auto alloc : allocators)
-        count += alloc->numDeviceAllocations();
+    uint64_t count = linearAllocator->numDeviceAllocations() + optimalAllocator->numDeviceAllocations();
     std::unique_lock lock(mutex);
     return count + dedicatedAllocations.size();
 }
 
 uint64_t VulkanMemoryPool::totalMemorySize() const {
-    uint64_t count = 0;
-    for (auto alloc : allocators)
-        count += alloc->totalMemorySize();
+    uint64_t count = linearAllocator->totalMemorySize() + optimalAllocator->totalMemorySize();
     std::unique_lock lock(mutex);
     for (auto& chunk : dedicatedAllocations)
         count += chunk->chunkSize;
@@ -480,9 +392,7 @@ uint64_t VulkanMemoryPool::totalMemorySize() const {
 }
 
 uint64_t VulkanMemoryPool::memorySizeInUse() const {
-    uint64_t count = 0;
-    for (auto alloc : allocators)
-        count += alloc->memorySizeInUse();
+    uint64_t count = linearAllocator->memorySizeInUse() + optimalAllocator->memorySizeInUse();
     std::unique_lock lock(mutex);
     for (auto& chunk : dedicatedAllocations)
         count += chunk->chunkSize;
@@ -7,6 +7,7 @@
 
 #if FVCORE_ENABLE_VULKAN
 #include <vulkan/vulkan.h>
+#include "../TLSFAllocator.h"
 
 namespace FV {
 
@@ -14,6 +15,7 @@ namespace FV {
         uint64_t offset;
         uint64_t size;
         class VulkanMemoryChunk* chunk;
+        uint32_t allocationNode;    // TLSFAllocator node, sub-allocated chunks only
     };
 
     class VulkanGraphicsDevice;
@@ -24,13 +26,11 @@ namespace FV {
                           class VulkanMemoryAllocator*,
                           VkDeviceMemory,
                           VkMemoryPropertyFlags,
-                          uint64_t, uint64_t, uint64_t,
+                          uint64_t chunkSize,
                           bool dedicated);
         ~VulkanMemoryChunk();
 
         const uint64_t chunkSize;
-        const uint64_t blockSize;
-        const uint64_t totalBlocks;
         const bool dedicated;
         void* mapped;
 
@@ -43,19 +43,25 @@ namespace FV {
         bool invalidate(uint64_t offset, uint64_t size) const;
         bool flush(uint64_t offset, uint64_t size) const;
 
-        void push(const VulkanMemoryBlock&);
-        std::optional<VulkanMemoryBlock> pop();
+        // chunks without an allocator hold a single block.
+        std::optional<VulkanMemoryBlock> alloc(uint64_t size, uint64_t alignment);
+        void dealloc(const VulkanMemoryBlock&);
 
-        size_t numFreeBlocks() const { return freeBlocks.size(); }
+        uint64_t numAllocations() const { return blocks.numAllocations(); }
+        uint64_t memorySizeInUse() const { return blocks.sizeInUse(); }
+        bool isEmpty() const { return blocks.isEmpty(); }
 
     private:
-        std::vector<VulkanMemoryBlock> freeBlocks;
+        TLSFAllocator blocks;
         VulkanGraphicsDevice* const gdevice;
     };
 
+    // Sub-allocates blocks from large device memory chunks of one memory type.
+    // Linear (buffer) and optimal-tiling (image) resources use separate
+    // allocators, so bufferImageGranularity never applies within a chunk.
     class VulkanMemoryAllocator final {
     public:
-        VulkanMemoryAllocator(class VulkanMemoryPool*, uint64_t, uint64_t);
+        VulkanMemoryAllocator(class VulkanMemoryPool*, uint64_t chunkSize);
         ~VulkanMemoryAllocator();
 
         uint64_t numAllocations() const;
@@ -64,18 +70,16 @@ namespace FV {
         uint64_t totalMemorySize() const;
         uint64_t memorySizeInUse() const;
 
-        std::optional<VulkanMemoryBlock> alloc(uint64_t);
+        std::optional<VulkanMemoryBlock> alloc(uint64_t size, uint64_t alignment);
         void dealloc(VulkanMemoryBlock&);
 
         uint64_t purge();
 
         class VulkanMemoryPool* const pool;
 
-        const uint64_t blockSize;
-        const uint64_t blocksPerChunk;
+        const uint64_t chunkSize;
 
     private:
-        uint64_t memoryInUse;
         std::vector<VulkanMemoryChunk*> chunks;
         mutable std::mutex mutex;
     };
@@ -92,7 +96,7 @@ namespace FV {
         const VkMemoryPropertyFlags memoryPropertyFlags;
         const VkMemoryHeap memoryHeap;
 
-        std::optional<VulkanMemoryBlock> alloc(uint64_t size);
+        std::optional<VulkanMemoryBlock> alloc(uint64_t size, uint64_t alignment, bool linear);
         std::optional<VulkanMemoryBlock> allocDedicated(uint64_t size, VkImage, VkBuffer);
         void dealloc(VulkanMemoryBlock&);
 
@@ -106,7 +110,10 @@ namespace FV {
         class VulkanGraphicsDevice* const gdevice;
 
     private:
-        std::vector<VulkanMemoryAllocator*> allocators;
+        std::optional<VulkanMemoryBlock> allocSingle(uint64_t size, VkImage, VkBuffer);
+
+        VulkanMemoryAllocator* linearAllocator;
+        VulkanMemoryAllocator* optimalAllocator;
 
         mutable std::mutex mutex;
         std::unordered_set<VulkanMemoryChunk*> dedicatedAllocations;
@@ -1,10 +1,14 @@
 #include <chrono>
 #include <numeric>
 #include <algorithm>
+#include <fstream>
 #include "../../Logger.h"
 #include "../../Hash.h"
+#include "../../Application.h"
+#include "../../DispatchQueue.h"
 #include "VulkanGraphicsDevice.h"
 #include "VulkanCommandQueue.h"
+#include "VulkanDescriptorAllocator.h"
 #include "VulkanShaderModule.h"
 #include "VulkanShaderFunction.h"
 #include "VulkanShaderBindingSet.h"
@@ -37,7 +41,8 @@ VulkanGraphicsDevice::VulkanGraphicsDevice(std::shared_ptr<VulkanInstance> ins,
     , physicalDevice(pd)
     , device(VK_NULL_HANDLE)
     , pipelineCache(VK_NULL_HANDLE)
-    , numberOfFences(0)
+    , pipelineCacheDirty(false)
+    , pipelineCacheSaveScheduled(false)
     , extensionProc{} {
     std::vector<float> queuePriority = std::vector<float>(physicalDevice.maxQueues, 0.0f);
 
@@ -180,19 +185,9 @@ VulkanGraphicsDevice::VulkanGraphicsDevice(std::shared_ptr<VulkanInstance> ins,
     this->queueFamilies.shrink_to_fit();
 
     this->loadPipelineCache();
-
-    // launch thread.
-    this->fenceCompletionThread = std::jthread(
-        [this](std::stop_token stopToken) {
-            fenceCompletionCallbackThreadProc(stopToken);
-        });
 }
 
 VulkanGraphicsDevice::~VulkanGraphicsDevice() {
-    fenceCompletionThread.request_stop();
-    fenceCompletionCond.notify_all();
-    fenceCompletionThread.join();
-
     for (int i = 0; i < NumDescriptorPoolChainBuckets; ++i) {
         auto& chainMap = descriptorPoolChainMaps[i].poolChainMap;
         for (auto& cmap : chainMap) {
@@ -204,14 +199,12 @@ VulkanGraphicsDevice::~VulkanGraphicsDevice() {
         }
         chainMap.clear();
     }
+    for (VkDescriptorPool pool : transientDescriptorPools)
+        vkDestroyDescriptorPool(device, pool, allocationCallbacks());
+    transientDescriptorPools.clear();
 
     vkDeviceWaitIdle(device);
 
-    FVASSERT_DEBUG(pendingFenceCallbacks.empty());
-    for (VkFence fence : reusableFences)
-        vkDestroyFence(device, fence, allocationCallbacks());
-    reusableFences.clear();
-
     for (VulkanQueueFamily* family : queueFamilies) {
         delete family;
     }
@@ -219,6 +212,8 @@ VulkanGraphicsDevice::~VulkanGraphicsDevice() {
 
     // destroy pipeline cache
     if (pipelineCache != VK_NULL_HANDLE) {
+        if (pipelineCacheDirty)
+            savePipelineCache();
         vkDestroyPipelineCache(device, pipelineCache, allocationCallbacks());
         this->pipelineCache = VK_NULL_HANDLE;
     }
@@ -454,6 +449,48 @@ void VulkanGraphicsDevice::releaseDescriptorSets(VulkanDescriptorPool* pool, VkD
     }
 }
 
+VkDescriptorPool VulkanGraphicsDevice::transientDescriptorPool() {
+    if (true) {
+        std::scoped_lock guard(transientDescriptorPoolLock);
+        if (transientDescriptorPools.empty() == false) {
+            VkDescriptorPool pool = transientDescriptorPools.back();
+            transientDescriptorPools.pop_back();
+            return pool;
+        }
+    }
+
+    std::vector<VkDescriptorPoolSize> poolSizes;
+    poolSizes.reserve(numDescriptorTypes);
+    for (VkDescriptorType type : descriptorTypes) {
+        if (type != VK_DESCRIPTOR_TYPE_INLINE_UNIFORM_BLOCK)
+            poolSizes.push_back({ type, VulkanDescriptorAllocator::poolDescriptorCount });
+    }
+    // no VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT, sets are only released by reset.
+    VkDescriptorPoolCreateInfo ci = { VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
+    ci.poolSizeCount = (uint32_t)poolSizes.size();
+    ci.pPoolSizes = poolSizes.data();
+    ci.maxSets = VulkanDescriptorAllocator::poolMaxSets;
+
+    VkDescriptorPool pool = VK_NULL_HANDLE;
+    VkResult err = vkCreateDescriptorPool(device, &ci, allocationCallbacks(), &pool);
+    if (err != VK_SUCCESS) {
+        Log::error("vkCreateDescriptorPool failed: {}", err);
+        return VK_NULL_HANDLE;
+    }
+    return pool;
+}
+
+void VulkanGraphicsDevice::recycleTransientDescriptorPools(const std::vector<VkDescriptorPool>& pools) {
+    for (VkDescriptorPool pool : pools) {
+        VkResult err = vkResetDescriptorPool(device, pool, 0);
+        if (err != VK_SUCCESS) {
+            Log::error("vkResetDescriptorPool failed: {}", err);
+        }
+    }
+    std::scoped_lock guard(transientDescriptorPoolLock);
+    transientDescriptorPools.insert(transientDescriptorPools.end(), pools.begin(), pools.end());
+}
+
 std::shared_ptr<GPUBuffer> VulkanGraphicsDevice::makeBuffer(size_t length, GPUBuffer::StorageMode storageMode, CPUCacheMode cpuCacheMode) {
     if (length == 0) return nullptr;
 
@@ -512,7 +549,7 @@ std::shared_ptr<GPUBuffer> VulkanGraphicsDevice::makeBuffer(size_t length, GPUBu
     if (dedicatedRequirements.prefersDedicatedAllocation) {
         memory = memoryPools.at(memoryTypeIndex)->allocDedicated(memReqs.size, VK_NULL_HANDLE, buffer);
     } else {
-        memory = memoryPools.at(memoryTypeIndex)->alloc(memReqs.size);
+        memory = memoryPools.at(memoryTypeIndex)->alloc(memReqs.size, memReqs.alignment, true);
     }
     if (!memory) {
         Log::error("Memory allocation failed.");
@@ -642,7 +679,7 @@ std::shared_ptr<Texture> VulkanGraphicsDevice::makeTexture(const TextureDescript
     if (dedicatedRequirements.prefersDedicatedAllocation) {
         memory = memoryPools.at(memoryTypeIndex)->allocDedicated(memReqs.size, image, VK_NULL_HANDLE);
     } else {
-        memory = memoryPools.at(memoryTypeIndex)->alloc(memReqs.size);
+        memory = memoryPools.at(memoryTypeIndex)->alloc(memReqs.size, memReqs.alignment, false);
     }
     if (!memory) {
         Log::error("Memory allocation failed.");
@@ -756,7 +793,7 @@ std::shared_ptr<Texture> VulkanGraphicsDevice::makeTransientRenderTarget(Texture
     if (dedicatedRequirements.prefersDedicatedAllocation) {
         memory = memoryPools.at(memoryTypeIndex)->allocDedicated(memReqs.size, image, VK_NULL_HANDLE);
     } else {
-        memory = memoryPools.at(memoryTypeIndex)->alloc(memReqs.size);
+        memory = memoryPools.at(memoryTypeIndex)->alloc(memReqs.size, memReqs.alignment, false);
     }
     if (!memory) {
         Log::error("Memory allocation failed.");
@@ -1249,7 +1286,7 @@ std::shared_ptr<RenderPipelineState> VulkanGraphicsDevice::makeRenderPipelineSta
         Log::error("vkCreateGraphicsPipelines failed: {}", err);
         return nullptr;
     }
-    savePipelineCache();
+    setPipelineCacheDirty();
 
     if (reflection) {
         size_t maxResourceCount = 0;
@@ -1390,7 +1427,7 @@ std::shared_ptr<ComputePipelineState> VulkanGraphicsDevice::makeComputePipelineS
         Log::error("vkCreateComputePipelines failed: {}", err);
         return nullptr;
     }
-    savePipelineCache();
+    setPipelineCacheDirty();
 
     if (reflection) {
         reflection->inputAttributes = module->inputAttributes;
@@ -1480,21 +1517,74 @@ void VulkanGraphicsDevice::loadPipelineCache() {
         this->pipelineCache = VK_NULL_HANDLE;
     }
 
+    if (this->pipelineCachePath.empty()) {
+        auto dir = Application::environmentPath(Application::EnvironmentPath::UserCache);
+        if (dir.empty()) {
+            std::error_code ec;
+            dir = std::filesystem::temp_directory_path(ec);
+        }
+        auto props = this->properties();
+        this->pipelineCachePath = dir / std::format("FVCore_PipelineCache_{:04x}_{:04x}.bin",
+                                                    props.vendorID, props.deviceID);
+    }
+
+    // load cache from file, the header must match this device.
     std::vector<unsigned char> buffer;
-    VkPipelineCacheCreateInfo pipelineCreateInfo = { VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO };
+    if (std::ifstream fs(this->pipelineCachePath, std::ifstream::binary | std::ifstream::in); fs.good()) {
+        buffer.assign(std::istreambuf_iterator<char>(fs), std::istreambuf_iterator<char>());
+        auto props = this->properties();
+        VkPipelineCacheHeaderVersionOne header = {};
+        if (buffer.size() >= sizeof(header))
+            memcpy(&header, buffer.data(), sizeof(header));
+        if (buffer.size() < sizeof(header) ||
+            header.headerSize < sizeof(header) ||
+            header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+            header.vendorID != props.vendorID ||
+            header.deviceID != props.deviceID ||
+            memcmp(header.pipelineCacheUUID, props.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+            Log::warning("Pipeline cache file ignored: {}", this->pipelineCachePath.generic_u8string());
+            buffer.clear();
+        }
+    }
 
-    // load cache from file!
-    pipelineCreateInfo.initialDataSize = 0;
-    pipelineCreateInfo.pInitialData = nullptr;
+    VkPipelineCacheCreateInfo pipelineCreateInfo = { VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO };
+    pipelineCreateInfo.initialDataSize = buffer.size();
+    pipelineCreateInfo.pInitialData = buffer.empty() ? nullptr : buffer.data();
 
     VkResult err = vkCreatePipelineCache(this->device, &pipelineCreateInfo, allocationCallbacks(), &this->pipelineCache);
+    if (err != VK_SUCCESS && buffer.empty() == false) {
+        Log::warning("vkCreatePipelineCache failed with cache data: {}", err);
+        pipelineCreateInfo.initialDataSize = 0;
+        pipelineCreateInfo.pInitialData = nullptr;
+        err = vkCreatePipelineCache(this->device, &pipelineCreateInfo, allocationCallbacks(), &this->pipelineCache);
+    }
     if (err != VK_SUCCESS) {
         Log::error("vkCreatePipelineCache failed: {}", err);
     }
+    this->pipelineCacheDirty = false;
+}
+
+void VulkanGraphicsDevice::setPipelineCacheDirty() {
+    this->pipelineCacheDirty = true;
+    if (this->pipelineCacheSaveScheduled.exchange(true))
+        return; // pipelines created until the task runs are saved together.
+
+    detachedTask([](std::weak_ptr<VulkanGraphicsDevice> weak)->Task<> {
+        co_await dispatchGlobal().schedule(pipelineCacheSaveDelay);
+        if (auto device = weak.lock()) {
+            device->pipelineCacheSaveScheduled = false;
+            if (device->pipelineCacheDirty)
+                device->savePipelineCache();
+        }
+    }(weak_from_this()));
 }
 
 void VulkanGraphicsDevice::savePipelineCache() {
+    std::scoped_lock guard(pipelineCacheSaveLock);
     if (this->pipelineCache != VK_NULL_HANDLE) {
+        // pipelines created after this point make the cache dirty again.
+        this->pipelineCacheDirty = false;
+
         std::vector<uint8_t> buffer;
         VkResult err = VK_SUCCESS;
         do {
@@ -1515,7 +1605,30 @@ void VulkanGraphicsDevice::savePipelineCache() {
 
         } while (0);
         if (err == VK_SUCCESS) {
-            // save data to file!
+            if (buffer.empty() || this->pipelineCachePath.empty())
+                return;
+            // write to a temporary file and rename it, readers never see a partial file.
+            auto tmpPath = this->pipelineCachePath;
+            tmpPath += ".tmp";
+            if (true) {
+                std::ofstream fs(tmpPath, std::ofstream::binary | std::ofstream::out | std::ofstream::trunc);
+                if (fs.good() == false) {
+                    Log::error("Failed to open file: {}", tmpPath.generic_u8string());
+                    return;
+                }
+                fs.write(reinterpret_cast<const char*>(buffer.data()), std::streamsize(buffer.size()));
+                if (fs.good() == false) {
+                    Log::error("Failed to write file: {}", tmpPath.generic_u8string());
+                    return;
+                }
+            }
+            std::error_code ec;
+            std::filesystem::rename(tmpPath, this->pipelineCachePath, ec);
+            if (ec) {
+                Log::error("Failed to rename file: {}, error: {}",
+                           this->pipelineCachePath.generic_u8string(), ec.message());
+                std::filesystem::remove(tmpPath, ec);
+            }
         } else {
             Log::error("vkGetPipelineCacheData failed: {}", err);
         }
@@ -1667,135 +1780,4 @@ VkPipelineLayout VulkanGraphicsDevice::makePipelineLayout(std::initializer_list<
     return pipelineLayout;
 }
 
-void VulkanGraphicsDevice::fenceCompletionCallbackThreadProc(std::stop_token stopToken) {
-    constexpr double fenceWaitInterval = 0.002;
-
-    VkResult err = VK_SUCCESS;
-
-    std::vector<VkFence> fences;
-    std::vector<FenceCallback> waitingFences;
-    std::vector<std::function<void()>> completionHandlers;
-
-    Log::info("Vulkan Queue Completion Helper thread is started.");
-
-    std::unique_lock fenceMutex(fenceCompletionMutex);
-    while (stopToken.stop_requested() == false) {
-        // move callbacks to waitingFences
-        waitingFences.insert(waitingFences.end(), pendingFenceCallbacks.begin(), pendingFenceCallbacks.end());
-        pendingFenceCallbacks.clear();
-
-        if (waitingFences.empty() == false) {
-            // condition is unlocked from here.
-            fenceMutex.unlock();
-
-            fences.clear();
-            fences.reserve(waitingFences.size());
-            for (FenceCallback& cb : waitingFences)
-                fences.push_back(cb.fence);
-
-            FVASSERT_DEBUG(fences.empty() == false);
-            err = vkWaitForFences(device,
-                                  (uint32_t)fences.size(), fences.data(),
-                                  VK_FALSE, 0);
-            fences.clear();
-            if (err == VK_SUCCESS) {
-                std::vector<FenceCallback> waitingFencesCopy;
-                waitingFencesCopy.reserve(waitingFences.size());
-
-                // check state for each fences
-                for (FenceCallback& cb : waitingFences) {
-                    if (vkGetFenceStatus(device, cb.fence) == VK_SUCCESS) {
-                        fences.push_back(cb.fence);
-                        completionHandlers.push_back(cb.completionHandler);
-                    } else
-                        waitingFencesCopy.push_back(cb); // fence is not ready (unsignaled)
-                }
-                // save unsignaled fences
-                waitingFences.clear();
-                waitingFences = std::move(waitingFencesCopy);
-
-                // reset signaled fences
-                if (fences.empty() == false) {
-                    err = vkResetFences(device,
-                                        (uint32_t)fences.size(), fences.data());
-                    if (err != VK_SUCCESS) {
-                        Log::error("vkResetFences failed: {}", err);
-                        // runtime error!
-                        //FVASSERT(err == VK_SUCCESS);
-                        FVERROR_ABORT("vkResetFences failed");
-                    }
-                }
-            } else if (err != VK_TIMEOUT) {
-                Log::error("vkResetFences failed: {}", err);
-                //FVASSERT(0);
-                FVERROR_ABORT("vkResetFences failed");
-            }
-
-            if (completionHandlers.empty() == false) {
-                for (auto& handler : completionHandlers) {
-                    if (handler)
-                        handler();
-                }
-                completionHandlers.clear();
-            }
-
-            // lock condition (requires to reset fences mutually exclusive)
-            fenceMutex.lock();
-            if (fences.empty() == false) {
-                reusableFences.insert(reusableFences.end(), fences.begin(), fences.end());
-                fences.clear();
-            }
-            if (err == VK_TIMEOUT) {
-                if (fenceWaitInterval > 0.0)
-                    fenceCompletionCond.wait_for(
-                        fenceMutex,
-                        std::chrono::duration<double, std::ratio<1, 1>>(fenceWaitInterval),
-                        [&] {
-                            return stopToken.stop_requested();
-                        });
-                else
-                    std::this_thread::yield();
-            }
-        } else {
-            fenceCompletionCond.wait(fenceMutex);
-        }
-    }
-    Log::info("Vulkan Queue Completion Helper thread is finished.");
-}
-
-void VulkanGraphicsDevice::addFenceCompletionHandler(VkFence fence, std::function<void()> op) {
-    FVASSERT_DEBUG(fence != VK_NULL_HANDLE);
-
-    if (op) {
-        std::unique_lock lock(fenceCompletionMutex);
-        FenceCallback cb = { fence, op };
-        pendingFenceCallbacks.push_back(cb);
-        fenceCompletionCond.notify_all();
-    }
-}
-
-VkFence VulkanGraphicsDevice::fence() {
-    VkFence fence = VK_NULL_HANDLE;
-
-    if (fence == VK_NULL_HANDLE) {
-        std::unique_lock lock(fenceCompletionMutex);
-        if (reusableFences.empty() == false) {
-            fence = reusableFences.front();
-            reusableFences.erase(reusableFences.begin());
-        }
-    }
-    if (fence == VK_NULL_HANDLE) {
-        VkFenceCreateInfo fenceCreateInfo = { VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
-        VkResult err = vkCreateFence(device, &fenceCreateInfo, allocationCallbacks(), &fence);
-        if (err != VK_SUCCESS) {
-            Log::error("vkCreateFence failed: {}", err);
-            FVASSERT(err == VK_SUCCESS);
-        }
-        std::unique_lock lock(fenceCompletionMutex);
-        this->numberOfFences += 1;
-        Log::info("Queue Completion Helper: Num-Fences: {:d}", numberOfFences);
-    }
-    return fence;
-}
-
 #endif //#if FVCORE_ENABLE_VULKAN
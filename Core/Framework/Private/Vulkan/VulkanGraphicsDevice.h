@@ -2,8 +2,8 @@
 #include <atomic>
 #include <memory>
 #include <mutex>
-#include <condition_variable>
 #include <string>
+#include <filesystem>
 
 #include "../../GraphicsDevice.h"
 #if FVCORE_ENABLE_VULKAN
@@ -48,11 +48,16 @@ namespace FV {
         std::shared_ptr<VulkanDescriptorSet> makeDescriptorSet(VkDescriptorSetLayout, const VulkanDescriptorPoolID&);
         void releaseDescriptorSets(VulkanDescriptorPool*, VkDescriptorSet*, uint32_t);
 
-        void addFenceCompletionHandler(VkFence, std::function<void()>);
-        VkFence fence();
+        // pools of VulkanDescriptorAllocator, recycled pools are reset and reused.
+        VkDescriptorPool transientDescriptorPool();
+        void recycleTransientDescriptorPools(const std::vector<VkDescriptorPool>&);
 
+        // The pipeline cache is shared by all threads creating pipelines.
+        // Changes are written to the file by a background task after
+        // pipelineCacheSaveDelay, and once more when the device is destroyed.
         void loadPipelineCache();
         void savePipelineCache();
+        void setPipelineCacheDirty();
 
 
         std::shared_ptr<VulkanInstance> instance;
@@ -84,6 +89,9 @@ namespace FV {
             std::mutex lock;
         } descriptorPoolChainMaps[NumDescriptorPoolChainBuckets];
 
+        std::vector<VkDescriptorPool> transientDescriptorPools;
+        std::mutex transientDescriptorPoolLock;
+
         uint32_t indexOfMemoryType(uint32_t typeBits, VkMemoryPropertyFlags properties) {
             for (uint32_t i = 0; i < deviceMemoryTypes.size(); ++i) {
                 if ((typeBits & (1U << i)) && (deviceMemoryTypes.at(i).propertyFlags & properties) == properties)
@@ -93,19 +101,11 @@ namespace FV {
         };
 
         VkPipelineCache pipelineCache;
-
-        struct FenceCallback {
-            VkFence fence;
-            std::function<void()> completionHandler;
-        };
-        std::vector<FenceCallback> pendingFenceCallbacks;
-        std::vector<VkFence> reusableFences;
-        size_t numberOfFences;
-
-        std::mutex fenceCompletionMutex;
-        std::condition_variable fenceCompletionCond;
-        std::jthread fenceCompletionThread;
-        void fenceCompletionCallbackThreadProc(std::stop_token);
+        std::filesystem::path pipelineCachePath;
+        std::atomic<bool> pipelineCacheDirty;
+        std::atomic<bool> pipelineCacheSaveScheduled;
+        std::mutex pipelineCacheSaveLock;
+        static constexpr double pipelineCacheSaveDelay = 2.0;
 
         bool autoIncrementTimelineEvent = false;
     };
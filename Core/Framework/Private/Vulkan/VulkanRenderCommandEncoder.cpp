@@ -691,7 +691,7 @@ void VulkanRenderCommandEncoder::setResource(uint32_t index, std::shared_ptr<Sha
         auto bindingSet = std::dynamic_pointer_cast<VulkanShaderBindingSet>(set);
         FVASSERT_DEBUG(bindingSet);
 
-        descriptorSet = bindingSet->makeDescriptorSet();
+        descriptorSet = bindingSet->makeDescriptorSet(encoder->cbuffer->descriptorAllocator());
         FVASSERT_DEBUG(descriptorSet);
 
         encoder->descriptorSets.push_back(descriptorSet);
@@ -6,6 +6,40 @@
 #if FVCORE_ENABLE_VULKAN
 using namespace FV;
 
+namespace {
+    // descriptors of bindings are compared by handles, the bindings hold
+    // the resources so the handles are not reused.
+    bool isEqual(const VulkanDescriptorSet::Binding& lhs, const VulkanDescriptorSet::Binding& rhs) {
+        if (lhs.valueSet != rhs.valueSet)
+            return false;
+        if (lhs.valueSet == false)
+            return true;
+        const VkWriteDescriptorSet& w1 = lhs.write;
+        const VkWriteDescriptorSet& w2 = rhs.write;
+        if (w1.dstArrayElement != w2.dstArrayElement ||
+            w1.descriptorCount != w2.descriptorCount ||
+            (w1.pImageInfo == nullptr) != (w2.pImageInfo == nullptr) ||
+            (w1.pBufferInfo == nullptr) != (w2.pBufferInfo == nullptr) ||
+            (w1.pTexelBufferView == nullptr) != (w2.pTexelBufferView == nullptr))
+            return false;
+        return std::equal(lhs.imageInfos.begin(), lhs.imageInfos.end(),
+                          rhs.imageInfos.begin(), rhs.imageInfos.end(),
+                          [](auto& a, auto& b) {
+                              return a.sampler == b.sampler &&
+                                  a.imageView == b.imageView &&
+                                  a.imageLayout == b.imageLayout;
+                          }) &&
+            std::equal(lhs.bufferInfos.begin(), lhs.bufferInfos.end(),
+                       rhs.bufferInfos.begin(), rhs.bufferInfos.end(),
+                       [](auto& a, auto& b) {
+                           return a.buffer == b.buffer &&
+                               a.offset == b.offset &&
+                               a.range == b.range;
+                       }) &&
+            lhs.texelBufferViews == rhs.texelBufferViews;
+    }
+}
+
 VulkanShaderBindingSet::VulkanShaderBindingSet(std::shared_ptr<VulkanGraphicsDevice> dev,
                                    VkDescriptorSetLayout layout,
                                    const VulkanDescriptorPoolID& poolID,
@@ -13,7 +47,10 @@ VulkanShaderBindingSet::VulkanShaderBindingSet(std::shared_ptr<VulkanGraphicsDev
     : gdevice(dev)
     , descriptorSetLayout(layout)
     , poolID(poolID)
-    , layoutFlags(createInfo.flags) {
+    , layoutFlags(createInfo.flags)
+    , version(1)
+    , lastUsedVersion(0)
+    , cachedVersion(0) {
     FVASSERT_DEBUG(descriptorSetLayout != VK_NULL_HANDLE);
 
     bindings.reserve(createInfo.bindingCount);
@@ -30,39 +67,43 @@ VulkanShaderBindingSet::~VulkanShaderBindingSet() {
     vkDestroyDescriptorSetLayout(gdevice->device, descriptorSetLayout, gdevice->allocationCallbacks());
 }
 
-std::shared_ptr<VulkanDescriptorSet> VulkanShaderBindingSet::makeDescriptorSet() const {
-    std::shared_ptr<VulkanDescriptorSet> descriptorSet = gdevice->makeDescriptorSet(descriptorSetLayout, poolID);
-    FVASSERT_DEBUG(descriptorSet);
-
-    descriptorSet->bindings = this->bindings;
-
-    std::vector<VkWriteDescriptorSet> descriptorWrites;
-    descriptorWrites.reserve(descriptorSet->bindings.size());
-
-    for (DescriptorBinding& binding : descriptorSet->bindings) {
-        if (!binding.valueSet)
-            continue;
-
-        VkWriteDescriptorSet& write = binding.write;
-        write.dstSet = descriptorSet->descriptorSet;
-        if (write.pImageInfo)
-            write.pImageInfo = binding.imageInfos.data();
-        if (write.pBufferInfo)
-            write.pBufferInfo = binding.bufferInfos.data();
-        if (write.pTexelBufferView)
-            write.pTexelBufferView = binding.texelBufferViews.data();
-
-        descriptorWrites.push_back(write);
+std::shared_ptr<VulkanDescriptorSet> VulkanShaderBindingSet::makeDescriptorSet(VulkanDescriptorAllocator* allocator) {
+    std::shared_ptr<VulkanDescriptorSet> cached = nullptr;
+    if (true) {
+        std::scoped_lock guard(cacheLock);
+        if (cachedDescriptorSet && cachedVersion == version) {
+            cached = cachedDescriptorSet;
+        } else {
+            // the descriptors changed, the old set and the resources of
+            // its bindings are released. Sets in flight hold their own.
+            cachedDescriptorSet = nullptr;
+            if (lastUsedVersion == version || allocator == nullptr) {
+                cachedDescriptorSet = gdevice->makeDescriptorSet(descriptorSetLayout, poolID);
+                FVASSERT_DEBUG(cachedDescriptorSet);
+                if (cachedDescriptorSet) {
+                    cachedDescriptorSet->setBindings(bindings, true);
+                    cachedVersion = version;
+                    cached = cachedDescriptorSet;
+                }
+            }
+        }
+        lastUsedVersion = version;
     }
-
-    FVASSERT_DEBUG(descriptorWrites.empty() == false);
-
-    vkUpdateDescriptorSets(gdevice->device,
-                           (uint32_t)descriptorWrites.size(),
-                           descriptorWrites.data(),
-                           0,
-                           nullptr);
-
+    if (cached)
+        return std::make_shared<VulkanDescriptorSet>(cached, shared_from_this(), allocator);
+
+    std::shared_ptr<VulkanDescriptorSet> descriptorSet = nullptr;
+    VkDescriptorSet ds = VK_NULL_HANDLE;
+    if (allocator)
+        ds = allocator->allocateDescriptorSet(descriptorSetLayout, poolID);
+    if (ds != VK_NULL_HANDLE) {
+        descriptorSet = std::make_shared<VulkanDescriptorSet>(gdevice, nullptr, ds);
+    } else {
+        descriptorSet = gdevice->makeDescriptorSet(descriptorSetLayout, poolID);
+    }
+    FVASSERT_DEBUG(descriptorSet);
+    if (descriptorSet)
+        descriptorSet->setBindings(bindings, true);
     return descriptorSet;
 }
 
@@ -83,6 +124,7 @@ void VulkanShaderBindingSet::setBuffer(uint32_t binding, std::shared_ptr<GPUBuff
 void VulkanShaderBindingSet::setBufferArray(uint32_t binding, uint32_t numBuffers, BufferInfo* bufferArray) {
     DescriptorBinding* descriptorBinding = findDescriptorBinding(binding);
     if (descriptorBinding) {
+        const DescriptorBinding previous = *descriptorBinding;
         descriptorBinding->valueSet = false;
         descriptorBinding->bufferInfos.clear();
         descriptorBinding->imageInfos.clear();
@@ -158,6 +200,8 @@ void VulkanShaderBindingSet::setBufferArray(uint32_t binding, uint32_t numBuffer
         }
         descriptorBinding->write = write;
         descriptorBinding->valueSet = true;
+        if (isEqual(previous, *descriptorBinding) == false)
+            version++;
     }
 }
 
@@ -168,6 +212,7 @@ void VulkanShaderBindingSet::setTexture(uint32_t binding, std::shared_ptr<Textur
 void VulkanShaderBindingSet::setTextureArray(uint32_t binding, uint32_t numTextures, std::shared_ptr<Texture>* textureArray) {
     DescriptorBinding* descriptorBinding = findDescriptorBinding(binding);
     if (descriptorBinding) {
+        const DescriptorBinding previous = *descriptorBinding;
         //descriptorBinding->descriptorWrites.Clear();
         descriptorBinding->bufferInfos.clear();
         //descriptorBinding->imageInfos.clear();
@@ -257,6 +302,8 @@ void VulkanShaderBindingSet::setTextureArray(uint32_t binding, uint32_t numTextu
             FVASSERT_DESC_DEBUG(0, "Invalid descriptor type!");
             return;
         }
+        if (isEqual(previous, *descriptorBinding) == false)
+            version++;
     }
 }
 
@@ -267,6 +314,7 @@ void VulkanShaderBindingSet::setSamplerState(uint32_t binding, std::shared_ptr<S
 void VulkanShaderBindingSet::setSamplerStateArray(uint32_t binding, uint32_t numSamplers, std::shared_ptr<SamplerState>* samplerArray) {
     DescriptorBinding* descriptorBinding = findDescriptorBinding(binding);
     if (descriptorBinding) {
+        const DescriptorBinding previous = *descriptorBinding;
         //descriptorBinding->descriptorWrites.clear();
         descriptorBinding->bufferInfos.clear();
         //descriptorBinding->imageInfos.clear();
@@ -330,6 +378,8 @@ void VulkanShaderBindingSet::setSamplerStateArray(uint32_t binding, uint32_t num
             FVASSERT_DESC_DEBUG(0, "Invalid descriptor type!");
             return;
         }
+        if (isEqual(previous, *descriptorBinding) == false)
+            version++;
     }
 }
 
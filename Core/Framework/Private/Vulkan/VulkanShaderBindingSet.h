@@ -1,6 +1,7 @@
 #pragma once
 #include <memory>
 #include <vector>
+#include <mutex>
 #include "../../ShaderBindingSet.h"
 
 #if FVCORE_ENABLE_VULKAN
@@ -10,11 +11,11 @@
 #include "VulkanSampler.h"
 #include "VulkanDescriptorSet.h"
 #include "VulkanDescriptorPool.h"
+#include "VulkanDescriptorAllocator.h"
 
 namespace FV {
     class VulkanGraphicsDevice;
-    class VulkanShaderBindingSet : public ShaderBindingSet {
-        const VulkanDescriptorPoolID poolID;
+    class VulkanShaderBindingSet : public ShaderBindingSet, public std::enable_shared_from_this<VulkanShaderBindingSet> {
     public:
         VulkanShaderBindingSet(std::shared_ptr<VulkanGraphicsDevice>,
                          VkDescriptorSetLayout,
@@ -22,6 +23,7 @@ namespace FV {
                          const VkDescriptorSetLayoutCreateInfo&);
         ~VulkanShaderBindingSet();
 
+        const VulkanDescriptorPoolID poolID;
         VkDescriptorSetLayout descriptorSetLayout;
         VkDescriptorSetLayoutCreateFlags layoutFlags;
 
@@ -37,9 +39,19 @@ namespace FV {
         void setSamplerState(uint32_t binding, std::shared_ptr<SamplerState>) override;
         void setSamplerStateArray(uint32_t binding, uint32_t numSamplers, std::shared_ptr<SamplerState>*) override;
 
-        std::shared_ptr<VulkanDescriptorSet> makeDescriptorSet() const;
+        // A binding set used again without changes keeps its descriptor
+        // set, following uses share it. Sets of binding sets which were
+        // changed since their last use are allocated from the allocator.
+        std::shared_ptr<VulkanDescriptorSet> makeDescriptorSet(VulkanDescriptorAllocator*);
 
         DescriptorBinding* findDescriptorBinding(uint32_t binding);
+
+    private:
+        uint64_t version;           // incremented when the descriptors change
+        uint64_t lastUsedVersion;
+        uint64_t cachedVersion;
+        std::shared_ptr<VulkanDescriptorSet> cachedDescriptorSet;
+        std::mutex cacheLock;
     };
 }
 #endif //#if FVCORE_ENABLE_VULKAN
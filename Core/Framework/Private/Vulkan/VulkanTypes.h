@@ -181,6 +181,15 @@ namespace FV {
 
         case PixelFormat::Depth24Unorm_stencil8:    return VK_FORMAT_D24_UNORM_S8_UINT;
         case PixelFormat::Depth32Float_stencil8:    return VK_FORMAT_D32_SFLOAT_S8_UINT;
+
+        case PixelFormat::BC1RGBAUnorm:         return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+        case PixelFormat::BC1RGBAUnorm_srgb:    return VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
+        case PixelFormat::BC3RGBAUnorm:         return VK_FORMAT_BC3_UNORM_BLOCK;
+        case PixelFormat::BC3RGBAUnorm_srgb:    return VK_FORMAT_BC3_SRGB_BLOCK;
+        case PixelFormat::BC4RUnorm:            return VK_FORMAT_BC4_UNORM_BLOCK;
+        case PixelFormat::BC5RGUnorm:           return VK_FORMAT_BC5_UNORM_BLOCK;
+        case PixelFormat::BC7RGBAUnorm:         return VK_FORMAT_BC7_UNORM_BLOCK;
+        case PixelFormat::BC7RGBAUnorm_srgb:    return VK_FORMAT_BC7_SRGB_BLOCK;
         }
         return VK_FORMAT_UNDEFINED;
     }
@@ -247,6 +256,15 @@ namespace FV {
 
         case VK_FORMAT_D24_UNORM_S8_UINT:           return PixelFormat::Depth24Unorm_stencil8;
         case VK_FORMAT_D32_SFLOAT_S8_UINT:	        return PixelFormat::Depth32Float_stencil8;
+
+        case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:        return PixelFormat::BC1RGBAUnorm;
+        case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:         return PixelFormat::BC1RGBAUnorm_srgb;
+        case VK_FORMAT_BC3_UNORM_BLOCK:             return PixelFormat::BC3RGBAUnorm;
+        case VK_FORMAT_BC3_SRGB_BLOCK:              return PixelFormat::BC3RGBAUnorm_srgb;
+        case VK_FORMAT_BC4_UNORM_BLOCK:             return PixelFormat::BC4RUnorm;
+        case VK_FORMAT_BC5_UNORM_BLOCK:             return PixelFormat::BC5RGUnorm;
+        case VK_FORMAT_BC7_UNORM_BLOCK:             return PixelFormat::BC7RGBAUnorm;
+        case VK_FORMAT_BC7_SRGB_BLOCK:              return PixelFormat::BC7RGBAUnorm_srgb;
         }
         return PixelFormat::Invalid;
     }
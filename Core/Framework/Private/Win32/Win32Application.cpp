@@ -131,6 +131,7 @@ int Win32App::runApplication(Application* app) {
         ::UnhookWindowsHookEx(keyboardHook);
     keyboardHook = nullptr;
 
+    Logger::flush();
     logger->unbind();
 
     return exitCode;
@@ -1,10 +1,16 @@
 #include <algorithm>
 #include <fstream>
 #include <iterator>
+#include <mutex>
+#include <thread>
+#include <optional>
 #include "../Libs/SPIRV-Cross/spirv_cross.hpp"
 #include "../Libs/SPIRV-Cross/spirv_common.hpp"
 #include "Shader.h"
 #include "Logger.h"
+#include "Hash.h"
+#include "Application.h"
+#include "Private/MappedFile.h"
 
 using namespace FV;
 
@@ -194,6 +200,285 @@ namespace {
         }
         return dataType;
     }
+
+    std::mutex reflectionCacheLock;
+    std::optional<std::filesystem::path> reflectionCacheDir;
+
+    constexpr char reflectionCacheMagic[4] = { 'F', 'V', 'S', 'R' };
+    constexpr uint32_t reflectionCacheVersion = 1;
+
+    struct ReflectionCacheHeader {
+        char magic[4];
+        uint32_t version;
+        uint64_t words;
+        XXH3_128Digest digest;      // SPIR-V
+        uint64_t checksum;          // XXH3 of the data after the header
+    };
+
+    struct ReflectionWriter {
+        std::vector<uint8_t> buffer;
+
+        template <typename T> void put(T value) {
+            static_assert(std::is_trivially_copyable_v<T>);
+            auto p = reinterpret_cast<const uint8_t*>(&value);
+            buffer.insert(buffer.end(), p, p + sizeof(T));
+        }
+        void put(const std::string& str) {
+            put(uint32_t(str.size()));
+            buffer.insert(buffer.end(), str.begin(), str.end());
+        }
+        void put(const std::vector<ShaderResourceStructMember>& members) {
+            put(uint32_t(members.size()));
+            for (auto& member : members) {
+                put(member.dataType);
+                put(member.name);
+                put(member.offset);
+                put(member.size);
+                put(member.count);
+                put(member.stride);
+                put(member.members);
+            }
+        }
+        void put(const ShaderAttribute& attr) {
+            put(attr.name);
+            put(attr.location);
+            put(attr.type);
+            put(attr.enabled);
+        }
+    };
+
+    // reads from a mapped file, any out of range read fails the whole entry.
+    struct ReflectionReader {
+        const uint8_t* p;
+        const uint8_t* end;
+        bool ok = true;
+
+        template <typename T> T get() {
+            static_assert(std::is_trivially_copyable_v<T>);
+            T value = {};
+            if (ok && size_t(end - p) >= sizeof(T)) {
+                memcpy(&value, p, sizeof(T));
+                p += sizeof(T);
+            } else {
+                ok = false;
+            }
+            return value;
+        }
+        // element counts are bounded by the bytes left, so a corrupted
+        // count fails instead of allocating.
+        uint32_t count() {
+            uint32_t n = get<uint32_t>();
+            if (n > size_t(end - p))
+                ok = false;
+            return ok ? n : 0;
+        }
+        std::string string() {
+            uint32_t length = count();
+            std::string str(reinterpret_cast<const char*>(p), length);
+            p += length;
+            return str;
+        }
+        std::vector<ShaderResourceStructMember> members(int depth = 0) {
+            std::vector<ShaderResourceStructMember> members;
+            if (depth > 32) {
+                ok = false;
+                return members;
+            }
+            uint32_t n = count();
+            members.reserve(n);
+            for (uint32_t i = 0; i < n && ok; ++i) {
+                ShaderResourceStructMember member = {};
+                member.dataType = get<ShaderDataType>();
+                member.name = string();
+                member.offset = get<uint32_t>();
+                member.size = get<uint32_t>();
+                member.count = get<uint32_t>();
+                member.stride = get<uint32_t>();
+                member.members = this->members(depth + 1);
+                members.push_back(std::move(member));
+            }
+            return members;
+        }
+        ShaderAttribute attribute() {
+            ShaderAttribute attr = {};
+            attr.name = string();
+            attr.location = get<uint32_t>();
+            attr.type = get<ShaderDataType>();
+            attr.enabled = get<bool>();
+            return attr;
+        }
+    };
+}
+
+void Shader::setReflectionCacheDirectory(const std::filesystem::path& path) {
+    std::scoped_lock guard(reflectionCacheLock);
+    reflectionCacheDir = path;
+}
+
+std::filesystem::path Shader::reflectionCacheDirectory() {
+    std::scoped_lock guard(reflectionCacheLock);
+    if (reflectionCacheDir.has_value() == false) {
+        auto dir = Application::environmentPath(Application::EnvironmentPath::UserCache);
+        if (dir.empty()) {
+            std::error_code ec;
+            dir = std::filesystem::temp_directory_path(ec);
+        }
+        if (dir.empty() == false)
+            dir = dir / "FVCore" / "ShaderReflection";
+        reflectionCacheDir = dir;
+    }
+    return reflectionCacheDir.value();
+}
+
+bool Shader::loadReflection(const std::filesystem::path& path, const XXH3_128Digest& digest) {
+    MappedFile file(path);
+    if (file.isValid() == false)
+        return false;
+
+    ReflectionReader reader = { file.data(), file.data() + file.size() };
+    auto header = reader.get<ReflectionCacheHeader>();
+    if (reader.ok == false ||
+        memcmp(header.magic, reflectionCacheMagic, sizeof(reflectionCacheMagic)) != 0 ||
+        header.version != reflectionCacheVersion ||
+        header.words != _data.size() ||
+        header.digest != digest ||
+        header.checksum != XXH3::hash(reader.p, size_t(reader.end - reader.p)).hash) {
+        return false;
+    }
+
+    this->_stage = reader.get<ShaderStage>();
+    this->_threadgroupSize.x = reader.get<uint32_t>();
+    this->_threadgroupSize.y = reader.get<uint32_t>();
+    this->_threadgroupSize.z = reader.get<uint32_t>();
+
+    this->_functions.resize(reader.count());
+    for (auto& fn : this->_functions)
+        fn = reader.string();
+
+    this->_inputAttributes.resize(reader.count());
+    for (auto& attr : this->_inputAttributes)
+        attr = reader.attribute();
+    this->_outputAttributes.resize(reader.count());
+    for (auto& attr : this->_outputAttributes)
+        attr = reader.attribute();
+
+    this->_resources.resize(reader.count());
+    for (auto& res : this->_resources) {
+        res.set = reader.get<uint32_t>();
+        res.binding = reader.get<uint32_t>();
+        res.name = reader.string();
+        res.type = reader.get<ShaderResource::Type>();
+        res.stages = reader.get<uint32_t>();
+        res.count = reader.get<uint32_t>();
+        res.stride = reader.get<uint32_t>();
+        res.enabled = reader.get<bool>();
+        res.access = reader.get<ShaderResource::Access>();
+        res.typeInfo = reader.get<decltype(res.typeInfo)>();
+        res.members = reader.members();
+    }
+
+    this->_pushConstantLayouts.resize(reader.count());
+    for (auto& layout : this->_pushConstantLayouts) {
+        layout.name = reader.string();
+        layout.offset = reader.get<uint32_t>();
+        layout.size = reader.get<uint32_t>();
+        layout.stages = reader.get<uint32_t>();
+        layout.members = reader.members();
+    }
+
+    this->_descriptors.resize(reader.count());
+    for (auto& desc : this->_descriptors)
+        desc = reader.get<ShaderDescriptor>();
+
+    if (reader.ok == false || reader.p != reader.end) {
+        Log::warning("Invalid shader reflection cache: {}", path.generic_u8string());
+        return false;
+    }
+    return true;
+}
+
+bool Shader::storeReflection(const std::filesystem::path& path, const XXH3_128Digest& digest) const {
+    ReflectionCacheHeader header = {};
+    memcpy(header.magic, reflectionCacheMagic, sizeof(reflectionCacheMagic));
+    header.version = reflectionCacheVersion;
+    header.words = _data.size();
+    header.digest = digest;
+
+    ReflectionWriter writer;
+    writer.put(header);
+    const size_t headerSize = writer.buffer.size();
+    writer.put(_stage);
+    writer.put(_threadgroupSize.x);
+    writer.put(_threadgroupSize.y);
+    writer.put(_threadgroupSize.z);
+
+    writer.put(uint32_t(_functions.size()));
+    for (auto& fn : _functions)
+        writer.put(fn);
+
+    writer.put(uint32_t(_inputAttributes.size()));
+    for (auto& attr : _inputAttributes)
+        writer.put(attr);
+    writer.put(uint32_t(_outputAttributes.size()));
+    for (auto& attr : _outputAttributes)
+        writer.put(attr);
+
+    writer.put(uint32_t(_resources.size()));
+    for (auto& res : _resources) {
+        writer.put(res.set);
+        writer.put(res.binding);
+        writer.put(res.name);
+        writer.put(res.type);
+        writer.put(res.stages);
+        writer.put(res.count);
+        writer.put(res.stride);
+        writer.put(res.enabled);
+        writer.put(res.access);
+        writer.put(res.typeInfo);
+        writer.put(res.members);
+    }
+
+    writer.put(uint32_t(_pushConstantLayouts.size()));
+    for (auto& layout : _pushConstantLayouts) {
+        writer.put(layout.name);
+        writer.put(layout.offset);
+        writer.put(layout.size);
+        writer.put(layout.stages);
+        writer.put(layout.members);
+    }
+
+    writer.put(uint32_t(_descriptors.size()));
+    for (auto& desc : _descriptors)
+        writer.put(desc);
+
+    header.checksum = XXH3::hash(writer.buffer.data() + headerSize, writer.buffer.size() - headerSize).hash;
+    memcpy(writer.buffer.data(), &header, sizeof(header));
+
+    std::error_code ec;
+    std::filesystem::create_directories(path.parent_path(), ec);
+
+    // write to a temporary file and rename it, readers never see a partial file.
+    auto tmpPath = path;
+    tmpPath += std::format(".{}.tmp", std::hash<std::thread::id>{}(std::this_thread::get_id()));
+    if (true) {
+        std::ofstream fs(tmpPath, std::ofstream::binary | std::ofstream::out | std::ofstream::trunc);
+        if (fs.good() == false) {
+            Log::error("Failed to open file: {}", tmpPath.generic_u8string());
+            return false;
+        }
+        fs.write(reinterpret_cast<const char*>(writer.buffer.data()), std::streamsize(writer.buffer.size()));
+        if (fs.good() == false) {
+            Log::error("Failed to write file: {}", tmpPath.generic_u8string());
+            return false;
+        }
+    }
+    std::filesystem::rename(tmpPath, path, ec);
+    if (ec) {
+        // another thread or process may have stored it already.
+        std::filesystem::remove(tmpPath, ec);
+        return false;
+    }
+    return true;
 }
 
 Shader::Shader()
@@ -241,6 +526,15 @@ bool Shader::compile() {
     if (_data.empty())
         return false;
 
+    std::filesystem::path cachePath = reflectionCacheDirectory();
+    XXH3_128Digest digest = {};
+    if (cachePath.empty() == false) {
+        digest = XXH3_128::hash(_data.data(), _data.size() * sizeof(uint32_t));
+        cachePath = cachePath / (digest.string() + ".refl");
+        if (loadReflection(cachePath, digest))
+            return true;
+    }
+
     try {
         spirv_cross::Compiler compiler(_data);
 
@@ -578,6 +872,9 @@ bool Shader::compile() {
         this->_resources.shrink_to_fit();
         this->_inputAttributes.shrink_to_fit();
         this->_outputAttributes.shrink_to_fit();
+
+        if (cachePath.empty() == false)
+            storeReflection(cachePath, digest);
         return true;
     } catch (const spirv_cross::CompilerError& err) {
         Log::error("Compiler error: {}", err.what());
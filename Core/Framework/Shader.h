@@ -5,6 +5,8 @@
 #include "ShaderResource.h"
 
 namespace FV {
+    struct XXH3_128Digest;
+
     struct ShaderAttribute {
         std::string name;
         uint32_t location;
@@ -59,8 +61,16 @@ namespace FV {
         // compute-shader threadgroup
         auto threadgroupSize() const { return _threadgroupSize; }
 
+        // Reflection results are stored in this directory, in files named
+        // by a hash of the SPIR-V. Shaders loaded again skip SPIRV-Cross.
+        // An empty path disables the cache.
+        static void setReflectionCacheDirectory(const std::filesystem::path&);
+        static std::filesystem::path reflectionCacheDirectory();
+
     private:
         bool compile();
+        bool loadReflection(const std::filesystem::path&, const XXH3_128Digest&);
+        bool storeReflection(const std::filesystem::path&, const XXH3_128Digest&) const;
 
         ShaderStage _stage;
         std::vector<uint32_t> _data;
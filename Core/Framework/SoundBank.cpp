@@ -0,0 +1,123 @@
+#include "SoundBank.h"
+#include "DispatchQueue.h"
+#include "Logger.h"
+
+using namespace FV;
+
+SoundBank::SoundBank(std::shared_ptr<AudioDevice> dev, size_t budget, bool keep)
+    : device(dev)
+    , keepSamples(keep)
+    , budgetBytes(budget)
+    , usedBytes(0) {
+    FVASSERT_DEBUG(device);
+}
+
+SoundBank::~SoundBank() {
+}
+
+std::shared_ptr<AudioClip> SoundBank::find(const std::string& name) {
+    std::scoped_lock guard(lock);
+    if (auto it = index.find(name); it != index.end()) {
+        entries.splice(entries.begin(), entries, it->second);
+        return it->second->clip;
+    }
+    return nullptr;
+}
+
+std::shared_ptr<AudioClip> SoundBank::clip(const std::filesystem::path& path) {
+    std::string name = path.string();
+    if (auto clip = find(name))
+        return clip;
+
+    AudioStream stream(path);
+    if (auto clip = device->makeClip(stream, keepSamples))
+        return insert(name, clip);
+    Log::error("SoundBank failed to decode file: {}", name);
+    return nullptr;
+}
+
+std::shared_ptr<AudioClip> SoundBank::clip(const std::string& name, std::shared_ptr<AudioStream> stream) {
+    if (auto clip = find(name))
+        return clip;
+
+    if (stream) {
+        if (auto clip = device->makeClip(*stream, keepSamples))
+            return insert(name, clip);
+    }
+    Log::error("SoundBank failed to decode stream: {}", name);
+    return nullptr;
+}
+
+void SoundBank::preload(const std::vector<std::filesystem::path>& paths) {
+    std::vector<std::filesystem::path> missing;
+    missing.reserve(paths.size());
+    if (true) {
+        std::scoped_lock guard(lock);
+        for (auto& path : paths) {
+            if (index.contains(path.string()) == false)
+                missing.push_back(path);
+        }
+    }
+    dispatchApply(missing.size(), [&](size_t i) {
+        clip(missing[i]);
+    });
+}
+
+std::shared_ptr<AudioClip> SoundBank::insert(const std::string& name, std::shared_ptr<AudioClip> clip) {
+    std::scoped_lock guard(lock);
+    // another thread may have decoded the same clip meanwhile.
+    if (auto it = index.find(name); it != index.end()) {
+        entries.splice(entries.begin(), entries, it->second);
+        return it->second->clip;
+    }
+    if (clip->memorySize() > budgetBytes) {
+        Log::warning("SoundBank: clip {} ({} bytes) exceeds the budget, not cached.", name, clip->memorySize());
+        return clip;
+    }
+    entries.push_front({ name, clip });
+    index[name] = entries.begin();
+    usedBytes += clip->memorySize();
+    evict();
+    return clip;
+}
+
+void SoundBank::evict() {
+    while (usedBytes > budgetBytes && entries.empty() == false) {
+        Entry& entry = entries.back();
+        usedBytes -= entry.clip->memorySize();
+        index.erase(entry.name);
+        entries.pop_back();
+    }
+}
+
+void SoundBank::remove(const std::string& name) {
+    std::scoped_lock guard(lock);
+    if (auto it = index.find(name); it != index.end()) {
+        usedBytes -= it->second->clip->memorySize();
+        entries.erase(it->second);
+        index.erase(it);
+    }
+}
+
+void SoundBank::removeAll() {
+    std::scoped_lock guard(lock);
+    entries.clear();
+    index.clear();
+    usedBytes = 0;
+}
+
+size_t SoundBank::budget() const {
+    std::scoped_lock guard(lock);
+    return budgetBytes;
+}
+
+void SoundBank::setBudget(size_t budget) {
+    std::scoped_lock guard(lock);
+    budgetBytes = budget;
+    evict();
+}
+
+size_t SoundBank::memoryInUse() const {
+    std::scoped_lock guard(lock);
+    return usedBytes;
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include "../include.h"
+#include <filesystem>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "AudioClip.h"
+#include "AudioDevice.h"
+#include "AudioStream.h"
+
+namespace FV {
+    // Cache of decoded clips for short sounds that are played repeatedly.
+    // Clips are decoded once and shared by every player, the least recently
+    // used clips are released when the decoded size exceeds the budget.
+    // A released clip stays valid while players still hold it.
+    // With keepSamples the clips can be played by AudioMixer voices,
+    // their sample copies count towards the budget.
+    class FVCORE_API SoundBank {
+    public:
+        SoundBank(std::shared_ptr<AudioDevice>, size_t budget = 64 << 20, bool keepSamples = false);
+        ~SoundBank();
+
+        const std::shared_ptr<AudioDevice> device;
+        const bool keepSamples;
+
+        // returns the clip of a file, decodes it if not cached.
+        std::shared_ptr<AudioClip> clip(const std::filesystem::path&);
+        // returns the clip stored with the name, decodes the stream if not cached.
+        std::shared_ptr<AudioClip> clip(const std::string& name, std::shared_ptr<AudioStream>);
+        // returns a cached clip or nullptr, files are stored with path.string().
+        std::shared_ptr<AudioClip> find(const std::string& name);
+
+        // decodes files not cached yet in parallel and waits for them.
+        void preload(const std::vector<std::filesystem::path>&);
+
+        void remove(const std::string& name);
+        void removeAll();
+
+        size_t budget() const;
+        void setBudget(size_t);
+        size_t memoryInUse() const;
+
+    private:
+        std::shared_ptr<AudioClip> insert(const std::string& name, std::shared_ptr<AudioClip>);
+        void evict();
+
+        struct Entry {
+            std::string name;
+            std::shared_ptr<AudioClip> clip;
+        };
+        std::list<Entry> entries; // most recently used first
+        std::unordered_map<std::string, std::list<Entry>::iterator> index;
+        size_t budgetBytes;
+        size_t usedBytes;
+        mutable std::mutex lock;
+    };
+}
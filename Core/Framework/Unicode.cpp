@@ -1,5 +1,7 @@
+#include <bit>
+#include <cstring>
 #include "Unicode.h"
-#include <vector>
+#include "Private/CPUFeatures.h"
 
 namespace {
     static const uint8_t trailingBytesForUTF8[256] = {
@@ -23,7 +25,7 @@ namespace {
             return false;
         case 4:	if ((ch = (*--p)) < 0x80 || ch > 0xbf)	return false;
         case 3: if ((ch = (*--p)) < 0x80 || ch > 0xbf)	return false;
-        case 2: if ((ch = (*--p)) > 0xbf) return false;
+        case 2: if ((ch = (*--p)) < 0x80 || ch > 0xbf) return false;
             switch (*str & 0xff) {
             case 0xe0: if (ch < 0xa0) return false; break;
             case 0xed: if (ch > 0x9f) return false; break;
@@ -273,6 +275,845 @@ namespace {
     }
 }
 
+namespace {
+    // Scalar conversion with the output measured by a first pass.
+    template <typename Output, typename Input, typename Converter>
+    Output convertScalar(const Input* input, size_t length, bool strict, Converter&& convert) {
+        size_t count = 0;
+        if (convert(input, input + length, strict, [&](auto) { ++count; }) == false)
+            return {};
+        Output output(count, 0);
+        auto p = output.data();
+        convert(input, input + length, strict, [&](auto ch) {
+            *p++ = static_cast<typename Output::value_type>(ch);
+        });
+        return output;
+    }
+
+    // A block with surrogates goes through the scalar converters,
+    // a trailing high surrogate takes the next unit with it.
+    const char16_t* scalarBlockEnd(const char16_t* p, const char16_t* end) {
+        while (p < end && p[-1] >= unicodeHighSurrogateBegin && p[-1] <= unicodeHighSurrogateEnd)
+            ++p;
+        return p;
+    }
+
+    // decodes a code point of validated UTF-8.
+    FORCEINLINE char32_t decodeValidUTF8(const char8_t*& p) {
+        char32_t ch = *p++;
+        if (ch < 0x80)
+            return ch;
+        if (ch < 0xE0) {
+            ch = ((ch & 0x1F) << 6) | (p[0] & 0x3F);
+            p += 1;
+        } else if (ch < 0xF0) {
+            ch = ((ch & 0x0F) << 12) | ((p[0] & 0x3F) << 6) | (p[1] & 0x3F);
+            p += 2;
+        } else {
+            ch = ((ch & 0x07) << 18) | ((p[0] & 0x3F) << 12) | ((p[1] & 0x3F) << 6) | (p[2] & 0x3F);
+            p += 3;
+        }
+        return ch;
+    }
+
+    template <typename Char>
+    FORCEINLINE Char* writeCodePoint(char32_t ch, Char* output) {
+        if constexpr (sizeof(Char) == sizeof(char16_t)) {
+            if (ch > 0xFFFF) {
+                ch -= unicodeHalfBase;
+                output[0] = Char((ch >> unicodeHalfShift) + unicodeHighSurrogateBegin);
+                output[1] = Char((ch & unicodeHalfMask) + unicodeLowSurrogateBegin);
+                return output + 2;
+            }
+        }
+        *output = Char(ch);
+        return output + 1;
+    }
+
+    // Validates well-formed UTF-8 (RFC 3629) and counts the code units
+    // of UTF-16 and UTF-32. Anything else is left to the scalar converters.
+    bool measureUTF8Portable(const char8_t* input, size_t length, size_t& utf16Length, size_t& utf32Length) {
+        const char8_t* end = input + length;
+        size_t codePoints = 0;
+        size_t supplementary = 0;
+        while (input < end) {
+            if (end - input >= 8) {
+                uint64_t v;
+                memcpy(&v, input, 8);
+                if ((v & 0x8080808080808080ULL) == 0) {
+                    input += 8;
+                    codePoints += 8;
+                    continue;
+                }
+            }
+            const uint8_t c = *input;
+            if (c < 0x80) {
+                input++;
+                codePoints++;
+                continue;
+            }
+            size_t len;
+            uint8_t low = 0x80, high = 0xBF;
+            if (c >= 0xC2 && c <= 0xDF) {
+                len = 2;
+            } else if (c >= 0xE0 && c <= 0xEF) {
+                len = 3;
+                if (c == 0xE0) low = 0xA0;
+                else if (c == 0xED) high = 0x9F;
+            } else if (c >= 0xF0 && c <= 0xF4) {
+                len = 4;
+                if (c == 0xF0) low = 0x90;
+                else if (c == 0xF4) high = 0x8F;
+                supplementary++;
+            } else {
+                return false;
+            }
+            if (size_t(end - input) < len)
+                return false;
+            if (input[1] < low || input[1] > high)
+                return false;
+            for (size_t i = 2; i < len; ++i) {
+                if ((input[i] & 0xC0) != 0x80)
+                    return false;
+            }
+            input += len;
+            codePoints++;
+        }
+        utf32Length = codePoints;
+        utf16Length = codePoints + supplementary;
+        return true;
+    }
+
+    template <typename Char>
+    void decodeUTF8Portable(const char8_t* input, size_t length, Char* output) {
+        const char8_t* end = input + length;
+        while (input < end) {
+            if (end - input >= 8) {
+                uint64_t v;
+                memcpy(&v, input, 8);
+                if ((v & 0x8080808080808080ULL) == 0) {
+                    for (int i = 0; i < 8; ++i)
+                        output[i] = Char(input[i]);
+                    input += 8;
+                    output += 8;
+                    continue;
+                }
+            }
+            output = writeCodePoint(decodeValidUTF8(input), output);
+        }
+    }
+
+#if FVCORE_ARCH_X86
+    enum class SIMDLevel { None, SSE42, AVX2 };
+    SIMDLevel simdLevel() {
+        static const SIMDLevel level = [] {
+            const auto& cpu = FV::CPUFeatures::current();
+            // every CPU with SSE4.2 also has POPCNT.
+            if (cpu.avx2)
+                return SIMDLevel::AVX2;
+            if (cpu.sse42)
+                return SIMDLevel::SSE42;
+            return SIMDLevel::None;
+        }();
+        return level;
+    }
+
+    // UTF-8 validation with three nibble lookups per byte, see
+    // Keiser & Lemire, "Validating UTF-8 In Less Than One Instruction Per Byte".
+    enum : uint8_t {
+        tooShort = 1 << 0,      // lead byte followed by a lead byte or ASCII
+        tooLong = 1 << 1,       // ASCII followed by a continuation
+        overlong3 = 1 << 2,
+        tooLarge = 1 << 3,      // above U+10FFFF
+        surrogate = 1 << 4,
+        overlong2 = 1 << 5,
+        tooLarge1000 = 1 << 6,
+        overlong4 = 1 << 6,
+        twoConts = 1 << 7,      // continuation after continuation, valid if 3rd/4th byte
+        carry = tooShort | tooLong | twoConts,
+    };
+    alignas(16) constexpr uint8_t utf8Byte1High[16] = {
+        tooLong, tooLong, tooLong, tooLong, tooLong, tooLong, tooLong, tooLong,
+        twoConts, twoConts, twoConts, twoConts,
+        tooShort | overlong2,
+        tooShort,
+        tooShort | overlong3 | surrogate,
+        tooShort | tooLarge | tooLarge1000 | overlong4,
+    };
+    alignas(16) constexpr uint8_t utf8Byte1Low[16] = {
+        carry | overlong3 | overlong2 | overlong4,
+        carry | overlong2,
+        carry,
+        carry,
+        carry | tooLarge,
+        carry | tooLarge | tooLarge1000,
+        carry | tooLarge | tooLarge1000,
+        carry | tooLarge | tooLarge1000,
+        carry | tooLarge | tooLarge1000,
+        carry | tooLarge | tooLarge1000,
+        carry | tooLarge | tooLarge1000,
+        carry | tooLarge | tooLarge1000,
+        carry | tooLarge | tooLarge1000,
+        carry | tooLarge | tooLarge1000 | surrogate,
+        carry | tooLarge | tooLarge1000,
+        carry | tooLarge | tooLarge1000,
+    };
+    alignas(16) constexpr uint8_t utf8Byte2High[16] = {
+        tooShort, tooShort, tooShort, tooShort, tooShort, tooShort, tooShort, tooShort,
+        tooLong | overlong2 | twoConts | overlong3 | tooLarge1000 | overlong4,
+        tooLong | overlong2 | twoConts | overlong3 | tooLarge,
+        tooLong | overlong2 | twoConts | surrogate | tooLarge,
+        tooLong | overlong2 | twoConts | surrogate | tooLarge,
+        tooShort, tooShort, tooShort, tooShort,
+    };
+    // a lead byte in the last three bytes of a block needs the next block.
+    alignas(32) constexpr uint8_t utf8IncompleteMax[32] = {
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xEF, 0xDF, 0xBF,
+    };
+
+    struct UTF8Counter {
+        size_t codePoints = 0;
+        size_t supplementary = 0;
+    };
+
+    FVCORE_TARGET("sse4.2,popcnt") FORCEINLINE
+    __m128i nibbleLookupSSE42(const uint8_t* table, __m128i index) {
+        return _mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<const __m128i*>(table)), index);
+    }
+
+    FVCORE_TARGET("sse4.2,popcnt") FORCEINLINE
+    void validateUTF8BlockSSE42(__m128i input, __m128i& prev, __m128i& prevIncomplete, __m128i& error, UTF8Counter& counter) {
+        if (_mm_movemask_epi8(input) == 0) {
+            error = _mm_or_si128(error, prevIncomplete);
+            prevIncomplete = _mm_setzero_si128();
+            counter.codePoints += 16;
+        } else {
+            const __m128i nibble = _mm_set1_epi8(0x0F);
+            __m128i prev1 = _mm_alignr_epi8(input, prev, 15);
+            __m128i special = _mm_and_si128(
+                _mm_and_si128(nibbleLookupSSE42(utf8Byte1High, _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble)),
+                              nibbleLookupSSE42(utf8Byte1Low, _mm_and_si128(prev1, nibble))),
+                nibbleLookupSSE42(utf8Byte2High, _mm_and_si128(_mm_srli_epi16(input, 4), nibble)));
+            __m128i third = _mm_subs_epu8(_mm_alignr_epi8(input, prev, 14), _mm_set1_epi8(char(0xE0 - 0x80)));
+            __m128i fourth = _mm_subs_epu8(_mm_alignr_epi8(input, prev, 13), _mm_set1_epi8(char(0xF0 - 0x80)));
+            __m128i must23 = _mm_and_si128(_mm_or_si128(third, fourth), _mm_set1_epi8(char(0x80)));
+            error = _mm_or_si128(error, _mm_xor_si128(must23, special));
+            prevIncomplete = _mm_subs_epu8(input, _mm_loadu_si128(reinterpret_cast<const __m128i*>(utf8IncompleteMax + 16)));
+
+            __m128i leading = _mm_cmpgt_epi8(input, _mm_set1_epi8(char(0xBF)));
+            __m128i four = _mm_cmpeq_epi8(_mm_max_epu8(input, _mm_set1_epi8(char(0xF0))), input);
+            counter.codePoints += std::popcount(uint32_t(_mm_movemask_epi8(leading)));
+            counter.supplementary += std::popcount(uint32_t(_mm_movemask_epi8(four)));
+        }
+        prev = input;
+    }
+
+    FVCORE_TARGET("sse4.2,popcnt")
+    bool measureUTF8SSE42(const char8_t* input, size_t length, size_t& utf16Length, size_t& utf32Length) {
+        __m128i prev = _mm_setzero_si128();
+        __m128i prevIncomplete = _mm_setzero_si128();
+        __m128i error = _mm_setzero_si128();
+        UTF8Counter counter = {};
+        size_t i = 0;
+        for (; i + 16 <= length; i += 16) {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+            validateUTF8BlockSSE42(block, prev, prevIncomplete, error, counter);
+        }
+        if (i < length) {
+            alignas(16) uint8_t tail[16] = {};
+            memcpy(tail, input + i, length - i);
+            validateUTF8BlockSSE42(_mm_load_si128(reinterpret_cast<const __m128i*>(tail)),
+                                   prev, prevIncomplete, error, counter);
+            counter.codePoints -= 16 - (length - i); // zero padding
+        }
+        error = _mm_or_si128(error, prevIncomplete);
+        if (_mm_testz_si128(error, error) == 0)
+            return false;
+        utf32Length = counter.codePoints;
+        utf16Length = counter.codePoints + counter.supplementary;
+        return true;
+    }
+
+    FVCORE_TARGET("avx2,popcnt") FORCEINLINE
+    __m256i nibbleLookupAVX2(const uint8_t* table, __m256i index) {
+        __m256i t = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(table)));
+        return _mm256_shuffle_epi8(t, index);
+    }
+
+    FVCORE_TARGET("avx2,popcnt") FORCEINLINE
+    void validateUTF8BlockAVX2(__m256i input, __m256i& prev, __m256i& prevIncomplete, __m256i& error, UTF8Counter& counter) {
+        if (_mm256_movemask_epi8(input) == 0) {
+            error = _mm256_or_si256(error, prevIncomplete);
+            prevIncomplete = _mm256_setzero_si256();
+            counter.codePoints += 32;
+        } else {
+            const __m256i nibble = _mm256_set1_epi8(0x0F);
+            __m256i shifted = _mm256_permute2x128_si256(prev, input, 0x21);
+            __m256i prev1 = _mm256_alignr_epi8(input, shifted, 15);
+            __m256i special = _mm256_and_si256(
+                _mm256_and_si256(nibbleLookupAVX2(utf8Byte1High, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble)),
+                                 nibbleLookupAVX2(utf8Byte1Low, _mm256_and_si256(prev1, nibble))),
+                nibbleLookupAVX2(utf8Byte2High, _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble)));
+            __m256i third = _mm256_subs_epu8(_mm256_alignr_epi8(input, shifted, 14), _mm256_set1_epi8(char(0xE0 - 0x80)));
+            __m256i fourth = _mm256_subs_epu8(_mm256_alignr_epi8(input, shifted, 13), _mm256_set1_epi8(char(0xF0 - 0x80)));
+            __m256i must23 = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8(char(0x80)));
+            error = _mm256_or_si256(error, _mm256_xor_si256(must23, special));
+            prevIncomplete = _mm256_subs_epu8(input, _mm256_load_si256(reinterpret_cast<const __m256i*>(utf8IncompleteMax)));
+
+            __m256i leading = _mm256_cmpgt_epi8(input, _mm256_set1_epi8(char(0xBF)));
+            __m256i four = _mm256_cmpeq_epi8(_mm256_max_epu8(input, _mm256_set1_epi8(char(0xF0))), input);
+            counter.codePoints += std::popcount(uint32_t(_mm256_movemask_epi8(leading)));
+            counter.supplementary += std::popcount(uint32_t(_mm256_movemask_epi8(four)));
+        }
+        prev = input;
+    }
+
+    FVCORE_TARGET("avx2,popcnt")
+    bool measureUTF8AVX2(const char8_t* input, size_t length, size_t& utf16Length, size_t& utf32Length) {
+        __m256i prev = _mm256_setzero_si256();
+        __m256i prevIncomplete = _mm256_setzero_si256();
+        __m256i error = _mm256_setzero_si256();
+        UTF8Counter counter = {};
+        size_t i = 0;
+        for (; i + 32 <= length; i += 32) {
+            __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(input + i));
+            validateUTF8BlockAVX2(block, prev, prevIncomplete, error, counter);
+        }
+        if (i < length) {
+            alignas(32) uint8_t tail[32] = {};
+            memcpy(tail, input + i, length - i);
+            validateUTF8BlockAVX2(_mm256_load_si256(reinterpret_cast<const __m256i*>(tail)),
+                                  prev, prevIncomplete, error, counter);
+            counter.codePoints -= 32 - (length - i); // zero padding
+        }
+        error = _mm256_or_si256(error, prevIncomplete);
+        if (_mm256_testz_si256(error, error) == 0)
+            return false;
+        utf32Length = counter.codePoints;
+        utf16Length = counter.codePoints + counter.supplementary;
+        return true;
+    }
+
+    // pshufb masks gathering the 16-bit lanes selected by an 8-bit mask.
+    struct Compress16Table {
+        alignas(16) uint8_t shuffle[256][16];
+    };
+    constexpr Compress16Table compress16Table = [] {
+        Compress16Table table = {};
+        for (int mask = 0; mask < 256; ++mask) {
+            int n = 0;
+            for (int lane = 0; lane < 8; ++lane) {
+                if ((mask >> lane) & 1) {
+                    table.shuffle[mask][n++] = uint8_t(lane * 2);
+                    table.shuffle[mask][n++] = uint8_t(lane * 2 + 1);
+                }
+            }
+            for (; n < 16; ++n)
+                table.shuffle[mask][n] = 0x80;
+        }
+        return table;
+    }();
+
+    // Decodes validated UTF-8: 16 bytes at once for ASCII, 8 lead positions
+    // at once for 1-3 byte sequences and one code point at a time otherwise.
+    template <typename Char> FVCORE_TARGET("sse4.2,popcnt")
+    void decodeUTF8SSE42(const char8_t* input, size_t length, Char* output, Char* outputEnd) {
+        const char8_t* end = input + length;
+        while (end - input >= 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input));
+            if (_mm_movemask_epi8(v) == 0) {
+                auto out = reinterpret_cast<__m128i*>(output);
+                if constexpr (sizeof(Char) == sizeof(char16_t)) {
+                    _mm_storeu_si128(out, _mm_cvtepu8_epi16(v));
+                    _mm_storeu_si128(out + 1, _mm_cvtepu8_epi16(_mm_srli_si128(v, 8)));
+                } else {
+                    _mm_storeu_si128(out, _mm_cvtepu8_epi32(v));
+                    _mm_storeu_si128(out + 1, _mm_cvtepu8_epi32(_mm_srli_si128(v, 4)));
+                    _mm_storeu_si128(out + 2, _mm_cvtepu8_epi32(_mm_srli_si128(v, 8)));
+                    _mm_storeu_si128(out + 3, _mm_cvtepu8_epi32(_mm_srli_si128(v, 12)));
+                }
+                input += 16;
+                output += 16;
+                continue;
+            }
+            __m128i four = _mm_cmpeq_epi8(_mm_max_epu8(v, _mm_set1_epi8(char(0xF0))), v);
+            if ((_mm_movemask_epi8(four) & 0xFF) == 0 && outputEnd - output >= 8) {
+                // every lead byte in the first 8 bytes with its continuation bytes.
+                const __m128i mask6 = _mm_set1_epi16(0x3F);
+                __m128i b0 = _mm_cvtepu8_epi16(v);
+                __m128i c1 = _mm_and_si128(_mm_cvtepu8_epi16(_mm_srli_si128(v, 1)), mask6);
+                __m128i c2 = _mm_and_si128(_mm_cvtepu8_epi16(_mm_srli_si128(v, 2)), mask6);
+                __m128i two = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(b0, _mm_set1_epi16(0x1F)), 6), c1);
+                __m128i three = _mm_or_si128(_mm_or_si128(_mm_slli_epi16(b0, 12), _mm_slli_epi16(c1, 6)), c2);
+                __m128i ch = _mm_blendv_epi8(b0, two, _mm_cmpgt_epi16(b0, _mm_set1_epi16(0xBF)));
+                ch = _mm_blendv_epi8(ch, three, _mm_cmpgt_epi16(b0, _mm_set1_epi16(0xDF)));
+                __m128i cont = _mm_cmpeq_epi8(_mm_and_si128(v, _mm_set1_epi8(char(0xC0))), _mm_set1_epi8(char(0x80)));
+                int leads = ~_mm_movemask_epi8(cont) & 0xFF;
+                ch = _mm_shuffle_epi8(ch, _mm_load_si128(reinterpret_cast<const __m128i*>(compress16Table.shuffle[leads])));
+                auto out = reinterpret_cast<__m128i*>(output);
+                if constexpr (sizeof(Char) == sizeof(char16_t)) {
+                    _mm_storeu_si128(out, ch);
+                } else {
+                    _mm_storeu_si128(out, _mm_cvtepu16_epi32(ch));
+                    _mm_storeu_si128(out + 1, _mm_cvtepu16_epi32(_mm_srli_si128(ch, 8)));
+                }
+                output += std::popcount(uint32_t(leads));
+                // the next window may start with continuation bytes of the
+                // last sequence, they are not leads and get dropped there.
+                input += 8;
+                continue;
+            }
+            const char8_t* blockEnd = input + 16;
+            while ((*input & 0xC0) == 0x80)
+                ++input;
+            while (input < blockEnd)
+                output = writeCodePoint(decodeValidUTF8(input), output);
+        }
+        while (input < end && (*input & 0xC0) == 0x80)
+            ++input;
+        while (input < end)
+            output = writeCodePoint(decodeValidUTF8(input), output);
+    }
+
+    // pshufb masks packing four 32-bit lanes of [lead, cont, cont, 0] into
+    // 1-3 byte sequences, indexed by the 1-byte and 3-byte lane masks.
+    struct UTF8PackTable {
+        alignas(16) uint8_t shuffle[256][16];
+        uint8_t length[256];
+    };
+    constexpr UTF8PackTable utf8PackTable = [] {
+        UTF8PackTable table = {};
+        for (int index = 0; index < 256; ++index) {
+            int n = 0;
+            for (int lane = 0; lane < 4; ++lane) {
+                int len = (index >> lane) & 1 ? 1 : (index >> (lane + 4)) & 1 ? 3 : 2;
+                for (int b = 0; b < len; ++b)
+                    table.shuffle[index][n++] = uint8_t(lane * 4 + b);
+            }
+            table.length[index] = uint8_t(n);
+            for (; n < 16; ++n)
+                table.shuffle[index][n] = 0x80;
+        }
+        return table;
+    }();
+
+    // code points below U+10000 that are not surrogates.
+    FVCORE_TARGET("sse4.2,popcnt") FORCEINLINE
+    char8_t* encodeUTF8x4SSE42(__m128i c, char8_t* output) {
+        const __m128i mask6 = _mm_set1_epi32(0x3F);
+        __m128i t0 = _mm_or_si128(_mm_and_si128(c, mask6), _mm_set1_epi32(0x80));
+        __m128i t1 = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(c, 6), mask6), _mm_set1_epi32(0x80));
+        __m128i lead2 = _mm_or_si128(_mm_srli_epi32(c, 6), _mm_set1_epi32(0xC0));
+        __m128i lead3 = _mm_or_si128(_mm_srli_epi32(c, 12), _mm_set1_epi32(0xE0));
+        __m128i one = _mm_cmplt_epi32(c, _mm_set1_epi32(0x80));
+        __m128i three = _mm_cmpgt_epi32(c, _mm_set1_epi32(0x7FF));
+        __m128i b0 = _mm_blendv_epi8(_mm_blendv_epi8(lead2, lead3, three), c, one);
+        __m128i b1 = _mm_blendv_epi8(t0, t1, three);
+        __m128i bytes = _mm_or_si128(_mm_or_si128(b0, _mm_slli_epi32(b1, 8)), _mm_slli_epi32(t0, 16));
+        int index = _mm_movemask_ps(_mm_castsi128_ps(one)) | (_mm_movemask_ps(_mm_castsi128_ps(three)) << 4);
+        __m128i shuffle = _mm_load_si128(reinterpret_cast<const __m128i*>(utf8PackTable.shuffle[index]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output), _mm_shuffle_epi8(bytes, shuffle));
+        return output + utf8PackTable.length[index];
+    }
+
+    FVCORE_TARGET("avx2,popcnt") FORCEINLINE
+    char8_t* encodeUTF8x8AVX2(__m256i c, char8_t* output) {
+        const __m256i mask6 = _mm256_set1_epi32(0x3F);
+        __m256i t0 = _mm256_or_si256(_mm256_and_si256(c, mask6), _mm256_set1_epi32(0x80));
+        __m256i t1 = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(c, 6), mask6), _mm256_set1_epi32(0x80));
+        __m256i lead2 = _mm256_or_si256(_mm256_srli_epi32(c, 6), _mm256_set1_epi32(0xC0));
+        __m256i lead3 = _mm256_or_si256(_mm256_srli_epi32(c, 12), _mm256_set1_epi32(0xE0));
+        __m256i one = _mm256_cmpgt_epi32(_mm256_set1_epi32(0x80), c);
+        __m256i three = _mm256_cmpgt_epi32(c, _mm256_set1_epi32(0x7FF));
+        __m256i b0 = _mm256_blendv_epi8(_mm256_blendv_epi8(lead2, lead3, three), c, one);
+        __m256i b1 = _mm256_blendv_epi8(t0, t1, three);
+        __m256i bytes = _mm256_or_si256(_mm256_or_si256(b0, _mm256_slli_epi32(b1, 8)), _mm256_slli_epi32(t0, 16));
+        int m1 = _mm256_movemask_ps(_mm256_castsi256_ps(one));
+        int m3 = _mm256_movemask_ps(_mm256_castsi256_ps(three));
+        int low = (m1 & 0xF) | ((m3 & 0xF) << 4);
+        int high = (m1 >> 4) | ((m3 >> 4) << 4);
+        __m256i shuffle = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(utf8PackTable.shuffle[low]))),
+            _mm_load_si128(reinterpret_cast<const __m128i*>(utf8PackTable.shuffle[high])), 1);
+        bytes = _mm256_shuffle_epi8(bytes, shuffle);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output), _mm256_castsi256_si128(bytes));
+        output += utf8PackTable.length[low];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output), _mm256_extracti128_si256(bytes, 1));
+        return output + utf8PackTable.length[high];
+    }
+
+    FVCORE_TARGET("sse4.2,popcnt") FORCEINLINE
+    bool hasSurrogates16SSE42(__m128i u) {
+        __m128i s = _mm_cmpeq_epi16(_mm_and_si128(u, _mm_set1_epi16(short(0xF800))), _mm_set1_epi16(short(0xD800)));
+        return _mm_movemask_epi8(s) != 0;
+    }
+
+    FVCORE_TARGET("sse4.2,popcnt") FORCEINLINE
+    size_t countAtLeast16SSE42(__m128i u, uint16_t value) {
+        __m128i ge = _mm_cmpeq_epi16(_mm_max_epu16(u, _mm_set1_epi16(short(value))), u);
+        return std::popcount(uint32_t(_mm_movemask_epi8(ge))) / 2;
+    }
+
+    // below U+10000 and not a surrogate.
+    FVCORE_TARGET("sse4.2,popcnt") FORCEINLINE
+    bool isBMP32SSE42(__m128i a, __m128i b) {
+        const __m128i max = _mm_set1_epi32(0xFFFF);
+        __m128i outside = _mm_or_si128(_mm_xor_si128(_mm_min_epu32(a, max), a),
+                                       _mm_xor_si128(_mm_min_epu32(b, max), b));
+        __m128i sa = _mm_cmpeq_epi32(_mm_and_si128(a, _mm_set1_epi32(0xFFFFF800)), _mm_set1_epi32(0xD800));
+        __m128i sb = _mm_cmpeq_epi32(_mm_and_si128(b, _mm_set1_epi32(0xFFFFF800)), _mm_set1_epi32(0xD800));
+        outside = _mm_or_si128(outside, _mm_or_si128(sa, sb));
+        return _mm_testz_si128(outside, outside) != 0;
+    }
+
+    FVCORE_TARGET("sse4.2,popcnt")
+    bool measureUTF16toUTF8SSE42(const char16_t* input, size_t length, bool strict, size_t& utf8Length) {
+        const char16_t* end = input + length;
+        size_t count = 0;
+        auto counter = [&](char8_t) { ++count; };
+        while (end - input >= 8) {
+            __m128i u = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input));
+            if (hasSurrogates16SSE42(u) == false) {
+                count += 8 + countAtLeast16SSE42(u, 0x80) + countAtLeast16SSE42(u, 0x800);
+                input += 8;
+            } else {
+                const char16_t* blockEnd = scalarBlockEnd(input + 8, end);
+                if (convertUTF16toUTF8(input, blockEnd, strict, counter) == false)
+                    return false;
+                input = blockEnd;
+            }
+        }
+        if (convertUTF16toUTF8(input, end, strict, counter) == false)
+            return false;
+        utf8Length = count;
+        return true;
+    }
+
+    FVCORE_TARGET("sse4.2,popcnt")
+    void encodeUTF16toUTF8SSE42(const char16_t* input, size_t length, bool strict, char8_t* output, char8_t* outputEnd) {
+        const char16_t* end = input + length;
+        auto writer = [&](char8_t ch) { *output++ = ch; };
+        while (end - input >= 8 && outputEnd - output >= 32) {
+            __m128i u = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input));
+            if (hasSurrogates16SSE42(u) == false) {
+                if (_mm_testz_si128(u, _mm_set1_epi16(short(0xFF80)))) {
+                    _mm_storel_epi64(reinterpret_cast<__m128i*>(output), _mm_packus_epi16(u, u));
+                    output += 8;
+                } else {
+                    output = encodeUTF8x4SSE42(_mm_cvtepu16_epi32(u), output);
+                    output = encodeUTF8x4SSE42(_mm_cvtepu16_epi32(_mm_srli_si128(u, 8)), output);
+                }
+                input += 8;
+            } else {
+                const char16_t* blockEnd = scalarBlockEnd(input + 8, end);
+                convertUTF16toUTF8(input, blockEnd, strict, writer);
+                input = blockEnd;
+            }
+        }
+        convertUTF16toUTF8(input, end, strict, writer);
+    }
+
+    FVCORE_TARGET("avx2,popcnt")
+    void encodeUTF16toUTF8AVX2(const char16_t* input, size_t length, bool strict, char8_t* output, char8_t* outputEnd) {
+        const char16_t* end = input + length;
+        auto writer = [&](char8_t ch) { *output++ = ch; };
+        while (end - input >= 16 && outputEnd - output >= 64) {
+            __m256i u = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(input));
+            __m256i s = _mm256_cmpeq_epi16(_mm256_and_si256(u, _mm256_set1_epi16(short(0xF800))),
+                                           _mm256_set1_epi16(short(0xD800)));
+            if (_mm256_testz_si256(s, s)) {
+                if (_mm256_testz_si256(u, _mm256_set1_epi16(short(0xFF80)))) {
+                    __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(u, u), 0xD8);
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(output), _mm256_castsi256_si128(packed));
+                    output += 16;
+                } else {
+                    output = encodeUTF8x8AVX2(_mm256_cvtepu16_epi32(_mm256_castsi256_si128(u)), output);
+                    output = encodeUTF8x8AVX2(_mm256_cvtepu16_epi32(_mm256_extracti128_si256(u, 1)), output);
+                }
+                input += 16;
+            } else {
+                const char16_t* blockEnd = scalarBlockEnd(input + 16, end);
+                convertUTF16toUTF8(input, blockEnd, strict, writer);
+                input = blockEnd;
+            }
+        }
+        convertUTF16toUTF8(input, end, strict, writer);
+    }
+
+    FVCORE_TARGET("sse4.2,popcnt")
+    bool measureUTF16toUTF32SSE42(const char16_t* input, size_t length, bool strict, size_t& utf32Length) {
+        const char16_t* end = input + length;
+        size_t count = 0;
+        auto counter = [&](char32_t) { ++count; };
+        while (end - input >= 8) {
+            __m128i u = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input));
+            if (hasSurrogates16SSE42(u) == false) {
+                count += 8;
+                input += 8;
+            } else {
+                const char16_t* blockEnd = scalarBlockEnd(input + 8, end);
+                if (convertUTF16toUTF32(input, blockEnd, strict, counter) == false)
+                    return false;
+                input = blockEnd;
+            }
+        }
+        if (convertUTF16toUTF32(input, end, strict, counter) == false)
+            return false;
+        utf32Length = count;
+        return true;
+    }
+
+    FVCORE_TARGET("sse4.2,popcnt")
+    void encodeUTF16toUTF32SSE42(const char16_t* input, size_t length, bool strict, char32_t* output) {
+        const char16_t* end = input + length;
+        auto writer = [&](char32_t ch) { *output++ = ch; };
+        while (end - input >= 8) {
+            __m128i u = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input));
+            if (hasSurrogates16SSE42(u) == false) {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(output), _mm_cvtepu16_epi32(u));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(output + 4), _mm_cvtepu16_epi32(_mm_srli_si128(u, 8)));
+                input += 8;
+                output += 8;
+            } else {
+                const char16_t* blockEnd = scalarBlockEnd(input + 8, end);
+                convertUTF16toUTF32(input, blockEnd, strict, writer);
+                input = blockEnd;
+            }
+        }
+        convertUTF16toUTF32(input, end, strict, writer);
+    }
+
+    FVCORE_TARGET("sse4.2,popcnt")
+    bool measureUTF32toUTF8SSE42(const char32_t* input, size_t length, bool strict, size_t& utf8Length) {
+        const char32_t* end = input + length;
+        size_t count = 0;
+        auto counter = [&](char8_t) { ++count; };
+        for (; end - input >= 8; input += 8) {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + 4));
+            if (isBMP32SSE42(a, b)) {
+                __m128i two = _mm_packs_epi32(_mm_cmpgt_epi32(a, _mm_set1_epi32(0x7F)),
+                                              _mm_cmpgt_epi32(b, _mm_set1_epi32(0x7F)));
+                __m128i three = _mm_packs_epi32(_mm_cmpgt_epi32(a, _mm_set1_epi32(0x7FF)),
+                                                _mm_cmpgt_epi32(b, _mm_set1_epi32(0x7FF)));
+                count += 8 + (std::popcount(uint32_t(_mm_movemask_epi8(two))) +
+                              std::popcount(uint32_t(_mm_movemask_epi8(three)))) / 2;
+            } else if (convertUTF32toUTF8(input, input + 8, strict, counter) == false) {
+                return false;
+            }
+        }
+        if (convertUTF32toUTF8(input, end, strict, counter) == false)
+            return false;
+        utf8Length = count;
+        return true;
+    }
+
+    FVCORE_TARGET("sse4.2,popcnt")
+    void encodeUTF32toUTF8SSE42(const char32_t* input, size_t length, bool strict, char8_t* output, char8_t* outputEnd) {
+        const char32_t* end = input + length;
+        auto writer = [&](char8_t ch) { *output++ = ch; };
+        for (; end - input >= 8 && outputEnd - output >= 32; input += 8) {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + 4));
+            if (isBMP32SSE42(a, b)) {
+                if (_mm_testz_si128(_mm_or_si128(a, b), _mm_set1_epi32(0xFFFFFF80))) {
+                    __m128i u = _mm_packus_epi32(a, b);
+                    _mm_storel_epi64(reinterpret_cast<__m128i*>(output), _mm_packus_epi16(u, u));
+                    output += 8;
+                } else {
+                    output = encodeUTF8x4SSE42(a, output);
+                    output = encodeUTF8x4SSE42(b, output);
+                }
+            } else {
+                convertUTF32toUTF8(input, input + 8, strict, writer);
+            }
+        }
+        convertUTF32toUTF8(input, end, strict, writer);
+    }
+
+    FVCORE_TARGET("sse4.2,popcnt")
+    bool measureUTF32toUTF16SSE42(const char32_t* input, size_t length, bool strict, size_t& utf16Length) {
+        const char32_t* end = input + length;
+        size_t count = 0;
+        auto counter = [&](char16_t) { ++count; };
+        for (; end - input >= 8; input += 8) {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + 4));
+            if (isBMP32SSE42(a, b))
+                count += 8;
+            else if (convertUTF32toUTF16(input, input + 8, strict, counter) == false)
+                return false;
+        }
+        if (convertUTF32toUTF16(input, end, strict, counter) == false)
+            return false;
+        utf16Length = count;
+        return true;
+    }
+
+    FVCORE_TARGET("sse4.2,popcnt")
+    void encodeUTF32toUTF16SSE42(const char32_t* input, size_t length, bool strict, char16_t* output) {
+        const char32_t* end = input + length;
+        auto writer = [&](char16_t ch) { *output++ = ch; };
+        for (; end - input >= 8; input += 8) {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + 4));
+            if (isBMP32SSE42(a, b)) {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(output), _mm_packus_epi32(a, b));
+                output += 8;
+            } else {
+                convertUTF32toUTF16(input, input + 8, strict, writer);
+            }
+        }
+        convertUTF32toUTF16(input, end, strict, writer);
+    }
+#endif
+
+    // The converters below validate and measure the whole input first,
+    // then write into a string of the exact length. Well-formed UTF-8 is
+    // decoded without further checks, any other UTF-8 input takes the
+    // scalar converters which define the results for ill-formed input.
+    template <typename Output>
+    Output utf8ToUTF16(const char8_t* input, size_t length, bool strict) {
+        static_assert(sizeof(typename Output::value_type) == sizeof(char16_t));
+        size_t utf16Length = 0, utf32Length = 0;
+        bool wellFormed;
+#if FVCORE_ARCH_X86
+        const auto simd = simdLevel();
+        if (simd == SIMDLevel::AVX2)
+            wellFormed = measureUTF8AVX2(input, length, utf16Length, utf32Length);
+        else if (simd == SIMDLevel::SSE42)
+            wellFormed = measureUTF8SSE42(input, length, utf16Length, utf32Length);
+        else
+#endif
+            wellFormed = measureUTF8Portable(input, length, utf16Length, utf32Length);
+
+        if (wellFormed == false) {
+            return convertScalar<Output>(input, length, strict, [](auto... args) {
+                return convertUTF8toUTF16(args...);
+            });
+        }
+        Output output(utf16Length, 0);
+        auto p = reinterpret_cast<char16_t*>(output.data());
+#if FVCORE_ARCH_X86
+        if (simd != SIMDLevel::None)
+            decodeUTF8SSE42(input, length, p, p + output.size());
+        else
+#endif
+            decodeUTF8Portable(input, length, p);
+        return output;
+    }
+
+    template <typename Output>
+    Output utf8ToUTF32(const char8_t* input, size_t length, bool strict) {
+        static_assert(sizeof(typename Output::value_type) == sizeof(char32_t));
+        size_t utf16Length = 0, utf32Length = 0;
+        bool wellFormed;
+#if FVCORE_ARCH_X86
+        const auto simd = simdLevel();
+        if (simd == SIMDLevel::AVX2)
+            wellFormed = measureUTF8AVX2(input, length, utf16Length, utf32Length);
+        else if (simd == SIMDLevel::SSE42)
+            wellFormed = measureUTF8SSE42(input, length, utf16Length, utf32Length);
+        else
+#endif
+            wellFormed = measureUTF8Portable(input, length, utf16Length, utf32Length);
+
+        if (wellFormed == false) {
+            return convertScalar<Output>(input, length, strict, [](auto... args) {
+                return convertUTF8toUTF32(args...);
+            });
+        }
+        Output output(utf32Length, 0);
+        auto p = reinterpret_cast<char32_t*>(output.data());
+#if FVCORE_ARCH_X86
+        if (simd != SIMDLevel::None)
+            decodeUTF8SSE42(input, length, p, p + output.size());
+        else
+#endif
+            decodeUTF8Portable(input, length, p);
+        return output;
+    }
+
+    template <typename Output>
+    Output utf16ToUTF8(const char16_t* input, size_t length, bool strict) {
+        static_assert(sizeof(typename Output::value_type) == sizeof(char8_t));
+#if FVCORE_ARCH_X86
+        const auto simd = simdLevel();
+        if (simd != SIMDLevel::None) {
+            size_t utf8Length = 0;
+            if (measureUTF16toUTF8SSE42(input, length, strict, utf8Length) == false)
+                return {};
+            Output output(utf8Length, 0);
+            auto p = reinterpret_cast<char8_t*>(output.data());
+            if (simd == SIMDLevel::AVX2)
+                encodeUTF16toUTF8AVX2(input, length, strict, p, p + utf8Length);
+            else
+                encodeUTF16toUTF8SSE42(input, length, strict, p, p + utf8Length);
+            return output;
+        }
+#endif
+        return convertScalar<Output>(input, length, strict, [](auto... args) {
+            return convertUTF16toUTF8(args...);
+        });
+    }
+
+    template <typename Output>
+    Output utf16ToUTF32(const char16_t* input, size_t length, bool strict) {
+        static_assert(sizeof(typename Output::value_type) == sizeof(char32_t));
+#if FVCORE_ARCH_X86
+        if (simdLevel() != SIMDLevel::None) {
+            size_t utf32Length = 0;
+            if (measureUTF16toUTF32SSE42(input, length, strict, utf32Length) == false)
+                return {};
+            Output output(utf32Length, 0);
+            encodeUTF16toUTF32SSE42(input, length, strict, reinterpret_cast<char32_t*>(output.data()));
+            return output;
+        }
+#endif
+        return convertScalar<Output>(input, length, strict, [](auto... args) {
+            return convertUTF16toUTF32(args...);
+        });
+    }
+
+    template <typename Output>
+    Output utf32ToUTF8(const char32_t* input, size_t length, bool strict) {
+        static_assert(sizeof(typename Output::value_type) == sizeof(char8_t));
+#if FVCORE_ARCH_X86
+        if (simdLevel() != SIMDLevel::None) {
+            size_t utf8Length = 0;
+            if (measureUTF32toUTF8SSE42(input, length, strict, utf8Length) == false)
+                return {};
+            Output output(utf8Length, 0);
+            auto p = reinterpret_cast<char8_t*>(output.data());
+            encodeUTF32toUTF8SSE42(input, length, strict, p, p + utf8Length);
+            return output;
+        }
+#endif
+        return convertScalar<Output>(input, length, strict, [](auto... args) {
+            return convertUTF32toUTF8(args...);
+        });
+    }
+
+    template <typename Output>
+    Output utf32ToUTF16(const char32_t* input, size_t length, bool strict) {
+        static_assert(sizeof(typename Output::value_type) == sizeof(char16_t));
+#if FVCORE_ARCH_X86
+        if (simdLevel() != SIMDLevel::None) {
+            size_t utf16Length = 0;
+            if (measureUTF32toUTF16SSE42(input, length, strict, utf16Length) == false)
+                return {};
+            Output output(utf16Length, 0);
+            encodeUTF32toUTF16SSE42(input, length, strict, reinterpret_cast<char16_t*>(output.data()));
+            return output;
+        }
+#endif
+        return convertScalar<Output>(input, length, strict, [](auto... args) {
+            return convertUTF32toUTF16(args...);
+        });
+    }
+}
+
 namespace FV {
     template <typename T, size_t S = sizeof(T)> struct _WNativeString;
     template <> struct _WNativeString<wchar_t, 4> {
@@ -300,39 +1141,19 @@ namespace FV {
     }
 
     FVCORE_API std::string string(const std::u16string& input, bool strict) {
-        auto length = input.size();
-        std::vector<char8_t> output;
-        output.reserve(length * 2);
-
-        if (convertUTF16toUTF8(input.data(),
-                               input.data() + length,
-                               strict,
-                               [&](char8_t ch) {
-                                   output.push_back(ch);
-                               }) == false) {
-            return {};
-        }
-        return { output.begin(), output.end() };
+        return utf16ToUTF8<std::string>(input.data(), input.size(), strict);
     }
 
     FVCORE_API std::string string(const std::u32string& input, bool strict) {
-        auto length = input.size();
-        std::vector<char8_t> output;
-        output.reserve(length * 4);
-
-        if (convertUTF32toUTF8(input.data(),
-                               input.data() + length,
-                               strict,
-                               [&](char8_t ch) {
-                                   output.push_back(ch);
-                               }) == false) {
-            return {};
-        }
-        return { output.begin(), output.end() };
+        return utf32ToUTF8<std::string>(input.data(), input.size(), strict);
     }
 
     FVCORE_API std::wstring wstring(const std::string& input, bool strict) {
-        return wstring(std::u8string(input.begin(), input.end()), strict);
+        auto data = reinterpret_cast<const char8_t*>(input.data());
+        if constexpr (sizeof(wchar_t) == sizeof(char16_t))
+            return utf8ToUTF16<std::wstring>(data, input.size(), strict);
+        else
+            return utf8ToUTF32<std::wstring>(data, input.size(), strict);
     }
 
     FVCORE_API std::wstring wstring(const std::wstring& input, bool strict) {
@@ -340,49 +1161,24 @@ namespace FV {
     }
 
     FVCORE_API std::wstring wstring(const std::u8string& input, bool strict) {
-        switch (sizeof(wchar_t)) {
-        case (sizeof(char16_t)):
-            do {
-                auto s = u16string(input, strict);
-                return { reinterpret_cast<const wchar_t*>(s.c_str()) };
-            } while (0);
-            break;
-        case (sizeof(char32_t)):
-            do {
-                auto s = u32string(input, strict);
-                return { reinterpret_cast<const wchar_t*>(s.c_str()) };
-            } while (0);
-            break;
-        }
-        return {};
+        if constexpr (sizeof(wchar_t) == sizeof(char16_t))
+            return utf8ToUTF16<std::wstring>(input.data(), input.size(), strict);
+        else
+            return utf8ToUTF32<std::wstring>(input.data(), input.size(), strict);
     }
 
     FVCORE_API std::wstring wstring(const std::u16string& input, bool strict) {
-        switch (sizeof(wchar_t)) {
-        case (sizeof(char16_t)):
+        if constexpr (sizeof(wchar_t) == sizeof(char16_t))
             return { reinterpret_cast<const wchar_t*>(input.c_str()) };
-        case (sizeof(char32_t)):
-            do {
-                auto s = u32string(input, strict);
-                return { reinterpret_cast<const wchar_t*>(s.c_str()) };
-            } while (0);
-            break;
-        }
-        return {};
+        else
+            return utf16ToUTF32<std::wstring>(input.data(), input.size(), strict);
     }
 
     FVCORE_API std::wstring wstring(const std::u32string& input, bool strict) {
-        switch (sizeof(wchar_t)) {
-        case (sizeof(char16_t)):
-            do {
-                auto s = u16string(input, strict);
-                return { reinterpret_cast<const wchar_t*>(s.c_str()) };
-            } while (0);
-            break;
-        case (sizeof(char32_t)):
+        if constexpr (sizeof(wchar_t) == sizeof(char16_t))
+            return utf32ToUTF16<std::wstring>(input.data(), input.size(), strict);
+        else
             return { reinterpret_cast<const wchar_t*>(input.c_str()) };
-        }
-        return {};
     }
 
     FVCORE_API std::u8string u8string(const std::string& input, bool strict) {
@@ -398,39 +1194,15 @@ namespace FV {
     }
 
     FVCORE_API std::u8string u8string(const std::u16string& input, bool strict) {
-        auto length = input.size();
-        std::vector<char8_t> output;
-        output.reserve(length * 2);
-
-        if (convertUTF16toUTF8(input.data(),
-                               input.data() + length,
-                               strict,
-                               [&](char8_t ch) {
-                                   output.push_back(ch);
-                               }) == false) {
-            return {};
-        }
-        return { output.begin(), output.end() };
+        return utf16ToUTF8<std::u8string>(input.data(), input.size(), strict);
     }
 
     FVCORE_API std::u8string u8string(const std::u32string& input, bool strict) {
-        auto length = input.size();
-        std::vector<char8_t> output;
-        output.reserve(length * 4);
-
-        if (convertUTF32toUTF8(input.data(),
-                               input.data() + length,
-                               strict,
-                               [&](char8_t ch) {
-                                   output.push_back(ch);
-                               }) == false) {
-            return {};
-        }
-        return { output.begin(), output.end() };
+        return utf32ToUTF8<std::u8string>(input.data(), input.size(), strict);
     }
 
     FVCORE_API std::u16string u16string(const std::string& input, bool strict) {
-        return u16string(std::u8string(input.begin(), input.end()), strict);
+        return utf8ToUTF16<std::u16string>(reinterpret_cast<const char8_t*>(input.data()), input.size(), strict);
     }
 
     FVCORE_API std::u16string u16string(const std::wstring& input, bool strict) {
@@ -438,19 +1210,7 @@ namespace FV {
     }
 
     FVCORE_API std::u16string u16string(const std::u8string& input, bool strict) {
-        auto length = input.size();
-        std::vector<char16_t> output;
-        output.reserve(length);
-
-        if (convertUTF8toUTF16(input.data(),
-                               input.data() + length,
-                               strict,
-                               [&](char16_t ch) {
-                                   output.push_back(ch);
-                               }) == false) {
-            return {};
-        }
-        return { output.begin(), output.end() };
+        return utf8ToUTF16<std::u16string>(input.data(), input.size(), strict);
     }
 
     FVCORE_API std::u16string u16string(const std::u16string& input, bool strict) {
@@ -458,23 +1218,11 @@ namespace FV {
     }
 
     FVCORE_API std::u16string u16string(const std::u32string& input, bool strict) {
-        auto length = input.size();
-        std::vector<char16_t> output;
-        output.reserve(length);
-
-        if (convertUTF32toUTF16(input.data(),
-                                input.data() + length,
-                                strict,
-                                [&](char16_t ch) {
-                                    output.push_back(ch);
-                                }) == false) {
-            return {};
-        }
-        return { output.begin(), output.end() };
+        return utf32ToUTF16<std::u16string>(input.data(), input.size(), strict);
     }
 
     FVCORE_API std::u32string u32string(const std::string& input, bool strict) {
-        return u32string(std::u8string(input.begin(), input.end()), strict);
+        return utf8ToUTF32<std::u32string>(reinterpret_cast<const char8_t*>(input.data()), input.size(), strict);
     }
 
     FVCORE_API std::u32string u32string(const std::wstring& input, bool strict) {
@@ -482,35 +1230,11 @@ namespace FV {
     }
 
     FVCORE_API std::u32string u32string(const std::u8string& input, bool strict) {
-        auto length = input.size();
-        std::vector<char32_t> output;
-        output.reserve(length);
-
-        if (convertUTF8toUTF32(input.data(),
-                               input.data() + length,
-                               strict,
-                               [&](char32_t ch) {
-                                   output.push_back(ch);
-                               }) == false) {
-            return {};
-        }
-        return { output.begin(), output.end() };
+        return utf8ToUTF32<std::u32string>(input.data(), input.size(), strict);
     }
 
     FVCORE_API std::u32string u32string(const std::u16string& input, bool strict) {
-        auto length = input.size();
-        std::vector<char32_t> output;
-        output.reserve(length);
-
-        if (convertUTF16toUTF32(input.data(),
-                                input.data() + length,
-                                strict,
-                                [&](char32_t ch) {
-                                    output.push_back(ch);
-                                }) == false) {
-            return {};
-        }
-        return { output.begin(), output.end() };
+        return utf16ToUTF32<std::u32string>(input.data(), input.size(), strict);
     }
 
     FVCORE_API std::u32string u32string(const std::u32string& input, bool strict) {
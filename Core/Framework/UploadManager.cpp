@@ -0,0 +1,207 @@
+#include <numeric>
+#include "UploadManager.h"
+#include "GraphicsDevice.h"
+#include "Logger.h"
+
+using namespace FV;
+
+UploadManager* CommandQueue::uploadManager() {
+    std::scoped_lock guard(uploadManagerLock);
+    if (_uploadManager == nullptr)
+        _uploadManager = std::make_shared<UploadManager>(this);
+    return _uploadManager.get();
+}
+
+UploadManager::UploadManager(CommandQueue* q, size_t c)
+    : queue(q)
+    , capacity(c)
+    , ring(std::make_shared<Ring>())
+    , ringUnavailable(false)
+    , writers(0)
+    , temporaryBuffers(0) {
+    FVASSERT_DEBUG(queue);
+    ring->capacity = capacity;
+}
+
+UploadManager::~UploadManager() {
+    std::scoped_lock guard(ring->lock);
+    FVASSERT_DEBUG(writers == 0);
+    if (pendingCopies.empty() == false)
+        Log::warning("UploadManager destroyed with {} copies not flushed.", pendingCopies.size());
+}
+
+std::optional<size_t> UploadManager::Ring::alloc(size_t length, size_t alignment) {
+    if (buffer == nullptr || length > capacity)
+        return {};
+    uint64_t offset = head % capacity;
+    uint64_t aligned = (offset + alignment - 1) / alignment * alignment;
+    uint64_t start = head + (aligned - offset);
+    if (aligned + length > capacity) {
+        // not contiguous, skip to the beginning.
+        aligned = 0;
+        start = head + (capacity - offset);
+    }
+    if (start + length - tail > capacity)
+        return {};
+    head = start + length;
+    return size_t(aligned);
+}
+
+void UploadManager::Ring::complete(uint64_t end) {
+    std::scoped_lock guard(lock);
+    for (auto& batch : batches) {
+        if (batch.end == end && batch.completed == false) {
+            batch.completed = true;
+            break;
+        }
+    }
+    // command buffers can complete out of order, the tail only moves
+    // over the completed front batches.
+    while (batches.empty() == false && batches.front().completed) {
+        tail = std::max(tail, batches.front().end);
+        batches.pop_front();
+    }
+}
+
+bool UploadManager::stage(size_t length, size_t alignment, const WriteFunction& write, RecordFunction record) {
+    if (length == 0)
+        return false;
+
+    std::shared_ptr<GPUBuffer> buffer;
+    size_t offset = 0;
+    uint8_t* p = nullptr;
+    if (true) {
+        std::scoped_lock guard(ring->lock);
+        if (ring->buffer == nullptr && ringUnavailable == false) {
+            ring->buffer = queue->device()->makeBuffer(capacity,
+                                                       GPUBuffer::StorageModeShared,
+                                                       CPUCacheModeWriteCombined);
+            if (ring->buffer)
+                ring->contents = reinterpret_cast<uint8_t*>(ring->buffer->contents());
+            if (ring->contents == nullptr) {
+                Log::warning("UploadManager: ring buffer unavailable, using temporary buffers.");
+                ring->buffer = nullptr;
+                ringUnavailable = true;
+            }
+        }
+        if (auto reserved = ring->alloc(length, alignment); reserved.has_value()) {
+            buffer = ring->buffer;
+            offset = reserved.value();
+            p = ring->contents + offset;
+            writers++;
+        }
+    }
+
+    if (buffer) {
+        write(p);
+        buffer->flush(offset, length);
+
+        std::scoped_lock guard(ring->lock);
+        pendingCopies.push_back(record(buffer, offset));
+        if (--writers == 0)
+            writersCond.notify_all();
+        return true;
+    }
+
+    // overflow
+    buffer = queue->device()->makeBuffer(length,
+                                         GPUBuffer::StorageModeShared,
+                                         CPUCacheModeWriteCombined);
+    if (buffer == nullptr) {
+        Log::error("Failed to make buffer object.");
+        return false;
+    }
+    p = reinterpret_cast<uint8_t*>(buffer->contents());
+    if (p == nullptr) {
+        Log::error("Buffer memory mapping failed.");
+        return false;
+    }
+    temporaryBuffers++;
+    write(p);
+    buffer->flush();
+
+    std::scoped_lock guard(ring->lock);
+    pendingCopies.push_back(record(buffer, 0));
+    return true;
+}
+
+bool UploadManager::upload(const void* data, size_t length, std::shared_ptr<GPUBuffer> buffer, size_t offset) {
+    return upload(length, [&](void* p) { memcpy(p, data, length); }, buffer, offset);
+}
+
+bool UploadManager::upload(size_t length, const WriteFunction& write, std::shared_ptr<GPUBuffer> buffer, size_t offset) {
+    if (buffer == nullptr || offset + length > buffer->length()) {
+        Log::error("UploadManager::upload failed: Invalid buffer region");
+        return false;
+    }
+    return stage(length, defaultAlignment, write,
+                 [=](std::shared_ptr<GPUBuffer> src, size_t srcOffset)->CopyFunction {
+                     return [=](CopyCommandEncoder* encoder) {
+                         encoder->copy(src, srcOffset, buffer, offset, length);
+                     };
+                 });
+}
+
+bool UploadManager::upload(size_t length, const WriteFunction& write,
+                           std::shared_ptr<Texture> texture,
+                           const TextureOrigin& origin, const TextureSize& size,
+                           uint32_t bufferWidth, uint32_t bufferHeight) {
+    if (texture == nullptr) {
+        Log::error("UploadManager::upload failed: Invalid texture");
+        return false;
+    }
+    // buffer offsets of texture copies are multiples of the texel block size.
+    size_t blockBytes = std::max(pixelFormatBytesPerBlock(texture->pixelFormat()), 1U);
+    size_t alignment = std::lcm(defaultAlignment, blockBytes);
+    return stage(length, alignment, write,
+                 [=](std::shared_ptr<GPUBuffer> src, size_t srcOffset)->CopyFunction {
+                     return [=](CopyCommandEncoder* encoder) {
+                         encoder->copy(src,
+                                       BufferImageOrigin{ srcOffset, bufferWidth, bufferHeight },
+                                       texture, origin, size);
+                     };
+                 });
+}
+
+bool UploadManager::flush() {
+    std::vector<CopyFunction> copies;
+    uint64_t end = 0;
+    if (true) {
+        std::unique_lock guard(ring->lock);
+        // memory reserved up to the head must be written before it is copied.
+        writersCond.wait(guard, [this] { return writers == 0; });
+        if (pendingCopies.empty())
+            return false;
+        copies.swap(pendingCopies);
+        end = ring->head;
+        ring->batches.push_back({ end, false });
+    }
+
+    std::shared_ptr<CopyCommandEncoder> encoder;
+    auto commandBuffer = queue->makeCommandBuffer();
+    if (commandBuffer)
+        encoder = commandBuffer->makeCopyCommandEncoder();
+    if (encoder == nullptr) {
+        Log::error("Failed to make copy command encoder.");
+        ring->complete(end);
+        return false;
+    }
+    for (auto& copy : copies)
+        copy(encoder.get());
+    encoder->endEncoding();
+
+    commandBuffer->addCompletedHandler([ring = this->ring, end] {
+        ring->complete(end);
+    });
+    if (commandBuffer->commit() == false) {
+        Log::error("Failed to commit command buffer.");
+        ring->complete(end);
+        return false;
+    }
+    return true;
+}
+
+size_t UploadManager::numberOfPendingCopies() const {
+    std::scoped_lock guard(ring->lock);
+    return pendingCopies.size();
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include "../include.h"
+#include <mutex>
+#include <deque>
+#include <atomic>
+#include <optional>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+#include "CommandQueue.h"
+#include "CopyCommandEncoder.h"
+#include "GPUBuffer.h"
+#include "Texture.h"
+
+namespace FV {
+    // Stages uploads to GPU buffers and textures in a persistently mapped
+    // ring buffer. Copies recorded until flush() are committed together in
+    // one command buffer and one copy encoder; their part of the ring is
+    // reused once that command buffer has completed. Uploads which do not
+    // fit in the free part of the ring use temporary staging buffers.
+    // The queue must outlive the manager, copies which were not flushed
+    // are discarded when it is destroyed.
+    class FVCORE_API UploadManager {
+    public:
+        using WriteFunction = std::function<void(void*)>;
+
+        UploadManager(CommandQueue*, size_t capacity = defaultCapacity);
+        ~UploadManager();
+
+        static constexpr size_t defaultCapacity = 32 << 20;
+        static constexpr size_t defaultAlignment = 16;
+
+        CommandQueue* const queue;
+        const size_t capacity;
+
+        bool upload(const void* data, size_t length, std::shared_ptr<GPUBuffer>, size_t offset = 0);
+        // write fills 'length' bytes of staging memory, it can be called
+        // from several threads at once.
+        bool upload(size_t length, const WriteFunction& write, std::shared_ptr<GPUBuffer>, size_t offset = 0);
+        // the staged rows are bufferWidth x bufferHeight pixels.
+        bool upload(size_t length, const WriteFunction& write,
+                    std::shared_ptr<Texture>, const TextureOrigin&, const TextureSize&,
+                    uint32_t bufferWidth, uint32_t bufferHeight);
+
+        // commits the recorded copies, returns false if there was nothing to commit.
+        bool flush();
+
+        size_t numberOfPendingCopies() const;
+        // staging buffers made because the ring was full, since creation.
+        size_t numberOfTemporaryBuffers() const { return temporaryBuffers; }
+
+    private:
+        using CopyFunction = std::function<void(CopyCommandEncoder*)>;
+        using RecordFunction = std::function<CopyFunction(std::shared_ptr<GPUBuffer>, size_t)>;
+        bool stage(size_t length, size_t alignment, const WriteFunction&, RecordFunction);
+
+        // shared with completion handlers, which may run after the manager is gone.
+        struct Ring {
+            std::mutex lock;
+            std::shared_ptr<GPUBuffer> buffer;
+            uint8_t* contents = nullptr;
+            uint64_t capacity = 0;
+            uint64_t head = 0;      // ring positions increase monotonically,
+            uint64_t tail = 0;      // the offset is position % capacity.
+            struct Batch {
+                uint64_t end;       // head when the batch was flushed
+                bool completed;
+            };
+            std::deque<Batch> batches;
+            std::optional<size_t> alloc(size_t length, size_t alignment);
+            void complete(uint64_t end);
+        };
+        std::shared_ptr<Ring> ring;
+        bool ringUnavailable;
+
+        // guarded by ring->lock
+        std::condition_variable writersCond;
+        uint32_t writers;           // stages writing to memory reserved before the next flush
+        std::vector<CopyFunction> pendingCopies;
+        std::atomic<size_t> temporaryBuffers;
+    };
+}
@@ -52,7 +52,7 @@ DKAudioStream* DKAudioStreamVorbisCreate(const char* file);
 DKAudioStream* DKAudioStreamVorbisCreate(DKStream* stream);
 DKAudioStream* DKAudioStreamOggFLACCreate(DKStream* stream);
 DKAudioStream* DKAudioStreamFLACCreate(DKStream* stream);
-DKAudioStream* DKAudioStreamMP3Create(DKStream* stream);
+DKAudioStream* DKAudioStreamMP3Create(DKStream* stream, const void* index, size_t indexSize);
 DKAudioStream* DKAudioStreamWaveCreate(DKStream* stream);
 
 void DKAudioStreamVorbisDestroy(DKAudioStream* stream);
@@ -61,9 +61,16 @@ void DKAudioStreamFLACDestroy(DKAudioStream* stream);
 void DKAudioStreamMP3Destroy(DKAudioStream* stream);
 void DKAudioStreamWaveDestroy(DKAudioStream* stream);
 
+size_t DKAudioStreamMP3CopySeekIndex(DKAudioStream* stream, void* buffer, size_t size);
+
 #define AUDIO_FORMAT_HEADER_LENGTH      35
 
 extern "C" DKAudioStream* DKAudioStreamCreate(DKStream* stream)
+{
+    return DKAudioStreamCreateWithSeekIndex(stream, nullptr, 0);
+}
+
+extern "C" DKAudioStream* DKAudioStreamCreateWithSeekIndex(DKStream* stream, const void* index, size_t indexSize)
 {
     if (stream && DKSTREAM_IS_READABLE(stream) && DKSTREAM_IS_SEEKABLE(stream))
     {
@@ -85,7 +92,7 @@ extern "C" DKAudioStream* DKAudioStreamCreate(DKStream* stream)
         case DKAudioStreamEncodingFormat_FLAC:
             return DKAudioStreamFLACCreate(stream);
         case DKAudioStreamEncodingFormat_MP3:
-            return DKAudioStreamMP3Create(stream);
+            return DKAudioStreamMP3Create(stream, index, indexSize);
         case DKAudioStreamEncodingFormat_Wave:
             return DKAudioStreamWaveCreate(stream);
         default:
@@ -118,3 +125,15 @@ extern "C" void DKAudioStreamDestroy(DKAudioStream* stream)
         break;
     }
 }
+
+extern "C" size_t DKAudioStreamCopySeekIndex(DKAudioStream* stream, void* buffer, size_t size)
+{
+    switch (stream->mediaType)
+    {
+    case DKAudioStreamEncodingFormat_MP3:
+        return DKAudioStreamMP3CopySeekIndex(stream, buffer, size);
+    default:
+        break;
+    }
+    return 0;
+}
@@ -93,6 +93,17 @@ typedef struct _DKAudioStream
 DKAudioStream* DKAudioStreamCreate(DKStream*);
 void DKAudioStreamDestroy(DKAudioStream*);
 
+/*
+ Seek index: a decoder which has to scan the whole stream to seek
+ precisely (MP3) can export its frame index and take it back on the next
+ open to skip the scan. The data is opaque and validated by the decoder,
+ an index that does not match the stream is ignored.
+*/
+DKAudioStream* DKAudioStreamCreateWithSeekIndex(DKStream*, const void* index, size_t size);
+/* returns the size of the index, copies it if it fits into buffer.
+   returns 0 if the decoder has no index or has not built it yet. */
+size_t DKAudioStreamCopySeekIndex(DKAudioStream*, void* buffer, size_t size);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -13,6 +13,7 @@
 *******************************************************************************/
 
 #include <vector>
+#include <algorithm>
 #define MINIMP3_IMPLEMENTATION
 #include "../minimp3/minimp3_ex.h"
 
@@ -28,6 +29,103 @@ namespace {
         mp3dec_io_t io;
         std::vector<uint8_t> buffer;
     };
+
+    // Serialized frame index, the frames follow the header as pairs of
+    // LEB128 encoded deltas (sample, offset) from the previous frame.
+    struct MP3SeekIndexHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t hz;
+        uint32_t channels;
+        uint32_t layer;
+        uint32_t numFrames;
+        uint64_t startOffset;
+        uint64_t samples;
+        uint64_t streamLength;
+    };
+    constexpr char seekIndexMagic[4] = { 'M', 'P', '3', 'I' };
+    constexpr uint32_t seekIndexVersion = 1;
+
+    size_t WriteVarint(uint8_t* p, uint64_t value)
+    {
+        size_t n = 0;
+        while (value >= 0x80)
+        {
+            if (p) p[n] = uint8_t(value) | 0x80;
+            value >>= 7;
+            n++;
+        }
+        if (p) p[n] = uint8_t(value);
+        return n + 1;
+    }
+
+    bool ReadVarint(const uint8_t*& p, const uint8_t* end, uint64_t& value)
+    {
+        value = 0;
+        for (int shift = 0; p < end && shift < 64; shift += 7)
+        {
+            uint8_t byte = *p++;
+            value |= uint64_t(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0)
+                return true;
+        }
+        return false;
+    }
+
+    // replaces the index of a decoder opened with MP3D_DO_NOT_SCAN.
+    bool LoadSeekIndex(MP3Context* context, const void* data, size_t size, uint64_t streamLength)
+    {
+        mp3dec_ex_t& dec = context->dec;
+        MP3SeekIndexHeader header;
+        if (data == nullptr || size < sizeof(header))
+            return false;
+        memcpy(&header, data, sizeof(header));
+        if (memcmp(header.magic, seekIndexMagic, 4) != 0 ||
+            header.version != seekIndexVersion ||
+            header.hz != uint32_t(dec.info.hz) ||
+            header.channels != uint32_t(dec.info.channels) ||
+            header.layer != uint32_t(dec.info.layer) ||
+            header.startOffset != dec.start_offset ||
+            header.streamLength != streamLength ||
+            header.numFrames == 0)
+            return false;
+
+        mp3dec_frame_t* frames = (mp3dec_frame_t*)malloc(sizeof(mp3dec_frame_t) * header.numFrames);
+        if (frames == nullptr)
+            return false;
+
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(data) + sizeof(header);
+        const uint8_t* end = reinterpret_cast<const uint8_t*>(data) + size;
+        uint64_t sample = 0, offset = 0;
+        for (uint32_t i = 0; i < header.numFrames; ++i)
+        {
+            uint64_t ds, dp;
+            if (!ReadVarint(p, end, ds) || !ReadVarint(p, end, dp))
+            {
+                free(frames);
+                return false;
+            }
+            sample += ds;
+            offset += dp;
+            frames[i].sample = sample;
+            frames[i].offset = offset;
+        }
+        if (p != end || offset >= streamLength)
+        {
+            free(frames);
+            return false;
+        }
+
+        free(dec.index.frames);
+        dec.index.frames = frames;
+        dec.index.num_frames = header.numFrames;
+        dec.index.capacity = header.numFrames;
+        dec.samples = header.samples;
+        dec.detected_samples = header.samples;
+        dec.indexes_built = 1;
+        return true;
+    }
 }
 
 uint64_t DKAudioStreamMP3Read(DKAudioStream* stream, void* buffer, size_t size)
@@ -52,38 +150,40 @@ uint64_t DKAudioStreamMP3Read(DKAudioStream* stream, void* buffer, size_t size)
 uint64_t DKAudioStreamMP3SeekRaw(DKAudioStream* stream, uint64_t pos)
 {
     MP3Context* context = reinterpret_cast<MP3Context*>(stream->decoder);
-    pos = pos / sizeof(mp3d_sample_t);
-    if (pos > context->dec.samples)
-        pos = context->dec.samples;
+    const uint64_t channels = context->dec.info.channels;
+    pos = (pos / channels) / sizeof(mp3d_sample_t);     // raw to pcm(frame)
+    pos = std::min<uint64_t>(pos, context->dec.samples / channels);
 
-    int result = mp3dec_ex_seek(&context->dec, pos);
+    int result = mp3dec_ex_seek(&context->dec, pos * channels);
     if (result)
     {
         DKLogE("AudioStreamMP3: Seek error! (%x)\n", result);
         return DKSTREAM_ERROR;
     }
-    return (context->dec.offset - context->dec.start_offset);
+    return pos * channels * sizeof(mp3d_sample_t);
 }
 
 uint64_t DKAudioStreamMP3SeekPcm(DKAudioStream* stream, uint64_t pos)
 {
     MP3Context* context = reinterpret_cast<MP3Context*>(stream->decoder);
-    if (pos > context->dec.samples)
-        pos = context->dec.samples;
+    const uint64_t channels = context->dec.info.channels;
+    // samples are interleaved, pos counts frames of all channels.
+    pos = std::min<uint64_t>(pos, context->dec.samples / channels);
 
-    int result = mp3dec_ex_seek(&context->dec, pos);
+    int result = mp3dec_ex_seek(&context->dec, pos * channels);
     if (result)
     {
         DKLogE("AudioStreamMP3: Seek error! (%x)\n", result);
         return DKSTREAM_ERROR;
     }
-    return (context->dec.offset - context->dec.start_offset) / sizeof(mp3d_sample_t);
+    return pos;
 }
 
 double DKAudioStreamMP3SeekTime(DKAudioStream* stream, double t)
 {
     MP3Context* context = reinterpret_cast<MP3Context*>(stream->decoder);
-    uint64_t pos = uint64_t(double(context->dec.info.hz) * t);
+    // samples are interleaved, seek to the first channel of a frame.
+    uint64_t pos = uint64_t(double(context->dec.info.hz) * t) * context->dec.info.channels;
     if (pos > context->dec.samples)
         pos = context->dec.samples;
 
@@ -105,13 +205,13 @@ uint64_t DKAudioStreamMP3RawPosition(DKAudioStream* stream)
 uint64_t DKAudioStreamMP3PcmPosition(DKAudioStream* stream)
 {
     MP3Context* context = reinterpret_cast<MP3Context*>(stream->decoder);
-    return context->dec.cur_sample;
+    return context->dec.cur_sample / context->dec.info.channels;
 }
 
 double DKAudioStreamMP3TimePosition(DKAudioStream* stream)
 {
     MP3Context* context = reinterpret_cast<MP3Context*>(stream->decoder);
-    double freq = double(context->dec.info.hz);
+    double freq = double(context->dec.info.hz) * context->dec.info.channels;
     double t = double(context->dec.cur_sample) / freq;
     return t;
 }
@@ -125,18 +225,64 @@ uint64_t DKAudioStreamMP3RawTotal(DKAudioStream* stream)
 uint64_t DKAudioStreamMP3PcmTotal(DKAudioStream* stream)
 {
     MP3Context* context = reinterpret_cast<MP3Context*>(stream->decoder);
-    return context->dec.samples;
+    return context->dec.samples / context->dec.info.channels;
 }
 
 double DKAudioStreamMP3TimeTotal(DKAudioStream* stream)
 {
     MP3Context* context = reinterpret_cast<MP3Context*>(stream->decoder);
-    double freq = double(context->dec.info.hz);
+    double freq = double(context->dec.info.hz) * context->dec.info.channels;
     double t = double(context->dec.samples) / freq;
     return t;
 }
 
-DKAudioStream* DKAudioStreamMP3Create(DKStream* stream)
+size_t DKAudioStreamMP3CopySeekIndex(DKAudioStream* stream, void* buffer, size_t size)
+{
+    MP3Context* context = reinterpret_cast<MP3Context*>(stream->decoder);
+    const mp3dec_ex_t& dec = context->dec;
+    if (!dec.indexes_built || dec.index.num_frames == 0 || dec.index.num_frames > UINT32_MAX)
+        return 0;
+
+    size_t length = sizeof(MP3SeekIndexHeader);
+    uint64_t sample = 0, offset = 0;
+    for (size_t i = 0; i < dec.index.num_frames; ++i)
+    {
+        length += WriteVarint(nullptr, dec.index.frames[i].sample - sample);
+        length += WriteVarint(nullptr, dec.index.frames[i].offset - offset);
+        sample = dec.index.frames[i].sample;
+        offset = dec.index.frames[i].offset;
+    }
+    if (buffer == nullptr || size < length)
+        return length;
+
+    MP3SeekIndexHeader header = {};
+    memcpy(header.magic, seekIndexMagic, 4);
+    header.version = seekIndexVersion;
+    header.hz = dec.info.hz;
+    header.channels = dec.info.channels;
+    header.layer = dec.info.layer;
+    header.numFrames = uint32_t(dec.index.num_frames);
+    header.startOffset = dec.start_offset;
+    header.samples = dec.samples;
+    header.streamLength = context->stream ? DKSTREAM_TOTAL_LENGTH(context->stream) : 0;
+    if (context->buffer.empty() == false)
+        header.streamLength = context->buffer.size();
+    memcpy(buffer, &header, sizeof(header));
+
+    uint8_t* p = reinterpret_cast<uint8_t*>(buffer) + sizeof(header);
+    sample = 0;
+    offset = 0;
+    for (size_t i = 0; i < dec.index.num_frames; ++i)
+    {
+        p += WriteVarint(p, dec.index.frames[i].sample - sample);
+        p += WriteVarint(p, dec.index.frames[i].offset - offset);
+        sample = dec.index.frames[i].sample;
+        offset = dec.index.frames[i].offset;
+    }
+    return length;
+}
+
+DKAudioStream* DKAudioStreamMP3Create(DKStream* stream, const void* index, size_t indexSize)
 {
     if (stream && DKSTREAM_IS_READABLE(stream))
     {
@@ -165,7 +311,18 @@ DKAudioStream* DKAudioStreamMP3Create(DKStream* stream)
                 return 0;
             };
 
-            result = mp3dec_ex_open_cb(&context->dec, &context->io, MP3D_SEEK_TO_SAMPLE);
+            uint64_t streamLength = DKSTREAM_TOTAL_LENGTH(stream);
+            if (index && indexSize > 0)
+            {
+                // the stored index replaces the scan of the whole stream.
+                result = mp3dec_ex_open_cb(&context->dec, &context->io, MP3D_SEEK_TO_SAMPLE | MP3D_DO_NOT_SCAN);
+                if (result == 0 && !LoadSeekIndex(context, index, indexSize, streamLength))
+                    result = -1;
+                if (result != 0)
+                    mp3dec_ex_close(&context->dec);
+            }
+            if (result != 0)
+                result = mp3dec_ex_open_cb(&context->dec, &context->io, MP3D_SEEK_TO_SAMPLE);
         }
         else
         {
@@ -180,7 +337,16 @@ DKAudioStream* DKAudioStreamMP3Create(DKStream* stream)
             }
             context->buffer.shrink_to_fit();
 
-            result = mp3dec_ex_open_buf(&context->dec, context->buffer.data(), context->buffer.size(), MP3D_SEEK_TO_SAMPLE);
+            if (index && indexSize > 0)
+            {
+                result = mp3dec_ex_open_buf(&context->dec, context->buffer.data(), context->buffer.size(), MP3D_SEEK_TO_SAMPLE | MP3D_DO_NOT_SCAN);
+                if (result == 0 && !LoadSeekIndex(context, index, indexSize, context->buffer.size()))
+                    result = -1;
+                if (result != 0)
+                    mp3dec_ex_close(&context->dec);
+            }
+            if (result != 0)
+                result = mp3dec_ex_open_buf(&context->dec, context->buffer.data(), context->buffer.size(), MP3D_SEEK_TO_SAMPLE);
         }
 
         if (result == 0)
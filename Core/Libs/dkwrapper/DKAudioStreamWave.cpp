@@ -123,7 +123,7 @@ uint64_t DKAudioStreamWaveRead(DKAudioStream* stream, void* buffer, size_t size)
     WaveFileContext* context = reinterpret_cast<WaveFileContext*>(stream->decoder);
     if (context->stream)
     {
-        size_t pos = DKSTREAM_GET_POSITION(context->stream);
+        uint64_t pos = DKSTREAM_GET_POSITION(context->stream) - context->dataOffset;
         if (pos + size > context->dataSize)
             size = context->dataSize - pos;
 
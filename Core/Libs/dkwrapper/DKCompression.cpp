@@ -17,7 +17,10 @@
 #include <algorithm>
 
 #include "../zlib/zlib.h"
+#define ZSTD_STATIC_LINKING_ONLY  /* ZSTD_getDictID_fromFrame */
 #include "../zstd/lib/zstd.h"
+#include "../zstd/lib/common/zstd_errors.h"
+#include "../zstd/lib/dictBuilder/zdict.h"
 
 #include "../lz4/lib/lz4.h"
 #include "../lz4/lib/lz4hc.h"
@@ -1050,3 +1053,166 @@ DKCompressionResult DKCompressionDecodeAutoDetect(DKStream* input, DKStream* out
         *pAlg = algo;
     return result;
 }
+
+struct _DKCompressionDictionary
+{
+    ZSTD_CDict* cdict;
+    ZSTD_DDict* ddict;
+    uint32_t dictID;
+};
+
+// Compression contexts are kept per thread and reused for every call,
+// dictionaries are digested once when created.
+struct ZstdThreadContext
+{
+    ZSTD_CCtx* cctx = nullptr;
+    ZSTD_DCtx* dctx = nullptr;
+    ~ZstdThreadContext()
+    {
+        if (cctx)
+            ZSTD_freeCCtx(cctx);
+        if (dctx)
+            ZSTD_freeDCtx(dctx);
+    }
+};
+static thread_local ZstdThreadContext zstdThreadContext;
+
+extern "C"
+size_t DKCompressionTrainDictionary(void* dictBuffer, size_t dictCapacity,
+                                    const void* samples, const size_t* sampleSizes, uint32_t numSamples)
+{
+    if (dictBuffer == nullptr || samples == nullptr || sampleSizes == nullptr || numSamples == 0)
+        return 0;
+    size_t result = ZDICT_trainFromBuffer(dictBuffer, dictCapacity, samples, sampleSizes, numSamples);
+    if (ZDICT_isError(result))
+    {
+        DKLogE("DKCompression Error: ZDICT_trainFromBuffer failed: %s\n",
+               ZDICT_getErrorName(result));
+        return 0;
+    }
+    return result;
+}
+
+extern "C"
+DKCompressionDictionary DKCompressionCreateDictionary(const void* dict, size_t dictSize, int level)
+{
+    if (dict == nullptr || dictSize == 0)
+        return nullptr;
+
+    ZSTD_CDict* cdict = ZSTD_createCDict(dict, dictSize, level);
+    ZSTD_DDict* ddict = ZSTD_createDDict(dict, dictSize);
+    if (cdict && ddict)
+    {
+        auto p = new _DKCompressionDictionary{ cdict, ddict, ZSTD_getDictID_fromDict(dict, dictSize) };
+        return p;
+    }
+    if (cdict)
+        ZSTD_freeCDict(cdict);
+    if (ddict)
+        ZSTD_freeDDict(ddict);
+    return nullptr;
+}
+
+extern "C"
+void DKCompressionDestroyDictionary(DKCompressionDictionary dict)
+{
+    if (dict)
+    {
+        ZSTD_freeCDict(dict->cdict);
+        ZSTD_freeDDict(dict->ddict);
+        delete dict;
+    }
+}
+
+extern "C"
+uint32_t DKCompressionDictionaryID(DKCompressionDictionary dict)
+{
+    return dict ? dict->dictID : 0;
+}
+
+extern "C"
+uint32_t DKCompressionDictionaryIDFromFrame(const void* data, size_t length)
+{
+    return ZSTD_getDictID_fromFrame(data, length);
+}
+
+extern "C"
+size_t DKCompressionDictionaryEncodeBound(size_t length)
+{
+    return ZSTD_compressBound(length);
+}
+
+extern "C"
+DKCompressionResult DKCompressionEncodeWithDictionary(DKCompressionDictionary dict, const void* input, size_t inputLength, void* output, size_t* outputLength)
+{
+    if (dict == nullptr || outputLength == nullptr)
+        return DKCompressionResult_InvalidParameter;
+    if (input == nullptr && inputLength > 0)
+        return DKCompressionResult_InputStreamError;
+    if (output == nullptr)
+        return DKCompressionResult_OutputStreamError;
+
+    auto& context = zstdThreadContext;
+    if (context.cctx == nullptr)
+        context.cctx = ZSTD_createCCtx();
+    if (context.cctx == nullptr)
+        return DKCompressionResult_OutOfMemory;
+
+    size_t result = ZSTD_compress_usingCDict(context.cctx, output, *outputLength, input, inputLength, dict->cdict);
+    if (ZSTD_isError(result))
+    {
+        if (ZSTD_getErrorCode(result) == ZSTD_error_dstSize_tooSmall)
+            return DKCompressionResult_OutputStreamError;
+        DKLogE("DKCompression Encode-Error: ZSTD_compress_usingCDict failed: %s\n",
+               ZSTD_getErrorName(result));
+        return DKCompressionResult_UnknownError;
+    }
+    *outputLength = result;
+    return DKCompressionResult_Success;
+}
+
+extern "C"
+uint64_t DKCompressionDictionaryDecodedLength(const void* data, size_t length)
+{
+    unsigned long long size = ZSTD_getFrameContentSize(data, length);
+    if (size == ZSTD_CONTENTSIZE_UNKNOWN || size == ZSTD_CONTENTSIZE_ERROR)
+        return ~uint64_t(0);
+    return size;
+}
+
+extern "C"
+DKCompressionResult DKCompressionDecodeWithDictionary(DKCompressionDictionary dict, const void* input, size_t inputLength, void* output, size_t* outputLength)
+{
+    if (dict == nullptr || outputLength == nullptr)
+        return DKCompressionResult_InvalidParameter;
+    if (input == nullptr)
+        return DKCompressionResult_InputStreamError;
+    if (output == nullptr && *outputLength > 0)
+        return DKCompressionResult_OutputStreamError;
+
+    auto& context = zstdThreadContext;
+    if (context.dctx == nullptr)
+        context.dctx = ZSTD_createDCtx();
+    if (context.dctx == nullptr)
+        return DKCompressionResult_OutOfMemory;
+
+    size_t result = ZSTD_decompress_usingDDict(context.dctx, output, *outputLength, input, inputLength, dict->ddict);
+    if (ZSTD_isError(result))
+    {
+        switch (ZSTD_getErrorCode(result))
+        {
+        case ZSTD_error_dstSize_tooSmall:
+            return DKCompressionResult_OutputStreamError;
+        case ZSTD_error_dictionary_wrong:
+        case ZSTD_error_prefix_unknown:
+            return DKCompressionResult_InvalidParameter;
+        default:
+            break;
+        }
+        DKLogE("DKCompression Decode-Error: ZSTD_decompress_usingDDict failed: %s\n",
+               ZSTD_getErrorName(result));
+        return DKCompressionResult_DataError;
+    }
+    *outputLength = result;
+    return DKCompressionResult_Success;
+}
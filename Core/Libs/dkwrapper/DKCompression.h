@@ -63,6 +63,25 @@ DKCompressionResult DKCompressionEncode(DKCompressionAlgorithm, DKStream* input,
 DKCompressionResult DKCompressionDecode(DKCompressionAlgorithm, DKStream* input, DKStream* output);
 DKCompressionResult DKCompressionDecodeAutoDetect(DKStream* input, DKStream* output, DKCompressionAlgorithm*);
 
+/* Dictionary compression (Zstd only), for small records. */
+typedef struct _DKCompressionDictionary* DKCompressionDictionary;
+
+/* returns dictionary size written to dictBuffer, 0 on failure. */
+size_t DKCompressionTrainDictionary(void* dictBuffer, size_t dictCapacity,
+                                    const void* samples, const size_t* sampleSizes, uint32_t numSamples);
+DKCompressionDictionary DKCompressionCreateDictionary(const void* dict, size_t dictSize, int level);
+void DKCompressionDestroyDictionary(DKCompressionDictionary);
+uint32_t DKCompressionDictionaryID(DKCompressionDictionary);
+/* dictionary ID stored in a compressed frame, 0 if none. */
+uint32_t DKCompressionDictionaryIDFromFrame(const void* data, size_t length);
+
+size_t DKCompressionDictionaryEncodeBound(size_t length);
+/* outputLength: capacity of output on input, written bytes on output. */
+DKCompressionResult DKCompressionEncodeWithDictionary(DKCompressionDictionary, const void* input, size_t inputLength, void* output, size_t* outputLength);
+/* returns decoded length stored in frame, ~0 if unknown or invalid. */
+uint64_t DKCompressionDictionaryDecodedLength(const void* data, size_t length);
+DKCompressionResult DKCompressionDecodeWithDictionary(DKCompressionDictionary, const void* input, size_t inputLength, void* output, size_t* outputLength);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -105,6 +105,7 @@ void MeshRenderer::render(const RenderPassDescriptor& rp, const Rect& frame) {
         Vector3 lightColor = { 1, 1, 1 };
         Vector3 ambientColor = { 0.7, 0.7, 0.7 };
 
+        std::vector<uint32_t> visibleMeshlets;
         auto& scene = model->scenes.at(model->defaultSceneIndex);
         for (auto& node : scene.nodes)
             ForEachNode{ node }(
@@ -122,7 +123,24 @@ void MeshRenderer::render(const RenderPassDescriptor& rp, const Rect& frame) {
                             .concatenating(trans.matrix4());
 
                         mesh.updateShadingProperties(&sceneStateLocal);
-                        mesh.encodeRenderCommand(encoder.get(), 1, 0);
+                        if (mesh.meshlets || mesh.levelsOfDetail.empty() == false) {
+                            // the frustum in the space of the mesh.
+                            auto modelTM = AffineTransform3(sceneStateLocal.model);
+                            auto modelView = ViewTransform{ modelTM.matrix3, modelTM.translation }
+                                .concatenating(view);
+                            auto frustum = ViewFrustum{ modelView, projection };
+                            if (auto level = mesh.levelOfDetail(frustum, frame.size.height, 1.0f); level > 0) {
+                                mesh.encodeRenderCommand(encoder.get(), 1, 0, mesh.levelsOfDetail.at(level - 1));
+                            } else if (mesh.meshlets) {
+                                visibleMeshlets.clear();
+                                mesh.cullMeshlets(frustum, visibleMeshlets);
+                                mesh.encodeRenderCommand(encoder.get(), 1, 0, visibleMeshlets);
+                            } else {
+                                mesh.encodeRenderCommand(encoder.get(), 1, 0);
+                            }
+                        } else {
+                            mesh.encodeRenderCommand(encoder.get(), 1, 0);
+                        }
                     }
                 });
         encoder->endEncoding();
@@ -9,11 +9,16 @@ using namespace FV;
 struct LoaderContext {
     tinygltf::Model model;
     CommandQueue* queue;
+    UploadManager* uploads;
+    std::filesystem::path path;
+    bool compressTextures = true;
+    bool keepGeometryContent = true; // for faceList, without reading buffers back
+    MeshProcessor::Options meshOptions;
 
     std::shared_ptr<Texture> defaultTexture;
     std::shared_ptr<SamplerState> defaultSampler;
 
-    std::vector<std::shared_ptr<GPUBuffer>> buffers;
+    std::vector<MeshProcessor::SharedContent> buffers;
     std::vector<std::shared_ptr<Texture>> images;
     std::vector<std::shared_ptr<Material>> materials;
 
@@ -21,133 +26,107 @@ struct LoaderContext {
     std::vector<SamplerDescriptor> samplerDescriptors;
 };
 
-std::shared_ptr<GPUBuffer> makeBuffer(CommandBuffer* cbuffer,
-                                      size_t length,
-                                      const void* data,
-                                      GPUBuffer::StorageMode storageMode = GPUBuffer::StorageModePrivate,
-                                      CPUCacheMode cpuCacheMode = CPUCacheModeDefault) {
-    FVASSERT(length > 0);
-
-    FVASSERT(cbuffer);
-    auto device = cbuffer->device();
-
-    std::shared_ptr<GPUBuffer> buffer;
-    if (storageMode == GPUBuffer::StorageModeShared) {
-        buffer = device->makeBuffer(length, storageMode, cpuCacheMode);
-        FVASSERT(buffer);
-        if (auto p = buffer->contents()) {
-            memcpy(p, data, length);
-            buffer->flush();
-        } else {
-            Log::error("GPUBuffer map failed.");
-            FVERROR_ABORT("GPUBuffer map failed.");
-            return nullptr;
-        }
-    } else {
-        auto stgBuffer = device->makeBuffer(length,
-                                            GPUBuffer::StorageModeShared,
-                                            CPUCacheModeWriteCombined);
-        FVASSERT(stgBuffer);
-        if (auto p = stgBuffer->contents()) {
-            memcpy(p, data, length);
-            stgBuffer->flush();
-        } else {
-            Log::error("GPUBuffer map failed.");
-            FVERROR_ABORT("GPUBuffer map failed.");
-            return nullptr;
-        }
-
-        buffer = device->makeBuffer(length, storageMode, cpuCacheMode);
-        FVASSERT(buffer);
-        auto encoder = cbuffer->makeCopyCommandEncoder();
-        FVASSERT(encoder);
-        encoder->copy(stgBuffer, 0, buffer, 0, length);
-        encoder->endEncoding();
-    }
-    return buffer;
+// keeps the vector as the CPU content of a mesh buffer.
+template <typename T>
+std::shared_ptr<const uint8_t> makeContent(std::vector<T>&& data) {
+    auto content = std::make_shared<std::vector<T>>(std::move(data));
+    return std::shared_ptr<const uint8_t>(content, reinterpret_cast<const uint8_t*>(content->data()));
 }
 
 void loadBuffers(LoaderContext& context) {
-    auto cbuffer = context.queue->makeCommandBuffer();
-    FVASSERT(cbuffer);
-
-    const auto& model = context.model;
-    context.buffers.resize(model.buffers.size(), nullptr);
+    auto& model = context.model;
+    context.buffers.resize(model.buffers.size());
 
     for (int index = 0; index < model.buffers.size(); ++index) {
         auto& glTFBuffer = model.buffers.at(index);
 
         auto& data = glTFBuffer.data;
 
-        auto buffer = makeBuffer(cbuffer.get(), data.size(), data.data());
-        FVASSERT(buffer);
-        context.buffers.at(index) = buffer;
+        // meshes share the data of the glTF buffer, it is not copied.
+        // The GPU buffer is made by MeshProcessor, if a mesh uses it.
+        auto& buffer = context.buffers.at(index);
+        buffer.length = data.size();
+        buffer.content = makeContent(std::move(data));
     }
     FVASSERT(context.buffers.size() == model.buffers.size());
-    cbuffer->commit();
+}
+
+// Images are kept encoded by tinygltf, loadImages decodes them in parallel.
+bool deferImageDecoding(tinygltf::Image* image, const int imageIndex,
+                        std::string* err, std::string* warn,
+                        int reqWidth, int reqHeight,
+                        const unsigned char* bytes, int size, void*) {
+    image->image.assign(bytes, bytes + size);
+    image->as_is = true;
+    return true;
+}
+
+std::shared_ptr<Image> decodeImage(const tinygltf::Image& glTFImage) {
+    if (glTFImage.as_is) {
+        try {
+            return std::make_shared<Image>(glTFImage.image.data(), glTFImage.image.size());
+        } catch (const std::exception&) {
+            return nullptr; // logged by Image
+        }
+    }
+    // decoded by tinygltf
+    return Image::fromPixels(glTFImage.width, glTFImage.height,
+                             glTFImage.component, glTFImage.bits,
+                             glTFImage.image.data(), glTFImage.image.size());
+}
+
+// Block compressed textures are cached next to the image file, or next
+// to the asset for embedded images.
+CompressedImageCache compressedImageCache(const LoaderContext& context, int index) {
+    auto& glTFImage = context.model.images.at(index);
+    std::filesystem::path path;
+    if (glTFImage.uri.empty() == false && glTFImage.uri.starts_with("data:") == false) {
+        path = context.path.parent_path() / glTFImage.uri;
+        path += ".bc";
+    } else {
+        path = context.path;
+        path += std::format(".{}.bc", index);
+    }
+    return CompressedImageCache(path, glTFImage.image.data(), glTFImage.image.size());
 }
 
 void loadImages(LoaderContext& context) {
     const auto& model = context.model;
     context.images.resize(model.images.size(), nullptr);
 
-    for (int index = 0; index < model.images.size(); ++index) {
-        auto& glTFImage = model.images.at(index);
-
-        auto width = glTFImage.width;
-        auto height = glTFImage.height;
-        auto component = glTFImage.component;
-        auto bits = glTFImage.bits;
-
-        ImagePixelFormat imageFormat = ImagePixelFormat::Invalid;
-        switch (component) {
-        case 1:
-            if (bits == 8)
-                imageFormat = ImagePixelFormat::R8;
-            else if (bits == 16)
-                imageFormat = ImagePixelFormat::R16;
-            else if (bits == 32)
-                imageFormat = ImagePixelFormat::R32;
-            break;
-        case 2:
-            if (bits == 8)
-                imageFormat = ImagePixelFormat::RG8;
-            else if (bits == 16)
-                imageFormat = ImagePixelFormat::RG16;
-            else if (bits == 32)
-                imageFormat = ImagePixelFormat::RG32;
-            break;
-        case 3:
-            if (bits == 8)
-                imageFormat = ImagePixelFormat::RGB8;
-            else if (bits == 16)
-                imageFormat = ImagePixelFormat::RGB16;
-            else if (bits == 32)
-                imageFormat = ImagePixelFormat::RGB32;
-            break;
-        case 4:
-            if (bits == 8)
-                imageFormat = ImagePixelFormat::RGBA8;
-            else if (bits == 16)
-                imageFormat = ImagePixelFormat::RGBA16;
-            else if (bits == 32)
-                imageFormat = ImagePixelFormat::RGBA32;
-            break;
-        }
-        if (imageFormat == ImagePixelFormat::Invalid) {
-            Log::error("Unsupported image pixel format.");
-            continue;
-        }
-        size_t reqLength = (bits >> 3) * width * height * component;
-        if (glTFImage.image.size() < reqLength) {
-            Log::error("invalid image pixel data.");
-            continue;
+    struct LoadedImage {
+        std::shared_ptr<Image> image;
+        std::shared_ptr<CompressedImage> compressed;
+    };
+    std::vector<LoadedImage> loaded(model.images.size());
+
+    // images are decoded and compressed on the global queue, all at once.
+    dispatchApply(model.images.size(), [&](size_t index) {
+        auto& result = loaded.at(index);
+        std::optional<CompressedImageCache> cache;
+        if (context.compressTextures) {
+            cache.emplace(compressedImageCache(context, int(index)));
+            result.compressed = cache->read();
+            if (result.compressed)
+                return;
         }
-        auto image = std::make_shared<Image>(width, height, imageFormat, glTFImage.image.data());
-        if (auto texture = image->makeTexture(context.queue)) {
+        result.image = decodeImage(model.images.at(index));
+        if (result.image && cache)
+            result.compressed = cache->compress(*result.image);
+    });
+
+    // textures are staged in order, uploaded with the next flush.
+    for (int index = 0; index < model.images.size(); ++index) {
+        auto& result = loaded.at(index);
+        std::shared_ptr<Texture> texture;
+        if (result.compressed)
+            texture = result.compressed->makeTexture(context.uploads);
+        if (texture == nullptr && result.image)
+            texture = result.image->makeTexture(context.uploads);
+        if (texture) {
             context.images.at(index) = texture;
         } else {
-            Log::error("Failed to load image: {}", glTFImage.name);
+            Log::error("Failed to load image: {}", model.images.at(index).name);
         }
     }
     FVASSERT(context.images.size() == model.images.size());
@@ -289,8 +268,6 @@ void loadMaterials(LoaderContext& context) {
 
 void loadMeshes(LoaderContext& context) {
     auto device = context.queue->device();
-    auto cbuffer = context.queue->makeCommandBuffer();
-    FVASSERT(cbuffer);
 
     const auto& model = context.model;
     context.meshes.resize(model.meshes.size());
@@ -313,7 +290,7 @@ void loadMeshes(LoaderContext& context) {
             for (auto& [attributeName, accessorIndex] : glTFPrimitive.attributes) {
                 auto& glTFAccessor = model.accessors[accessorIndex];
                 auto& glTFBufferView = model.bufferViews[glTFAccessor.bufferView];
-                auto& glTFBuffer = model.buffers[glTFBufferView.buffer];
+                auto& content = context.buffers.at(glTFBufferView.buffer).content;
 
                 uint32_t vertexStride = glTFAccessor.ByteStride(glTFBufferView);
                 uint32_t bufferOffset = glTFBufferView.byteOffset;
@@ -329,7 +306,8 @@ void loadMeshes(LoaderContext& context) {
                     .byteOffset = bufferOffset,
                     .byteStride = vertexStride,
                     .vertexCount = uint32_t(glTFAccessor.count),
-                    .buffer = context.buffers.at(glTFBufferView.buffer)
+                    .buffer = nullptr,
+                    .content = content
                 };
 
                 Mesh::VertexAttribute attribute = {};
@@ -456,7 +434,7 @@ void loadMeshes(LoaderContext& context) {
                     attribute.semantic = VertexAttributeSemantic::Position;
                     if (attribute.format == VertexFormat::Float3) {
                         // get AABB
-                        const uint8_t* ptr = glTFBuffer.data.data();
+                        const uint8_t* ptr = content.get();
                         ptr += bufferOffset + attribOffset;
                         AABB aabb = {};
                         positions.clear();
@@ -513,15 +491,16 @@ void loadMeshes(LoaderContext& context) {
             if (glTFPrimitive.indices >= 0) {
                 auto& glTFAccessor = model.accessors[glTFPrimitive.indices];
                 auto& glTFBufferView = model.bufferViews[glTFAccessor.bufferView];
-                auto& glTFBuffer = model.buffers[glTFBufferView.buffer];
+                auto& content = context.buffers.at(glTFBufferView.buffer).content;
 
                 mesh.indexBufferByteOffset = uint32_t(glTFBufferView.byteOffset + glTFAccessor.byteOffset);
                 mesh.indexCount = glTFAccessor.count;
-                mesh.indexBuffer = context.buffers[glTFBufferView.buffer];
+                mesh.indexBuffer = nullptr;
+                mesh.indexContent = content;
                 mesh.indexBufferBaseVertexIndex = 0;
 
                 indices.reserve(glTFAccessor.count);
-                uint8_t* p = ((uint8_t*)glTFBuffer.data.data()) + mesh.indexBufferByteOffset;
+                const uint8_t* p = content.get() + mesh.indexBufferByteOffset;
 
                 switch (glTFAccessor.componentType) {
                 case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE: // convert to uint16
@@ -534,10 +513,7 @@ void loadMeshes(LoaderContext& context) {
                             indices.push_back(p[i]);
                         }
 
-                        auto buffer = makeBuffer(cbuffer.get(), indexData.size() * 2,
-                                                 indexData.data());
-                        FVASSERT(buffer);
-                        mesh.indexBuffer = buffer;
+                        mesh.indexContent = makeContent(std::move(indexData));
                         mesh.indexType = IndexType::UInt16;
                         mesh.indexBufferByteOffset = 0;
 
@@ -546,14 +522,14 @@ void loadMeshes(LoaderContext& context) {
                 case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
                     mesh.indexType = IndexType::UInt16;
                     for (int i = 0; i < glTFAccessor.count; ++i) {
-                        uint16_t index = ((uint16_t*)p)[i];
+                        uint16_t index = ((const uint16_t*)p)[i];
                         indices.push_back(index);
                     }
                     break;
                 case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
                     mesh.indexType = IndexType::UInt32;
                     for (int i = 0; i < glTFAccessor.count; ++i) {
-                        uint32_t index = ((uint32_t*)p)[i];
+                        uint32_t index = ((const uint32_t*)p)[i];
                         indices.push_back(index);
                     }
                     break;
@@ -604,7 +580,6 @@ void loadMeshes(LoaderContext& context) {
                 for (auto& normal : normals)
                     normal.normalize();
 
-                auto buffer = makeBuffer(cbuffer.get(), normals.size() * sizeof(Vector3), normals.data());
                 Mesh::VertexAttribute attribute = {
                     VertexAttributeSemantic::Normal,
                     VertexFormat::Float3,
@@ -613,13 +588,13 @@ void loadMeshes(LoaderContext& context) {
                 };
                 Mesh::VertexBuffer vb = {
                     0, sizeof(Vector3), normals.size(),
-                    buffer, { attribute }
+                    nullptr, { attribute }
                 };
+                vb.content = makeContent(std::move(normals));
                 mesh.vertexBuffers.push_back(vb);
             }
             if (hasVertexColor == false) {
                 std::vector<Vector4> colors(positions.size(), Vector4(1, 1, 1, 1));
-                auto buffer = makeBuffer(cbuffer.get(), colors.size() * sizeof(Vector4), colors.data());
                 Mesh::VertexAttribute attribute = {
                     VertexAttributeSemantic::Color,
                     VertexFormat::Float4,
@@ -628,8 +603,9 @@ void loadMeshes(LoaderContext& context) {
                 };
                 Mesh::VertexBuffer vb = {
                     0, sizeof(Vector4), colors.size(),
-                    buffer, { attribute }
+                    nullptr, { attribute }
                 };
+                vb.content = makeContent(std::move(colors));
                 mesh.vertexBuffers.push_back(vb);
             }
 
@@ -654,7 +630,19 @@ void loadMeshes(LoaderContext& context) {
 
         context.meshes.at(index) = node;
     }
-    cbuffer->commit();
+
+    std::vector<Mesh*> meshes;
+    for (auto& node : context.meshes) {
+        ForEachNode{ node }([&](SceneNode& node) {
+            if (node.mesh.has_value())
+                meshes.push_back(&node.mesh.value());
+        });
+    }
+    MeshProcessor::Options options = context.meshOptions;
+    options.lodCachePath = context.path;
+    options.lodCachePath += ".lod";
+    MeshProcessor(options).process(meshes);
+    MeshProcessor::makeBuffers(meshes, context.uploads, context.buffers, context.keepGeometryContent);
 }
 
 SceneNode loadNode(const tinygltf::Node& node, const Matrix4& baseTM, LoaderContext& context) {
@@ -750,8 +738,9 @@ Model::Scene loadScene(const tinygltf::Scene& scene, LoaderContext& context) {
 }
 
 std::shared_ptr<Model> loadModel(std::filesystem::path path, CommandQueue* queue) {
-    LoaderContext context = { .queue = queue };
+    LoaderContext context = { .queue = queue, .uploads = queue->uploadManager(), .path = path };
     tinygltf::TinyGLTF loader;
+    loader.SetImageLoader(deferImageDecoding, nullptr);
     std::string err, warn;
     std::string lowercasedPath = path.string();
     std::transform(lowercasedPath.begin(), lowercasedPath.end(), lowercasedPath.begin(),
@@ -771,7 +760,7 @@ std::shared_ptr<Model> loadModel(std::filesystem::path path, CommandQueue* queue
         tinygltf::Model& model = context.model;
 
         auto defaultImage = Image(1, 1, ImagePixelFormat::RGBA8, Color(1, 0, 1, 1).rgba8().bytes);
-        context.defaultTexture = defaultImage.makeTexture(queue, TextureUsageSampled | TextureUsageStorage);
+        context.defaultTexture = defaultImage.makeTexture(context.uploads, TextureUsageSampled | TextureUsageStorage);
         context.defaultSampler = queue->device()->makeSamplerState(
             {
                 SamplerAddressMode::Repeat,
@@ -784,6 +773,8 @@ std::shared_ptr<Model> loadModel(std::filesystem::path path, CommandQueue* queue
         loadSamplerDescriptors(context);
         loadMaterials(context);
         loadMeshes(context);
+        // one command buffer for all buffers and textures of the model.
+        context.uploads->flush();
 
         auto output = std::make_shared<Model>();
 
@@ -807,7 +798,7 @@ std::vector<Triangle> Model::triangleList(int sceneIndex, GraphicsDeviceContext*
         std::vector<Triangle> triangles;
 
         std::vector<Vector3> positions;
-        mesh.enumerateVertexBufferContent(
+        mesh.forEachVertexAttribute(
             VertexAttributeSemantic::Position,
             graphicsContext,
             [&](const void* data, VertexFormat format, uint32_t index)->bool {
@@ -821,7 +812,7 @@ std::vector<Triangle> Model::triangleList(int sceneIndex, GraphicsDeviceContext*
         std::vector<uint32_t> indices;
         if (mesh.indexBuffer) {
             indices.reserve(mesh.indexCount);
-            mesh.enumerateIndexBufferContent(
+            mesh.forEachIndex(
                 graphicsContext,
                 [&](uint32_t index)->bool {
                     indices.push_back(index);
@@ -907,7 +898,7 @@ std::vector<MaterialFace> Model::faceList(int sceneIndex, GraphicsDeviceContext*
         std::vector<Vector4> colors;
 
         // positions
-        mesh.enumerateVertexBufferContent(
+        mesh.forEachVertexAttribute(
             VertexAttributeSemantic::Position, graphicsContext,
             [&](const void* data, VertexFormat format, uint32_t index)->bool {
                 if (format == VertexFormat::Float3) {
@@ -918,7 +909,7 @@ std::vector<MaterialFace> Model::faceList(int sceneIndex, GraphicsDeviceContext*
                 return false;
             });
         // tex uvs
-        mesh.enumerateVertexBufferContent(
+        mesh.forEachVertexAttribute(
             VertexAttributeSemantic::TextureCoordinates, graphicsContext,
             [&](const void* data, VertexFormat format, uint32_t index)->bool {
                 if (format == VertexFormat::Float2) {
@@ -928,7 +919,7 @@ std::vector<MaterialFace> Model::faceList(int sceneIndex, GraphicsDeviceContext*
                 return false;
             });
         // vertex colors
-        mesh.enumerateVertexBufferContent(
+        mesh.forEachVertexAttribute(
             VertexAttributeSemantic::Color, graphicsContext,
             [&](const void* data, VertexFormat format, uint32_t index)->bool {
 
@@ -1017,7 +1008,7 @@ std::vector<MaterialFace> Model::faceList(int sceneIndex, GraphicsDeviceContext*
         std::vector<uint32_t> indices;
         if (mesh.indexBuffer) {
             indices.reserve(mesh.indexCount);
-            mesh.enumerateIndexBufferContent(
+            mesh.forEachIndex(
                 graphicsContext,
                 [&](uint32_t index)->bool {
                     indices.push_back(index);
@@ -111,29 +111,16 @@ void VolumeRenderer::initialize(std::shared_ptr<GraphicsDeviceContext> gc,
         scale = std::lerp(0.1f, 1.0f, scale * scale);
         ssaoKernel[i] = Vector4(sample * scale, 0.0f);
     }
+    auto uploads = queue->uploadManager();
     auto makeBuffer = [&](const void* data, size_t length) -> std::shared_ptr<GPUBuffer> {
-        auto stgBuffer = device->makeBuffer(length,
-                                            GPUBuffer::StorageModeShared,
-                                            CPUCacheModeWriteCombined);
-        FVASSERT(stgBuffer);
-        if (auto p = stgBuffer->contents()) {
-            memcpy(p, data, length);
-            stgBuffer->flush();
-        } else {
-            Log::error("GPUBuffer map failed.");
-            FVERROR_ABORT("GPUBuffer map failed.");
-            return nullptr;
-        }
-        auto cbuffer = queue->makeCommandBuffer();
         auto buffer = device->makeBuffer(length,
                                          GPUBuffer::StorageModePrivate,
                                          CPUCacheModeDefault);
         FVASSERT(buffer);
-        auto encoder = cbuffer->makeCopyCommandEncoder();
-        FVASSERT(encoder);
-        encoder->copy(stgBuffer, 0, buffer, 0, length);
-        encoder->endEncoding();
-        cbuffer->commit();
+        if (uploads->upload(data, length, buffer) == false) {
+            FVERROR_ABORT("GPUBuffer upload failed.");
+            return nullptr;
+        }
         return buffer;
     };
     FVASSERT_DEBUG(ssaoKernel.size() == SSAOKernelSize);
@@ -150,7 +137,8 @@ void VolumeRenderer::initialize(std::shared_ptr<GraphicsDeviceContext> gc,
     }
     this->ssaoRandomNoise = Image(ssaoNoiseDimension, ssaoNoiseDimension,
                                   ImagePixelFormat::RGBA32F,
-                                  noiseValues.data()).makeTexture(queue.get());
+                                  noiseValues.data()).makeTexture(uploads);
+    uploads->flush();
 
     const int ssaoKernelSize = SSAOKernelSize;
     PixelFormat ssaoFormat = PixelFormat::R8Unorm;